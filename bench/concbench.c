@@ -0,0 +1,343 @@
+/* ========================================================================
+ * Benchmark: concurrent reading with simple uint64_t key
+ * ========================================================================
+ * The benchmark creates a plain index with 'count' keys
+ * and then reads random keys with 1, 2, 4, ... 'threads' threads,
+ * reporting the throughput for each number of threads.
+ * ========================================================================
+ */
+#include <beet/types.h>
+#include <beet/config.h>
+#include <beet/index.h>
+
+#include <common/cmd.h>
+#include <common/bench.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+uint64_t global_count = 100000;
+uint64_t global_ops   = 100000;
+uint32_t global_threads = 64;
+int32_t  global_cache = BEET_CACHE_IGNORE;
+uint64_t global_pool  = 0;
+int      global_builtin = 0;
+beet_pool_t global_bufpool = NULL;
+
+void *global_lib=NULL;
+
+/* ------------------------------------------------------------------------
+ * helptxt
+ * ------------------------------------------------------------------------
+ */
+void helptxt(char *prog) {
+	fprintf(stderr, "%s <base> <path> [options]\n", prog);
+	fprintf(stderr, "-count  : number of keys in the index\n");
+	fprintf(stderr, "-ops    : number of reads per thread\n");
+	fprintf(stderr, "-threads: max number of threads\n");
+	fprintf(stderr, "-cache  : cache size (pages) for leaves and nonleaves\n");
+	fprintf(stderr, "          (default: as created)\n");
+	fprintf(stderr, "-pool   : use a buffer pool of that many KiB\n");
+	fprintf(stderr, "          instead of the cache size\n");
+	fprintf(stderr, "-builtin: use the built-in UINT64 key type (true/false)\n");
+	fprintf(stderr, "          instead of the compare function\n");
+}
+
+/* ------------------------------------------------------------------------
+ * get options
+ * ------------------------------------------------------------------------
+ */
+int parsecmd(int argc, char **argv) {
+	int err = 0;
+
+	global_count = ts_algo_args_findUint(
+	               argc, argv, 2, "count", 100000, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+
+	global_ops = ts_algo_args_findUint(
+	               argc, argv, 2, "ops", 100000, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+
+	global_threads = (uint32_t)ts_algo_args_findUint(
+	               argc, argv, 2, "threads", 64, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+
+	global_cache = (int32_t)ts_algo_args_findUint(
+	               argc, argv, 2, "cache", 0, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	if (global_cache == 0) global_cache = BEET_CACHE_IGNORE;
+
+	global_pool = ts_algo_args_findUint(
+	               argc, argv, 2, "pool", 0, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+
+	global_builtin = ts_algo_args_findBool(
+	               argc, argv, 2, "builtin", 0, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	return 0;
+}
+
+void errmsg(beet_err_t err, char *msg) {
+	fprintf(stderr, "%s: %s (%d)\n", msg, beet_errdesc(err), err);
+	if (err < BEET_OSERR_ERRNO) {
+		fprintf(stderr, "%s\n", beet_oserrdesc());
+	}
+}
+
+int dropIndex(char *base, char *path) {
+	beet_err_t err;
+	char p[4100];
+	struct stat st;
+
+	sprintf(p, "%s/%s", base, path);
+	if (stat(p, &st) != 0) return 0;
+
+	err = beet_index_drop(base, path);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot drop index");
+		return -1;
+	}
+	return 0;
+}
+
+int createIndex(char *base, char *path) {
+	beet_config_t cfg;
+	beet_err_t    err;
+
+	beet_config_init(&cfg);
+
+	cfg.indexType = BEET_INDEX_PLAIN;
+	cfg.leafPageSize = 4096;
+	cfg.intPageSize = 4096;
+	cfg.leafNodeSize = 248;
+	cfg.intNodeSize = 335;
+	cfg.leafCacheSize = 10000;
+	cfg.intCacheSize = 10000;
+	cfg.keySize = 8;
+	cfg.dataSize = 8;
+	cfg.subPath = NULL;
+	cfg.compare = "beetSmokeUInt64Compare";
+	if (global_builtin) {
+		cfg.keyType = BEET_KEY_UINT64;
+		cfg.compare = NULL;
+	}
+	cfg.rscinit = NULL;
+	cfg.rscdest = NULL;
+
+	err = beet_index_create(base, path, 1, &cfg);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot create index");
+		return -1;
+	}
+	return 0;
+}
+
+beet_index_t openIndex(char *base, char *path) {
+	beet_index_t idx;
+	beet_open_config_t cfg;
+	beet_err_t err;
+
+	beet_open_config_ignore(&cfg);
+
+	cfg.leafCacheSize = global_cache;
+	cfg.intCacheSize = global_cache;
+	cfg.pool = global_bufpool;
+
+	err = beet_index_open(base, path, global_lib, &cfg, &idx);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot open index");
+		return NULL;
+	}
+	return idx;
+}
+
+int fill(beet_index_t idx, uint64_t count) {
+	beet_err_t err;
+
+	for(uint64_t k=0;k<count;k++) {
+		err = beet_index_insert(idx, &k, &k);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot not insert");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * What the threads do
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_index_t idx;
+	unsigned int seed;
+	uint64_t    found;
+	int          errs;
+} reader_t;
+
+void *reader(void *p) {
+	reader_t *r = p;
+	beet_err_t err;
+	uint64_t k, d;
+
+	for(uint64_t i=0; i<global_ops; i++) {
+		k = rand_r(&r->seed)%global_count;
+		err = beet_index_copy(r->idx, &k, &d);
+		if (err == BEET_OK) {
+			if (d != k) r->errs++; else r->found++;
+			continue;
+		}
+		errmsg(err, "cannot copy data");
+		r->errs++; break;
+	}
+	return NULL;
+}
+
+int runReaders(beet_index_t idx, uint32_t n) {
+	struct timespec t1, t2;
+	pthread_t *tids;
+	reader_t  *rs;
+	uint64_t d, found=0;
+	int errs=0;
+
+	tids = calloc(n, sizeof(pthread_t));
+	if (tids == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	rs = calloc(n, sizeof(reader_t));
+	if (rs == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		free(tids); return -1;
+	}
+
+	timestamp(&t1);
+	for(uint32_t i=0; i<n; i++) {
+		rs[i].idx = idx;
+		rs[i].seed = rand();
+		if (pthread_create(tids+i, NULL, &reader, rs+i) != 0) {
+			fprintf(stderr, "cannot create thread\n");
+			n = i; errs++; break;
+		}
+	}
+	for(uint32_t i=0; i<n; i++) {
+		pthread_join(tids[i], NULL);
+		found += rs[i].found;
+		errs += rs[i].errs;
+	}
+	timestamp(&t2);
+
+	d = minus(&t2, &t1)/1000;
+	if (d == 0) d = 1;
+
+	fprintf(stdout, "%3u threads: %10lu reads in %10luus: %12.0f reads/sec\n",
+	                n, found, d, (double)found * 1000000.0 / (double)d);
+	free(tids); free(rs);
+	return errs == 0 ? 0 : -1;
+}
+
+int bench(char *base, char *path) {
+	beet_index_t  idx;
+	int rc = 0;
+
+	fprintf(stderr, "%s/%s\n", base, path);
+
+	if (dropIndex(base, path) != 0) return -1;
+	if (createIndex(base, path) != 0) return -1;
+
+	idx = openIndex(base, path);
+	if (idx == NULL) return -1;
+
+	if (fill(idx, global_count) != 0) {
+		beet_index_close(idx);
+		return -1;
+	}
+	for(uint32_t n=1; n<=global_threads; n*=2) {
+		if (runReaders(idx, n) != 0) {
+			rc = -1; break;
+		}
+	}
+	beet_index_close(idx);
+	return rc;
+}
+
+int checkpath(char *path) {
+	if (strnlen(path, 4097) > 4096) {
+		fprintf(stderr, "path too long\n");
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int rc = EXIT_SUCCESS;
+	char *base;
+	char *path;
+
+	if (argc < 3) {
+		helptxt(argv[0]);
+		return EXIT_FAILURE;
+	}
+	base = argv[1];
+	if (checkpath(base) != 0) {
+		helptxt(argv[0]);
+		return EXIT_FAILURE;
+	}
+	path = argv[2];
+	if (checkpath(path) != 0) {
+		helptxt(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (parsecmd(argc, argv) != 0) {
+		helptxt(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (global_count == 0 || global_threads == 0) {
+		helptxt(argv[0]);
+		return EXIT_FAILURE;
+	}
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	global_lib = beet_lib_init("libcmp.so");
+	if (global_lib == NULL) {
+		fprintf(stderr, "cannot init compare library\n");
+		return EXIT_FAILURE;
+	}
+
+	if (global_pool > 0) {
+		if (beet_pool_new(global_pool*1024, &global_bufpool) != BEET_OK) {
+			fprintf(stderr, "cannot create buffer pool\n");
+			beet_lib_close(global_lib);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (bench(base, path) != 0) rc = EXIT_FAILURE;
+
+	if (global_bufpool != NULL) beet_pool_destroy(global_bufpool);
+	beet_lib_close(global_lib);
+	return rc;
+}
@@ -20,6 +20,7 @@
 uint64_t global_count = 1000;
 uint32_t global_iter = 1;
 int global_random = 1;
+uint32_t global_batch = 0;
 
 void *global_lib=NULL;
 
@@ -33,6 +34,7 @@ void helptxt(char *prog) {
 	fprintf(stderr, "-count: number of keys we (try) to insert\n");
 	fprintf(stderr, "-iter : number of iterations\n");
 	fprintf(stderr, "-random: randomise keys (default: true)\n");
+	fprintf(stderr, "-batch: insert in batches of that size (plain only)\n");
 }
 
 /* ------------------------------------------------------------------------
@@ -60,6 +62,12 @@ int parsecmd(int argc, char **argv) {
 		fprintf(stderr, "command line error: %d\n", err);
 		return -1;
 	}
+	global_batch = (uint32_t)ts_algo_args_findUint(
+	               argc, argv, 3, "batch", 0, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
 	return 0;
 }
 
@@ -96,8 +104,8 @@ int createIndex(char *base, char *path) {
 	cfg.indexType = BEET_INDEX_PLAIN;
 	cfg.leafPageSize = 4096;
 	cfg.intPageSize = 4096;
-	cfg.leafNodeSize = 255;
-	cfg.intNodeSize = 340;
+	cfg.leafNodeSize = 248;
+	cfg.intNodeSize = 335;
 	cfg.leafCacheSize = 10000;
 	cfg.intCacheSize = 10000;
 	cfg.keySize = 8;
@@ -176,6 +184,39 @@ int writeplain(beet_index_t idx, uint64_t count) {
 	return 0;
 }
 
+int writebatch(beet_index_t idx, uint64_t count) {
+	beet_err_t err;
+	int x;
+	uint64_t k=0;
+	uint64_t *keys;
+	uint32_t n=0;
+
+	keys = calloc(global_batch, sizeof(uint64_t));
+	if (keys == NULL) return -1;
+
+	for(uint64_t i=0;i<count;i++) {
+
+		if (global_random) {
+			k = rand();
+			x = rand()%4;
+			if (x) k*=rand();
+		} else {
+			k++;
+		}
+		keys[n++] = k;
+		if (n < global_batch && i+1 < count) continue;
+
+		err = beet_index_insertBatch(idx, keys, keys, n, !global_random);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot not insert");
+			free(keys); return -1;
+		}
+		n = 0;
+	}
+	free(keys);
+	return 0;
+}
+
 int writehost(beet_index_t idx, uint64_t count) {
 	beet_err_t err;
 	int x;
@@ -233,7 +274,11 @@ int bench(int type, char *base, char *path) {
 			if (writenull(idx, global_count) != 0) return -1;
 			break;
 		case BEET_INDEX_PLAIN:
-			if (writeplain(idx, global_count) != 0) return -1;
+			if (global_batch > 0) {
+				if (writebatch(idx, global_count) != 0) return -1;
+			} else {
+				if (writeplain(idx, global_count) != 0) return -1;
+			}
 			break;
 		case BEET_INDEX_HOST:
 			if (writehost(idx, global_count) != 0) return -1;
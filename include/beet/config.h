@@ -25,6 +25,7 @@
 #define beet_config_decl
 
 #include <beet/types.h>
+#include <beet/pool.h>
 #include <stdint.h>
 
 /* ------------------------------------------------------------------------
@@ -39,6 +40,9 @@ typedef struct {
 	uint32_t intNodeSize;   /* number of keys in internal nodes */
 	uint32_t keySize;       /* size of one key                  */
 	uint32_t dataSize;      /* data size                        */
+	uint32_t keyType;       /* built-in key type (see below)    */
+	uint32_t layout;        /* node layout (see below)          */
+	uint32_t pageIds;       /* pageid format (see below)        */
 	int32_t  leafCacheSize; /* cache size for leaf nodes        */
 	int32_t  intCacheSize;  /* cache size for internal nodes    */
 	char    *subPath;       /* path to the embedded index       */
@@ -66,6 +70,55 @@ void beet_config_init(beet_config_t *cfg);
 #define BEET_INDEX_PLAIN 2
 #define BEET_INDEX_HOST  3
 
+/* ------------------------------------------------------------------------
+ * Key Types:
+ * - CUSTOM keys are compared by the user-defined function 'compare'
+ * - UINT32, INT32 unsigned and signed 32bit integers (keySize 4)
+ * - UINT64, INT64 unsigned and signed 64bit integers (keySize 8)
+ * - BYTES  byte strings of keySize compared with memcmp
+ * Indices with a built-in key type do not need a compare function
+ * and search their nodes without calling one.
+ * ------------------------------------------------------------------------
+ */
+#define BEET_KEY_CUSTOM 0
+#define BEET_KEY_UINT32 1
+#define BEET_KEY_UINT64 2
+#define BEET_KEY_INT32  3
+#define BEET_KEY_INT64  4
+#define BEET_KEY_BYTES  5
+
+/* ------------------------------------------------------------------------
+ * Node Layout:
+ * - ALIGNED keys and data start on a cache line and pages
+ *           do not straddle I/O blocks (default)
+ * - PACKED  no padding; indices created before
+ *           format version 4 have this layout
+ * - LEGACY  no padding, no high keys and no right-links;
+ *           indices created before format version 2 have
+ *           this layout. They are always opened read-only
+ *           (as with BEET_READONLY_MMAP) and new indices
+ *           cannot be created with it.
+ * ------------------------------------------------------------------------
+ */
+#define BEET_LAYOUT_ALIGNED 0
+#define BEET_LAYOUT_PACKED  1
+#define BEET_LAYOUT_LEGACY  2
+
+/* ------------------------------------------------------------------------
+ * Pageid Format:
+ * - 32 pageids are stored with 4 bytes; the top bit marks leaves,
+ *      so files have at most 2^31-1 pages (default);
+ *      beyond that, inserts fail with BEET_ERR_TOOBIG
+ * - 64 pageids are stored with 8 bytes (format version 5)
+ * The data size of a host index must be the pageid size
+ * of its embedded index (BEET_PAGEID_SIZE).
+ * ------------------------------------------------------------------------
+ */
+#define BEET_PAGEID_32 0
+#define BEET_PAGEID_64 1
+
+#define BEET_PAGEID_SIZE(x) ((x) == BEET_PAGEID_64 ? 8 : 4)
+
 /* ------------------------------------------------------------------------
  * Cache Size
  * ------------------------------------------------------------------------
@@ -123,8 +176,159 @@ typedef struct {
 	beet_rscinit_t rscinit; /* pointer to rsc init function      */
 	beet_rscinit_t rscdest; /* pointer to rsc destroyer function */
 	void              *rsc; /* passed in to rscinit              */
+	int32_t  flushInterval; /* background flush in milliseconds  */
+	int32_t    evictPolicy; /* cache eviction policy (see below) */
+	int32_t    waitTimeout; /* wait for a cache frame in ms      */
+	beet_pool_t       pool; /* shared buffer pool or NULL        */
+	int32_t    preallocate; /* pages the files grow by at once   */
+	int32_t        ioDepth; /* pages in flight at once           */
+	int32_t       directIO; /* bypass the OS page cache          */
+	int32_t       readOnly; /* read-only over memory maps        */
+	int32_t        walSize; /* write-ahead log size in MB        */
+	int32_t     durability; /* when changes are synced to disk   */
 } beet_open_config_t;
 
+/* ------------------------------------------------------------------------
+ * Flush Interval:
+ * - NEVER   no background flusher; dirty pages are written
+ *           on eviction, on beet_index_sync and on close
+ * - DEFAULT the default interval (one second)
+ * ------------------------------------------------------------------------
+ */
+#define BEET_FLUSH_NEVER    0
+#define BEET_FLUSH_DEFAULT -1
+
+/* ------------------------------------------------------------------------
+ * Eviction Policy:
+ * - LRU   least recently used (every hit moves the page to the head)
+ * - CLOCK second chance (a hit only sets a reference bit)
+ * - 2Q    new pages enter a FIFO; only pages that are requested again
+ *         after having left the FIFO enter the main LRU queue,
+ *         so that one-time accesses (e.g. long range scans)
+ *         do not evict the hot pages.
+ * - DEFAULT is LRU
+ * ------------------------------------------------------------------------
+ */
+#define BEET_EVICT_DEFAULT 0
+#define BEET_EVICT_LRU     1
+#define BEET_EVICT_CLOCK   2
+#define BEET_EVICT_2Q      3
+
+/* ------------------------------------------------------------------------
+ * Wait Timeout:
+ * when all pages in the cache are in use, a request waits
+ * until another thread releases a page. If the timeout expires,
+ * the request fails with BEET_ERR_NORSC.
+ * - FOREVER do not time out
+ * - DEFAULT is FOREVER
+ * ------------------------------------------------------------------------
+ */
+#define BEET_WAIT_FOREVER  0
+#define BEET_WAIT_DEFAULT -1
+
+/* ------------------------------------------------------------------------
+ * Preallocation:
+ * the index files grow by a chunk of pages at once;
+ * new pages are then handed out without writing to the file.
+ * Any positive value is the number of pages per chunk.
+ * - NONE    the files grow page by page
+ *           (each new page is written immediately)
+ * - DEFAULT 64 pages
+ * ------------------------------------------------------------------------
+ */
+#define BEET_PREALLOC_DEFAULT  0
+#define BEET_PREALLOC_NONE    -1
+
+/* ------------------------------------------------------------------------
+ * I/O Depth:
+ * when dirty pages are flushed, they are submitted
+ * in batches to the kernel (io_uring on Linux),
+ * which writes them concurrently; when a scan starts,
+ * the first leaves are read in the same way.
+ * Any positive value is the number of pages in flight at once
+ * (shared by the batches of all threads).
+ * Where io_uring is not available, pages are read and written one by one.
+ * - NONE    pages are written one by one
+ * - DEFAULT is NONE
+ * ------------------------------------------------------------------------
+ */
+#define BEET_IODEPTH_DEFAULT 0
+#define BEET_IODEPTH_NONE    0
+
+/* ------------------------------------------------------------------------
+ * Direct I/O:
+ * - ON      the index files are opened with O_DIRECT,
+ *           pages are cached only by the index (not by the OS);
+ *           leaf and internal page sizes must be multiples
+ *           of the block size of the file system
+ *           (BEET_ERR_BADSIZE otherwise)
+ * - OFF     pages go through the OS page cache
+ * - DEFAULT is OFF
+ * ------------------------------------------------------------------------
+ */
+#define BEET_DIRECTIO_DEFAULT 0
+#define BEET_DIRECTIO_OFF     0
+#define BEET_DIRECTIO_ON      1
+
+/* ------------------------------------------------------------------------
+ * Read-only:
+ * - MMAP    the index files are mapped into memory (read-only);
+ *           nodes are read directly from the mapping
+ *           without caching, latching or locking.
+ *           The cache sizes are ignored and
+ *           all changes fail with BEET_ERR_RDONLY.
+ *           The files must not be changed while the index is open.
+ * - OFF     the index is read and written through its caches
+ * - DEFAULT is OFF
+ * ------------------------------------------------------------------------
+ */
+#define BEET_READONLY_DEFAULT 0
+#define BEET_READONLY_OFF     0
+#define BEET_READONLY_MMAP    1
+
+/* ------------------------------------------------------------------------
+ * Write-ahead Log:
+ * changes are logged and synced before the operations return;
+ * concurrent writers share one sync (group commit).
+ * On open, changes not yet written to the index files are
+ * recovered from the log. Any positive value enables the log;
+ * when it grows beyond that many megabytes,
+ * all pages are written, synced and the log starts anew.
+ * The caches must hold all pages changed by concurrent writers.
+ * - NONE    no log (a log left by an earlier session
+ *           is still recovered on open)
+ * - DEFAULT is NONE
+ * ------------------------------------------------------------------------
+ */
+#define BEET_WAL_DEFAULT 0
+#define BEET_WAL_NONE    0
+
+/* ------------------------------------------------------------------------
+ * Durability (without write-ahead log):
+ * - NONE     pages are written to the files, but never synced;
+ *            the OS decides when they reach the disk
+ * - ONSYNC   beet_index_sync and close sync the files
+ *            (embedded index, leaves, internal nodes, root);
+ *            between syncs,
+ *            the background flusher starts writeback
+ *            of the pages it has written (sync_file_range),
+ *            so that the final sync has little left to do
+ * - PERIODIC like ONSYNC and, additionally,
+ *            the background flusher syncs the files
+ *            after each round
+ * - DEFAULT  is NONE
+ * Without log, durable only means: synced up to the last sync.
+ * Pages are overwritten in place and written back in any order,
+ * so a crash between syncs may leave the index inconsistent.
+ * With a write-ahead log, the log provides durability
+ * and crash safety and this setting is ignored.
+ * ------------------------------------------------------------------------
+ */
+#define BEET_DURABLE_DEFAULT  0
+#define BEET_DURABLE_NONE     0
+#define BEET_DURABLE_ONSYNC   1
+#define BEET_DURABLE_PERIODIC 2
+
 /* ------------------------------------------------------------------------
  * Init open config: sets all values to zero/NULL
  * ------------------------------------------------------------------------
@@ -20,7 +20,6 @@
  * ========================================================================
  * BEET API
  * TODO:
- * - delete
  * - map, fold?
  * ========================================================================
  */
@@ -68,6 +67,20 @@ beet_err_t beet_index_open(const char       *base,
  */
 void beet_index_close(beet_index_t idx);
 
+/* ------------------------------------------------------------------------
+ * Write all pages changed in the cache to disk.
+ * Changes are otherwise written lazily, i.e.
+ * when pages are evicted from the cache,
+ * by the background flusher (see flushInterval in beet_open_config_t)
+ * and when the index is closed.
+ * With a write-ahead log (see walSize in beet_open_config_t),
+ * sync is a checkpoint: the log is started anew.
+ * With a durability policy (see durability in beet_open_config_t),
+ * the files are synced as well (leaves, internal nodes, root).
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_index_sync(beet_index_t idx);
+
 /* ------------------------------------------------------------------------
  * Get index type
  * ------------------------------------------------------------------------
@@ -102,6 +115,75 @@ beet_err_t beet_index_insert(beet_index_t idx, const void *key,
 beet_err_t beet_index_upsert(beet_index_t idx, const void *key,
                                                const void *data);
 
+/* ------------------------------------------------------------------------
+ * Insert a batch of n (key, data) pairs.
+ * 'keys' holds the n keys one after the other and 'data'
+ * the n data elements (for host indices: n beet_pair_t;
+ * NULL for indices without data).
+ * Keys that fall into the same leaf are inserted under one lock
+ * and the leaf is written once, so that batches of keys close
+ * to each other are inserted much faster than one by one.
+ * If 'sorted' is 0, the batch is sorted first
+ * (without changing the arrays); otherwise it must be
+ * sorted in ascending order.
+ * Like insert, the function fails with BEET_ERR_DBLKEY
+ * if a key already exists; the keys before it
+ * (in sorted order) have then been inserted.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_index_insertBatch(beet_index_t idx,
+                                  const void  *keys,
+                                  const void  *data,
+                                  uint32_t        n,
+                                  char       sorted);
+
+/* ------------------------------------------------------------------------
+ * Upsert a batch of n (key, data) pairs (see insertBatch).
+ * Of equal keys in the batch, the last one wins.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_index_upsertBatch(beet_index_t idx,
+                                  const void  *keys,
+                                  const void  *data,
+                                  uint32_t        n,
+                                  char       sorted);
+
+/* ------------------------------------------------------------------------
+ * Source of (key, data) pairs for bulk loading:
+ * sets key and data to the next pair or returns BEET_ERR_EOF.
+ * Key and data may point to the same buffers on every call;
+ * they are copied before the source is called again.
+ * For host indices, data points to a beet_pair_t
+ * holding the key and data for the embedded tree.
+ * ------------------------------------------------------------------------
+ */
+typedef beet_err_t (*beet_bulk_t)(void *stream, const void **key,
+                                                const void **data);
+
+/* ------------------------------------------------------------------------
+ * Load an empty index from a sorted stream.
+ * ------------------------------------------------------------------------
+ * The tree is built bottom-up: leaves are filled one after
+ * the other and the nonleaves are built on top of them, so pages
+ * are written in sequence and no node is ever split.
+ * 'fill' is the percentage up to which nodes are filled
+ * (0: as full as possible); leaving room avoids splits
+ * when keys are inserted later.
+ * Keys must be strictly ascending (for host indices:
+ * by the host key, then by the key of the embedded tree);
+ * otherwise the load fails with BEET_ERR_NOTSORTED or
+ * BEET_ERR_DBLKEY. The index must be empty (BEET_ERR_NOTEMPTY)
+ * and must not be used by other threads during the load.
+ * Internal nodes must have room for at least 3 keys
+ * (BEET_ERR_NOTSUPP otherwise).
+ * If the load fails, the index should be dropped.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_index_bulkload(beet_index_t   idx,
+                               beet_bulk_t   next,
+                               void       *stream,
+                               uint32_t      fill);
+
 /* ------------------------------------------------------------------------
  * Hide a key from the index. The key won't be found any more
  * but is physically still in the tree. This operation is much
@@ -121,19 +203,39 @@ beet_err_t beet_index_hide2(beet_index_t idx, const void *key1,
 /* ------------------------------------------------------------------------
  * Remove hidden keys.
  * ------------------------------------------------------------------------
+ * Walks through the leaves removing the hidden keys
+ * until 'runtime' (in milliseconds, 0: no limit) has expired.
+ * At least one leaf is processed per call.
+ * The next call continues where the previous one stopped,
+ * even after the index has been closed and opened again.
+ * Returns BEET_OK if there are leaves left and
+ * BEET_ERR_EOF if the end of the index has been reached
+ * (the next call starts from the beginning).
+ * Only keys of the index itself are purged, not those
+ * hidden in embedded indices. Concurrent purges
+ * on the same index run one after the other.
+ * ------------------------------------------------------------------------
  */
 beet_err_t beet_index_purge(beet_index_t idx, int runtime);
 
 /* ------------------------------------------------------------------------
  * Removes a key and all its data from the index.
- * TODO: implement!
+ * ------------------------------------------------------------------------
+ * Unlike hide, delete removes the key physically
+ * (hidden keys can be deleted as well).
+ * Leaves that become underfull are merged with or refilled
+ * from their neighbours and the pages of merged leaves
+ * are reused for new nodes.
+ * In a host index, the embedded tree of the key is removed
+ * with all its pages. Returns BEET_ERR_KEYNOF
+ * if the key is not in the index.
  * ------------------------------------------------------------------------
  */
 beet_err_t beet_index_delete(beet_index_t idx, const void *key);
 
 /* ------------------------------------------------------------------------
  * Removes single data point from a subtree.
- * TODO: implement!
+ * The key in the host index stays, even if its subtree becomes empty.
  * ------------------------------------------------------------------------
  */
 beet_err_t beet_index_delete2(beet_index_t  idx,
@@ -146,6 +248,16 @@ beet_err_t beet_index_delete2(beet_index_t  idx,
  */
 beet_err_t beet_index_height(beet_index_t idx, uint32_t *h);
 
+/* ------------------------------------------------------------------------
+ * Number of times requests had to wait for a page in the cache
+ * (because all pages were in use) and the total time waited
+ * in microseconds (see 'waitTimeout' in the open config)
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_index_waitStats(beet_index_t idx,
+                                uint64_t   *waits,
+                                uint64_t  *waited);
+
 /* ------------------------------------------------------------------------
  * Get data by key (simple)
  * ------------------------------------------------------------------------
@@ -0,0 +1,66 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2023
+ * 
+ * This file is part of the BEET Library.
+ *
+ * The BEET Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * The BEET Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the BEET Library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ *  
+ * ========================================================================
+ * BEET Buffer Pool
+ * ========================================================================
+ * A memory budget (in bytes) shared by the page caches
+ * of all indices opened with the pool (see beet_open_config_t).
+ * When the budget is exhausted, a cache that needs a page
+ * evicts the least recently used page among a sample of
+ * the caches in the pool, so that hot indices
+ * take memory from cold ones.
+ * ========================================================================
+ */
+#ifndef beet_pool_decl
+#define beet_pool_decl
+
+#include <beet/types.h>
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------
+ * Buffer Pool
+ * ------------------------------------------------------------------------
+ */
+typedef struct beet_pool_t *beet_pool_t;
+
+/* ------------------------------------------------------------------------
+ * Create a pool with a budget of 'budget' bytes
+ * for the pages of all caches using it.
+ * Note that each cache keeps at least as many pages
+ * as it currently uses (i.e. pinned pages are never evicted).
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_pool_new(uint64_t budget, beet_pool_t *pool);
+
+/* ------------------------------------------------------------------------
+ * Destroy the pool;
+ * all indices using the pool must be closed before.
+ * ------------------------------------------------------------------------
+ */
+void beet_pool_destroy(beet_pool_t pool);
+
+/* ------------------------------------------------------------------------
+ * Memory currently used for pages (in bytes) and number of pages
+ * evicted from one cache to make room for another
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_pool_stats(beet_pool_t pool, uint64_t *used,
+                                             uint64_t *evictions);
+#endif
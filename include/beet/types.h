@@ -98,8 +98,11 @@ typedef char beet_dir_t;
 /* -----------------------------------------------------------------------
  * Pageid
  * -----------------------------------------------------------------------
+ * In memory, pageids have 64 bits; on disk, they are stored
+ * with 4 or 8 bytes according to the index format (see config.h).
+ * -----------------------------------------------------------------------
  */
-typedef int32_t beet_pageid_t;
+typedef uint64_t beet_pageid_t;
 
 /* -----------------------------------------------------------------------
  * Return a constant string describing the error
@@ -166,6 +169,10 @@ const char *beet_oserrdesc();
 #define BEET_ERR_KEYSZ    46
 #define BEET_ERR_LPAGESZ  47
 #define BEET_ERR_IPAGESZ  48
+#define BEET_ERR_OLDVER   49
+#define BEET_ERR_NOTEMPTY 50
+#define BEET_ERR_NOTSORTED 51
+#define BEET_ERR_RDONLY   52
 #define BEET_ERR_TEST   199
 #define BEET_ERR_PANIC  999
 
@@ -180,6 +187,7 @@ const char *beet_oserrdesc();
 #define BEET_OSERR_PERM   -6
 #define BEET_OSERR_DEADLK -7
 #define BEET_OSERR_INTRP  -8
+#define BEET_OSERR_TIMEOUT -9
 
 /* -----------------------------------------------------------------------
  * Errors with further information in errno
@@ -0,0 +1,487 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2023
+ * ========================================================================
+ * Asynchronous Page I/O
+ * ========================================================================
+ * The ring is driven by the raw system calls
+ * (io_uring_setup and io_uring_enter),
+ * so that there is no dependency on liburing.
+ * ========================================================================
+ */
+#include <beet/aio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef BEET_AIO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#define AIONULL() \
+	if (aio == NULL) return BEET_ERR_INVALID;
+
+#define PAGESNULL() \
+	if (pages == NULL) return BEET_ERR_NOPAGE;
+
+/* ------------------------------------------------------------------------
+ * Helper: synchronous I/O for pages [i..n)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t syncIO(beet_page_t **pages, uint32_t i, uint32_t n,
+                         FILE *store, char write) {
+	beet_err_t err;
+
+	for(;i<n;i++) {
+		if (write) err = beet_page_store(pages[i], store);
+		else err = beet_page_load(pages[i], store);
+		if (err != BEET_OK) return err;
+	}
+	return BEET_OK;
+}
+
+#ifdef BEET_AIO_URING
+/* ------------------------------------------------------------------------
+ * The ring as mapped from the kernel
+ * ------------------------------------------------------------------------
+ */
+struct beet_aio_ring_st {
+	int                     fd; /* ring file descriptor        */
+	void                   *sq; /* submission ring mapping     */
+	size_t               sqlen; /* its size                    */
+	void                   *cq; /* completion ring mapping     */
+	size_t               cqlen; /* its size (0: shared with sq) */
+	struct io_uring_sqe  *sqes; /* submission entries          */
+	size_t              sqelen; /* their size                  */
+	unsigned           *sqtail; /* submission tail             */
+	unsigned           *sqmask; /* submission mask             */
+	unsigned          *sqarray; /* submission index array      */
+	unsigned           *cqhead; /* completion head             */
+	unsigned           *cqtail; /* completion tail             */
+	unsigned           *cqmask; /* completion mask             */
+	struct io_uring_cqe  *cqes; /* completion entries          */
+	uint32_t           entries; /* # of submission entries     */
+	uint32_t          inflight; /* # of requests in flight     */
+	char                leader; /* a thread waits in the kernel */
+	char                broken; /* the ring must not be used    */
+	beet_cond_t           done; /* signalled on completions     */
+	struct iovec         *bufs; /* registered buffers          */
+	uint32_t             nbufs; /* # of registered buffers     */
+};
+
+/* ------------------------------------------------------------------------
+ * A batch in the ring; each request points to its slot,
+ * where the reaper puts the result
+ * ------------------------------------------------------------------------
+ */
+typedef struct batch_st batch_t;
+
+typedef struct {
+	batch_t *batch; /* the batch the request belongs to */
+	int32_t    res; /* result of the request            */
+} slot_t;
+
+struct batch_st {
+	slot_t   *slots; /* one per page                 */
+	uint32_t pending; /* # of requests not completed  */
+};
+
+/* ------------------------------------------------------------------------
+ * Helper: unmap and close ring
+ * ------------------------------------------------------------------------
+ */
+static void closeRing(beet_aio_ring_t *ring) {
+	if (ring->bufs != NULL) free(ring->bufs);
+	beet_cond_destroy(&ring->done);
+	if (ring->sqes != NULL) munmap(ring->sqes, ring->sqelen);
+	if (ring->cq != NULL && ring->cqlen > 0) munmap(ring->cq, ring->cqlen);
+	if (ring->sq != NULL) munmap(ring->sq, ring->sqlen);
+	if (ring->fd >= 0) close(ring->fd);
+	free(ring);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: set up and map ring
+ * ------------------------------------------------------------------------
+ */
+static beet_aio_ring_t *openRing(uint32_t depth) {
+	struct io_uring_params p;
+	beet_aio_ring_t *ring;
+	char *sq, *cq;
+
+	ring = calloc(1, sizeof(beet_aio_ring_t));
+	if (ring == NULL) return NULL;
+
+	if (beet_cond_init(&ring->done) != BEET_OK) {
+		free(ring); return NULL;
+	}
+	memset(&p, 0, sizeof(struct io_uring_params));
+	ring->fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+	if (ring->fd < 0) {
+		beet_cond_destroy(&ring->done);
+		free(ring); return NULL;
+	}
+	ring->entries = p.sq_entries;
+
+	ring->sqlen = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+	ring->cqlen = p.cq_off.cqes +
+	              p.cq_entries*sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cqlen > ring->sqlen) ring->sqlen = ring->cqlen;
+		ring->cqlen = 0;
+	}
+	ring->sq = mmap(NULL, ring->sqlen, PROT_READ | PROT_WRITE,
+	                MAP_SHARED | MAP_POPULATE, ring->fd,
+	                IORING_OFF_SQ_RING);
+	if (ring->sq == MAP_FAILED) {
+		ring->sq = NULL; closeRing(ring); return NULL;
+	}
+	if (ring->cqlen == 0) ring->cq = ring->sq; else {
+		ring->cq = mmap(NULL, ring->cqlen, PROT_READ | PROT_WRITE,
+		                MAP_SHARED | MAP_POPULATE, ring->fd,
+		                IORING_OFF_CQ_RING);
+		if (ring->cq == MAP_FAILED) {
+			ring->cq = NULL; closeRing(ring); return NULL;
+		}
+	}
+	ring->sqelen = p.sq_entries*sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqelen, PROT_READ | PROT_WRITE,
+	                  MAP_SHARED | MAP_POPULATE, ring->fd,
+	                  IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL; closeRing(ring); return NULL;
+	}
+
+	sq = ring->sq; cq = ring->cq;
+	ring->sqtail  = (unsigned*)(sq + p.sq_off.tail);
+	ring->sqmask  = (unsigned*)(sq + p.sq_off.ring_mask);
+	ring->sqarray = (unsigned*)(sq + p.sq_off.array);
+	ring->cqhead  = (unsigned*)(cq + p.cq_off.head);
+	ring->cqtail  = (unsigned*)(cq + p.cq_off.tail);
+	ring->cqmask  = (unsigned*)(cq + p.cq_off.ring_mask);
+	ring->cqes    = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	return ring;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: registered buffer holding the page (-1: none)
+ * ------------------------------------------------------------------------
+ */
+static inline int fixedBuf(beet_aio_ring_t *ring, beet_page_t *page) {
+	char *base;
+
+	for(uint32_t b=0; b<ring->nbufs; b++) {
+		base = ring->bufs[b].iov_base;
+		if (page->data >= base && page->data + page->sz <=
+		                          base + ring->bufs[b].iov_len) {
+			return (int)b;
+		}
+	}
+	return -1;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: put pages [i..i+n) of the batch into the submission queue
+ * and submit them. Requests the kernel does not take
+ * are taken back and processed synchronously.
+ * The latch is held.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t submit(beet_aio_ring_t *ring, batch_t *batch,
+                         beet_page_t **pages, uint32_t i, uint32_t n,
+                         FILE *store, char write) {
+	struct io_uring_sqe *sqe;
+	unsigned tail, idx;
+	uint32_t submitted = 0;
+	int fd = fileno(store);
+	int b;
+	long r;
+
+	tail = *ring->sqtail;
+	for(uint32_t k=0; k<n; k++) {
+		beet_page_t *page = pages[i+k];
+
+		idx = tail & *ring->sqmask;
+		sqe = ring->sqes+idx;
+		memset(sqe, 0, sizeof(struct io_uring_sqe));
+		b = fixedBuf(ring, page);
+		if (b < 0) {
+			sqe->opcode = write ? IORING_OP_WRITE :
+			                      IORING_OP_READ;
+		} else {
+			sqe->opcode = write ? IORING_OP_WRITE_FIXED :
+			                      IORING_OP_READ_FIXED;
+			sqe->buf_index = (uint16_t)b;
+		}
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)(uintptr_t)page->data;
+		sqe->len = page->sz;
+		sqe->off = (uint64_t)page->pageid * (uint64_t)page->sz;
+		sqe->user_data = (uint64_t)(uintptr_t)(batch->slots+i+k);
+		ring->sqarray[idx] = idx;
+		tail++;
+	}
+	__atomic_store_n(ring->sqtail, tail, __ATOMIC_RELEASE);
+
+	while(submitted < n) {
+		r = syscall(__NR_io_uring_enter, ring->fd, n-submitted,
+		            0, 0, NULL, 0);
+		if (r < 0) {
+			if (errno == EINTR || errno == EAGAIN ||
+			    errno == EBUSY) continue;
+			break;
+		}
+		submitted += (uint32_t)r;
+	}
+	batch->pending += submitted;
+	ring->inflight += submitted;
+	if (submitted == n) return BEET_OK;
+
+	/* take back what was not submitted;
+	 * nobody else writes to the queue while we hold the latch */
+	__atomic_store_n(ring->sqtail, *ring->sqtail - (n-submitted),
+	                 __ATOMIC_RELEASE);
+	for(uint32_t k=submitted; k<n; k++) {
+		batch->slots[i+k].res = (int32_t)pages[i+k]->sz;
+	}
+	return syncIO(pages, i+submitted, i+n, store, write);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: wait for completions (the latch is held).
+ * One thread at a time (the leader) waits in the kernel
+ * without the latch, so that others can submit meanwhile;
+ * it hands the results to the slots of their batches
+ * and wakes up the others. If the kernel fails to wait,
+ * the requests in flight are lost and the ring is broken.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t reap(beet_aio_ring_t *ring, beet_latch_t *latch) {
+	struct io_uring_cqe *cqe;
+	unsigned head, tail;
+	slot_t *slot;
+	beet_err_t err;
+	long r;
+
+	if (ring->leader) return beet_cond_wait(&ring->done, latch, NULL);
+
+	ring->leader = 1;
+	err = beet_latch_unlock(latch);
+	if (err != BEET_OK) return err;
+	do r = syscall(__NR_io_uring_enter, ring->fd, 0, 1,
+	               IORING_ENTER_GETEVENTS, NULL, 0);
+	while(r < 0 && (errno == EINTR || errno == EAGAIN));
+	err = beet_latch_lock(latch);
+	if (err != BEET_OK) return err;
+	ring->leader = 0;
+
+	if (r < 0) ring->broken = 1;
+
+	head = *ring->cqhead;
+	tail = __atomic_load_n(ring->cqtail, __ATOMIC_ACQUIRE);
+	for(; head != tail; head++) {
+		cqe = ring->cqes + (head & *ring->cqmask);
+		slot = (slot_t*)(uintptr_t)cqe->user_data;
+		slot->res = cqe->res;
+		slot->batch->pending--;
+		ring->inflight--;
+	}
+	__atomic_store_n(ring->cqhead, head, __ATOMIC_RELEASE);
+	return beet_cond_broadcast(&ring->done);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: process pages [0..n) in the ring, n at most 'entries'
+ * at a time, together with the batches of other threads.
+ * The function does not return before all submitted requests
+ * of this batch have completed. Requests the kernel does not
+ * complete in full (short transfers, unsupported opcodes)
+ * are repeated synchronously afterwards (without the latch).
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t ringIO(beet_aio_t *aio,
+                         beet_page_t **pages, uint32_t n,
+                         FILE *store, char write) {
+	beet_aio_ring_t *ring = aio->ring;
+	beet_err_t err = BEET_OK, err2;
+	batch_t batch;
+	uint32_t i=0, k;
+
+	batch.pending = 0;
+	batch.slots = malloc(n*sizeof(slot_t));
+	if (batch.slots == NULL) return syncIO(pages, 0, n, store, write);
+	for(uint32_t j=0; j<n; j++) {
+		batch.slots[j].batch = &batch;
+		batch.slots[j].res = -1;
+	}
+
+	err = beet_latch_lock(&aio->latch);
+	if (err != BEET_OK) {
+		free(batch.slots); return err;
+	}
+	/* after an error, we only wait for what is in flight */
+	while(batch.pending > 0 || (i < n && err == BEET_OK)) {
+		if (ring->broken) break;
+		k = ring->entries - ring->inflight;
+		if (k > n-i) k = n-i;
+		if (err != BEET_OK) k = 0;
+		if (k > 0) {
+			err = submit(ring, &batch, pages, i, k, store, write);
+			i += k; continue;
+		}
+		/* without the latch, the slots must stay */
+		err2 = reap(ring, &aio->latch);
+		if (err2 != BEET_OK) return err2;
+	}
+	/* the pages in flight are not ours anymore */
+	if (ring->broken && batch.pending > 0) {
+		beet_latch_unlock(&aio->latch);
+		free(batch.slots);
+		return write ? BEET_OSERR_WRITE : BEET_OSERR_READ;
+	}
+	err2 = beet_latch_unlock(&aio->latch);
+	if (err == BEET_OK) err = err2;
+
+	/* what was not done in the ring is done synchronously */
+	if (err == BEET_OK && i < n) err = syncIO(pages, i, n, store, write);
+	for(uint32_t j=0; j<i && err == BEET_OK; j++) {
+		if (batch.slots[j].res != (int32_t)pages[j]->sz) {
+			err = syncIO(pages, j, j+1, store, write);
+		}
+	}
+	free(batch.slots);
+	return err;
+}
+#else
+struct beet_aio_ring_st {
+	int fd;
+};
+#endif
+
+/* ------------------------------------------------------------------------
+ * Init
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_aio_init(beet_aio_t *aio, uint32_t depth) {
+	beet_err_t err;
+
+	AIONULL();
+
+	aio->ring = NULL;
+	aio->depth = depth;
+	err = beet_latch_init(&aio->latch);
+	if (err != BEET_OK) return err;
+#ifdef BEET_AIO_URING
+	if (depth > 0) {
+		aio->ring = openRing(depth);
+		if (aio->ring != NULL) aio->depth = aio->ring->entries;
+	}
+#endif
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void beet_aio_destroy(beet_aio_t *aio) {
+	if (aio == NULL) return;
+#ifdef BEET_AIO_URING
+	if (aio->ring != NULL) {
+		closeRing(aio->ring); aio->ring = NULL;
+	}
+#endif
+	beet_latch_destroy(&aio->latch);
+}
+
+/* ------------------------------------------------------------------------
+ * Ring available
+ * ------------------------------------------------------------------------
+ */
+char beet_aio_uring(beet_aio_t *aio) {
+	return (aio != NULL && aio->ring != NULL);
+}
+
+/* ------------------------------------------------------------------------
+ * Register buffers
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_aio_register(beet_aio_t *aio,
+                             char      **bufs,
+                             size_t     *sizes,
+                             uint32_t        n) {
+	AIONULL();
+	if (n == 0) return BEET_OK;
+	if (bufs == NULL || sizes == NULL) return BEET_ERR_INVALID;
+#ifdef BEET_AIO_URING
+	struct iovec *iov;
+
+	if (aio->ring == NULL || aio->ring->bufs != NULL) return BEET_OK;
+
+	iov = calloc(n, sizeof(struct iovec));
+	if (iov == NULL) return BEET_ERR_NOMEM;
+	for(uint32_t i=0; i<n; i++) {
+		iov[i].iov_base = bufs[i];
+		iov[i].iov_len = sizes[i];
+	}
+	/* the kernel may refuse to pin that much memory */
+	if (syscall(__NR_io_uring_register, aio->ring->fd,
+	            IORING_REGISTER_BUFFERS, iov, n) != 0) {
+		free(iov); return BEET_OK;
+	}
+	aio->ring->bufs = iov;
+	aio->ring->nbufs = n;
+#endif
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: process the batch in the ring
+ * (or synchronously, if there is no ring)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t batchIO(beet_aio_t *aio,
+                          beet_page_t **pages, uint32_t n,
+                          FILE *store, char write) {
+	if (n == 0) return BEET_OK;
+#ifdef BEET_AIO_URING
+	if (aio->ring != NULL && n > 1 &&
+	    !__atomic_load_n(&aio->ring->broken, __ATOMIC_RELAXED)) {
+		return ringIO(aio, pages, n, store, write);
+	}
+#endif
+	return syncIO(pages, 0, n, store, write);
+}
+
+/* ------------------------------------------------------------------------
+ * Load pages
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_aio_load(beet_aio_t   *aio,
+                         beet_page_t **pages,
+                         uint32_t          n,
+                         FILE         *store) {
+	AIONULL();
+	PAGESNULL();
+	if (store == NULL) return BEET_ERR_NOFD;
+	return batchIO(aio, pages, n, store, 0);
+}
+
+/* ------------------------------------------------------------------------
+ * Store pages
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_aio_store(beet_aio_t   *aio,
+                          beet_page_t **pages,
+                          uint32_t          n,
+                          FILE         *store) {
+	AIONULL();
+	PAGESNULL();
+	if (store == NULL) return BEET_ERR_NOFD;
+	return batchIO(aio, pages, n, store, 1);
+}
@@ -0,0 +1,109 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2023
+ * ========================================================================
+ * Asynchronous Page I/O
+ * ========================================================================
+ * Reads or writes a batch of pages with one system call.
+ * On Linux, the batch is submitted to an io_uring
+ * and the kernel processes the requests concurrently.
+ * Batches of several threads share the ring: they are queued
+ * as long as the ring has room and one of the threads waits
+ * for the completions of all of them.
+ * Pages in buffers registered with the ring
+ * are read and written without mapping them for each request.
+ * Where io_uring is not available (old kernel, seccomp, other systems),
+ * the pages are read or written one by one with pread/pwrite.
+ * If the kernel fails to wait for requests in flight,
+ * the ring is not used anymore and pread/pwrite are used from then on.
+ * ========================================================================
+ */
+#ifndef beet_aio_decl
+#define beet_aio_decl
+
+#include <beet/types.h>
+#include <beet/lock.h>
+#include <beet/page.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* ------------------------------------------------------------------------
+ * io_uring is used if the kernel headers know it
+ * ------------------------------------------------------------------------
+ */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define BEET_AIO_URING
+#endif
+#endif
+
+/* ------------------------------------------------------------------------
+ * Submission and completion ring (see aio.c)
+ * ------------------------------------------------------------------------
+ */
+typedef struct beet_aio_ring_st beet_aio_ring_t;
+
+/* ------------------------------------------------------------------------
+ * Batched page I/O
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_latch_t    latch; /* protects the ring               */
+	beet_aio_ring_t *ring; /* NULL: pread/pwrite only         */
+	uint32_t        depth; /* max pages in flight             */
+} beet_aio_t;
+
+/* ------------------------------------------------------------------------
+ * Initialise with a queue depth of 'depth' pages.
+ * If no ring can be set up, the object is still usable
+ * and falls back to synchronous I/O.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_aio_init(beet_aio_t *aio, uint32_t depth);
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void beet_aio_destroy(beet_aio_t *aio);
+
+/* ------------------------------------------------------------------------
+ * Is the ring available?
+ * ------------------------------------------------------------------------
+ */
+char beet_aio_uring(beet_aio_t *aio);
+
+/* ------------------------------------------------------------------------
+ * Register 'n' buffers of 'sizes' bytes with the ring.
+ * Pages within these buffers are then transferred
+ * without mapping the memory for each request.
+ * Buffers can be registered only once and only while
+ * no batch is in flight; without ring, or if the kernel refuses
+ * (e.g. RLIMIT_MEMLOCK), this is a no-op.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_aio_register(beet_aio_t *aio,
+                             char      **bufs,
+                             size_t     *sizes,
+                             uint32_t        n);
+
+/* ------------------------------------------------------------------------
+ * Load 'n' pages from store (like beet_page_load for each page)
+ * and wait until all of them are read.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_aio_load(beet_aio_t   *aio,
+                         beet_page_t **pages,
+                         uint32_t          n,
+                         FILE         *store);
+
+/* ------------------------------------------------------------------------
+ * Store 'n' pages (like beet_page_store for each page)
+ * and wait until all of them are written.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_aio_store(beet_aio_t   *aio,
+                          beet_page_t **pages,
+                          uint32_t          n,
+                          FILE         *store);
+#endif
@@ -26,6 +26,7 @@
 #include <beet/rider.h>
 #include <beet/node.h>
 #include <beet/tree.h>
+#include <beet/keytype.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -35,7 +36,7 @@
 #include <dlfcn.h>
 
 #define MAGIC 0x8ee7
-#define VERSION 1
+#define VERSION 5
 
 /* ------------------------------------------------------------------------
  * Initialise external library,
@@ -92,6 +93,16 @@ void beet_open_config_ignore(beet_open_config_t *cfg) {
 	cfg->rscinit = NULL;
 	cfg->rscdest = NULL;
 	cfg->rsc     = NULL;
+	cfg->flushInterval = BEET_FLUSH_DEFAULT;
+	cfg->evictPolicy = BEET_EVICT_DEFAULT;
+	cfg->waitTimeout = BEET_WAIT_DEFAULT;
+	cfg->pool = NULL;
+	cfg->preallocate = BEET_PREALLOC_DEFAULT;
+	cfg->ioDepth = BEET_IODEPTH_DEFAULT;
+	cfg->directIO = BEET_DIRECTIO_DEFAULT;
+	cfg->readOnly = BEET_READONLY_DEFAULT;
+	cfg->walSize = BEET_WAL_DEFAULT;
+	cfg->durability = BEET_DURABLE_DEFAULT;
 }
 
 /* ------------------------------------------------------------------------
@@ -140,10 +151,13 @@ static inline beet_err_t validateCacheSize(int32_t *cacheSize, uint32_t sz) {
  * Check config
  * ------------------------------------------------------------------------
  */
-#define PTRSZ BEET_NODE_PTRSZ
-#define SIZESZ BEET_NODE_SIZESZ
 #define MAX_PAGE_SIZE 0x40000000
 beet_err_t beet_config_validate(beet_config_t *cfg) {
+	beet_node_layout_t layout;
+	beet_err_t err;
+	uint32_t pidsz;
+	char aligned;
+
 	if (cfg == NULL) return BEET_ERR_INVALID;
 
 	if (cfg->leafNodeSize < 2) return BEET_ERR_LNOSZ;
@@ -151,14 +165,31 @@ beet_err_t beet_config_validate(beet_config_t *cfg) {
 
 	if (cfg->keySize == 0) return BEET_ERR_KEYSZ;
 
-	cfg->leafPageSize = cfg->keySize  * cfg->leafNodeSize  +
-	                    cfg->dataSize * cfg->leafNodeSize  +
-	                    SIZESZ + PTRSZ + PTRSZ             + // size + next + prev
-	                    BEET_NODE_CTRLSZ(cfg->leafNodeSize);
+	err = beet_keytype_validate(cfg->keyType, cfg->keySize);
+	if (err != BEET_OK) return err;
+
+	switch(cfg->layout) {
+	case BEET_LAYOUT_ALIGNED: aligned = 1; break;
+	case BEET_LAYOUT_PACKED: aligned = 0; break;
+	case BEET_LAYOUT_LEGACY: return BEET_ERR_OLDVER;
+	default: return BEET_ERR_UNKNTYP;
+	}
+
+	switch(cfg->pageIds) {
+	case BEET_PAGEID_32: pidsz = BEET_NODE_PTRSZ; break;
+	case BEET_PAGEID_64: pidsz = BEET_NODE_PTRSZ64; break;
+	default: return BEET_ERR_UNKNTYP;
+	}
+
+	beet_node_layout(&layout, cfg->leafNodeSize,
+	                          cfg->keySize,
+	                          cfg->dataSize, pidsz, 1, aligned);
+	cfg->leafPageSize = beet_node_pagesize(&layout, aligned);
 
-	cfg->intPageSize = cfg->keySize * cfg->intNodeSize  +
-	                   PTRSZ * cfg->intNodeSize + PTRSZ + // one more pointer than keys
-                           SIZESZ;                            // size
+	beet_node_layout(&layout, cfg->intNodeSize,
+	                          cfg->keySize,
+	                          pidsz, pidsz, 0, aligned);
+	cfg->intPageSize = beet_node_pagesize(&layout, aligned);
 
 	if (cfg->leafPageSize > MAX_PAGE_SIZE) return BEET_ERR_LPAGESZ;
 	if (cfg->intPageSize > MAX_PAGE_SIZE) return BEET_ERR_IPAGESZ;
@@ -169,7 +200,8 @@ beet_err_t beet_config_validate(beet_config_t *cfg) {
 	if (validateCacheSize(&cfg->intCacheSize, cfg->intPageSize) != BEET_OK)
 		return BEET_ERR_ICACHESZ;
 
-	if (cfg->compare == NULL) return BEET_ERR_NOSYM;
+	if (cfg->keyType == BEET_KEY_CUSTOM &&
+	    cfg->compare == NULL) return BEET_ERR_NOSYM;
 
 	// fprintf(stderr, "Leaf Page Size: %u\n", cfg->leafPageSize);
 	// fprintf(stderr, "Leaf Int  Size: %u\n", cfg->intPageSize);
@@ -214,11 +246,17 @@ beet_err_t beet_config_getCompare(beet_config_t      *fcfg,
                                   void               *handle,
                                   beet_compare_t     *cmp) {
 
-	if (ocfg->compare != NULL) {
+	/* the order of built-in types cannot be overridden */
+	if (fcfg->keyType != BEET_KEY_CUSTOM) {
+		*cmp = beet_keytype_compare(fcfg->keyType);
+		return *cmp == NULL ? BEET_ERR_UNKNTYP : BEET_OK;
+	}
+	if (ocfg != NULL && ocfg->compare != NULL) {
 		*cmp = ocfg->compare;
 		return BEET_OK;
 	}
 	if (fcfg->compare == NULL) return BEET_ERR_INVALID;
+	if (handle == NULL) return BEET_ERR_INVALID;
 	*cmp = dlsym(handle, fcfg->compare);
 	if (*cmp == NULL) {
 		fprintf(stderr, "NO SYMBOL for %s: %s\n",
@@ -284,6 +322,9 @@ static inline beet_err_t writecfg(FILE *f, beet_config_t *cfg) {
 
 	if (fwrite(&cfg->keySize, 4, 1, f) != 1) return BEET_OSERR_WRITE;
 	if (fwrite(&cfg->dataSize, 4, 1, f) != 1) return BEET_OSERR_WRITE;
+	if (fwrite(&cfg->keyType, 4, 1, f) != 1) return BEET_OSERR_WRITE;
+	if (fwrite(&cfg->layout, 4, 1, f) != 1) return BEET_OSERR_WRITE;
+	if (fwrite(&cfg->pageIds, 4, 1, f) != 1) return BEET_OSERR_WRITE;
 
 	if (fwrite(&cfg->leafCacheSize, 4, 1, f) != 1) return BEET_OSERR_WRITE;
 	if (fwrite(&cfg->intCacheSize, 4, 1, f) != 1) return BEET_OSERR_WRITE;
@@ -329,7 +370,11 @@ static inline beet_err_t writecfg(FILE *f, beet_config_t *cfg) {
  */
 static inline beet_err_t chkver(uint32_t v) {
 	switch(v) {
-	case 1: return BEET_OK;
+	case 5:
+	case 4:                 /* 4: 32bit pageids */
+	case 3:                 /* 3: packed layout */
+	case 2:                 /* 2: no key type   */
+	case 1: return BEET_OK; /* 1: legacy layout */
 	case 0: return BEET_ERR_NOVER;
 	default: return BEET_ERR_UNKNVER;
 	}
@@ -372,6 +417,22 @@ static inline beet_err_t readcfg(FILE *f, size_t sz, beet_config_t *cfg) {
 
 	i+=8;
 
+	if (v > 2) {
+		if (fread(&cfg->keyType, 4, 1, f) != 1) return BEET_OSERR_READ;
+		i+=4;
+	} else cfg->keyType = BEET_KEY_CUSTOM;
+
+	if (v > 3) {
+		if (fread(&cfg->layout, 4, 1, f) != 1) return BEET_OSERR_READ;
+		i+=4;
+	} else if (v > 1) cfg->layout = BEET_LAYOUT_PACKED;
+	else cfg->layout = BEET_LAYOUT_LEGACY;
+
+	if (v > 4) {
+		if (fread(&cfg->pageIds, 4, 1, f) != 1) return BEET_OSERR_READ;
+		i+=4;
+	} else cfg->pageIds = BEET_PAGEID_32;
+
 	if (fread(&cfg->leafCacheSize, 4, 1, f) != 1) return BEET_OSERR_READ;
 	if (fread(&cfg->intCacheSize, 4, 1, f) != 1) return BEET_OSERR_READ;
 
@@ -104,6 +104,14 @@ const char *beet_errdesc(beet_err_t err) {
 		return "invalid leaf page size";
 	case BEET_ERR_IPAGESZ:
 		return "invalid internal page size";
+	case BEET_ERR_OLDVER:
+		return "index format no longer supported";
+	case BEET_ERR_NOTEMPTY:
+		return "index is not empty";
+	case BEET_ERR_NOTSORTED:
+		return "keys are not sorted";
+	case BEET_ERR_RDONLY:
+		return "index is read-only";
 	case BEET_ERR_TEST:
 		return "this is an injected error!";
 	case BEET_ERR_PANIC:
@@ -116,6 +124,7 @@ const char *beet_errdesc(beet_err_t err) {
 	case BEET_OSERR_PERM: return "insufficient permission";
 	case BEET_OSERR_DEADLK: return "deadlock detected";
 	case BEET_OSERR_INTRP: return "service was interrupted";
+	case BEET_OSERR_TIMEOUT: return "timeout expired";
 	
 	case BEET_OSERR_SEEK: return "seek error (see errno)";
 	case BEET_OSERR_TELL: return "tell error (see errno)";
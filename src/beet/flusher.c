@@ -0,0 +1,110 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2023
+ * ========================================================================
+ * Background Flusher
+ * ========================================================================
+ */
+#include <beet/flusher.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+
+/* ------------------------------------------------------------------------
+ * Helper: compute absolute wake-up time
+ * ------------------------------------------------------------------------
+ */
+static inline void wakeup(struct timespec *ts, uint32_t interval) {
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec  += interval / 1000;
+	ts->tv_nsec += (long)(interval % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++; ts->tv_nsec -= 1000000000;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Flusher thread
+ * ------------------------------------------------------------------------
+ */
+static void *run(void *arg) {
+	beet_flusher_t *flusher = arg;
+	struct timespec ts;
+	beet_err_t err;
+	int x;
+
+	for(;;) {
+		if (beet_latch_lock(&flusher->latch) != BEET_OK) break;
+		wakeup(&ts, flusher->interval);
+		x = 0;
+		while(!flusher->stop && x != ETIMEDOUT) {
+			x = pthread_cond_timedwait(&flusher->wake,
+			                           &flusher->latch, &ts);
+		}
+		if (flusher->stop) {
+			beet_latch_unlock(&flusher->latch);
+			break;
+		}
+		if (beet_latch_unlock(&flusher->latch) != BEET_OK) break;
+
+		err = flusher->flush(flusher->arg);
+		if (err != BEET_OK) {
+			fprintf(stderr, "background flush failed: %s\n",
+			                            beet_errdesc(err));
+		}
+	}
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Start the flusher thread
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_flusher_start(beet_flusher_t *flusher,
+                              uint32_t       interval,
+                              beet_flush_t      flush,
+                              void               *arg) {
+	beet_err_t err;
+	int x;
+
+	if (flusher == NULL || flush == NULL) return BEET_ERR_INVALID;
+
+	flusher->flush = flush;
+	flusher->arg = arg;
+	flusher->interval = interval;
+	flusher->stop = 0;
+
+	err = beet_latch_init(&flusher->latch);
+	if (err != BEET_OK) return err;
+
+	x = pthread_cond_init(&flusher->wake, NULL);
+	if (x != 0) {
+		beet_latch_destroy(&flusher->latch);
+		return BEET_OSERR_NOMEM;
+	}
+	x = pthread_create(&flusher->tid, NULL, &run, flusher);
+	if (x != 0) {
+		pthread_cond_destroy(&flusher->wake);
+		beet_latch_destroy(&flusher->latch);
+		return BEET_OSERR_AGAIN;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Stop the flusher thread and wait for its termination
+ * ------------------------------------------------------------------------
+ */
+void beet_flusher_stop(beet_flusher_t *flusher) {
+	if (flusher == NULL) return;
+
+	if (beet_latch_lock(&flusher->latch) == BEET_OK) {
+		flusher->stop = 1;
+		pthread_cond_signal(&flusher->wake);
+		beet_latch_unlock(&flusher->latch);
+	}
+	pthread_join(flusher->tid, NULL);
+	pthread_cond_destroy(&flusher->wake);
+	beet_latch_destroy(&flusher->latch);
+}
@@ -0,0 +1,53 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2023
+ * ========================================================================
+ * Background Flusher
+ * ========================================================================
+ * A thread that periodically calls a flush callback
+ * (usually writing dirty pages of an index to disk).
+ * ========================================================================
+ */
+#ifndef beet_flusher_decl
+#define beet_flusher_decl
+
+#include <beet/types.h>
+#include <beet/lock.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------
+ * Flush callback
+ * ------------------------------------------------------------------------
+ */
+typedef beet_err_t (*beet_flush_t)(void *arg);
+
+/* ------------------------------------------------------------------------
+ * Flusher
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	pthread_t         tid; /* the flusher thread              */
+	beet_latch_t    latch; /* protects 'stop'                 */
+	pthread_cond_t   wake; /* signalled on stop               */
+	beet_flush_t    flush; /* flush callback                  */
+	void             *arg; /* passed in to the flush callback */
+	uint32_t     interval; /* flush interval in milliseconds  */
+	char             stop; /* the flusher shall terminate     */
+} beet_flusher_t;
+
+/* ------------------------------------------------------------------------
+ * Start the flusher thread
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_flusher_start(beet_flusher_t *flusher,
+                              uint32_t       interval,
+                              beet_flush_t      flush,
+                              void               *arg);
+
+/* ------------------------------------------------------------------------
+ * Stop the flusher thread and wait for its termination
+ * ------------------------------------------------------------------------
+ */
+void beet_flusher_stop(beet_flusher_t *flusher);
+#endif
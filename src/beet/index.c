@@ -20,13 +20,14 @@
  * ========================================================================
  * BEET API
  * TODO:
- * - delete
  * - map, fold?
  * ========================================================================
  */
 #include <beet/rider.h>
 #include <beet/node.h>
 #include <beet/tree.h>
+#include <beet/flusher.h>
+#include <beet/wal.h>
 #include <beet/iterimp.h>
 #include <beet/iter.h>
 #include <beet/config.h>
@@ -36,10 +37,17 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
 
 #define LEAF "leaf"
 #define INTERN "nonleaf"
+#define PURGE  "purge"
+#define WAL    "wal"
+
+#define DEFAULT_FLUSH_INTERVAL 1000
 
 /* ------------------------------------------------------------------------
  * index
@@ -49,8 +57,14 @@ struct beet_index_t {
 	beet_tree_t   *tree;
 	beet_pageid_t  root;
 	FILE          *roof;
+	FILE         *purge;
+	beet_latch_t plock;
 	char     standalone;
 	beet_index_t subidx;
+	beet_flusher_t *flusher;
+	beet_wal_t         *wal;
+	char       readonly;
+	int32_t     durable;
 };
 
 /* ------------------------------------------------------------------------
@@ -77,6 +91,13 @@ struct beet_state_t {
 #define SUBNULL() \
 	if (idx->subidx == NULL) return BEET_ERR_NOSUB;
 
+/* ------------------------------------------------------------------------
+ * Macro: index is writable
+ * ------------------------------------------------------------------------
+ */
+#define WRITABLE() \
+	if (idx->readonly) return BEET_ERR_RDONLY;
+
 /* ------------------------------------------------------------------------
  * Macro: state not NULL
  * ------------------------------------------------------------------------
@@ -131,8 +152,8 @@ static inline beet_err_t mkempty(char *path, char *name) {
  * Helper: make roof
  * ------------------------------------------------------------------------
  */
-static inline beet_err_t mkroof(char *path) {
-	beet_pageid_t root = BEET_PAGE_LEAF;
+static inline beet_err_t mkroof(char *path, uint32_t pidsz) {
+	char root[sizeof(beet_pageid_t)];
 	FILE *f;
 	size_t s;
 	char *p;
@@ -147,7 +168,8 @@ static inline beet_err_t mkroof(char *path) {
 	f = fopen(p, "wb"); free(p);
 	if (f == NULL) return BEET_OSERR_OPEN;
 
-	if (fwrite(&root, sizeof(beet_pageid_t), 1, f) != 1) {
+	beet_page_putid(root, BEET_PAGE_LEAF, pidsz);
+	if (fwrite(root, pidsz, 1, f) != 1) {
 		fclose(f);
 		return BEET_OSERR_WRITE;
 	}
@@ -156,6 +178,25 @@ static inline beet_err_t mkroof(char *path) {
 	return BEET_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: remove the log of an earlier index
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t rmwal(char *path) {
+	char *p;
+
+	p = malloc(strlen(path) + strlen(WAL) + 2);
+	if (p == NULL) return BEET_ERR_NOMEM;
+
+	sprintf(p, "%s/%s", path, WAL);
+
+	if (remove(p) != 0 && errno != ENOENT) {
+		free(p); return BEET_OSERR_REMOV;
+	}
+	free(p);
+	return BEET_OK;
+}
+
 /* ------------------------------------------------------------------------
  * Helper: make root
  * ------------------------------------------------------------------------
@@ -190,7 +231,9 @@ static inline beet_err_t mkroot(beet_index_t idx,
  * Helper: get roof
  * ------------------------------------------------------------------------
  */
-static inline beet_err_t getroof(beet_index_t idx, char *path) {
+static inline beet_err_t getroof(beet_index_t idx, char *path,
+                                                 uint32_t pidsz) {
+	char root[sizeof(beet_pageid_t)];
 	char *p;
 
 	p = malloc(strlen(path) + 6);
@@ -198,13 +241,76 @@ static inline beet_err_t getroof(beet_index_t idx, char *path) {
 
 	sprintf(p, "%s/roof", path);
 
-	idx->roof = fopen(p, "rb+"); free(p);
+	idx->roof = fopen(p, idx->readonly ? "rb" : "rb+"); free(p);
 	if (idx->roof == NULL) return BEET_OSERR_OPEN;
 	
-	if (fread(&idx->root, sizeof(beet_pageid_t), 1, idx->roof) != 1) {
+	if (fread(root, pidsz, 1, idx->roof) != 1) {
 		fclose(idx->roof); idx->roof = NULL;
 		return BEET_OSERR_READ;
 	}
+	idx->root = beet_page_getid(root, pidsz);
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: open purge cursor (created on first open)
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t getpurge(beet_index_t idx, char *path) {
+	char *p;
+
+	p = malloc(strlen(path) + strlen(PURGE) + 2);
+	if (p == NULL) return BEET_ERR_NOMEM;
+
+	sprintf(p, "%s/%s", path, PURGE);
+
+	idx->purge = fopen(p, "rb+");
+	if (idx->purge == NULL) idx->purge = fopen(p, "wb+");
+	free(p);
+	if (idx->purge == NULL) return BEET_OSERR_OPEN;
+	if (beet_latch_init(&idx->plock) != BEET_OK) {
+		fclose(idx->purge); idx->purge = NULL;
+		return BEET_OSERR_OPEN;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: apply open config to rider
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t configRider(beet_rider_t       *rider,
+                                     beet_open_config_t *ocfg) {
+	beet_err_t err;
+
+	if (ocfg == NULL) return BEET_OK;
+	if (ocfg->pool != NULL) {
+		err = beet_rider_setPool(rider, ocfg->pool);
+		if (err != BEET_OK) return err;
+	}
+	if (ocfg->evictPolicy != BEET_EVICT_DEFAULT) {
+		err = beet_rider_setPolicy(rider, ocfg->evictPolicy);
+		if (err != BEET_OK) return err;
+	}
+	if (ocfg->waitTimeout > 0) {
+		err = beet_rider_setTimeout(rider, ocfg->waitTimeout);
+		if (err != BEET_OK) return err;
+	}
+	if (ocfg->preallocate > 0) {
+		err = beet_rider_setPrealloc(rider, ocfg->preallocate);
+		if (err != BEET_OK) return err;
+	} else if (ocfg->preallocate == BEET_PREALLOC_NONE) {
+		err = beet_rider_setPrealloc(rider, 0);
+		if (err != BEET_OK) return err;
+	}
+	if (ocfg->ioDepth > 0) {
+		err = beet_rider_setAio(rider, ocfg->ioDepth);
+		if (err != BEET_OK) return err;
+	}
+	if (ocfg->directIO == BEET_DIRECTIO_ON) {
+		err = beet_rider_setDirect(rider);
+		if (err != BEET_OK) return err;
+	}
 	return BEET_OK;
 }
 
@@ -215,13 +321,31 @@ static inline beet_err_t getroof(beet_index_t idx, char *path) {
 static inline beet_err_t getLeafRider(beet_index_t   sidx,
                                       char          *path,
                                       beet_config_t *cfg,
+                                 beet_open_config_t *ocfg,
                                       beet_rider_t  **rider) {
 	beet_err_t err;
 	*rider = calloc(1,sizeof(beet_rider_t));
 	if (*rider == NULL) return BEET_ERR_NOMEM;
-	err = beet_rider_init(*rider, path, LEAF,
-	 cfg->leafPageSize, cfg->leafCacheSize); 
+	if (sidx->readonly) {
+		err = beet_rider_map(*rider, path, LEAF, cfg->leafPageSize);
+		if (err != BEET_OK) {
+			free(*rider); *rider = NULL;
+		}
+		return err;
+	}
+	/* with a buffer pool, the pool limits the cache */
+	err = beet_rider_init(*rider, path, LEAF, cfg->leafPageSize,
+	      ocfg != NULL && ocfg->pool != NULL ? 0 : cfg->leafCacheSize);
+	if (err != BEET_OK) {
+		free(*rider); *rider = NULL; return err;
+	}
+	err = configRider(*rider, ocfg);
+	if (err == BEET_OK) {
+		err = beet_rider_setIdSize(*rider,
+		                BEET_PAGEID_SIZE(cfg->pageIds));
+	}
 	if (err != BEET_OK) {
+		beet_rider_destroy(*rider);
 		free(*rider); *rider = NULL; return err;
 	}
 	return BEET_OK;
@@ -234,13 +358,30 @@ static inline beet_err_t getLeafRider(beet_index_t   sidx,
 static inline beet_err_t getIntRider(beet_index_t   sidx,
                                      char          *path,
                                      beet_config_t *cfg,
+                                beet_open_config_t *ocfg,
                                      beet_rider_t  **rider) {
 	beet_err_t err;
 	*rider = calloc(1,sizeof(beet_rider_t));
 	if (*rider == NULL) return BEET_ERR_NOMEM;
-	err = beet_rider_init(*rider, path, INTERN,
-	     cfg->intPageSize, cfg->intCacheSize); 
+	if (sidx->readonly) {
+		err = beet_rider_map(*rider, path, INTERN, cfg->intPageSize);
+		if (err != BEET_OK) {
+			free(*rider); *rider = NULL;
+		}
+		return err;
+	}
+	err = beet_rider_init(*rider, path, INTERN, cfg->intPageSize,
+	      ocfg != NULL && ocfg->pool != NULL ? 0 : cfg->intCacheSize);
+	if (err != BEET_OK) {
+		free(*rider); *rider = NULL; return err;
+	}
+	err = configRider(*rider, ocfg);
+	if (err == BEET_OK) {
+		err = beet_rider_setIdSize(*rider,
+		                BEET_PAGEID_SIZE(cfg->pageIds));
+	}
 	if (err != BEET_OK) {
+		beet_rider_destroy(*rider);
 		free(*rider); *rider = NULL; return err;
 	}
 	return BEET_OK;
@@ -314,7 +455,11 @@ beet_err_t beet_index_create(const char *base,
 	}
 
 	if (standalone) {
-		err = mkroof(p);
+		err = mkroof(p, BEET_PAGEID_SIZE(cfg->pageIds));
+		if (err != BEET_OK) {
+			free(p); return err;
+		}
+		err = rmwal(p);
 		if (err != BEET_OK) {
 			free(p); return err;
 		}
@@ -358,14 +503,338 @@ beet_err_t beet_index_drop(const char *base, const char *path) {
 
 	REMOVE(p, ip, LEAF, s);
 	REMOVE(p, ip, INTERN, s);
+	REMOVE(p, ip, LEAF ".free", s);
+	REMOVE(p, ip, INTERN ".free", s);
+	REMOVE(p, ip, LEAF ".used", s);
+	REMOVE(p, ip, INTERN ".used", s);
 	REMOVE(p, ip, "config", s);
 	REMOVE(p, ip, "roof", s);
+	REMOVE(p, ip, PURGE, s);
+	REMOVE(p, ip, WAL, s);
+
+	free(p);
+
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: write dirty pages of index and subindex to disk
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t flushIndex(beet_index_t idx, char wait) {
+	beet_err_t err;
+
+	if (idx->subidx != NULL) {
+		err = flushIndex(idx->subidx, wait);
+		if (err != BEET_OK) return err;
+	}
+	return beet_tree_flush(idx->tree, wait);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: start writeback of the files of index and subindex
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t writeback(beet_index_t idx) {
+	beet_err_t err;
+
+	if (idx->subidx != NULL) {
+		err = writeback(idx->subidx);
+		if (err != BEET_OK) return err;
+	}
+	err = beet_rider_writeback(idx->tree->lfs);
+	if (err != BEET_OK) return err;
+	return beet_rider_writeback(idx->tree->nolfs);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: sync the files of index and subindex
+ * ------------------------------------------------------------------------
+ * When this returns, all pages written before are on disk.
+ * The order gives no guarantee in case of a crash before:
+ * pages are overwritten in place and the flusher and eviction
+ * write them in any order, so the files on disk may then
+ * mix old and new pages. Only the write-ahead log protects
+ * against that.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t syncFiles(beet_index_t idx) {
+	beet_err_t err;
+
+	if (idx->subidx != NULL) {
+		err = syncFiles(idx->subidx);
+		if (err != BEET_OK) return err;
+	}
+	err = beet_rider_sync(idx->tree->lfs);
+	if (err != BEET_OK) return err;
+	return beet_rider_sync(idx->tree->nolfs);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: sync the files and, finally, the roof
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t syncDisk(beet_index_t idx) {
+	beet_err_t err;
+
+	err = syncFiles(idx);
+	if (err != BEET_OK) return err;
+
+	if (idx->roof != NULL) {
+		if (fflush(idx->roof) != 0) return BEET_OSERR_FLUSH;
+		if (fdatasync(fileno(idx->roof)) != 0) return BEET_OSERR_FLUSH;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: sync callback for checkpoints:
+ *         write all pages, sync the files and the roof
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t syncIndex(void *arg) {
+	beet_index_t idx = arg;
+	beet_err_t err;
+
+	err = flushIndex(idx, 1);
+	if (err != BEET_OK) return err;
+
+	return syncDisk(idx);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: flush callback for the background flusher
+ * ------------------------------------------------------------------------
+ * With a durability policy, the pages just written
+ * are pushed towards the disk, so that they do not
+ * pile up for the next sync.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t bgflush(void *arg) {
+	beet_index_t idx = arg;
+	beet_err_t err;
+
+	err = flushIndex(idx, 0);
+	if (err != BEET_OK) return err;
+
+	if (idx->wal != NULL) return BEET_OK;
+
+	switch(idx->durable) {
+	case BEET_DURABLE_ONSYNC: return writeback(idx);
+	case BEET_DURABLE_PERIODIC:
+		err = writeback(idx);
+		if (err != BEET_OK) return err;
+		return syncDisk(idx);
+	default: return BEET_OK;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: start background flusher
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t startFlusher(beet_index_t idx, int32_t interval) {
+	beet_err_t err;
+
+	if (interval < 0) interval = DEFAULT_FLUSH_INTERVAL;
 
+	idx->flusher = calloc(1, sizeof(beet_flusher_t));
+	if (idx->flusher == NULL) return BEET_ERR_NOMEM;
+
+	err = beet_flusher_start(idx->flusher, interval, &bgflush, idx);
+	if (err != BEET_OK) {
+		free(idx->flusher); idx->flusher = NULL;
+		return err;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: start the write-ahead log
+ * ------------------------------------------------------------------------
+ * What was written without log is synced first,
+ * so that the base record describes the files.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t startWal(beet_index_t idx, char *path, int32_t mb) {
+	beet_err_t err;
+	char *p;
+
+	err = syncIndex(idx);
+	if (err != BEET_OK) return err;
+
+	p = malloc(strlen(path) + strlen(WAL) + 2);
+	if (p == NULL) return BEET_ERR_NOMEM;
+
+	sprintf(p, "%s/%s", path, WAL);
+
+	idx->wal = calloc(1, sizeof(beet_wal_t));
+	if (idx->wal == NULL) {
+		free(p); return BEET_ERR_NOMEM;
+	}
+	err = beet_wal_init(idx->wal, p, &idx->root, (uint64_t)mb << 20);
 	free(p);
+	if (err != BEET_OK) {
+		free(idx->wal); idx->wal = NULL;
+		return err;
+	}
+	err = beet_wal_addRider(idx->wal, idx->tree->lfs, BEET_WAL_LEAF);
+	if (err != BEET_OK) return err;
+	err = beet_wal_addRider(idx->wal, idx->tree->nolfs, BEET_WAL_NONLEAF);
+	if (err != BEET_OK) return err;
+	if (idx->subidx != NULL) {
+		err = beet_wal_addRider(idx->wal, idx->subidx->tree->lfs,
+		                                  BEET_WAL_SUBLEAF);
+		if (err != BEET_OK) return err;
+		err = beet_wal_addRider(idx->wal, idx->subidx->tree->nolfs,
+		                                  BEET_WAL_SUBNOLEAF);
+		if (err != BEET_OK) return err;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: files written on recovery
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	char *dir[BEET_WAL_FILES]; /* directory of the file */
+	int    fd[BEET_WAL_FILES]; /* opened on demand      */
+	uint64_t pages[BEET_WAL_FILES]; /* pages written up to */
+} recovery_t;
 
+/* ------------------------------------------------------------------------
+ * Helper: replay callback, write one page image
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t recoverPage(void         *arg,
+                              uint32_t     file,
+                              beet_pageid_t pageid,
+                              uint32_t     size,
+                              char        *image) {
+	recovery_t *rc = arg;
+	ssize_t r;
+	off_t off;
+	char *p;
+
+	if (rc->dir[file] == NULL) return BEET_ERR_BADF;
+	if (rc->fd[file] < 0) {
+		char *name = file%2 == 0 ? LEAF : INTERN;
+
+		p = malloc(strlen(rc->dir[file]) + strlen(name) + 2);
+		if (p == NULL) return BEET_ERR_NOMEM;
+		sprintf(p, "%s/%s", rc->dir[file], name);
+		rc->fd[file] = open(p, O_WRONLY); free(p);
+		if (rc->fd[file] < 0) return BEET_OSERR_OPEN;
+	}
+	if (pageid >= rc->pages[file]) rc->pages[file] = pageid+1;
+
+	off = (off_t)pageid*size;
+	while(size > 0) {
+		r = pwrite(rc->fd[file], image, size, off);
+		if (r <= 0) return BEET_OSERR_WRITE;
+		image += r; size -= (uint32_t)r; off += r;
+	}
 	return BEET_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: recover from the write-ahead log (if there is one)
+ * ------------------------------------------------------------------------
+ * The page images of all complete groups are written to the files
+ * and the root of the last one to the roof; then the files are synced
+ * and the log is cleared.
+ * Read-only indices cannot be recovered (BEET_ERR_RDONLY).
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t recover(const char *base, char *path,
+                          beet_config_t *cfg, char readonly) {
+	char rb[sizeof(beet_pageid_t)];
+	uint32_t pidsz = BEET_PAGEID_SIZE(cfg->pageIds);
+	beet_pageid_t root, old;
+	beet_err_t err, err2;
+	uint64_t groups;
+	recovery_t rc;
+	char *p, *r;
+	FILE *roof;
+
+	memset(&rc, 0, sizeof(recovery_t));
+	for(int i=0; i<BEET_WAL_FILES; i++) rc.fd[i] = -1;
+
+	p = malloc(strlen(path) + strlen(WAL) + 2);
+	if (p == NULL) return BEET_ERR_NOMEM;
+	sprintf(p, "%s/%s", path, WAL);
+
+	r = malloc(strlen(path) + 6);
+	if (r == NULL) {
+		free(p); return BEET_ERR_NOMEM;
+	}
+	sprintf(r, "%s/roof", path);
+
+	roof = fopen(r, readonly ? "rb" : "rb+"); free(r);
+	if (roof == NULL) {
+		free(p); return BEET_OSERR_OPEN;
+	}
+	if (fread(rb, pidsz, 1, roof) != 1) {
+		fclose(roof); free(p); return BEET_OSERR_READ;
+	}
+	old = beet_page_getid(rb, pidsz); root = old;
+
+	rc.dir[BEET_WAL_LEAF] = path;
+	rc.dir[BEET_WAL_NONLEAF] = path;
+	if (cfg->indexType == BEET_INDEX_HOST && cfg->subPath != NULL) {
+		rc.dir[BEET_WAL_SUBLEAF] = malloc(strlen(base) +
+		                                  strlen(cfg->subPath) + 2);
+		if (rc.dir[BEET_WAL_SUBLEAF] == NULL) {
+			fclose(roof); free(p); return BEET_ERR_NOMEM;
+		}
+		sprintf(rc.dir[BEET_WAL_SUBLEAF], "%s/%s", base, cfg->subPath);
+		rc.dir[BEET_WAL_SUBNOLEAF] = rc.dir[BEET_WAL_SUBLEAF];
+	}
+
+	err = beet_wal_replay(p, readonly ? NULL : recoverPage,
+	                      &rc, &root, &groups);
+	if (err == BEET_ERR_NOFILE) err = BEET_OK;
+	else if (err == BEET_OK && readonly &&
+	         (groups > 0 || root != old)) err = BEET_ERR_RDONLY;
+
+	for(int i=0; i<BEET_WAL_FILES; i++) {
+		if (rc.fd[i] < 0) continue;
+		if (err == BEET_OK && fdatasync(rc.fd[i]) != 0) {
+			err = BEET_OSERR_FLUSH;
+		}
+		close(rc.fd[i]);
+
+		/* pages of the log may be beyond the size saved */
+		if (err == BEET_OK) {
+			err = beet_rider_cover(rc.dir[i],
+			                       i%2 == 0 ? LEAF : INTERN,
+			                       rc.pages[i]);
+		}
+	}
+	free(rc.dir[BEET_WAL_SUBLEAF]);
+
+	/* the root of the last group */
+	if (err == BEET_OK && root != old) {
+		beet_page_putid(rb, root, pidsz);
+		if (fseek(roof, 0, SEEK_SET) != 0 ||
+		    fwrite(rb, pidsz, 1, roof) != 1) err = BEET_OSERR_WRITE;
+		else if (fflush(roof) != 0 ||
+		         fdatasync(fileno(roof)) != 0) err = BEET_OSERR_FLUSH;
+	}
+	err2 = fclose(roof) == 0 ? BEET_OK : BEET_OSERR_CLOSE;
+	if (err == BEET_OK) err = err2;
+
+	/* everything is on disk: the log is not needed anymore */
+	if (err == BEET_OK && !readonly) {
+		if (truncate(p, 0) != 0 && errno != ENOENT) {
+			err = BEET_OSERR_WRITE;
+		}
+	}
+	free(p);
+	return err;
+}
+
 /* ------------------------------------------------------------------------
  * Helper: open an index
  * ------------------------------------------------------------------------
@@ -422,10 +891,19 @@ static beet_err_t openIndex(const char       *base,
 	}
 
 	sidx->standalone = standalone;
+	sidx->readonly = (ocfg != NULL &&
+	                  ocfg->readOnly == BEET_READONLY_MMAP);
+
+	/* indices without right-links can only be read */
+	if (fcfg.layout == BEET_LAYOUT_LEGACY) sidx->readonly = 1;
 
 	/* open roof and set root */
 	if (standalone) {
-		err = getroof(sidx, p);
+		err = recover(base, p, &fcfg, sidx->readonly);
+		if (err == BEET_OK) {
+			err = getroof(sidx, p, BEET_PAGEID_SIZE(fcfg.pageIds));
+		}
+		if (err == BEET_OK && !sidx->readonly) err = getpurge(sidx, p);
 		if (err != BEET_OK) {
 			beet_config_destroy(&fcfg);
 			beet_index_close(sidx); free(p);
@@ -434,7 +912,7 @@ static beet_err_t openIndex(const char       *base,
 	}
 
 	/* init leaf rider */
-	err = getLeafRider(sidx, p, &fcfg, &lfs);
+	err = getLeafRider(sidx, p, &fcfg, ocfg, &lfs);
 	if (err != BEET_OK) {
 		beet_config_destroy(&fcfg);
 		beet_index_close(sidx); free(p);
@@ -442,7 +920,7 @@ static beet_err_t openIndex(const char       *base,
 	}
 
 	/* init nonleaf rider */
-	err = getIntRider(sidx, p, &fcfg, &nolfs);
+	err = getIntRider(sidx, p, &fcfg, ocfg, &nolfs);
 	if (err != BEET_OK) {
 		beet_rider_destroy(lfs); free(lfs);
 		beet_config_destroy(&fcfg);
@@ -457,6 +935,11 @@ static beet_err_t openIndex(const char       *base,
                                 fcfg.subPath,
 		                handle,ocfg,0,
 		                &sidx->subidx);
+		/* the host stores the roots of the embedded trees */
+		if (err == BEET_OK &&
+		    fcfg.dataSize != sidx->subidx->tree->pidsz) {
+			err = BEET_ERR_BADCFG;
+		}
 		if (err != BEET_OK) {
 			beet_rider_destroy(lfs); free(lfs);
 			beet_rider_destroy(nolfs); free(nolfs);
@@ -527,6 +1010,13 @@ static beet_err_t openIndex(const char       *base,
 		beet_index_close(sidx);
 		return err;
 	}
+	if (fcfg.layout == BEET_LAYOUT_LEGACY) {
+		beet_tree_setUnlinked(sidx->tree);
+	} else {
+		beet_tree_setLayout(sidx->tree,
+		                    fcfg.layout == BEET_LAYOUT_ALIGNED,
+		                    BEET_PAGEID_SIZE(fcfg.pageIds));
+	}
 
 	/* make first root node */
 	if (standalone) {
@@ -537,6 +1027,30 @@ static beet_err_t openIndex(const char       *base,
 			return err;
 		}
 	}
+	/* start write-ahead log */
+	if (standalone && ocfg != NULL && !sidx->readonly &&
+	    ocfg->walSize > 0) {
+		err = startWal(sidx, p, ocfg->walSize);
+		if (err != BEET_OK) {
+			beet_config_destroy(&fcfg);
+			beet_index_close(sidx); free(p);
+			return err;
+		}
+	}
+	/* durability policy */
+	if (standalone && ocfg != NULL && !sidx->readonly) {
+		sidx->durable = ocfg->durability;
+	}
+	/* start background flusher */
+	if (standalone && ocfg != NULL && !sidx->readonly &&
+	    ocfg->flushInterval != BEET_FLUSH_NEVER) {
+		err = startFlusher(sidx, ocfg->flushInterval);
+		if (err != BEET_OK) {
+			beet_config_destroy(&fcfg);
+			beet_index_close(sidx); free(p);
+			return err;
+		}
+	}
 	beet_config_destroy(&fcfg); free(p);
 	*idx = sidx;
 	return BEET_OK;
@@ -561,9 +1075,27 @@ beet_err_t beet_index_open(const char       *base,
 void beet_index_close(beet_index_t idx) {
 
 	if (idx == NULL) return;
+	if (idx->flusher != NULL) {
+		beet_flusher_stop(idx->flusher);
+		free(idx->flusher); idx->flusher = NULL;
+	}
+	if (idx->wal != NULL) {
+		if (beet_wal_checkpoint(idx->wal, syncIndex,
+		                        idx, 1) != BEET_OK) {
+			fprintf(stderr, "cannot checkpoint index\n");
+		}
+	} else if (idx->durable != BEET_DURABLE_NONE) {
+		if (syncIndex(idx) != BEET_OK) {
+			fprintf(stderr, "cannot sync index\n");
+		}
+	}
 	if (idx->roof != NULL) {
 		fclose(idx->roof); idx->roof = NULL;
 	}
+	if (idx->purge != NULL) {
+		fclose(idx->purge); idx->purge = NULL;
+		beet_latch_destroy(&idx->plock);
+	}
 	if (idx->subidx != NULL) {
 		beet_index_close(idx->subidx); idx->subidx = NULL;
 	}
@@ -571,9 +1103,37 @@ void beet_index_close(beet_index_t idx) {
 		beet_tree_destroy(idx->tree);
 		free(idx->tree); idx->tree = NULL;
 	}
+	if (idx->wal != NULL) {
+		beet_wal_destroy(idx->wal);
+		free(idx->wal); idx->wal = NULL;
+	}
 	free(idx);
 }
 
+/* ------------------------------------------------------------------------
+ * Write all dirty pages to disk
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_index_sync(beet_index_t idx) {
+	beet_err_t err;
+
+	IDXNULL();
+
+	if (idx->wal != NULL) {
+		return beet_wal_checkpoint(idx->wal, syncIndex, idx, 1);
+	}
+
+	if (idx->durable != BEET_DURABLE_NONE) return syncIndex(idx);
+
+	err = flushIndex(idx, 1);
+	if (err != BEET_OK) return err;
+
+	if (idx->roof != NULL) {
+		if (fflush(idx->roof) != 0) return BEET_OSERR_FLUSH;
+	}
+	return BEET_OK;
+}
+
 /* ------------------------------------------------------------------------
  * Get Index type
  * ------------------------------------------------------------------------
@@ -605,6 +1165,33 @@ void *beet_index_getResource(beet_index_t idx) {
 	return idx->tree->rsc;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: begin a logged operation
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t beginop(beet_index_t idx) {
+	if (idx->wal == NULL) return BEET_OK;
+	return beet_wal_begin(idx->wal);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: end a logged operation that returned 'err';
+ *         waits until the changes are synced
+ *         and checkpoints when the log is full
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t endop(beet_index_t idx, beet_err_t err) {
+	beet_err_t err2;
+
+	if (idx->wal == NULL) return err;
+
+	err2 = beet_wal_end(idx->wal);
+	if (err2 == BEET_OK && beet_wal_full(idx->wal)) {
+		err2 = beet_wal_checkpoint(idx->wal, syncIndex, idx, 0);
+	}
+	return err != BEET_OK ? err : err2;
+}
+
 /* ------------------------------------------------------------------------
  * Insert a (key, data) pair into the index without updating the data
  * if the key already exists.
@@ -612,9 +1199,16 @@ void *beet_index_getResource(beet_index_t idx) {
  */
 beet_err_t beet_index_insert(beet_index_t idx, const void *key,
                                                const void *data) {
+	beet_err_t err;
+
 	IDXNULL();
-	return beet_tree_insert(idx->tree,
-	                       &idx->root, key, data);
+	WRITABLE();
+
+	err = beginop(idx);
+	if (err != BEET_OK) return err;
+
+	err = beet_tree_insert(idx->tree, &idx->root, key, data);
+	return endop(idx, err);
 }
 
 /* ------------------------------------------------------------------------
@@ -624,9 +1218,305 @@ beet_err_t beet_index_insert(beet_index_t idx, const void *key,
  */
 beet_err_t beet_index_upsert(beet_index_t idx, const void *key,
                                                const void *data) {
+	beet_err_t err;
+
 	IDXNULL();
-	return beet_tree_upsert(idx->tree,
-	                       &idx->root, key, data);
+	WRITABLE();
+
+	err = beginop(idx);
+	if (err != BEET_OK) return err;
+
+	err = beet_tree_upsert(idx->tree, &idx->root, key, data);
+	return endop(idx, err);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: logged operation that is renewed while it runs
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_index_t idx;
+	char        open; /* an operation is running */
+} oparg_t;
+
+/* ------------------------------------------------------------------------
+ * Helper: end the operation and begin the next one
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t nextop(void *arg) {
+	oparg_t *op = arg;
+	beet_err_t err;
+
+	op->open = 0;
+	err = endop(op->idx, BEET_OK);
+	if (err != BEET_OK) return err;
+
+	err = beginop(op->idx);
+	if (err == BEET_OK) op->open = 1;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: insert or upsert a batch
+ * ------------------------------------------------------------------------
+ * With a log, each leaf is one operation (as in purge):
+ * the pages changed by an operation stay in the cache
+ * until its group is committed, so a batch as one operation
+ * could fill the cache and then wait forever for room.
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t batch(beet_index_t idx,
+                               const void  *keys,
+                               const void  *data,
+                               uint32_t        n,
+                               char       sorted,
+                               char          upd) {
+	beet_err_t err;
+	uint32_t stride;
+	oparg_t op;
+
+	IDXNULL();
+	WRITABLE();
+
+	/* host indices receive pairs for the embedded tree */
+	stride = idx->subidx != NULL ? sizeof(beet_pair_t) :
+	                               idx->tree->dsize;
+
+	err = beginop(idx);
+	if (err != BEET_OK) return err;
+
+	op.idx = idx; op.open = 1;
+	err = beet_tree_insertBatch(idx->tree, &idx->root,
+	                            keys, data, stride,
+	                            n, sorted, upd,
+	                            idx->wal != NULL ? nextop : NULL, &op);
+	if (!op.open) return err;
+	return endop(idx, err);
+}
+
+/* ------------------------------------------------------------------------
+ * Insert a batch of (key, data) pairs
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_index_insertBatch(beet_index_t idx,
+                                  const void  *keys,
+                                  const void  *data,
+                                  uint32_t        n,
+                                  char       sorted) {
+	return batch(idx, keys, data, n, sorted, 0);
+}
+
+/* ------------------------------------------------------------------------
+ * Upsert a batch of (key, data) pairs
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_index_upsertBatch(beet_index_t idx,
+                                  const void  *keys,
+                                  const void  *data,
+                                  uint32_t        n,
+                                  char       sorted) {
+	return batch(idx, keys, data, n, sorted, 1);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: bulk load a host index
+ * ------------------------------------------------------------------------
+ * The stream delivers (key1, (key2, data2)) ordered by key1 and key2.
+ * The host tree is loaded from a source that yields
+ * each key1 once together with the root of an embedded tree,
+ * which is loaded (before key1 is passed on)
+ * from all pairs with that key1.
+ * One pair is read ahead to see where the key1 changes.
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_index_t    idx; /* the host index              */
+	beet_bulk_t    next; /* the user stream             */
+	void        *stream;
+	uint32_t       fill;
+	char           *key; /* current key1                */
+	char          *key1; /* key1 of the pair read ahead */
+	char          *key2; /* key2 of the pair read ahead */
+	char         *data2; /* data of the pair read ahead */
+	beet_pageid_t   sub; /* root of the embedded tree
+	                        (as stored in the host)     */
+	char          ahead; /* a pair was read ahead       */
+	char            eof; /* the stream is exhausted     */
+} hostbulk_t;
+
+/* ------------------------------------------------------------------------
+ * Helper: read the next pair ahead
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t bulkfetch(hostbulk_t *hb) {
+	beet_tree_t *sub = hb->idx->subidx->tree;
+	const void *key, *data;
+	beet_pair_t *pair;
+	beet_err_t err;
+
+	if (hb->eof) return BEET_ERR_EOF;
+
+	err = hb->next(hb->stream, &key, &data);
+	if (err == BEET_ERR_EOF) hb->eof = 1;
+	if (err != BEET_OK) return err;
+
+	pair = (beet_pair_t*)data;
+	if (key == NULL || pair == NULL || pair->key == NULL) {
+		return BEET_ERR_NOKEY;
+	}
+
+	memcpy(hb->key1, key, hb->idx->tree->ksize);
+	memcpy(hb->key2, pair->key, sub->ksize);
+	if (sub->dsize > 0 && pair->data != NULL) {
+		memcpy(hb->data2, pair->data, sub->dsize);
+	}
+	hb->ahead = 1;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: source for the embedded tree
+ *         (all pairs with the current key1)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t bulksub(void *src, const void **key, const void **data) {
+	hostbulk_t *hb = src;
+	beet_tree_t *tree = hb->idx->tree;
+	beet_err_t err;
+
+	if (!hb->ahead) {
+		err = bulkfetch(hb);
+		if (err != BEET_OK) return err;
+	}
+	if (tree->cmp(hb->key1, hb->key, tree->rsc) != BEET_CMP_EQUAL) {
+		return BEET_ERR_EOF;
+	}
+	hb->ahead = 0;
+
+	*key = hb->key2;
+	*data = hb->data2;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: source for the host tree
+ *         (key1 and the root of its embedded tree)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t bulkhost(void *src, const void **key, const void **data) {
+	hostbulk_t *hb = src;
+	beet_err_t err;
+
+	if (!hb->ahead) {
+		err = bulkfetch(hb);
+		if (err != BEET_OK) return err;
+	}
+	memcpy(hb->key, hb->key1, hb->idx->tree->ksize);
+
+	beet_page_putid(&hb->sub, BEET_PAGE_NULL,
+	                hb->idx->subidx->tree->pidsz);
+	err = beet_tree_bulkload(hb->idx->subidx->tree, &hb->sub,
+	                         bulksub, hb, hb->fill);
+	if (err != BEET_OK) return err;
+
+	*key = hb->key;
+	*data = &hb->sub;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: bulk load host index
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t bulkloadHost(beet_index_t idx,
+                               beet_bulk_t next,
+                               void     *stream,
+                               uint32_t    fill) {
+	hostbulk_t hb;
+	beet_err_t err;
+	uint32_t k1 = idx->tree->ksize;
+	uint32_t k2 = idx->subidx->tree->ksize;
+	uint32_t d2 = idx->subidx->tree->dsize;
+
+	memset(&hb, 0, sizeof(hostbulk_t));
+
+	hb.idx = idx;
+	hb.next = next;
+	hb.stream = stream;
+	hb.fill = fill;
+
+	/* one buffer for key, key1, key2 and data2 */
+	hb.key = malloc(2*k1+k2+d2);
+	if (hb.key == NULL) return BEET_ERR_NOMEM;
+
+	hb.key1 = hb.key+k1;
+	hb.key2 = hb.key1+k1;
+	hb.data2 = hb.key2+k2;
+
+	err = beet_tree_bulkload(idx->tree, &idx->root, bulkhost, &hb, fill);
+	free(hb.key);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: bulk load arguments (for the write-ahead log)
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_index_t   idx;
+	beet_bulk_t   next;
+	void       *stream;
+	uint32_t      fill;
+} bulkargs_t;
+
+/* ------------------------------------------------------------------------
+ * Helper: bulk load
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t bulkload(void *arg) {
+	bulkargs_t *a = arg;
+
+	if (a->idx->subidx != NULL) {
+		return bulkloadHost(a->idx, a->next, a->stream, a->fill);
+	}
+	return beet_tree_bulkload(a->idx->tree, &a->idx->root,
+	                          a->next, a->stream, a->fill);
+}
+
+/* ------------------------------------------------------------------------
+ * Load an empty index from a sorted stream
+ * ------------------------------------------------------------------------
+ * With write-ahead log, the load is not logged;
+ * it excludes all writers and ends with a checkpoint.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_index_bulkload(beet_index_t   idx,
+                               beet_bulk_t   next,
+                               void       *stream,
+                               uint32_t      fill) {
+	bulkargs_t args;
+	beet_err_t err;
+
+	IDXNULL();
+	WRITABLE();
+
+	if (next == NULL) return BEET_ERR_INVALID;
+
+	args.idx = idx;
+	args.next = next;
+	args.stream = stream;
+	args.fill = fill;
+
+	if (idx->wal != NULL) {
+		return beet_wal_unlogged(idx->wal, bulkload, &args,
+		                                   syncIndex, idx);
+	}
+
+	err = bulkload(&args);
+	if (err != BEET_OK) return err;
+
+	/* the pages are written in the order they were allocated */
+	return flushIndex(idx, 1);
 }
 
 /* ------------------------------------------------------------------------
@@ -660,9 +1550,16 @@ static inline beet_err_t staterelease(beet_state_t state) {
  * ------------------------------------------------------------------------
  */
 beet_err_t beet_index_hide(beet_index_t idx, const void *key) {
+	beet_err_t err;
+
 	IDXNULL();
-	return beet_tree_hide(idx->tree,
-	                     &idx->root, key);
+	WRITABLE();
+
+	err = beginop(idx);
+	if (err != BEET_OK) return err;
+
+	err = beet_tree_hide(idx->tree, &idx->root, key);
+	return endop(idx, err);
 }
 
 /* ------------------------------------------------------------------------
@@ -676,43 +1573,151 @@ beet_err_t beet_index_hide2(beet_index_t   idx,
 	struct beet_state_t state;
 
 	IDXNULL();
+	WRITABLE();
 	if (idx->subidx == NULL) return BEET_ERR_NOSUB;
 
 	CLEANSTATE(&state);
 
-	err = beet_index_get(idx, &state, BEET_FLAGS_ROOT, key1, NULL);
+	err = beginop(idx);
 	if (err != BEET_OK) return err;
 
+	err = beet_index_get(idx, &state, BEET_FLAGS_ROOT, key1, NULL);
+	if (err != BEET_OK) return endop(idx, err);
+
 	err = beet_tree_hide(idx->subidx->tree, state.root, key2);
 	staterelease(&state);
-	if (err != BEET_OK) {
-		return err;
-	}
 	// should we hide the upper key if all data are hidden?
-	return BEET_OK;
+	return endop(idx, err);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: milliseconds since 't0'
+ * ------------------------------------------------------------------------
+ */
+static inline int elapsed(struct timespec *t0) {
+	struct timespec t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (int)((t1.tv_sec - t0->tv_sec)*1000 +
+	             (t1.tv_nsec - t0->tv_nsec)/1000000);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: remove hidden keys (holding the cursor latch)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t purge(beet_index_t idx, int runtime) {
+	struct timespec t0;
+	beet_err_t err;
+	uint32_t   more = 0;
+	char    *cursor;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	cursor = malloc(idx->tree->ksize);
+	if (cursor == NULL) return BEET_ERR_NOMEM;
+
+	/* an empty (new) file means: start from the beginning */
+	rewind(idx->purge);
+	if (fread(&more, sizeof(uint32_t), 1, idx->purge) != 1 ||
+	    fread(cursor, idx->tree->ksize, 1, idx->purge) != 1) more = 0;
+
+	for(;;) {
+		/* each leaf is one operation */
+		err = beginop(idx);
+		if (err != BEET_OK) break;
+		err = beet_tree_purge(idx->tree, &idx->root,
+		                      more ? cursor : NULL,
+		                      cursor, NULL);
+		err = endop(idx, err);
+		if (err != BEET_OK) break;
+		more = 1;
+		if (runtime > 0 && elapsed(&t0) >= runtime) break;
+	}
+	if (err == BEET_ERR_EOF) more = 0;
+	if (err != BEET_OK && err != BEET_ERR_EOF) {
+		free(cursor); return err;
+	}
+
+	rewind(idx->purge);
+	if (fwrite(&more, sizeof(uint32_t), 1, idx->purge) != 1 ||
+	    fwrite(cursor, idx->tree->ksize, 1, idx->purge) != 1) {
+		free(cursor); return BEET_OSERR_WRITE;
+	}
+	free(cursor);
+	if (fflush(idx->purge) != 0) return BEET_OSERR_FLUSH;
+	return err;
 }
 
 /* ------------------------------------------------------------------------
  * Remove hidden keys.
  * ------------------------------------------------------------------------
+ * The cursor is stored in the purge file as
+ * a flag (0: start with the leftmost leaf) followed by the key.
+ * Concurrent calls take turns on the cursor.
+ * ------------------------------------------------------------------------
  */
-beet_err_t beet_index_purge(beet_index_t idx, int runtime);
+beet_err_t beet_index_purge(beet_index_t idx, int runtime) {
+	beet_err_t err, err2;
+
+	IDXNULL();
+	WRITABLE();
+	if (idx->purge == NULL) return BEET_ERR_NOTSUPP;
+
+	err = beet_latch_lock(&idx->plock);
+	if (err != BEET_OK) return err;
+
+	err = purge(idx, runtime);
+
+	err2 = beet_latch_unlock(&idx->plock);
+	if (err == BEET_OK) err = err2;
+	return err;
+}
 
 /* ------------------------------------------------------------------------
  * Removes a key and all its data from the index
- * TODO: implement!
+ * (the embedded tree of a host index is dropped by the inserter)
  * ------------------------------------------------------------------------
  */
-beet_err_t beet_index_delete(beet_index_t idx, const void *key);
+beet_err_t beet_index_delete(beet_index_t idx, const void *key) {
+	beet_err_t err;
+
+	IDXNULL();
+	WRITABLE();
+
+	err = beginop(idx);
+	if (err != BEET_OK) return err;
+
+	err = beet_tree_delete(idx->tree, &idx->root, key);
+	return endop(idx, err);
+}
 
 /* ------------------------------------------------------------------------
  * Removes a single data point from a subindex.
- * TODO: implement!
  * ------------------------------------------------------------------------
  */
 beet_err_t beet_index_delete2(beet_index_t  idx,
                               const void   *key1,
-                              const void   *key2);
+                              const void   *key2) {
+	beet_err_t err;
+	struct beet_state_t state;
+
+	IDXNULL();
+	WRITABLE();
+	if (idx->subidx == NULL) return BEET_ERR_NOSUB;
+
+	CLEANSTATE(&state);
+
+	err = beginop(idx);
+	if (err != BEET_OK) return err;
+
+	err = beet_index_get(idx, &state, BEET_FLAGS_ROOT, key1, NULL);
+	if (err != BEET_OK) return endop(idx, err);
+
+	err = beet_tree_delete(idx->subidx->tree, state.root, key2);
+	staterelease(&state);
+	return endop(idx, err);
+}
 
 /* ------------------------------------------------------------------------
  * Helper: get data
@@ -737,7 +1742,7 @@ static beet_err_t getdata(beet_index_t idx,
 	slot = beet_node_search(node, idx->tree->ksize,
 	                        key,  idx->tree->cmp,
 	                              idx->tree->rsc);
-	if (slot < 0 || slot > idx->tree->lsize) {
+	if (slot < 0 || slot >= node->size) {
 		beet_tree_release(idx->tree, node); free(node);
 		return BEET_ERR_KEYNOF;
 	}
@@ -774,6 +1779,29 @@ beet_err_t beet_index_height(beet_index_t idx, uint32_t *h) {
 	return beet_tree_height(idx->tree, &idx->root, h);
 }
 
+/* ------------------------------------------------------------------------
+ * Wait statistics
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_index_waitStats(beet_index_t idx,
+                                uint64_t   *waits,
+                                uint64_t  *waited) {
+	beet_err_t err;
+	uint64_t w, t;
+
+	IDXNULL();
+	if (waits == NULL || waited == NULL) return BEET_ERR_INVALID;
+
+	err = beet_rider_waitStats(idx->tree->lfs, waits, waited);
+	if (err != BEET_OK) return err;
+
+	err = beet_rider_waitStats(idx->tree->nolfs, &w, &t);
+	if (err != BEET_OK) return err;
+
+	*waits += w; *waited += t;
+	return BEET_OK;
+}
+
 /* ------------------------------------------------------------------------
  * Get data by key (simple)
  * ------------------------------------------------------------------------
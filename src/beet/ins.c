@@ -24,6 +24,9 @@ beet_err_t beet_ins_plain(void *ignore, char upd, uint32_t sz, void* trg,
 void beet_ins_plainclean(void *ignore) {}
 void beet_ins_plaininit(void *ignore, uint32_t n, void *kids) {}
 void beet_ins_plainclear(void *ignore, void *kids) {}
+beet_err_t beet_ins_plaindrop(void *ignore, void *kid) {
+	return BEET_OK;
+}
 
 beet_err_t beet_ins_setPlain(beet_ins_t *ins) {
 	ins->rsc = NULL;
@@ -31,6 +34,7 @@ beet_err_t beet_ins_setPlain(beet_ins_t *ins) {
 	ins->cleaner = &beet_ins_plainclean;
 	ins->ninit = &beet_ins_plaininit;
 	ins->clear = &beet_ins_plainclear;
+	ins->drop = &beet_ins_plaindrop;
 	return BEET_OK;
 }
 
@@ -41,10 +45,13 @@ beet_err_t beet_ins_setPlain(beet_ins_t *ins) {
 #define PAIR(x) \
 	((beet_pair_t*)x)
 
+#define ROOT(t,r) \
+	beet_page_getid(r, ((beet_tree_t*)t)->pidsz)
+
 beet_err_t beet_ins_embedded(void *tree, char upd, uint32_t sz, void *root,
                                                           const void *data) {
 	beet_err_t err;
-	if (*(beet_pageid_t*)root == BEET_PAGE_NULL) {
+	if (ROOT(tree, root) == BEET_PAGE_NULL) {
 		err = beet_tree_makeRoot(tree, root);
 		if (err != BEET_OK) return err;
 		// fprintf(stderr, "new root is %u\n", *(beet_pageid_t*)root);
@@ -69,14 +76,20 @@ void beet_ins_embeddedclean(void *ins) {
 	*/
 }
 
-void beet_ins_embeddedinit(void *ignore, uint32_t n, void *kids) {
+void beet_ins_embeddedinit(void *tree, uint32_t n, void *kids) {
+	uint32_t sz = ((beet_tree_t*)tree)->pidsz;
 	for(int i=0; i<n; i++) {
-		((beet_pageid_t*)kids)[i] = BEET_PAGE_NULL;
+		beet_page_putid((char*)kids+i*sz, BEET_PAGE_NULL, sz);
 	}
 }
 
-void beet_ins_embeddedclear(void *ignore, void *kid) {
-		*(beet_pageid_t*)kid = BEET_PAGE_NULL;
+void beet_ins_embeddedclear(void *tree, void *kid) {
+	beet_page_putid(kid, BEET_PAGE_NULL, ((beet_tree_t*)tree)->pidsz);
+}
+
+beet_err_t beet_ins_embeddeddrop(void *tree, void *root) {
+	if (ROOT(tree, root) == BEET_PAGE_NULL) return BEET_OK;
+	return beet_tree_drop(tree, root);
 }
 
 beet_err_t beet_ins_setEmbedded(beet_ins_t *ins, void *subtree) {
@@ -85,5 +98,6 @@ beet_err_t beet_ins_setEmbedded(beet_ins_t *ins, void *subtree) {
 	ins->cleaner = &beet_ins_embeddedclean;
 	ins->ninit = &beet_ins_embeddedinit;
 	ins->clear = &beet_ins_embeddedclear;
+	ins->drop = &beet_ins_embeddeddrop;
 	return BEET_OK;
 }
@@ -64,6 +64,17 @@ typedef void (*beet_ins_nodeinit_t)(void*, uint32_t, void*);
  */
 typedef void (*beet_ins_nodeclear_t)(void*, void*);
 
+/* -------------------------------------------------------------------------
+ * Generic field release callback
+ * ------------------------------
+ * Releases what one cell in the data segment refers to,
+ * before the key is removed from the node.
+ * Parameters: 1) resource ("closure")
+ *             2) The cell in the kids segment of the node
+ * -------------------------------------------------------------------------
+ */
+typedef beet_err_t (*beet_ins_nodedrop_t)(void*, void*);
+
 /* -------------------------------------------------------------------------
  * Generic insert
  * --------------
@@ -80,6 +91,7 @@ typedef struct {
 	beet_ins_cleanup_t cleaner; /* clean  method     */
 	beet_ins_nodeinit_t  ninit; /* node init method  */
 	beet_ins_nodeclear_t clear; /* field init method */
+	beet_ins_nodedrop_t   drop; /* field drop method */
 } beet_ins_t;
 
 /* -------------------------------------------------------------------------
@@ -91,6 +103,7 @@ beet_err_t beet_ins_plain(void *ignore, char upd, uint32_t sz, void* trg,
 void beet_ins_plainclean(void *ignore);
 void beet_ins_plaininit(void *ignore, uint32_t n, void *kids);
 void beet_ins_plainclear(void *ignore, void *kids);
+beet_err_t beet_ins_plaindrop(void *ignore, void *kid);
 
 beet_err_t beet_ins_setPlain(beet_ins_t *ins);
 
@@ -101,8 +114,9 @@ beet_err_t beet_ins_setPlain(beet_ins_t *ins);
 beet_err_t beet_ins_embedded(void *tree, char upd, uint32_t sz, void* root,
                                                          const void *data);
 void beet_ins_embeddedclean(void *ins);
-void beet_ins_embeddedinit(void *ignore, uint32_t n, void *kids);
-void beet_ins_embeddedclear(void *ignore, void *kids);
+void beet_ins_embeddedinit(void *tree, uint32_t n, void *kids);
+void beet_ins_embeddedclear(void *tree, void *kids);
+beet_err_t beet_ins_embeddeddrop(void *tree, void *root);
 
 beet_err_t beet_ins_setEmbedded(beet_ins_t *ins, void *subtree);
 
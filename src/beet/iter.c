@@ -25,6 +25,9 @@
 #include <beet/iterimp.h>
 #include <beet/index.h>
 
+#include <stdlib.h>
+#include <string.h>
+
 /* ------------------------------------------------------------------------
  * Reset the iterator to start position
  * ------------------------------------------------------------------------
@@ -46,6 +49,7 @@ beet_err_t beet_iter_init(beet_iter_t    iter,
 	iter->dir  = dir;
 	iter->pos  = -1;
 	iter->node = NULL;
+	iter->bound = 0;
 
 	return BEET_OK;
 }
@@ -61,6 +65,7 @@ void beet_iter_destroy(beet_iter_t iter) {
 		beet_tree_release(iter->tree, iter->node);
 		free(iter->node); iter->node = NULL;
 	}
+	if (iter->low != NULL) free(iter->low);
 	free(iter);
 }
 
@@ -79,6 +84,7 @@ beet_err_t beet_iter_reset(beet_iter_t iter) {
 		if (err != BEET_OK) return err;
 	}
 	iter->pos = -1;
+	iter->bound = 0;
 	return BEET_OK;
 }
 
@@ -92,6 +98,11 @@ static inline beet_err_t getfrom(beet_iter_t iter) {
 	beet_node_t *tmp;
 
 	for(;;) {
+		/* empty leaves are skipped (see beet_iter_move) */
+		if (iter->node->size == 0) {
+			iter->pos = iter->dir == BEET_DIR_ASC?0:-1;
+			return BEET_OK;
+		}
 		iter->pos = beet_node_search(iter->node,
 		                             iter->tree->ksize,
 		                             iter->from,
@@ -144,18 +155,9 @@ static inline beet_err_t getfrom(beet_iter_t iter) {
 			} else {
 				iter->pos--;
 				if (iter->pos < 0) {
-					/* is this case possible -- 
-					 * or should we rather
-					 * treat it as error ? */
-					err = beet_tree_prev(iter->tree,
-					                     iter->node,
-					                          &tmp);
-					if (err != BEET_OK) return err;
-				
-					err = beet_tree_release(iter->tree,
-					                        iter->node);
-					if (err != BEET_OK) return err;
-					iter->node = tmp; break;
+					/* continue with the left neighbour
+					 * (see beet_iter_move) */
+					return BEET_OK;
 				}
 			}
 		}
@@ -163,6 +165,39 @@ static inline beet_err_t getfrom(beet_iter_t iter) {
 	return BEET_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: remember the least key seen so far
+ *         when moving backwards
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t lowest(beet_iter_t iter) {
+	if (iter->node->size == 0) return BEET_OK;
+	if (iter->low == NULL) {
+		iter->low = malloc(iter->tree->ksize);
+		if (iter->low == NULL) return BEET_ERR_NOMEM;
+	}
+	if (iter->bound &&
+	    iter->tree->cmp(iter->node->keys, iter->low,
+	                    iter->tree->rsc) != BEET_CMP_LESS) return BEET_OK;
+	memcpy(iter->low, iter->node->keys, iter->tree->ksize);
+	iter->bound = 1;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: position of the greatest key in node
+ *         less than the least key seen so far
+ * ------------------------------------------------------------------------
+ */
+static inline int32_t below(beet_iter_t iter, beet_node_t *node) {
+	int32_t pos = (int32_t)node->size-1;
+	if (!iter->bound) return pos;
+	while(pos >= 0 && iter->tree->cmp(node->keys+pos*iter->tree->ksize,
+	                                  iter->low, iter->tree->rsc) !=
+	                                                 BEET_CMP_LESS) pos--;
+	return pos;
+}
+
 /* ------------------------------------------------------------------------
  * Move the iterator one key forward
  * ------------------------------------------------------------------------
@@ -181,14 +216,26 @@ beet_err_t beet_iter_move(beet_iter_t iter, void **key, void **data) {
 		   (iter->dir == BEET_DIR_DESC && iter->pos == -1))) {
 			if (iter->dir == BEET_DIR_ASC) {
 				err = beet_tree_next(iter->tree, iter->node, &tmp);
-			} else {
-				err = beet_tree_prev(iter->tree, iter->node, &tmp);
-			}
-			if (err != BEET_OK) return err;
+				if (err != BEET_OK) return err;
+
+				iter->pos = 0;
 
-			iter->pos = iter->dir == BEET_DIR_ASC?0:tmp->size-1;
+				err = beet_tree_release(iter->tree, iter->node);
+			} else {
+				err = lowest(iter);
+				if (err != BEET_OK) return err;
 
-			err = beet_tree_release(iter->tree, iter->node);
+				/* prev releases the node */
+				err = beet_tree_prev(iter->tree, iter->node,
+				                     iter->bound?iter->low:NULL,
+				                                         &tmp);
+				if (err != BEET_OK) {
+					free(iter->node); iter->node = NULL;
+					iter->pos = 0; /* see below */
+					return err;
+				}
+				iter->pos = below(iter, tmp);
+			}
 			free(iter->node); iter->node = tmp;
 		}
 		if (iter->node == NULL) {
@@ -206,8 +253,6 @@ beet_err_t beet_iter_move(beet_iter_t iter, void **key, void **data) {
 			}
 			if (err != BEET_OK) return err;
 
-			if (iter->node->size == 0) return BEET_ERR_EOF;
-
 			if (iter->from != NULL) {
 				err = getfrom(iter);
 				if (err != BEET_OK) return err;
@@ -217,6 +262,11 @@ beet_err_t beet_iter_move(beet_iter_t iter, void **key, void **data) {
 			}
 		}
 
+		/* leaves emptied by delete may still be linked */
+		if (iter->pos < 0 || iter->pos >= (int32_t)iter->node->size) {
+			continue;
+		}
+
 		int repeat = 0;
 		while (beet_node_hidden(iter->node, iter->pos)) {
 			if (iter->dir == BEET_DIR_ASC) {
@@ -269,7 +319,7 @@ beet_err_t beet_iter_enter(beet_iter_t iter) {
 	pos = iter->dir==BEET_DIR_ASC?iter->pos-1:iter->pos+1;
 	if (pos < 0 || pos >= iter->node->size) return BEET_ERR_BADSTAT;
 	iter->sub->root = (beet_pageid_t*)(iter->node->kids+pos*
-	                                   sizeof(beet_pageid_t));
+	                                   iter->tree->dsize);
 	iter->level = 1;
 	return beet_iter_reset(iter->sub);
 }
@@ -39,6 +39,8 @@ struct beet_iter_t {
 	const void    *from;
 	const void    *to;
 	int32_t       pos;
+	char         *low;
+	char          bound;
 	char          level;
 	char          use;
 	beet_dir_t    dir;
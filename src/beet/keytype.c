@@ -0,0 +1,77 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2023
+ * ========================================================================
+ * Built-in Key Types
+ * ========================================================================
+ */
+#include <beet/keytype.h>
+
+/* ------------------------------------------------------------------------
+ * Compare integers
+ * ------------------------------------------------------------------------
+ */
+#define CMPINT(T) \
+	T x, y; \
+	memcpy(&x, one, sizeof(T)); \
+	memcpy(&y, two, sizeof(T)); \
+	if (x < y) return BEET_CMP_LESS; \
+	if (x > y) return BEET_CMP_GREATER; \
+	return BEET_CMP_EQUAL;
+
+char beet_keytype_cmpUInt32(const void *one, const void *two, void *ignore) {
+	CMPINT(uint32_t);
+}
+
+char beet_keytype_cmpUInt64(const void *one, const void *two, void *ignore) {
+	CMPINT(uint64_t);
+}
+
+char beet_keytype_cmpInt32(const void *one, const void *two, void *ignore) {
+	CMPINT(int32_t);
+}
+
+char beet_keytype_cmpInt64(const void *one, const void *two, void *ignore) {
+	CMPINT(int64_t);
+}
+
+/* ------------------------------------------------------------------------
+ * Compare byte strings
+ * ------------------------------------------------------------------------
+ */
+char beet_keytype_cmpBytes(const void *one, const void *two, void *ksize) {
+	int r = memcmp(one, two, *(uint32_t*)ksize);
+	if (r < 0) return BEET_CMP_LESS;
+	if (r > 0) return BEET_CMP_GREATER;
+	return BEET_CMP_EQUAL;
+}
+
+/* ------------------------------------------------------------------------
+ * Get the compare function for a key type
+ * ------------------------------------------------------------------------
+ */
+beet_compare_t beet_keytype_compare(uint32_t keyType) {
+	switch(keyType) {
+	case BEET_KEY_UINT32: return beet_keytype_cmpUInt32;
+	case BEET_KEY_UINT64: return beet_keytype_cmpUInt64;
+	case BEET_KEY_INT32: return beet_keytype_cmpInt32;
+	case BEET_KEY_INT64: return beet_keytype_cmpInt64;
+	case BEET_KEY_BYTES: return beet_keytype_cmpBytes;
+	default: return NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Check that the key size fits the key type
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_keytype_validate(uint32_t keyType, uint32_t keySize) {
+	switch(keyType) {
+	case BEET_KEY_CUSTOM:
+	case BEET_KEY_BYTES: return BEET_OK;
+	case BEET_KEY_UINT32:
+	case BEET_KEY_INT32: return keySize == 4 ? BEET_OK : BEET_ERR_KEYSZ;
+	case BEET_KEY_UINT64:
+	case BEET_KEY_INT64: return keySize == 8 ? BEET_OK : BEET_ERR_KEYSZ;
+	default: return BEET_ERR_UNKNTYP;
+	}
+}
@@ -0,0 +1,233 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2023
+ * ========================================================================
+ * Built-in Key Types
+ * ========================================================================
+ * Indices with one of the built-in key types (see config.h)
+ * need no user-defined compare function.
+ * The compare functions below are used wherever a beet_compare_t
+ * is expected; node search recognises them and searches
+ * the keys inline (vectorised where available)
+ * instead of calling the compare function for each key.
+ * ========================================================================
+ */
+#ifndef beet_keytype_decl
+#define beet_keytype_decl
+
+#include <beet/types.h>
+#include <beet/config.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* ------------------------------------------------------------------------
+ * Compare functions for the built-in key types.
+ * beet_keytype_cmpBytes expects a pointer to the key size (uint32_t)
+ * as resource.
+ * ------------------------------------------------------------------------
+ */
+char beet_keytype_cmpUInt32(const void *one, const void *two, void *ignore);
+char beet_keytype_cmpUInt64(const void *one, const void *two, void *ignore);
+char beet_keytype_cmpInt32(const void *one, const void *two, void *ignore);
+char beet_keytype_cmpInt64(const void *one, const void *two, void *ignore);
+char beet_keytype_cmpBytes(const void *one, const void *two, void *ksize);
+
+/* ------------------------------------------------------------------------
+ * Get the compare function for a key type
+ * (NULL for BEET_KEY_CUSTOM and unknown types)
+ * ------------------------------------------------------------------------
+ */
+beet_compare_t beet_keytype_compare(uint32_t keyType);
+
+/* ------------------------------------------------------------------------
+ * Check that the key size fits the key type
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_keytype_validate(uint32_t keyType, uint32_t keySize);
+
+/* ------------------------------------------------------------------------
+ * Lower bound search
+ * ------------------------------------------------------------------------
+ * Returns the index of the first of the 'n' sorted keys
+ * that is not less than 'key' ('n' if there is none).
+ * Binary search narrows the range down to a few keys;
+ * those are then counted in one go.
+ * ------------------------------------------------------------------------
+ */
+#define BEET_KEYTYPE_LINEAR 16
+
+/* ------------------------------------------------------------------------
+ * Helper: count the 32bit keys less than k.
+ * Unsigned keys are compared as signed after flipping the sign bit.
+ * ------------------------------------------------------------------------
+ */
+static inline int32_t beet_keytype_count32(const char *keys,
+                                           int32_t     k,
+                                           int32_t     n,
+                                           int32_t  flip) {
+	int32_t c=0, i=0, x;
+
+#if defined(__AVX2__)
+	__m256i vk = _mm256_set1_epi32(k^flip);
+	__m256i vf = _mm256_set1_epi32(flip);
+	for(; i+8<=n; i+=8) {
+		__m256i vx = _mm256_loadu_si256((const __m256i*)(keys+i*4));
+		vx = _mm256_xor_si256(vx, vf);
+		c += __builtin_popcount(_mm256_movemask_ps(
+		         _mm256_castsi256_ps(_mm256_cmpgt_epi32(vk, vx))));
+	}
+#endif
+#if defined(__SSE2__)
+	__m128i wk = _mm_set1_epi32(k^flip);
+	__m128i wf = _mm_set1_epi32(flip);
+	for(; i+4<=n; i+=4) {
+		__m128i wx = _mm_loadu_si128((const __m128i*)(keys+i*4));
+		wx = _mm_xor_si128(wx, wf);
+		c += __builtin_popcount(_mm_movemask_ps(
+		         _mm_castsi128_ps(_mm_cmplt_epi32(wx, wk))));
+	}
+#endif
+	for(; i<n; i++) {
+		memcpy(&x, keys+i*4, 4);
+		c += ((x^flip) < (k^flip));
+	}
+	return c;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: count the 64bit keys less than k (see above).
+ * 64bit comparisons need SSE4.2 or AVX2.
+ * ------------------------------------------------------------------------
+ */
+static inline int32_t beet_keytype_count64(const char *keys,
+                                           int64_t     k,
+                                           int32_t     n,
+                                           int64_t  flip) {
+	int32_t c=0, i=0;
+	int64_t x;
+
+#if defined(__AVX2__)
+	__m256i vk = _mm256_set1_epi64x(k^flip);
+	__m256i vf = _mm256_set1_epi64x(flip);
+	for(; i+4<=n; i+=4) {
+		__m256i vx = _mm256_loadu_si256((const __m256i*)(keys+i*8));
+		vx = _mm256_xor_si256(vx, vf);
+		c += __builtin_popcount(_mm256_movemask_pd(
+		         _mm256_castsi256_pd(_mm256_cmpgt_epi64(vk, vx))));
+	}
+#endif
+#if defined(__SSE4_2__)
+	__m128i wk = _mm_set1_epi64x(k^flip);
+	__m128i wf = _mm_set1_epi64x(flip);
+	for(; i+2<=n; i+=2) {
+		__m128i wx = _mm_loadu_si128((const __m128i*)(keys+i*8));
+		wx = _mm_xor_si128(wx, wf);
+		c += __builtin_popcount(_mm_movemask_pd(
+		         _mm_castsi128_pd(_mm_cmpgt_epi64(wk, wx))));
+	}
+#endif
+	for(; i<n; i++) {
+		memcpy(&x, keys+i*8, 8);
+		c += ((x^flip) < (k^flip));
+	}
+	return c;
+}
+
+#define BEET_KEYTYPE_FLIP32 INT32_MIN
+#define BEET_KEYTYPE_FLIP64 INT64_MIN
+
+/* ------------------------------------------------------------------------
+ * Lower bound for 32bit keys
+ * ------------------------------------------------------------------------
+ */
+static inline int32_t beet_keytype_search32(const char *keys,
+                                            const void  *key,
+                                            int32_t        n,
+                                            int32_t     flip) {
+	int32_t k, x, h, lo=0;
+
+	memcpy(&k, key, 4); k ^= flip;
+	while(n > BEET_KEYTYPE_LINEAR) {
+		h = n/2;
+		memcpy(&x, keys+(lo+h)*4, 4);
+		if ((x^flip) < k) {
+			lo += h+1; n -= h+1;
+		} else n = h;
+	}
+	return lo + beet_keytype_count32(keys+lo*4, k^flip, n, flip);
+}
+
+/* ------------------------------------------------------------------------
+ * Lower bound for 64bit keys
+ * ------------------------------------------------------------------------
+ */
+static inline int32_t beet_keytype_search64(const char *keys,
+                                            const void  *key,
+                                            int32_t        n,
+                                            int64_t     flip) {
+	int64_t k, x;
+	int32_t h, lo=0;
+
+	memcpy(&k, key, 8); k ^= flip;
+	while(n > BEET_KEYTYPE_LINEAR) {
+		h = n/2;
+		memcpy(&x, keys+(lo+h)*8, 8);
+		if ((x^flip) < k) {
+			lo += h+1; n -= h+1;
+		} else n = h;
+	}
+	return lo + beet_keytype_count64(keys+lo*8, k^flip, n, flip);
+}
+
+/* ------------------------------------------------------------------------
+ * Lower bound for byte strings
+ * ------------------------------------------------------------------------
+ */
+static inline int32_t beet_keytype_searchBytes(const char *keys,
+                                               const void  *key,
+                                               uint32_t   ksize,
+                                               int32_t        n) {
+	int32_t h, lo=0;
+
+	while(n > 0) {
+		h = n/2;
+		if (memcmp(keys+(lo+h)*ksize, key, ksize) < 0) {
+			lo += h+1; n -= h+1;
+		} else n = h;
+	}
+	return lo;
+}
+
+/* ------------------------------------------------------------------------
+ * Search the keys with the built-in search for 'cmp';
+ * returns -1 if cmp is not a built-in compare function.
+ * ------------------------------------------------------------------------
+ */
+static inline int32_t beet_keytype_search(const char    *keys,
+                                          const void     *key,
+                                          uint32_t      ksize,
+                                          int32_t           n,
+                                          beet_compare_t  cmp) {
+	if (cmp == beet_keytype_cmpUInt64) {
+		return beet_keytype_search64(keys, key, n, BEET_KEYTYPE_FLIP64);
+	}
+	if (cmp == beet_keytype_cmpInt64) {
+		return beet_keytype_search64(keys, key, n, 0);
+	}
+	if (cmp == beet_keytype_cmpUInt32) {
+		return beet_keytype_search32(keys, key, n, BEET_KEYTYPE_FLIP32);
+	}
+	if (cmp == beet_keytype_cmpInt32) {
+		return beet_keytype_search32(keys, key, n, 0);
+	}
+	if (cmp == beet_keytype_cmpBytes) {
+		return beet_keytype_searchBytes(keys, key, ksize, n);
+	}
+	return -1;
+}
+#endif
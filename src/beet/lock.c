@@ -27,6 +27,7 @@ static inline beet_err_t geterr(int x) {
 	case EPERM: return BEET_OSERR_PERM;
 	case EDEADLK: return BEET_OSERR_DEADLK;
 	case EINTR: return BEET_OSERR_INVAL;
+	case ETIMEDOUT: return BEET_OSERR_TIMEOUT;
 	default: return BEET_OSERR_UNKN;
 	}
 }
@@ -34,6 +35,9 @@ static inline beet_err_t geterr(int x) {
 #define LATCHNULL() \
 	if (latch == NULL) return BEET_ERR_NOLATCH;
 
+#define CONDNULL() \
+	if (cond == NULL) return BEET_ERR_NOLATCH;
+
 #define LOCKNULL() \
 	if (lock == NULL) return BEET_ERR_NOLOCK;
 
@@ -71,6 +75,17 @@ beet_err_t beet_latch_lock(beet_latch_t *latch) {
 	return BEET_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * try to lock latch
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_latch_trylock(beet_latch_t *latch) {
+	LATCHNULL();
+	int x = pthread_mutex_trylock(latch);
+	PTHREADERR(x);
+	return BEET_OK;
+}
+
 /* ------------------------------------------------------------------------
  * unlock latch
  * ------------------------------------------------------------------------
@@ -82,6 +97,79 @@ beet_err_t beet_latch_unlock(beet_latch_t *latch) {
 	return BEET_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * init condition variable
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_cond_init(beet_cond_t *cond) {
+	pthread_condattr_t attr;
+	int x;
+
+	CONDNULL();
+	x = pthread_condattr_init(&attr);
+	PTHREADERR(x);
+	x = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	if (x != 0) {
+		pthread_condattr_destroy(&attr);
+		return geterr(x);
+	}
+	x = pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+	PTHREADERR(x);
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * destroy condition variable
+ * ------------------------------------------------------------------------
+ */
+void beet_cond_destroy(beet_cond_t *cond) {
+	if (cond == NULL) return;
+	pthread_cond_destroy(cond);
+}
+
+/* ------------------------------------------------------------------------
+ * wait on condition variable
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_cond_wait(beet_cond_t  *cond,
+                          beet_latch_t *latch,
+                          const struct timespec *deadline) {
+	int x;
+
+	CONDNULL();
+	LATCHNULL();
+	if (deadline == NULL) {
+		x = pthread_cond_wait(cond, latch);
+	} else {
+		x = pthread_cond_timedwait(cond, latch, deadline);
+	}
+	PTHREADERR(x);
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * signal condition variable
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_cond_signal(beet_cond_t *cond) {
+	CONDNULL();
+	int x = pthread_cond_signal(cond);
+	PTHREADERR(x);
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * broadcast condition variable
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_cond_broadcast(beet_cond_t *cond) {
+	CONDNULL();
+	int x = pthread_cond_broadcast(cond);
+	PTHREADERR(x);
+	return BEET_OK;
+}
+
 /* ------------------------------------------------------------------------
  * init read/write lock
  * ------------------------------------------------------------------------
@@ -113,6 +201,17 @@ beet_err_t beet_lock_read(beet_lock_t *lock) {
 	return BEET_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * try to lock read/write lock for reading
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_lock_tryread(beet_lock_t *lock) {
+	LOCKNULL();
+	int x = pthread_rwlock_tryrdlock(lock);
+	PTHREADERR(x);
+	return BEET_OK;
+}
+
 /* ------------------------------------------------------------------------
  * unlock read/write lock acquired for reading
  * ------------------------------------------------------------------------
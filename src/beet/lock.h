@@ -9,6 +9,7 @@
 
 #include <beet/types.h>
 #include <pthread.h>
+#include <time.h>
 
 /* ------------------------------------------------------------------------
  * Latch for in memory locking
@@ -35,6 +36,54 @@ void beet_latch_destroy(beet_latch_t *latch);
 beet_err_t beet_latch_lock(beet_latch_t *latch);
 beet_err_t beet_latch_unlock(beet_latch_t *latch);
 
+/* ------------------------------------------------------------------------
+ * Try to lock latch without blocking
+ * (returns BEET_OSERR_BUSY if the latch is held)
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_latch_trylock(beet_latch_t *latch);
+
+/* ------------------------------------------------------------------------
+ * Condition variable to wait on a latch
+ * ------------------------------------------------------------------------
+ */
+typedef pthread_cond_t beet_cond_t;
+
+/* ------------------------------------------------------------------------
+ * Initialise condition variable
+ * (timeouts are measured with the monotonic clock)
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_cond_init(beet_cond_t *cond);
+
+/* ------------------------------------------------------------------------
+ * Destroy condition variable
+ * ------------------------------------------------------------------------
+ */
+void beet_cond_destroy(beet_cond_t *cond);
+
+/* ------------------------------------------------------------------------
+ * Wait on condition variable; the latch must be locked.
+ * If 'deadline' (CLOCK_MONOTONIC) is not NULL,
+ * BEET_OSERR_TIMEOUT is returned when the deadline has passed.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_cond_wait(beet_cond_t  *cond,
+                          beet_latch_t *latch,
+                          const struct timespec *deadline);
+
+/* ------------------------------------------------------------------------
+ * Wake up one thread waiting on the condition variable
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_cond_signal(beet_cond_t *cond);
+
+/* ------------------------------------------------------------------------
+ * Wake up all threads waiting on the condition variable
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_cond_broadcast(beet_cond_t *cond);
+
 /* ------------------------------------------------------------------------
  * Read/Write Lock for pages
  * ------------------------------------------------------------------------
@@ -59,6 +108,13 @@ void beet_lock_destroy(beet_lock_t *lock);
  */
 beet_err_t beet_lock_read(beet_lock_t *lock);
 
+/* ------------------------------------------------------------------------
+ * Try to lock Read Lock without blocking
+ * (returns BEET_OSERR_BUSY if the lock is held for writing)
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_lock_tryread(beet_lock_t *lock);
+
 /* ------------------------------------------------------------------------
  * Unlock Read Lock
  * ------------------------------------------------------------------------
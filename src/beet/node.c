@@ -7,10 +7,13 @@
  * The binary format of a node, which is stored in a page, is
  *
  * 1) Internal Node
- *    +------------------------------------------+
- *    | Size | Keys[nodesize] | Kids[nodesize+1] |
- *    +------------------------------------------+
- *     4byte  keysize*nodesz    4*(nodsz+1)
+ *    +----------------------------------------------------------------+
+ *    | Size | Next | Level | High    | Keys[nodesize] | Kids[nodesize+1] |
+ *    +----------------------------------------------------------------+
+ *     4byte  pidsz  4byte   keysize  keysize*nodesz    pidsz*(nodsz+1)
+ *
+ *    pidsz, the size of a pageid, is 4 or, with 64bit pageids
+ *    (format version 5), 8 bytes.
  *
  *    Here, keysize and nodesz mean the respective size
  *    stored in the tree structure (i.e. 
@@ -39,17 +42,34 @@
  *
  *    We consequently need n+1 kids for n keys.
  *
+ *    Next points to the right sibling on the same level and
+ *    High is the high key: all keys in the node (and below it)
+ *    are less than High; greater or equal keys are found
+ *    following Next. In the rightmost node of a level,
+ *    Next is NULL and High is undefined.
+ *    Level is the distance to the leaves (1 for the parents of leaves).
+ *    Next and High allow to descend without lock coupling:
+ *    if a node was split after we have seen its parent,
+ *    we just move right (Lehman and Yao, 1981).
+ *
  * 2) Leaf Node
- *    +-------------------------------------------------------------------+
- *    | Size | Next | Prev | Control    | Keys[nodesize] | Kids[nodesize] |
- *    +-------------------------------------------------------------------+
- *     4byte  4byte  4byte   nodesz/8+1   keysize*nodesz   datasize*nodesz
+ *    +-----------------------------------------------------------------------------+
+ *    | Size | Next | Prev | High    | Control    | Keys[nodesize] | Kids[nodesize] |
+ *    +-----------------------------------------------------------------------------+
+ *     4byte  pidsz  pidsz  keysize   nodesz/8+1   keysize*nodesz   datasize*nodesz
+ *
+ *    With the aligned layout (format version 4), there is padding
+ *    between the sections: High starts at 8 bytes, Control,
+ *    Keys and Kids start at a cache line (see beet_node_layout).
+ *    Nodes of format version 1 have no High and nonleaves
+ *    have neither Next nor Level (see beet_node_unlinked).
  *
  *    The keys, as before, contain the keys of this tree and
  *    the kids contain the data for their keys.
  *
  *    Next points to the next leaf node in the chain.
  *    Prev points to the previous leaf node in the chain.
+ *    High is the high key as in internal nodes.
  *
  *    Control is a block of bits that indicate whether the key is
  *      - actually present or
@@ -61,44 +81,147 @@
  * ========================================================================
  */
 #include <beet/node.h>
+#include <beet/keytype.h>
 #include <string.h>
 
 #define CTRLSZ BEET_NODE_CTRLSZ
 
+/* ------------------------------------------------------------------------
+ * Helper: round up to a multiple of a (a power of two)
+ * ------------------------------------------------------------------------
+ */
+#define ALIGN(x,a) \
+	(((x)+(a)-1)&~((a)-1))
+
+/* ------------------------------------------------------------------------
+ * Compute the layout of a node
+ * ------------------------------------------------------------------------
+ */
+void beet_node_layout(beet_node_layout_t *layout,
+                      uint32_t            nodesz,
+                      uint32_t             keysz,
+                      uint32_t             kidsz,
+                      uint32_t             pidsz,
+                      char                  leaf,
+                      char               aligned) {
+	uint32_t line = aligned ? BEET_NODE_LINESZ : 1;
+	uint32_t off;
+
+	layout->pid = pidsz;
+	layout->links = 1;
+
+	/* size, next and prev or level */
+	off = BEET_NODE_SIZESZ + pidsz +
+	     (leaf ? pidsz : BEET_NODE_LEVELSZ);
+
+	layout->high = aligned ? ALIGN(off, 8) : off;
+	off = layout->high + keysz;
+
+	if (leaf) {
+		layout->ctrl = ALIGN(off, line);
+		off = layout->ctrl + CTRLSZ(nodesz);
+	} else layout->ctrl = 0;
+
+	layout->keys = ALIGN(off, line);
+	off = layout->keys + keysz*nodesz;
+
+	layout->kids = ALIGN(off, line);
+
+	/* a nonleaf has one more kid than keys */
+	layout->size = layout->kids + kidsz*(leaf ? nodesz : nodesz+1);
+}
+
+/* ------------------------------------------------------------------------
+ * Compute the layout of a node of format version 1
+ * ------------------------------------------------------------------------
+ */
+void beet_node_unlinked(beet_node_layout_t *layout,
+                        uint32_t            nodesz,
+                        uint32_t             keysz,
+                        uint32_t             kidsz,
+                        char                  leaf) {
+	uint32_t off = BEET_NODE_SIZESZ;
+
+	layout->pid = BEET_NODE_PTRSZ;
+	layout->links = 0;
+	layout->high = 0;
+
+	/* only leaves have next and prev */
+	if (leaf) {
+		off += 2*BEET_NODE_PTRSZ;
+		layout->ctrl = off;
+		off += CTRLSZ(nodesz);
+	} else layout->ctrl = 0;
+
+	layout->keys = off;
+	layout->kids = off + keysz*nodesz;
+	layout->size = layout->kids + kidsz*(leaf ? nodesz : nodesz+1);
+}
+
+/* ------------------------------------------------------------------------
+ * Size of the page for a layout
+ * ------------------------------------------------------------------------
+ */
+uint32_t beet_node_pagesize(beet_node_layout_t *layout, char aligned) {
+	uint32_t sz = layout->size;
+	uint32_t p  = BEET_NODE_LINESZ;
+
+	if (!aligned) return sz;
+	if (sz > BEET_NODE_BLOCKSZ) return ALIGN(sz, BEET_NODE_BLOCKSZ);
+	while(p < sz) p <<= 1;
+	return p;
+}
+
 /* ------------------------------------------------------------------------
  * initialise a node from a page (i.e. page -> node)
  * ------------------------------------------------------------------------
  */
-void beet_node_init(beet_node_t *node,
-                    beet_page_t *page,
-                    uint32_t   nodesz,
-                    uint32_t    keysz,
-                    char         leaf) {
+void beet_node_init(beet_node_t              *node,
+                    beet_page_t              *page,
+                    const beet_node_layout_t *layout,
+                    char                       leaf) {
 	int off = 0;
 
 	node->page  = page;
 	node->self  = page->pageid;
 	node->leaf  = leaf;
+	node->pidsz = layout->pid;
 
 	memcpy(&node->size, page->data, sizeof(uint32_t));
 	off += sizeof(uint32_t);
+
+	/* format version 1: no right-links in nonleaves */
+	if (!layout->links && !leaf) {
+		node->next = BEET_PAGE_NULL;
+		node->level = 0;
+		node->ctrl = NULL;
+		node->high = NULL;
+		node->keys = page->data+layout->keys;
+		node->kids = page->data+layout->kids;
+		return;
+	}
+
+	node->next = beet_page_getid(page->data+off, node->pidsz);
+	off += node->pidsz;
 	if (leaf) {
-		memcpy(&node->next, page->data+off, sizeof(uint32_t));
-		off += sizeof(int32_t);
-		memcpy(&node->prev, page->data+off, sizeof(uint32_t));
-		off += sizeof(int32_t);
-		node->ctrl = (uint8_t*)page->data+off; off += CTRLSZ(nodesz);
+		node->prev = beet_page_getid(page->data+off, node->pidsz);
+		node->level = 0;
+		node->ctrl = (uint8_t*)page->data+layout->ctrl;
 
 		/* debug
 		uint16_t x = 0xdead;
 		memcpy(node->ctrl, &x, 2);
 		*/
+	} else {
+		memcpy(&node->level, page->data+off, sizeof(uint32_t));
+		node->ctrl = NULL;
 	}
 
 	// fprintf(stderr, "NODE SIZE : %d\n", node->size);
 	
-	node->keys = page->data+off; off += keysz*nodesz;
-	node->kids = page->data+off;
+	node->high = layout->links ? page->data+layout->high : NULL;
+	node->keys = page->data+layout->keys;
+	node->kids = page->data+layout->kids;
 
 	/* debug
 	fprintf(stderr, "CTRL BLOCK (%u): ", CTRLSZ(nodesz));
@@ -116,11 +239,13 @@ void beet_node_init(beet_node_t *node,
 void beet_node_serialise(beet_node_t *node) {
 	int off=0;
 	memcpy(node->page->data, &node->size, sizeof(uint32_t));
+	off+=sizeof(int32_t);
+	beet_page_putid(node->page->data+off, node->next, node->pidsz);
+	off+=node->pidsz;
 	if (node->leaf) {
-		off+=sizeof(int32_t);
-		memcpy(node->page->data+off, &node->next, sizeof(int32_t));
-		off+=sizeof(int32_t);
-		memcpy(node->page->data+off, &node->prev, sizeof(int32_t));
+		beet_page_putid(node->page->data+off, node->prev, node->pidsz);
+	} else {
+		memcpy(node->page->data+off, &node->level, sizeof(uint32_t));
 	}
 }
 
@@ -242,7 +367,7 @@ static inline beet_err_t add2slot(beet_node_t *node,
 	if (data == NULL) return BEET_OK;
 
 	/* datasize depends on node type */
-	dsz=node->leaf?dsize:sizeof(beet_pageid_t);
+	dsz=node->leaf?dsize:node->pidsz;
 
  	shift = (node->size-slot)*dsz;
 	src = node->kids+slot*dsz;
@@ -265,7 +390,7 @@ static inline beet_err_t add2slot(beet_node_t *node,
 	
 	/* in a nonleaf we copy the new key to the right of 'slot' */
 	} else {
-		if (dsz > 0) memcpy(node->kids+(slot+1)*dsz, data, dsz);
+		beet_node_setPageid(node, slot+1, *(beet_pageid_t*)data);
 	}
 
 	/* done ! */
@@ -300,7 +425,17 @@ void *beet_node_getData(beet_node_t *node,
  */
 beet_pageid_t beet_node_getPageid(beet_node_t *node,
                                   uint32_t     slot) {
-	return (*(beet_pageid_t*)(node->kids+slot*sizeof(beet_pageid_t)));
+	return beet_page_getid(node->kids+slot*node->pidsz, node->pidsz);
+}
+
+/* ------------------------------------------------------------------------
+ * Set pageid at slot (internal node only!)
+ * ------------------------------------------------------------------------
+ */
+void beet_node_setPageid(beet_node_t  *node,
+                         uint32_t      slot,
+                         beet_pageid_t  pge) {
+	beet_page_putid(node->kids+slot*node->pidsz, pge, node->pidsz);
 }
 
 /* ------------------------------------------------------------------------
@@ -311,6 +446,7 @@ beet_pageid_t beet_node_getPageid(beet_node_t *node,
  * Otherwise, we return the slot with the least key >= key
  *            if the key is greater than the greatest in the node,
  *            we return the first free slot.
+ * Keys of a built-in type are searched without calling cmp.
  * ------------------------------------------------------------------------
  */
 static inline int32_t binsearch(char          *keys, 
@@ -320,7 +456,10 @@ static inline int32_t binsearch(char          *keys,
                                 beet_compare_t cmp,
                                 void          *rsc)
 {
-	int r = size; // the least key greater than key
+	int r = beet_keytype_search(keys, key, ksize, size, cmp);
+	if (r >= 0) return r;
+
+	r = size;     // the least key greater than key
 	int s = 0;    // start index
 	int e = r-1;  // end   index
 
@@ -405,6 +544,24 @@ beet_pageid_t beet_node_searchPageid(beet_node_t  *node,
 	return BEET_PAGE_NULL;
 }
 
+/* ------------------------------------------------------------------------
+ * Key beyond high key
+ * ------------------------------------------------------------------------
+ */
+uint8_t beet_node_beyond(beet_node_t  *node,
+                         uint32_t     keysz,
+                         const void    *key,
+                         beet_compare_t cmp,
+                         void          *rsc) {
+	if (node->next == BEET_PAGE_NULL) return 0;
+	if (node->high == NULL) return 0;
+
+	/* an empty leaf with right-link has given its keys away */
+	if (node->leaf && node->size == 0) return 1;
+
+	return (cmp(key, node->high, rsc) != BEET_CMP_LESS);
+}
+
 /* ------------------------------------------------------------------------
  * Generic search
  * ------------------------------------------------------------------------
@@ -457,3 +614,112 @@ void beet_node_unhide(beet_node_t *node,
                       uint32_t     slot) {
 	unhide(node, slot);
 }
+
+/* ------------------------------------------------------------------------
+ * Helper: copy hidden flag from slot 'i' in src to slot 'j' in trg
+ * ------------------------------------------------------------------------
+ */
+static inline void copyctrl(beet_node_t *src, uint32_t i,
+                            beet_node_t *trg, uint32_t j) {
+	if (hidden(src, i)) hide(trg, j); else unhide(trg, j);
+}
+
+/* ------------------------------------------------------------------------
+ * Remove the entry at slot
+ * ------------------------------------------------------------------------
+ */
+void beet_node_remove(beet_node_t *node,
+                      uint32_t    ksize,
+                      uint32_t    dsize,
+                      uint32_t     slot) {
+	uint32_t dsz, kid, n;
+
+	if (slot >= node->size) return;
+
+	n = node->size-slot-1;
+	if (n > 0) {
+		memmove(node->keys+slot*ksize,
+		        node->keys+(slot+1)*ksize, n*ksize);
+	}
+
+	/* in a nonleaf, the kid to the right of the key goes */
+	dsz = node->leaf ? dsize : node->pidsz;
+	kid = node->leaf ? slot : slot+1;
+	if (n > 0 && dsz > 0) {
+		memmove(node->kids+kid*dsz,
+		        node->kids+(kid+1)*dsz, n*dsz);
+	}
+	if (node->leaf) {
+		for(uint32_t i=slot; i+1<node->size; i++) {
+			copyctrl(node, i+1, node, i);
+		}
+		unhide(node, node->size-1);
+	}
+	node->size--;
+}
+
+/* ------------------------------------------------------------------------
+ * Remove all hidden entries
+ * ------------------------------------------------------------------------
+ */
+uint32_t beet_node_compact(beet_node_t *node,
+                           uint32_t    ksize,
+                           uint32_t    dsize) {
+	uint32_t i, j=0, n;
+
+	if (!node->leaf) return 0;
+
+	for(i=0; i<node->size; i++) {
+		if (hidden(node, i)) continue;
+		if (i != j) {
+			memcpy(node->keys+j*ksize, node->keys+i*ksize, ksize);
+			if (dsize > 0) {
+				memcpy(node->kids+j*dsize,
+				       node->kids+i*dsize, dsize);
+			}
+		}
+		j++;
+	}
+	n = node->size - j;
+	for(i=0; i<node->size; i++) unhide(node, i);
+	node->size = j;
+	return n;
+}
+
+/* ------------------------------------------------------------------------
+ * Move the last n entries of leaf src to the front of leaf trg
+ * ------------------------------------------------------------------------
+ */
+void beet_node_give(beet_node_t *src,
+                    beet_node_t *trg,
+                    uint32_t   ksize,
+                    uint32_t   dsize,
+                    uint32_t       n) {
+	uint32_t from;
+
+	if (n > src->size) n = src->size;
+	if (n == 0) return;
+
+	from = src->size - n;
+
+	/* make room in trg */
+	if (trg->size > 0) {
+		memmove(trg->keys+n*ksize, trg->keys, trg->size*ksize);
+		if (dsize > 0) {
+			memmove(trg->kids+n*dsize, trg->kids, trg->size*dsize);
+		}
+		for(uint32_t i=trg->size; i>0; i--) {
+			copyctrl(trg, i-1, trg, i-1+n);
+		}
+	}
+	memcpy(trg->keys, src->keys+from*ksize, n*ksize);
+	if (dsize > 0) {
+		memcpy(trg->kids, src->kids+from*dsize, n*dsize);
+	}
+	for(uint32_t i=0; i<n; i++) {
+		copyctrl(src, from+i, trg, i);
+		unhide(src, from+i);
+	}
+	src->size -= n;
+	trg->size += n;
+}
@@ -24,31 +24,98 @@
  */
 typedef struct {
 	beet_pageid_t self; /* reference to this node     */
-	beet_pageid_t next; /* next node (leaf only)      */
+	beet_pageid_t next; /* right sibling (right-link) */
 	beet_pageid_t prev; /* previous node (leaf only)  */
 	uint32_t      size; /* number of keys in the node */
+	uint32_t     level; /* height (nonleaf only)      */
+	char         *high; /* high key (if next is set)  */
 	uint8_t      *ctrl; /* control block (leaf only)  */
 	char         *keys; /* array of keys              */
 	char         *kids; /* array of pointers          */
 	beet_page_t  *page; /* the page data              */
 	char          mode; /* reading or writing         */
 	char          leaf; /* is leaf node               */
+	uint8_t      pidsz; /* size of pageids on disk    */
 } beet_node_t;
 
 #define BEET_NODE_CTRLSZ(x) (x/8+1)
 #define BEET_NODE_PTRSZ 4
+#define BEET_NODE_PTRSZ64 8
 #define BEET_NODE_SIZESZ 4
+#define BEET_NODE_LEVELSZ 4
 
+/* ------------------------------------------------------------------------
+ * Layout of a node in its page:
+ * the offsets of the sections that follow the header
+ * and the number of bytes used.
+ * In the aligned layout, the high key is aligned to 8 bytes and
+ * the control block, the keys and the kids start on a cache line.
+ * The packed layout (indices created before format version 4)
+ * has no padding at all.
+ * Nodes of format version 1 have neither high keys
+ * nor right-links and nonleaves do not know their level;
+ * they can only be read (see beet_node_unlinked).
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	uint32_t  high; /* offset of the high key          */
+	uint32_t  ctrl; /* offset of the control block     */
+	uint32_t  keys; /* offset of the keys              */
+	uint32_t  kids; /* offset of the kids              */
+	uint32_t  size; /* bytes used by the node          */
+	uint32_t   pid; /* size of pageids                 */
+	uint32_t links; /* high keys and right-links       */
+} beet_node_layout_t;
+
+#define BEET_NODE_LINESZ   64
+#define BEET_NODE_BLOCKSZ 4096
+
+/* ------------------------------------------------------------------------
+ * Compute the layout for nodes with 'nodesz' keys of size 'keysz'
+ * and kids of size 'kidsz' (data size or pageid size);
+ * pageids are stored with 'pidsz' bytes
+ * (BEET_NODE_PTRSZ or BEET_NODE_PTRSZ64).
+ * ------------------------------------------------------------------------
+ */
+void beet_node_layout(beet_node_layout_t *layout,
+                      uint32_t            nodesz,
+                      uint32_t             keysz,
+                      uint32_t             kidsz,
+                      uint32_t             pidsz,
+                      char                  leaf,
+                      char               aligned);
+
+/* ------------------------------------------------------------------------
+ * Compute the layout of format version 1 for nodes
+ * with 'nodesz' keys of size 'keysz' and kids of size 'kidsz':
+ * no high key, no padding and 32bit pageids.
+ * Nodes with this layout have an infinite high key,
+ * nonleaves have no right-link and level 0.
+ * ------------------------------------------------------------------------
+ */
+void beet_node_unlinked(beet_node_layout_t *layout,
+                        uint32_t            nodesz,
+                        uint32_t             keysz,
+                        uint32_t             kidsz,
+                        char                  leaf);
+
+/* ------------------------------------------------------------------------
+ * Size of the page for a layout:
+ * aligned pages do not straddle I/O blocks, i.e.
+ * they are rounded up to a power of two below BEET_NODE_BLOCKSZ
+ * and to a multiple of BEET_NODE_BLOCKSZ above it.
+ * ------------------------------------------------------------------------
+ */
+uint32_t beet_node_pagesize(beet_node_layout_t *layout, char aligned);
 
 /* ------------------------------------------------------------------------
  * Initialise the node from a page
  * ------------------------------------------------------------------------
  */
-void beet_node_init(beet_node_t *node,
-                    beet_page_t *page,
-                    uint32_t   nodesz,
-                    uint32_t    keysz,
-                    char        leaf);
+void beet_node_init(beet_node_t              *node,
+                    beet_page_t              *page,
+                    const beet_node_layout_t *layout,
+                    char                       leaf);
 
 /* ------------------------------------------------------------------------
  * Serialise the node to its page
@@ -74,6 +141,38 @@ beet_err_t beet_node_add(beet_node_t     *node,
                          char              upd,
                          char           *wrote);
 
+/* ------------------------------------------------------------------------
+ * Remove the entry at 'slot'.
+ * In a nonleaf, the key and the kid to its right are removed.
+ * ------------------------------------------------------------------------
+ */
+void beet_node_remove(beet_node_t *node,
+                      uint32_t    ksize,
+                      uint32_t    dsize,
+                      uint32_t     slot);
+
+/* ------------------------------------------------------------------------
+ * Remove all hidden entries from leaf 'node'
+ * in one pass. Returns the number of entries removed.
+ * ------------------------------------------------------------------------
+ */
+uint32_t beet_node_compact(beet_node_t *node,
+                           uint32_t    ksize,
+                           uint32_t    dsize);
+
+/* ------------------------------------------------------------------------
+ * Move the last n entries (keys, data and hidden flags)
+ * of leaf 'src' to the front of leaf 'trg'.
+ * The keys must be less than those in trg and
+ * trg must have room for them.
+ * ------------------------------------------------------------------------
+ */
+void beet_node_give(beet_node_t *src,
+                    beet_node_t *trg,
+                    uint32_t   ksize,
+                    uint32_t   dsize,
+                    uint32_t       n);
+
 /* ------------------------------------------------------------------------
  * Get the key at 'slot'
  * ------------------------------------------------------------------------
@@ -97,6 +196,14 @@ void *beet_node_getData(beet_node_t *node,
 beet_pageid_t beet_node_getPageid(beet_node_t *node,
                                   uint32_t     slot);
 
+/* ------------------------------------------------------------------------
+ * Set pageid at slot (internal node only!)
+ * ------------------------------------------------------------------------
+ */
+void beet_node_setPageid(beet_node_t  *node,
+                         uint32_t      slot,
+                         beet_pageid_t  pge);
+
 /* ------------------------------------------------------------------------
  * Search link to follow
  * ------------------------------------------------------------------------
@@ -107,6 +214,19 @@ beet_pageid_t beet_node_searchPageid(beet_node_t   *node,
                                      beet_compare_t cmp,
                                      void          *rsc);
 
+/* ------------------------------------------------------------------------
+ * Test if key is beyond the high key of the node,
+ * i.e. if it belongs to a right sibling.
+ * Every key is beyond an empty leaf that has a right sibling
+ * and no key is beyond a node without high key.
+ * ------------------------------------------------------------------------
+ */
+uint8_t beet_node_beyond(beet_node_t  *node,
+                         uint32_t     keysz,
+                         const void    *key,
+                         beet_compare_t cmp,
+                         void          *rsc);
+
 /* ------------------------------------------------------------------------
  * Generic search
  * ------------------------------------------------------------------------
@@ -20,6 +20,19 @@
 #define STORENULL() \
 	if (store == NULL) return BEET_ERR_NOFD;
 
+/* ------------------------------------------------------------------------
+ * Allocate aligned memory for pages
+ * ------------------------------------------------------------------------
+ */
+char *beet_page_mem(size_t n, uint32_t sz) {
+	size_t align = BEET_PAGE_ALIGN;
+	void *mem;
+
+	while(align < BEET_PAGE_BLOCK && sz % (2*align) == 0) align *= 2;
+	if (posix_memalign(&mem, align, n*(size_t)sz) != 0) return NULL;
+	return mem;
+}
+
 /* ------------------------------------------------------------------------
  * Allocate a new page in a file
  * ------------------------------------------------------------------------
@@ -63,13 +76,17 @@ beet_err_t beet_page_init(beet_page_t *page, uint32_t sz) {
 	page->data = NULL;
 	page->sz = sz;
 	page->pageid = 0;
+	page->version = 0;
+	page->dirty = 0;
+	page->changed = 0;
 	err = beet_lock_init(&page->lock);
 	if (err != BEET_OK) return err;
-	page->data = calloc(1,sz);
+	page->data = beet_page_mem(1,sz);
 	if (page->data == NULL) {
 		beet_lock_destroy(&page->lock);
 		return BEET_ERR_NOMEM;
 	}
+	memset(page->data, 0, sz);
 	return BEET_OK;
 }
 
@@ -85,6 +102,38 @@ void beet_page_destroy(beet_page_t *page) {
 	beet_lock_destroy(&page->lock);
 }
 
+/* ------------------------------------------------------------------------
+ * Initialise page with memory provided by the caller
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_page_attach(beet_page_t *page, char *data, uint32_t sz) {
+	beet_err_t err;
+
+	PAGENULL();
+
+	page->data = data;
+	page->sz = sz;
+	page->pageid = 0;
+	page->version = 0;
+	page->dirty = 0;
+	page->changed = 0;
+	err = beet_lock_init(&page->lock);
+	if (err != BEET_OK) {
+		page->data = NULL; return err;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy page without freeing its memory
+ * ------------------------------------------------------------------------
+ */
+void beet_page_detach(beet_page_t *page) {
+	if (page == NULL) return;
+	page->data = NULL;
+	beet_lock_destroy(&page->lock);
+}
+
 /* ------------------------------------------------------------------------
  * Load page from store into memory
  * ------------------------------------------------------------------------
@@ -15,21 +15,90 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
-#define BEET_PAGE_NULL 0xffffffff
-#define BEET_PAGE_LEAF 0x80000000
+#define BEET_PAGE_NULL 0xffffffffffffffffULL
+#define BEET_PAGE_LEAF 0x8000000000000000ULL
+
+/* ------------------------------------------------------------------------
+ * Pageids on disk are 4 or 8 bytes wide.
+ * The 4 byte format marks leaves with the top bit of 32 bits,
+ * NULL is all bits set in both formats.
+ * ------------------------------------------------------------------------
+ */
+#define BEET_PAGE_NULL32 0xffffffff
+#define BEET_PAGE_LEAF32 0x80000000
+
+/* ------------------------------------------------------------------------
+ * Read a pageid of 'sz' bytes from 'src'
+ * ------------------------------------------------------------------------
+ */
+static inline beet_pageid_t beet_page_getid(const void *src, uint32_t sz) {
+	beet_pageid_t pge;
+	uint32_t p;
+
+	if (sz == sizeof(beet_pageid_t)) {
+		memcpy(&pge, src, sz); return pge;
+	}
+	memcpy(&p, src, sizeof(uint32_t));
+	if (p == BEET_PAGE_NULL32) return BEET_PAGE_NULL;
+	if (p & BEET_PAGE_LEAF32) return (p^BEET_PAGE_LEAF32)|BEET_PAGE_LEAF;
+	return p;
+}
+
+/* ------------------------------------------------------------------------
+ * Write pageid with 'sz' bytes to 'trg'
+ * ------------------------------------------------------------------------
+ */
+static inline void beet_page_putid(void *trg, beet_pageid_t pge,
+                                              uint32_t       sz) {
+	uint32_t p;
+
+	if (sz == sizeof(beet_pageid_t)) {
+		memcpy(trg, &pge, sz); return;
+	}
+	if (pge == BEET_PAGE_NULL) p = BEET_PAGE_NULL32;
+	else if (pge & BEET_PAGE_LEAF) {
+		p = (uint32_t)(pge^BEET_PAGE_LEAF)|BEET_PAGE_LEAF32;
+	} else p = (uint32_t)pge;
+	memcpy(trg, &p, sizeof(uint32_t));
+}
 
 /* ------------------------------------------------------------------------
  * Memory representation of a page
  * ------------------------------------------------------------------------
+ * The version is maintained by the rider for optimistic readers:
+ * it is odd while a writer may be changing the page and
+ * increases whenever the page content or identity has changed.
+ * ------------------------------------------------------------------------
  */
 typedef struct {
 	char           *data; /* binary data associated with this page   */
 	beet_lock_t     lock; /* read/write lock to work on this page    */
 	beet_pageid_t pageid; /* file position where this page is stored */
 	uint32_t          sz; /* size of the page in byte                */
+	uint32_t     version; /* changes with every modification         */
+	char           dirty; /* changed in memory but not yet stored    */
+	char         changed; /* stored since the write lock was taken   */
 } beet_page_t;
 
+/* ------------------------------------------------------------------------
+ * Page memory is aligned to cache lines and,
+ * if the page size allows, to the largest power of two
+ * dividing the page size up to BEET_PAGE_BLOCK,
+ * so that pages can be used for direct I/O
+ * ------------------------------------------------------------------------
+ */
+#define BEET_PAGE_ALIGN 64
+#define BEET_PAGE_BLOCK 4096
+
+/* ------------------------------------------------------------------------
+ * Allocate aligned memory for 'n' pages of 'sz' bytes (not zeroed)
+ * to be freed with free
+ * ------------------------------------------------------------------------
+ */
+char *beet_page_mem(size_t n, uint32_t sz);
+
 /* ------------------------------------------------------------------------
  * Allocate a new page in a file
  * ------------------------------------------------------------------------
@@ -51,6 +120,20 @@ beet_err_t beet_page_init(beet_page_t *page, uint32_t sz);
  */
 void beet_page_destroy(beet_page_t *page);
 
+/* ------------------------------------------------------------------------
+ * Initialise a page using memory provided by the caller
+ * (e.g. a page frame pool); the memory is not cleared
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_page_attach(beet_page_t *page, char *data, uint32_t sz);
+
+/* ------------------------------------------------------------------------
+ * Destroy a page initialised with beet_page_attach
+ * (the memory remains with the caller)
+ * ------------------------------------------------------------------------
+ */
+void beet_page_detach(beet_page_t *page);
+
 /* ------------------------------------------------------------------------
  * Load page from store into memory
  * ------------------------------------------------------------------------
@@ -0,0 +1,141 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2023
+ * ========================================================================
+ * Buffer Pool
+ * ========================================================================
+ */
+#include <beet/poolimp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* ------------------------------------------------------------------------
+ * Create pool
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_pool_new(uint64_t budget, beet_pool_t *pool) {
+	beet_err_t err;
+
+	if (pool == NULL) return BEET_ERR_INVALID;
+	if (budget == 0) return BEET_ERR_INVALID;
+
+	*pool = calloc(1, sizeof(struct beet_pool_t));
+	if (*pool == NULL) return BEET_ERR_NOMEM;
+
+	err = beet_latch_init(&(*pool)->latch);
+	if (err != BEET_OK) {
+		free(*pool); *pool = NULL;
+		return err;
+	}
+	err = beet_cond_init(&(*pool)->idle);
+	if (err != BEET_OK) {
+		beet_latch_destroy(&(*pool)->latch);
+		free(*pool); *pool = NULL;
+		return err;
+	}
+	(*pool)->budget = budget;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy pool
+ * ------------------------------------------------------------------------
+ */
+void beet_pool_destroy(beet_pool_t pool) {
+	if (pool == NULL) return;
+	if (pool->nriders > 0) {
+		fprintf(stderr, "destroying pool with %u riders\n",
+		                                   pool->nriders);
+	}
+	beet_cond_destroy(&pool->idle);
+	beet_latch_destroy(&pool->latch);
+	if (pool->riders != NULL) free(pool->riders);
+	free(pool);
+}
+
+/* ------------------------------------------------------------------------
+ * Pool statistics
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_pool_stats(beet_pool_t pool, uint64_t *used,
+                                             uint64_t *evictions) {
+	beet_err_t err;
+
+	if (pool == NULL) return BEET_ERR_INVALID;
+
+	err = beet_latch_lock(&pool->latch);
+	if (err != BEET_OK) return err;
+	if (used != NULL) *used = pool->used;
+	if (evictions != NULL) *evictions = pool->evictions;
+	return beet_latch_unlock(&pool->latch);
+}
+
+/* ------------------------------------------------------------------------
+ * Register rider
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_pool_register(beet_pool_t pool, beet_rider_t *rider) {
+	beet_rider_t **riders;
+	beet_err_t err;
+
+	err = beet_latch_lock(&pool->latch);
+	if (err != BEET_OK) return err;
+
+	riders = realloc(pool->riders,
+	                (pool->nriders+1)*sizeof(beet_rider_t*));
+	if (riders == NULL) {
+		beet_latch_unlock(&pool->latch);
+		return BEET_ERR_NOMEM;
+	}
+	pool->riders = riders;
+	pool->riders[pool->nriders++] = rider;
+
+	return beet_latch_unlock(&pool->latch);
+}
+
+/* ------------------------------------------------------------------------
+ * Unregister rider and wait for evictions that may still
+ * write back a page of the rider without holding the latch
+ * ------------------------------------------------------------------------
+ */
+void beet_pool_unregister(beet_pool_t pool, beet_rider_t *rider) {
+	if (beet_latch_lock(&pool->latch) != BEET_OK) return;
+	for(uint32_t i=0; i<pool->nriders; i++) {
+		if (pool->riders[i] == rider) {
+			pool->riders[i] = pool->riders[--pool->nriders];
+			break;
+		}
+	}
+	while(pool->busy > 0) {
+		if (beet_cond_wait(&pool->idle,
+		                   &pool->latch, NULL) != BEET_OK) break;
+	}
+	beet_latch_unlock(&pool->latch);
+}
+
+/* ------------------------------------------------------------------------
+ * Reserve memory
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_pool_reserve(beet_pool_t pool, uint32_t sz) {
+	beet_err_t err;
+
+	err = beet_latch_lock(&pool->latch);
+	if (err != BEET_OK) return err;
+	if (pool->used + sz > pool->budget) {
+		beet_latch_unlock(&pool->latch);
+		return BEET_ERR_NORSC;
+	}
+	pool->used += sz;
+	return beet_latch_unlock(&pool->latch);
+}
+
+/* ------------------------------------------------------------------------
+ * Release memory
+ * ------------------------------------------------------------------------
+ */
+void beet_pool_release(beet_pool_t pool, uint64_t sz) {
+	if (beet_latch_lock(&pool->latch) != BEET_OK) return;
+	pool->used -= sz;
+	beet_latch_unlock(&pool->latch);
+}
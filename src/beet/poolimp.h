@@ -0,0 +1,52 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2023
+ * ========================================================================
+ * Internal buffer pool API
+ * ========================================================================
+ * The pool accounts for the memory of the pages
+ * of all riders registered with it.
+ * Eviction across riders is implemented in the rider.
+ * ========================================================================
+ */
+#ifndef beet_pool_internal_decl
+#define beet_pool_internal_decl
+
+#include <beet/types.h>
+#include <beet/pool.h>
+#include <beet/lock.h>
+#include <beet/rider.h>
+
+#include <stdint.h>
+
+struct beet_pool_t {
+	beet_latch_t    latch; /* protects everything but 'tick' */
+	uint64_t       budget; /* max bytes for pages            */
+	uint64_t         used; /* bytes allocated for pages      */
+	uint64_t    evictions; /* pages evicted for other riders */
+	uint64_t         tick; /* logical clock (page loads)     */
+	beet_rider_t **riders; /* registered riders              */
+	uint32_t      nriders; /* # of registered riders         */
+	uint32_t       cursor; /* next rider to sample           */
+	uint32_t         busy; /* evictions writing without latch */
+	beet_cond_t      idle; /* signalled when busy drops to 0 */
+};
+
+/* ------------------------------------------------------------------------
+ * Register/unregister rider
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_pool_register(beet_pool_t pool, beet_rider_t *rider);
+void beet_pool_unregister(beet_pool_t pool, beet_rider_t *rider);
+
+/* ------------------------------------------------------------------------
+ * Reserve 'sz' bytes; returns BEET_ERR_NORSC if the budget is exhausted.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_pool_reserve(beet_pool_t pool, uint32_t sz);
+
+/* ------------------------------------------------------------------------
+ * Give 'sz' bytes back to the pool
+ * ------------------------------------------------------------------------
+ */
+void beet_pool_release(beet_pool_t pool, uint64_t sz);
+#endif
@@ -7,459 +7,3192 @@
  * ========================================================================
  */
 #include <beet/rider.h>
+#include <beet/poolimp.h>
+#include <beet/wal.h>
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 /* ------------------------------------------------------------------------
- * Node
+ * Frame
  * ------------------------------------------------------------------------
  */
-typedef struct {
-	beet_pageid_t      pageid;
-	beet_page_t         *page;
-	ts_algo_list_node_t *list;
-	int                  used;
-} beet_rider_node_t;
+struct beet_rider_frame_st {
+	beet_pageid_t          pageid; /* page in this frame           */
+	beet_page_t              page; /* data points into chunk slab  */
+	beet_rider_frame_t       *prv; /* eviction queue: previous     */
+	beet_rider_frame_t       *nxt; /* eviction queue: next or free */
+	int                      used; /* pin count                    */
+	char                   walpin; /* pinned until logged          */
+	char                  walpend; /* change not yet in a group    */
+	uint64_t               walcut; /* group of the last image      */
+	char                      ref; /* CLOCK reference bit          */
+	char                       in; /* frame is in 2Q 'in' queue    */
+	char                      bad; /* prefetch could not load it   */
+	uint64_t                stamp; /* pool tick of last access     */
+};
 
 /* ------------------------------------------------------------------------
- * Create a new node
+ * Frames per chunk in unlimited shards
+ * and initial hash table size
  * ------------------------------------------------------------------------
  */
-static beet_err_t newNode(beet_rider_node_t **node,
-                          beet_rider_t      *rider,
-                          beet_pageid_t     pageid) {
-	beet_err_t err;
-
-	*node = calloc(1,sizeof(beet_rider_node_t));
-	if (*node == NULL) return BEET_ERR_NOMEM;
-
-	if (pageid == BEET_PAGE_NULL) {
-		err = beet_page_alloc(&(*node)->page, rider->file,
-		                                      rider->fsz,
-		                                      rider->pagesz);
-		if (err != BEET_OK) return err;
-		rider->fsz += rider->pagesz;
-	} else {
-		(*node)->page = calloc(1, sizeof(beet_page_t));
-		if ((*node)->page == NULL) {
-			free(*node); return BEET_ERR_NOMEM;
-		}
-		err = beet_page_init((*node)->page, rider->pagesz);
-		(*node)->page->pageid = pageid;
-	}
-	(*node)->pageid = (*node)->page->pageid;
-	return BEET_OK;
-}
+#define CHUNKSZ 64
+#define MINSLOTS 128
 
 /* ------------------------------------------------------------------------
- * Destroy node
+ * Initial capacity of the 2Q ghost set
  * ------------------------------------------------------------------------
  */
-static void destroyNode(beet_rider_node_t *node) {
-	beet_page_destroy(node->page); free(node->page);
-}
+#define MINGHOSTS 16
 
 /* ------------------------------------------------------------------------
- * MACRO: lock rider
+ * Candidates sampled when looking for a victim in a buffer pool
+ * and max time to wait at once for a page pinned in another rider (ms)
  * ------------------------------------------------------------------------
  */
-#define LOCK() \
-	err = beet_latch_lock(&rider->latch); \
-	if (err != BEET_OK) return err;
+#define POOLSAMPLE 8
+#define POOLWAIT   1
 
 /* ------------------------------------------------------------------------
- * MACRO: unlock rider
+ * Page version: a change begins (the version becomes odd)
  * ------------------------------------------------------------------------
  */
-#define UNLOCK() \
-	err2 = beet_latch_unlock(&rider->latch); \
-	if (err2 != BEET_OK) return err2;
+static inline void beginChange(beet_page_t *page) {
+	__atomic_store_n(&page->version, page->version+1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
 
 /* ------------------------------------------------------------------------
- * MACRO: rider not null
+ * Page version: a change ends (the version becomes even again);
+ * if nothing has changed, the old version is restored,
+ * so that optimistic readers do not need to restart.
  * ------------------------------------------------------------------------
  */
-#define RIDERNULL() \
-	if (rider == NULL) return BEET_ERR_NORIDER;
+static inline void endChange(beet_page_t *page, char changed) {
+	uint32_t v = changed ? page->version+1 : page->version-1;
+	__atomic_store_n(&page->version, v, __ATOMIC_RELEASE);
+}
 
 /* ------------------------------------------------------------------------
- * MACRO: page not null
+ * The used-size file (name.used):
+ * the number of pages in use (64bit). The data file may be longer
+ * (preallocated pages). The size is saved when the file grows
+ * by a preallocated chunk, on sync and on close, but not for every
+ * page handed out: pages beyond the saved size may be in use.
+ * After a crash, only the pages beyond the saved size that were
+ * never written (i.e. that are still zero) are cut off.
  * ------------------------------------------------------------------------
  */
-#define PAGENULL() \
-	if (page == NULL) return BEET_ERR_NOPAGE;
+#define USEDEXT ".used"
 
 /* ------------------------------------------------------------------------
- * tree callbacks
+ * Helper: open used-size file (create it if 'create')
  * ------------------------------------------------------------------------
  */
-#define CONV(x) \
-	((beet_rider_node_t*)x)
+static FILE *openUsed(char *base, char *name, char create) {
+	char *path;
+	FILE *f;
 
-#define DEREF(x) \
-	(*(beet_rider_node_t**)x)
+	path = malloc(strlen(base) + strlen(name) + strlen(USEDEXT) + 2);
+	if (path == NULL) return NULL;
 
-static ts_algo_cmp_t compare(void *tree,
-                             void *one,
-                             void *two) {
-	if (CONV(one)->pageid <
-	    CONV(two)->pageid) return ts_algo_cmp_less;
-	if (CONV(one)->pageid >
-	    CONV(two)->pageid) return ts_algo_cmp_greater;
-	return ts_algo_cmp_equal;
-}
+	sprintf(path, "%s/%s%s", base, name, USEDEXT);
 
-static ts_algo_rc_t update(void *tree, void *o, void *n) {
-	return TS_ALGO_OK;
+	f = fopen(path, "rb+");
+	if (f == NULL && create) f = fopen(path, "wb+");
+	free(path);
+	return f;
 }
 
-static void delete(void  *tree,
-                   void **node) {
-	if (node == NULL) return;
-	if (DEREF(node)->page != NULL) {
-		beet_page_destroy(DEREF(node)->page);
-		free(DEREF(node)->page);
+/* ------------------------------------------------------------------------
+ * Helper: save the used size (caller holds the latch)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t saveUsed(beet_rider_t *rider) {
+	uint64_t n = (uint64_t)(rider->fsz / rider->pagesz);
+
+	if (rider->fused == NULL) {
+		rider->fused = openUsed(rider->base, rider->name, 1);
+		if (rider->fused == NULL) return BEET_OSERR_OPEN;
 	}
-	free(*node); *node = NULL;
+	if (pwrite(fileno(rider->fused), &n, sizeof(uint64_t), 0) !=
+	                                     sizeof(uint64_t)) {
+		return BEET_OSERR_WRITE;
+	}
+	return BEET_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Helper: open file
+ * Helper: page was never written
  * ------------------------------------------------------------------------
  */
-static inline beet_err_t openFile(beet_rider_t *rider) {
-	struct stat st;
-	size_t s;
-	char *path;
+static inline char zeroPage(const char *buf, uint32_t sz) {
+	for(uint32_t i=0; i<sz; i++) if (buf[i] != 0) return 0;
+	return 1;
+}
 
-	s = strlen(rider->base);
-	s += strlen(rider->name);
+/* ------------------------------------------------------------------------
+ * Helper: load the used size and cut off
+ *         what was preallocated but not used before a crash
+ * ------------------------------------------------------------------------
+ * Pages beyond the saved size may have been handed out and written
+ * after the size was saved; we only cut off the zero pages at the end.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t loadUsed(beet_rider_t *rider) {
+	uint64_t n;
+	off_t sz, end;
+	char *buf;
 
-	path = malloc(s+2);
-	if (path == NULL) return BEET_ERR_NOMEM;
+	rider->fused = openUsed(rider->base, rider->name, 0);
+	if (rider->fused == NULL) return BEET_OK;
 
-	sprintf(path, "%s/%s", rider->base, rider->name);
+	if (pread(fileno(rider->fused), &n, sizeof(uint64_t), 0) !=
+	                                    sizeof(uint64_t)) return BEET_OK;
 
-	if (stat(path, &st) != 0) return BEET_ERR_NOFILE;
-	rider->fsz = st.st_size;
+	sz = (off_t)n * rider->pagesz;
+	if (sz >= rider->fsz) return BEET_OK;
 
-	rider->file = fopen(path, "rb+"); free(path);
-	if (rider->file == NULL) return BEET_OSERR_OPEN;
+	buf = malloc(rider->pagesz);
+	if (buf == NULL) return BEET_ERR_NOMEM;
 
+	end = (rider->fsz / rider->pagesz) * rider->pagesz;
+	while(end > sz) {
+		if (pread(fileno(rider->file), buf, rider->pagesz,
+		          end - rider->pagesz) != rider->pagesz) {
+			free(buf); return BEET_OSERR_READ;
+		}
+		if (!zeroPage(buf, rider->pagesz)) break;
+		end -= rider->pagesz;
+	}
+	free(buf);
+
+	if (end == rider->fsz) return BEET_OK;
+	if (ftruncate(fileno(rider->file), end) != 0) return BEET_OSERR_WRITE;
+	rider->fsz = end;
+	rider->fcap = end;
 	return BEET_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Initialise the rider
+ * Helper: make room for a new page at the end of the file
+ * ------------------------------------------------------------------------
+ * The file grows by 'prealloc' pages at once.
+ * A new page within the preallocated region needs no I/O;
+ * it is marked dirty and written when it is evicted or flushed.
+ * Without preallocation (or if it fails), the page is written at once.
  * ------------------------------------------------------------------------
  */
-beet_err_t beet_rider_init(beet_rider_t    *rider,
-                           char *base, char *name,
-                           uint32_t        pagesz,
-                           uint32_t           max) {
+static beet_err_t growFile(beet_rider_t *rider, beet_page_t *page) {
 	beet_err_t err;
-	size_t s;
-	
-	RIDERNULL();
-	if (base == NULL || name == NULL) return BEET_ERR_NONAME;
-
-	rider->max = max;
-	rider->pagesz = pagesz;
-	rider->base = NULL;
-	rider->name = NULL;
-	rider->file = NULL;
-	rider->tree = NULL;
+	off_t sz;
 
-	ts_algo_list_init(&rider->queue);
-	err = beet_latch_init(&rider->latch);
-	if (err != BEET_OK) return err;
+	page->dirty = 1;
+	if (rider->fsz + rider->pagesz <= rider->fcap) return BEET_OK;
+	if (rider->prealloc > 0) {
+		/* the region is not in use before the size is saved */
+		err = saveUsed(rider);
+		if (err != BEET_OK) return err;
 
-	rider->tree = ts_algo_tree_new(
-	                      &compare, NULL,
-	                      &update,
-	                      &delete, &delete);
-	if (rider->tree == NULL) {
-		beet_latch_destroy(&rider->latch);
-		ts_algo_list_destroy(&rider->queue);
-		return BEET_ERR_NOMEM;
+		sz = (off_t)rider->prealloc * rider->pagesz;
+		if (posix_fallocate(fileno(rider->file),
+		                    rider->fsz, sz) == 0) {
+			rider->fcap = rider->fsz + sz;
+			return BEET_OK;
+		}
+		/* do not try again for every page */
+		rider->prealloc = 0;
 	}
+	page->dirty = 0;
+	return beet_page_store(page, rider->file);
+}
 
-	s = strnlen(base, 4097);
-	if (s >= 4096) {
-		err = BEET_ERR_TOOBIG;
-		goto cleanup;
-	}
+/* ------------------------------------------------------------------------
+ * Load page into frame
+ * ------------------------------------------------------------------------
+ * The page memory belongs to the frame and is reused as is,
+ * the page is either read completely from the file
+ * or, if it is a new page, explicitly cleared (see growFile).
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t loadFrame(beet_rider_frame_t *frame,
+                            beet_rider_t       *rider,
+                            beet_pageid_t      pageid) {
+	beet_err_t err;
 
-	rider->base = strdup(base);
-	if (rider->base == NULL) {
-		err = BEET_ERR_NOMEM;
-		goto cleanup;
+	/* optimistic readers may still look at the old page */
+	beginChange(&frame->page);
+	if (pageid == BEET_PAGE_NULL) {
+		memset(frame->page.data, 0, rider->pagesz);
+		frame->page.pageid = (beet_pageid_t)(rider->fsz/rider->pagesz);
+		err = growFile(rider, &frame->page);
+		if (err != BEET_OK) {
+			endChange(&frame->page, 1); return err;
+		}
+		rider->fsz += rider->pagesz;
+	} else {
+		frame->page.pageid = pageid;
+		err = beet_page_load(&frame->page, rider->file);
+		if (err != BEET_OK) {
+			endChange(&frame->page, 1); return err;
+		}
+		frame->page.dirty = 0;
 	}
+	frame->pageid = frame->page.pageid;
+	frame->used = 0;
+	frame->walpin = 0;
+	frame->walpend = 0;
+	frame->bad = 0;
+	endChange(&frame->page, 1);
+	return BEET_OK;
+}
 
-	s = strnlen(name, 4097);
-	if (s >= 4096) {
-		err = BEET_ERR_TOOBIG;
-		goto cleanup;
-	}
+/* ------------------------------------------------------------------------
+ * MACRO: lock shard (or rider)
+ * ------------------------------------------------------------------------
+ */
+#define LOCK(s) \
+	err = beet_latch_lock(&(s)->latch); \
+	if (err != BEET_OK) return err;
 
-	rider->name = strdup(name);
-	if (rider->name == NULL) {
-		err = BEET_ERR_NOMEM;
-		goto cleanup;
-	}
+/* ------------------------------------------------------------------------
+ * MACRO: unlock shard (or rider)
+ * ------------------------------------------------------------------------
+ */
+#define UNLOCK(s) \
+	err2 = beet_latch_unlock(&(s)->latch); \
+	if (err2 != BEET_OK) return err2;
 
-	err = openFile(rider);
-	if (err != BEET_OK) goto cleanup;
+/* ------------------------------------------------------------------------
+ * MACRO: rider not null
+ * ------------------------------------------------------------------------
+ */
+#define RIDERNULL() \
+	if (rider == NULL) return BEET_ERR_NORIDER;
 
-	return BEET_OK;
-	
-cleanup:
-	beet_rider_destroy(rider);
-	return err;
+/* ------------------------------------------------------------------------
+ * MACRO: page not null
+ * ------------------------------------------------------------------------
+ */
+#define PAGENULL() \
+	if (page == NULL) return BEET_ERR_NOPAGE;
+
+/* ------------------------------------------------------------------------
+ * MACRO: rider is writable
+ * ------------------------------------------------------------------------
+ */
+#define WRITABLE() \
+	if (rider->mapped) return BEET_ERR_RDONLY;
+
+/* ------------------------------------------------------------------------
+ * Helper: the shard responsible for pageid
+ * ------------------------------------------------------------------------
+ */
+static inline beet_rider_shard_t *getShard(beet_rider_t *rider,
+                                           beet_pageid_t pageid) {
+	uint32_t h = (uint32_t)(pageid ^ (pageid >> 32)) * 0x9e3779b1;
+	return rider->shards + ((h >> 16) & (rider->nshards - 1));
 }
 
 /* ------------------------------------------------------------------------
- * Destroy the rider
+ * Helper: home slot of pageid in the hash table
  * ------------------------------------------------------------------------
  */
-void beet_rider_destroy(beet_rider_t *rider) {
-	if (rider == NULL) return;
-	beet_latch_destroy(&rider->latch);
-	ts_algo_list_destroy(&rider->queue);
-	if (rider->base != NULL) {
-		free(rider->base); rider->base = NULL;
-	}
-	if (rider->name != NULL) {
-		free(rider->name); rider->name = NULL;
-	}
-	if (rider->tree != NULL) {
-		ts_algo_tree_destroy(rider->tree);
-		free(rider->tree); rider->tree = NULL;
-	}
-	if (rider->file != NULL) {
-		fclose(rider->file); rider->file = NULL;
-	}
+static inline uint32_t home(beet_rider_shard_t *shard,
+                            beet_pageid_t      pageid) {
+	uint32_t h = (uint32_t)(pageid ^ (pageid >> 32));
+	h ^= h >> 16; h *= 0x85ebca6b;
+	h ^= h >> 13; h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h & (shard->nslots - 1);
 }
 
 /* ------------------------------------------------------------------------
- * Helper: make room for more
+ * Hash table: find frame holding pageid
  * ------------------------------------------------------------------------
  */
-static beet_err_t makeRoom(beet_rider_t *rider) {
-	ts_algo_list_node_t *runner;
-	beet_rider_node_t *node;
+static inline beet_rider_frame_t *lookup(beet_rider_shard_t *shard,
+                                         beet_pageid_t      pageid) {
+	uint32_t m = shard->nslots - 1;
+	uint32_t i = home(shard, pageid);
 
-	for(runner=rider->queue.last;runner!=NULL;runner=runner->prv) {
-		node = runner->cont;
-		if (node->used == 0) {
-			// fprintf(stderr, "removing %u\n", node->pageid);
-			ts_algo_list_remove(&rider->queue, runner);
-			ts_algo_tree_delete(rider->tree, node);
-			free(runner); break;
-		}
+	while(shard->slots[i] != NULL) {
+		if (shard->slots[i]->pageid == pageid) return shard->slots[i];
+		i = (i+1)&m;
 	}
-	return BEET_OK;
+	return NULL;
 }
 
 /* ------------------------------------------------------------------------
- * Helper: check if there is room for more
+ * Hash table: insert frame (the table is never full)
  * ------------------------------------------------------------------------
  */
-static inline char hasRoom(beet_rider_t *rider) {
-	return (rider->max == 0 || rider->max > rider->tree->count);
-}
+static inline void slotInsert(beet_rider_shard_t *shard,
+                              beet_rider_frame_t *frame) {
+	uint32_t m = shard->nslots - 1;
+	uint32_t i = home(shard, frame->pageid);
 
-#define READ   0
-#define WRITE  1
-#define CREATE 2
+	while(shard->slots[i] != NULL) i = (i+1)&m;
+	__atomic_store_n(shard->slots+i, frame, __ATOMIC_RELEASE);
+}
 
 /* ------------------------------------------------------------------------
- * Get and lock a page for reading or writing
+ * Hash table: remove frame with backward shift,
+ * so that no tombstones are needed
  * ------------------------------------------------------------------------
  */
-static beet_err_t getpage(beet_rider_t *rider,
-                          beet_pageid_t pageid,
-                          char          x,
-                          beet_page_t **page) {
-	beet_err_t err = BEET_OK;
-	beet_err_t err2;
-	beet_rider_node_t *node=NULL;
-	beet_rider_node_t pattern;
-
-	LOCK();
-	if (x != CREATE) {
-		pattern.pageid = pageid;
-		node = ts_algo_tree_find(rider->tree, &pattern);
-		if (node != NULL) {
-			ts_algo_list_promote(&rider->queue, node->list);
-			goto found;
-		}
-	}
-	if (!hasRoom(rider)) {
-		err = makeRoom(rider);
-		if (err != BEET_OK) {
-			UNLOCK();
-			return err;
-		}
-	}
-	if (!hasRoom(rider)) {
-		UNLOCK();
-		return BEET_ERR_NORSC;
-	}
-	if (x == CREATE) {
-		err = newNode(&node, rider, BEET_PAGE_NULL);
-		if (err != BEET_OK) {
-			UNLOCK();
-			return err;
-		}
-	} else {
-		err = newNode(&node, rider, pageid);
-		if (err != BEET_OK) {
-			UNLOCK();
-			return err;
-		}
-		err = beet_page_load(node->page, rider->file);
-		if (err != BEET_OK) {
-			destroyNode(node); free(node);
-			UNLOCK();
-			return err;
-		}
-	}
-	if (ts_algo_list_insert(&rider->queue, node) != TS_ALGO_OK) {
-		destroyNode(node); free(node);
-		UNLOCK();
-		return BEET_ERR_NOMEM;
-	}
-	node->list = rider->queue.head;
-	if (ts_algo_tree_insert(rider->tree, node) != TS_ALGO_OK) {
-		ts_algo_list_remove(&rider->queue, node->list);
-		free(node->list);
-		destroyNode(node); free(node);
-		UNLOCK();
-		return BEET_ERR_NOMEM;
-	}
-found:
+static inline void slotRemove(beet_rider_shard_t *shard,
+                              beet_rider_frame_t *frame) {
+	uint32_t m = shard->nslots - 1;
+	uint32_t i = home(shard, frame->pageid);
+	uint32_t j, k;
 
-	node->used++;
+	while(shard->slots[i] != frame) i = (i+1)&m;
+	__atomic_store_n(shard->slots+i, NULL, __ATOMIC_RELAXED);
 
-	UNLOCK();
-	if (x == READ) {
-		err = beet_lock_read(&node->page->lock);
-	} else {
-		err = beet_lock_write(&node->page->lock);
+	/* the table is read without latch by beet_rider_peek:
+	 * the stores are atomic, but a peek may miss a page in motion */
+	for(j=(i+1)&m; shard->slots[j] != NULL; j=(j+1)&m) {
+		k = home(shard, shard->slots[j]->pageid);
+		/* move j to i if its home is not in (i,j] */
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) continue;
+		__atomic_store_n(shard->slots+i, shard->slots[j], __ATOMIC_RELAXED);
+		__atomic_store_n(shard->slots+j, NULL, __ATOMIC_RELAXED);
+		i = j;
 	}
-	if (err != BEET_OK) return err;
-
-	*page = node->page;
-	return BEET_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Release a page for reading or writing
+ * Hash table: double the size
  * ------------------------------------------------------------------------
  */
-static beet_err_t releasepage(beet_rider_t *rider,
-                              beet_pageid_t pageid,
-                              char          x) {
-	beet_err_t err;
-	beet_err_t err2;
-	beet_rider_node_t pattern;
-	beet_rider_node_t *node;
-
-	LOCK();
-	
-	pattern.pageid = pageid;
-	node = ts_algo_tree_find(rider->tree, &pattern);
-	if (node == NULL) {
-		UNLOCK();
-		return BEET_ERR_UNKNKEY;
-	}
-	if (x == READ) {
-		err = beet_unlock_read(&node->page->lock);
-	} else {
-		err = beet_unlock_write(&node->page->lock);
+static beet_err_t slotGrow(beet_rider_shard_t *shard) {
+	beet_rider_frame_t **old = shard->slots;
+	uint32_t n = shard->nslots;
+
+	shard->slots = calloc(2*n, sizeof(beet_rider_frame_t*));
+	if (shard->slots == NULL) {
+		shard->slots = old; return BEET_ERR_NOMEM;
 	}
-	if (err != BEET_OK) {
-		UNLOCK();
-		return err;
+	shard->nslots = 2*n;
+	for(uint32_t i=0; i<n; i++) {
+		if (old[i] != NULL) slotInsert(shard, old[i]);
 	}
-	node->used--;
-	UNLOCK();
+	free(old);
 	return BEET_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Get the page identified by 'pageid' for reading
+ * Eviction queue: add frame at the head
  * ------------------------------------------------------------------------
  */
-beet_err_t beet_rider_getRead(beet_rider_t  *rider,
-                              beet_pageid_t pageid,
-                              beet_page_t  **page) {
-	RIDERNULL();
-	PAGENULL();
-	return getpage(rider, pageid, READ, page);
+static inline void enqueue(beet_rider_queue_t *q,
+                           beet_rider_frame_t *frame) {
+	frame->prv = NULL;
+	frame->nxt = q->head;
+	if (q->head != NULL) q->head->prv = frame;
+	q->head = frame;
+	if (q->tail == NULL) q->tail = frame;
+	q->count++;
 }
 
 /* ------------------------------------------------------------------------
- * Get the page identified by 'pageid' for writing
+ * Eviction queue: add frame before 'pos' (at the tail if pos is NULL)
  * ------------------------------------------------------------------------
  */
-beet_err_t beet_rider_getWrite(beet_rider_t *rider,
-                               beet_pageid_t pageid,
-                               beet_page_t **page) {
-	RIDERNULL();
-	PAGENULL();
-	return getpage(rider, pageid, WRITE, page);
+static inline void enqueueBefore(beet_rider_queue_t *q,
+                                 beet_rider_frame_t *pos,
+                                 beet_rider_frame_t *frame) {
+	if (pos == NULL) {
+		frame->nxt = NULL;
+		frame->prv = q->tail;
+		if (q->tail != NULL) q->tail->nxt = frame;
+		q->tail = frame;
+		if (q->head == NULL) q->head = frame;
+	} else {
+		frame->nxt = pos;
+		frame->prv = pos->prv;
+		if (pos->prv != NULL) pos->prv->nxt = frame;
+		else q->head = frame;
+		pos->prv = frame;
+	}
+	q->count++;
 }
 
 /* ------------------------------------------------------------------------
- * Release the page identified by 'pageid'
- * and obtained before for reading 
+ * Eviction queue: remove frame
  * ------------------------------------------------------------------------
  */
-beet_err_t beet_rider_releaseRead(beet_rider_t *rider,
-                                  beet_page_t   *page) {
-	RIDERNULL();
-	PAGENULL();
-	return releasepage(rider, page->pageid, READ);
+static inline void dequeue(beet_rider_queue_t *q,
+                           beet_rider_frame_t *frame) {
+	if (frame->prv != NULL) frame->prv->nxt = frame->nxt;
+	else q->head = frame->nxt;
+	if (frame->nxt != NULL) frame->nxt->prv = frame->prv;
+	else q->tail = frame->prv;
+	frame->prv = NULL; frame->nxt = NULL;
+	q->count--;
 }
 
 /* ------------------------------------------------------------------------
- * Release the page identified by 'pageid'
- * and obtained before for writing 
+ * Eviction queue: move frame to the head
  * ------------------------------------------------------------------------
  */
-beet_err_t beet_rider_releaseWrite(beet_rider_t *rider,
-                                   beet_page_t   *page) {
-	RIDERNULL();
-	PAGENULL();
-	return releasepage(rider, page->pageid, WRITE);
+static inline void promote(beet_rider_queue_t *q,
+                           beet_rider_frame_t *frame) {
+	if (q->head == frame) return;
+	dequeue(q, frame);
+	enqueue(q, frame);
 }
 
 /* ------------------------------------------------------------------------
- * Allocate a new page
+ * Eviction queue: least recently used unpinned frame
  * ------------------------------------------------------------------------
  */
-beet_err_t beet_rider_alloc(beet_rider_t  *rider,
-                            beet_page_t  **page) {
-	RIDERNULL();
-	PAGENULL();
-	return getpage(rider,0,CREATE,page);
+static inline beet_rider_frame_t *lastUnused(beet_rider_queue_t *q) {
+	beet_rider_frame_t *frame;
+
+	for(frame=q->tail; frame!=NULL; frame=frame->prv) {
+		if (frame->used == 0) return frame;
+	}
+	return NULL;
 }
 
 /* ------------------------------------------------------------------------
- * Store page to disk 
+ * Eviction queue: least recently used unpinned frame
+ * giving a second chance to frames referenced by beet_rider_peek
+ * (which does not touch the queue)
  * ------------------------------------------------------------------------
  */
-beet_err_t beet_rider_store(beet_rider_t *rider,
-                            beet_page_t  *page) {
-	RIDERNULL();
-	PAGENULL();
-	return beet_page_store(page, rider->file);
-}
+static inline beet_rider_frame_t *lruUnused(beet_rider_queue_t *q) {
+	beet_rider_frame_t *frame, *prv;
+	uint32_t n = q->count;
 
+	for(frame=q->tail; frame!=NULL && n>0; frame=prv, n--) {
+		prv = frame->prv;
+		if (frame->used != 0) continue;
+		if (!frame->ref) return frame;
+		frame->ref = 0;
+		promote(q, frame);
+	}
+	return lastUnused(q);
+}
+
+/* ------------------------------------------------------------------------
+ * Ghosts: home slot of pageid
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t ghostHome(beet_rider_ghosts_t *g,
+                                 beet_pageid_t   pageid) {
+	return ((uint32_t)(pageid ^ (pageid >> 32)) * 0x9e3779b1) &
+	                                             (g->nslots - 1);
+}
+
+/* ------------------------------------------------------------------------
+ * Ghosts: init (initial capacity max)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t ghostInit(beet_rider_ghosts_t *g, uint32_t max) {
+	uint32_t n = 16;
+
+	if (max < MINGHOSTS) max = MINGHOSTS;
+	while(n < 2*max) n*=2;
+
+	g->slots = malloc(n*sizeof(beet_pageid_t));
+	if (g->slots == NULL) return BEET_ERR_NOMEM;
+	g->fifo = malloc(max*sizeof(beet_pageid_t));
+	if (g->fifo == NULL) {
+		free(g->slots); g->slots = NULL;
+		return BEET_ERR_NOMEM;
+	}
+	for(uint32_t i=0; i<n; i++) g->slots[i] = BEET_PAGE_NULL;
+	g->nslots = n;
+	g->max = max;
+	g->first = 0;
+	g->count = 0;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Ghosts: destroy
+ * ------------------------------------------------------------------------
+ */
+static void ghostDestroy(beet_rider_ghosts_t *g) {
+	if (g->slots != NULL) {
+		free(g->slots); g->slots = NULL;
+	}
+	if (g->fifo != NULL) {
+		free(g->fifo); g->fifo = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Ghosts: remove pageid from hash set (backward shift),
+ * returns 1 if pageid was in the set
+ * ------------------------------------------------------------------------
+ */
+static char ghostRemove(beet_rider_ghosts_t *g, beet_pageid_t pageid) {
+	uint32_t m = g->nslots - 1;
+	uint32_t i = ghostHome(g, pageid);
+	uint32_t j, k;
+
+	while(g->slots[i] != pageid) {
+		if (g->slots[i] == BEET_PAGE_NULL) return 0;
+		i = (i+1)&m;
+	}
+	g->slots[i] = BEET_PAGE_NULL;
+
+	for(j=(i+1)&m; g->slots[j] != BEET_PAGE_NULL; j=(j+1)&m) {
+		k = ghostHome(g, g->slots[j]);
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) continue;
+		g->slots[i] = g->slots[j];
+		g->slots[j] = BEET_PAGE_NULL;
+		i = j;
+	}
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Ghosts: insert pageid into hash set
+ * ------------------------------------------------------------------------
+ */
+static inline void ghostInsert(beet_rider_ghosts_t *g, beet_pageid_t pageid) {
+	uint32_t m = g->nslots - 1;
+	uint32_t i = ghostHome(g, pageid);
+
+	while(g->slots[i] != BEET_PAGE_NULL) {
+		if (g->slots[i] == pageid) return;
+		i = (i+1)&m;
+	}
+	g->slots[i] = pageid;
+}
+
+/* ------------------------------------------------------------------------
+ * Ghosts: grow ring buffer and hash set to capacity max
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t ghostGrow(beet_rider_ghosts_t *g, uint32_t max) {
+	beet_pageid_t *fifo, *old;
+	uint32_t n = g->nslots;
+	uint32_t k;
+
+	fifo = malloc(max*sizeof(beet_pageid_t));
+	if (fifo == NULL) return BEET_ERR_NOMEM;
+	for(uint32_t i=0; i<g->count; i++) {
+		fifo[i] = g->fifo[(g->first+i)%g->max];
+	}
+	while(n < 2*max) n*=2;
+	if (n > g->nslots) {
+		old = g->slots;
+		g->slots = malloc(n*sizeof(beet_pageid_t));
+		if (g->slots == NULL) {
+			g->slots = old;
+			free(fifo); return BEET_ERR_NOMEM;
+		}
+		for(uint32_t i=0; i<n; i++) g->slots[i] = BEET_PAGE_NULL;
+
+		/* entries only in the ring are not rehashed */
+		k = g->nslots; g->nslots = n;
+		for(uint32_t i=0; i<k; i++) {
+			if (old[i] != BEET_PAGE_NULL) ghostInsert(g, old[i]);
+		}
+		free(old);
+	}
+	free(g->fifo); g->fifo = fifo;
+	g->max = max;
+	g->first = 0;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Ghosts: add pageid keeping at most 'limit' entries,
+ * forgetting the oldest ones if there are more.
+ * The limit follows the size of the shard, which,
+ * for unlimited and pooled shards, changes over time;
+ * the ring grows with it (if that fails, we just forget more).
+ * Entries removed from the set stay in the ring until they
+ * are replaced; removing them again is a no-op.
+ * ------------------------------------------------------------------------
+ */
+static void ghostAdd(beet_rider_ghosts_t *g, beet_pageid_t pageid,
+                                             uint32_t       limit) {
+	if (limit == 0) return;
+	if (limit > g->max && g->count == g->max) {
+		(void)ghostGrow(g, limit > 2*g->max ? limit : 2*g->max);
+	}
+	while(g->count >= limit || g->count == g->max) {
+		ghostRemove(g, g->fifo[g->first]);
+		g->first = (g->first+1)%g->max;
+		g->count--;
+	}
+	g->fifo[(g->first+g->count)%g->max] = pageid;
+	g->count++;
+
+	ghostInsert(g, pageid);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: allocate a chunk of frames together with the memory
+ * for their pages and put the frames on the free list.
+ * If pagesz is 0, the frames get no memory (buffer pool)
+ * and are put on the 'empty' list instead.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t addChunk(beet_rider_shard_t *shard,
+                           uint32_t n, uint32_t pagesz) {
+	beet_rider_chunk_t *chunks;
+	beet_rider_frame_t *frames;
+	beet_err_t err;
+	char *data;
+
+	chunks = realloc(shard->chunks,
+	                (shard->nchunks+1)*sizeof(beet_rider_chunk_t));
+	if (chunks == NULL) return BEET_ERR_NOMEM;
+	shard->chunks = chunks;
+
+	frames = calloc(n, sizeof(beet_rider_frame_t));
+	if (frames == NULL) return BEET_ERR_NOMEM;
+
+	/* no need to zero: pages are either loaded or cleared */
+	if (pagesz > 0) {
+		data = beet_page_mem(n, pagesz);
+		if (data == NULL) {
+			free(frames); return BEET_ERR_NOMEM;
+		}
+	} else data = NULL;
+
+	for(uint32_t i=0; i<n; i++) {
+		err = beet_page_attach(&frames[i].page,
+		      data == NULL ? NULL : data+(size_t)i*pagesz, pagesz);
+		if (err != BEET_OK) {
+			for(uint32_t k=0; k<i; k++) {
+				beet_page_detach(&frames[k].page);
+			}
+			free(data); free(frames);
+			return err;
+		}
+	}
+
+	shard->chunks[shard->nchunks].frames = frames;
+	shard->chunks[shard->nchunks].data = data;
+	shard->chunks[shard->nchunks].n = n;
+	shard->nchunks++;
+
+	for(uint32_t i=0; i<n; i++) {
+		if (data == NULL) {
+			frames[i].nxt = shard->empty;
+			shard->empty = frames+i;
+		} else {
+			frames[i].nxt = shard->free;
+			shard->free = frames+i;
+		}
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: free all chunks
+ * returns the number of pages with memory of their own (buffer pool)
+ * ------------------------------------------------------------------------
+ */
+static uint32_t freeChunks(beet_rider_shard_t *shard) {
+	beet_rider_chunk_t *chunk;
+	uint32_t n = 0;
+
+	for(uint32_t i=0; i<shard->nchunks; i++) {
+		chunk = shard->chunks+i;
+		for(uint32_t k=0; k<chunk->n; k++) {
+			if (chunk->data == NULL &&
+			    chunk->frames[k].page.data != NULL) {
+				free(chunk->frames[k].page.data); n++;
+			}
+			beet_page_detach(&chunk->frames[k].page);
+		}
+		free(chunk->data); free(chunk->frames);
+	}
+	free(shard->chunks); shard->chunks = NULL;
+	shard->nchunks = 0;
+	return n;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get an empty frame and allocate memory for its page
+ * (the memory was reserved from the pool before)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t getEmptyFrame(beet_rider_shard_t  *shard,
+                                uint32_t            pagesz,
+                                beet_rider_frame_t **frame) {
+	beet_err_t err;
+
+	if (shard->empty == NULL) {
+		err = addChunk(shard, CHUNKSZ, 0);
+		if (err != BEET_OK) return err;
+	}
+	(*frame) = shard->empty;
+	(*frame)->page.data = beet_page_mem(1, pagesz);
+	if ((*frame)->page.data == NULL) return BEET_ERR_NOMEM;
+	(*frame)->page.sz = pagesz;
+	shard->empty = (*frame)->nxt;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get an unused frame
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t getFrame(beet_rider_t        *rider,
+                           beet_rider_shard_t  *shard,
+                           beet_rider_frame_t **frame) {
+	beet_err_t err;
+
+	if (shard->free != NULL) {
+		*frame = shard->free;
+		shard->free = (*frame)->nxt;
+	} else if (rider->pool != NULL) {
+		err = getEmptyFrame(shard, rider->pagesz, frame);
+		if (err != BEET_OK) {
+			beet_pool_release(rider->pool, rider->pagesz);
+			return err;
+		}
+	} else {
+		err = addChunk(shard, CHUNKSZ, rider->pagesz);
+		if (err != BEET_OK) return err;
+		*frame = shard->free;
+		shard->free = (*frame)->nxt;
+	}
+	(*frame)->nxt = NULL;
+	(*frame)->prv = NULL;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: return frame to the free list
+ * ------------------------------------------------------------------------
+ */
+static inline void putFrame(beet_rider_shard_t *shard,
+                            beet_rider_frame_t *frame) {
+	frame->nxt = shard->free;
+	frame->prv = NULL;
+	shard->free = frame;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: number of shards for a cache of size max
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t countShards(uint32_t max) {
+	uint32_t n = 1;
+
+	if (max == 0) return BEET_RIDER_MAXSHARDS;
+	while(n < BEET_RIDER_MAXSHARDS &&
+	      2*n*BEET_RIDER_MINSHARD <= max) n*=2;
+	return n;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: init shard
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t initShard(beet_rider_shard_t *shard,
+                            uint32_t max, uint32_t pagesz) {
+	beet_err_t err;
+	uint32_t n = MINSLOTS;
+
+	memset(shard, 0, sizeof(beet_rider_shard_t));
+
+	shard->max = max;
+
+	/* keep the load factor at or below 1/2 */
+	while(n < 2*max) n*=2;
+
+	shard->slots = calloc(n, sizeof(beet_rider_frame_t*));
+	if (shard->slots == NULL) return BEET_ERR_NOMEM;
+	shard->nslots = n;
+
+	if (max > 0) {
+		err = addChunk(shard, max, pagesz);
+		if (err != BEET_OK) {
+			freeChunks(shard);
+			free(shard->slots); shard->slots = NULL;
+			return err;
+		}
+	}
+	err = beet_latch_init(&shard->latch);
+	if (err != BEET_OK) {
+		freeChunks(shard);
+		free(shard->slots); shard->slots = NULL;
+		return err;
+	}
+	err = beet_cond_init(&shard->room);
+	if (err != BEET_OK) {
+		beet_latch_destroy(&shard->latch);
+		freeChunks(shard);
+		free(shard->slots); shard->slots = NULL;
+		return err;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: store a batch of pages and mark them clean
+ * ------------------------------------------------------------------------
+ */
+static void storePages(beet_rider_t *rider, beet_page_t **pages, uint32_t n) {
+	if (beet_aio_store(&rider->aio, pages, n, rider->file) != BEET_OK) {
+		return;
+	}
+	for(uint32_t i=0; i<n; i++) pages[i]->dirty = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: write the dirty pages of a shard that is no longer used
+ * in batches; pages that could not be written remain dirty
+ * ------------------------------------------------------------------------
+ */
+static void storeShard(beet_rider_t *rider, beet_rider_shard_t *shard) {
+	beet_rider_queue_t *qs[2] = {&shard->main, &shard->in};
+	beet_rider_frame_t *frame;
+	beet_page_t **pages;
+	uint32_t depth = rider->aio.depth;
+	uint32_t m = 0;
+
+	pages = malloc(depth*sizeof(beet_page_t*));
+	if (pages == NULL) return;
+	for(int i=0; i<2; i++) {
+		for(frame=qs[i]->head; frame!=NULL; frame=frame->nxt) {
+			if (!frame->page.dirty || frame->walpin) continue;
+			pages[m++] = &frame->page;
+			if (m == depth) {
+				storePages(rider, pages, m); m = 0;
+			}
+		}
+	}
+	if (m > 0) storePages(rider, pages, m);
+	free(pages);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: destroy shard writing dirty pages back
+ * ------------------------------------------------------------------------
+ */
+static void destroyShard(beet_rider_t *rider, beet_rider_shard_t *shard) {
+	beet_rider_queue_t *qs[2] = {&shard->main, &shard->in};
+	beet_rider_frame_t *frame;
+	uint32_t n;
+
+	if (rider->file != NULL && beet_aio_uring(&rider->aio)) {
+		storeShard(rider, shard);
+	}
+	for(int i=0; i<2; i++) {
+		for(frame=qs[i]->head; frame!=NULL; frame=frame->nxt) {
+			/* pages not yet logged must not be written */
+			if (frame->walpin) continue;
+			if (rider->file != NULL && frame->page.dirty) {
+				if (beet_page_store(&frame->page,
+				                    rider->file) != BEET_OK) {
+					fprintf(stderr,
+					"cannot write page %llu of %s\n",
+					 (unsigned long long)frame->pageid,
+					 rider->name);
+				}
+			}
+		}
+	}
+	ghostDestroy(&shard->ghosts);
+	beet_cond_destroy(&shard->room);
+	beet_latch_destroy(&shard->latch);
+	n = freeChunks(shard);
+	if (rider->pool != NULL) {
+		beet_pool_release(rider->pool, (uint64_t)n*rider->pagesz);
+	}
+	free(shard->slots); shard->slots = NULL;
+
+	/* spilled pages were not logged */
+	if (shard->spilled != NULL) {
+		free(shard->spilled); shard->spilled = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: path of the data file
+ * ------------------------------------------------------------------------
+ */
+static char *dataPath(beet_rider_t *rider) {
+	size_t s;
+	char *path;
+
+	s = strlen(rider->base);
+	s += strlen(rider->name);
+
+	path = malloc(s+2);
+	if (path == NULL) return NULL;
+
+	sprintf(path, "%s/%s", rider->base, rider->name);
+	return path;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: open file
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t openFile(beet_rider_t *rider) {
+	struct stat st;
+	char *path;
+
+	path = dataPath(rider);
+	if (path == NULL) return BEET_ERR_NOMEM;
+
+	if (stat(path, &st) != 0) {
+		free(path); return BEET_ERR_NOFILE;
+	}
+	rider->fsz = st.st_size;
+	rider->fcap = st.st_size;
+
+	rider->file = fopen(path, "rb+"); free(path);
+	if (rider->file == NULL) return BEET_OSERR_OPEN;
+
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * The free-list file (name.free):
+ * the number of pages (32bit) followed by their pageids (64bit)
+ * ------------------------------------------------------------------------
+ */
+#define FREEXT ".free"
+
+/* ------------------------------------------------------------------------
+ * Helper: add page to free-list (caller holds the latch)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t pushFree(beet_rider_t *rider, beet_pageid_t pageid) {
+	beet_pageid_t *tmp;
+	uint32_t m;
+
+	if (rider->nfreed == rider->mfreed) {
+		m = rider->mfreed == 0 ? 64 : 2*rider->mfreed;
+		tmp = realloc(rider->freed, m*sizeof(beet_pageid_t));
+		if (tmp == NULL) return BEET_ERR_NOMEM;
+		rider->freed = tmp;
+		rider->mfreed = m;
+	}
+	rider->freed[rider->nfreed++] = pageid;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: write the number of saved pages to the free-list file
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t writeSaved(beet_rider_t *rider, uint32_t n) {
+	if (fseeko(rider->flist, 0, SEEK_SET) != 0) return BEET_OSERR_SEEK;
+	if (fwrite(&n, sizeof(uint32_t), 1, rider->flist) != 1) {
+		return BEET_OSERR_WRITE;
+	}
+	if (fflush(rider->flist) != 0) return BEET_OSERR_FLUSH;
+	rider->nsaved = n;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: open free-list file (create it if 'create')
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t openFree(beet_rider_t *rider, char create) {
+	char *path;
+
+	path = malloc(strlen(rider->base) + strlen(rider->name) +
+	              strlen(FREEXT) + 2);
+	if (path == NULL) return BEET_ERR_NOMEM;
+
+	sprintf(path, "%s/%s%s", rider->base, rider->name, FREEXT);
+
+	rider->flist = fopen(path, "rb+");
+	if (rider->flist == NULL && create) {
+		rider->flist = fopen(path, "wb+");
+	}
+	free(path);
+	if (rider->flist == NULL && create) return BEET_OSERR_OPEN;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: load the free-list
+ * ------------------------------------------------------------------------
+ * Pages beyond the end of the data file are ignored;
+ * the file then no longer reflects the list and is reset.
+ * Lists with 32bit pageids (written by earlier versions)
+ * are recognised by their size and rewritten as well.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t loadFree(beet_rider_t *rider) {
+	beet_pageid_t pid;
+	beet_err_t err;
+	struct stat st;
+	uint32_t n, p32;
+	off_t  max;
+	char   bad = 0;
+	char   old = 0;
+
+	err = openFree(rider, 0);
+	if (err != BEET_OK) return err;
+	if (rider->flist == NULL) return BEET_OK;
+
+	if (fread(&n, sizeof(uint32_t), 1, rider->flist) != 1) n = 0;
+
+	if (n > 0 && fstat(fileno(rider->flist), &st) == 0 &&
+	    st.st_size == sizeof(uint32_t)*(off_t)(n+1)) old = 1;
+
+	max = rider->fsz / rider->pagesz;
+	for(uint32_t i=0; i<n; i++) {
+		if (old) {
+			if (fread(&p32, sizeof(uint32_t), 1, rider->flist) != 1) {
+				bad = 1; break;
+			}
+			pid = p32;
+		} else if (fread(&pid, sizeof(beet_pageid_t),
+		                    1, rider->flist) != 1) {
+			bad = 1; break;
+		}
+		if (pid == BEET_PAGE_NULL || (off_t)pid >= max) {
+			bad = 1; continue;
+		}
+		err = pushFree(rider, pid);
+		if (err != BEET_OK) return err;
+	}
+	if (bad || old) {
+		rider->nsaved = 0;
+		return writeSaved(rider, 0);
+	}
+	rider->nsaved = rider->nfreed;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: save the free-list (caller holds the latch);
+ * only the pages added since the last save are written.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t saveFree(beet_rider_t *rider) {
+	beet_err_t err;
+	off_t off;
+	uint32_t n;
+
+	if (rider->nsaved == rider->nfreed) return BEET_OK;
+	if (rider->flist == NULL) {
+		err = openFree(rider, 1);
+		if (err != BEET_OK) return err;
+	}
+	n = rider->nfreed - rider->nsaved;
+	off = sizeof(uint32_t) + (off_t)rider->nsaved*sizeof(beet_pageid_t);
+	if (fseeko(rider->flist, off, SEEK_SET) != 0) return BEET_OSERR_SEEK;
+	if (fwrite(rider->freed+rider->nsaved,
+	           sizeof(beet_pageid_t), n, rider->flist) != n) {
+		return BEET_OSERR_WRITE;
+	}
+	return writeSaved(rider, rider->nfreed);
+}
+
+/* ------------------------------------------------------------------------
+ * Initialise the rider
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_init(beet_rider_t    *rider,
+                           char *base, char *name,
+                           uint32_t        pagesz,
+                           uint32_t           max) {
+	beet_err_t err;
+	uint32_t n, m;
+	size_t s;
+
+	RIDERNULL();
+	if (base == NULL || name == NULL) return BEET_ERR_NONAME;
+
+	rider->max = max;
+	rider->pagesz = pagesz;
+	rider->base = NULL;
+	rider->name = NULL;
+	rider->file = NULL;
+	rider->shards = NULL;
+	rider->nshards = 0;
+	rider->policy = BEET_EVICT_LRU;
+	rider->timeout = 0;
+	rider->pool = NULL;
+	rider->freed = NULL;
+	rider->nfreed = 0;
+	rider->mfreed = 0;
+	rider->nsaved = 0;
+	rider->flist = NULL;
+	rider->fused = NULL;
+	rider->fcap = 0;
+	rider->prealloc = BEET_RIDER_PREALLOC;
+	rider->maxpid = BEET_PAGE_LEAF;
+	rider->wblo = BEET_PAGE_NULL;
+	rider->wbhi = 0;
+	rider->mapped = 0;
+	rider->map = NULL;
+	rider->npages = 0;
+	rider->mpages = NULL;
+	rider->wal = NULL;
+	rider->walid = 0;
+	rider->spill = NULL;
+
+	err = beet_latch_init(&rider->latch);
+	if (err != BEET_OK) return err;
+
+	err = beet_aio_init(&rider->aio, 0);
+	if (err != BEET_OK) {
+		beet_latch_destroy(&rider->latch);
+		return err;
+	}
+
+	n = countShards(max);
+	rider->shards = calloc(n, sizeof(beet_rider_shard_t));
+	if (rider->shards == NULL) {
+		beet_aio_destroy(&rider->aio);
+		beet_latch_destroy(&rider->latch);
+		return BEET_ERR_NOMEM;
+	}
+
+	/* nshards counts initialised shards until all are ready */
+	for(uint32_t i=0; i<n; i++) {
+		m = max/n + (i < max%n ? 1 : 0);
+		err = initShard(rider->shards+i, m, pagesz);
+		if (err != BEET_OK) goto cleanup;
+		rider->nshards++;
+	}
+
+	s = strnlen(base, 4097);
+	if (s >= 4096) {
+		err = BEET_ERR_TOOBIG;
+		goto cleanup;
+	}
+
+	rider->base = strdup(base);
+	if (rider->base == NULL) {
+		err = BEET_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	s = strnlen(name, 4097);
+	if (s >= 4096) {
+		err = BEET_ERR_TOOBIG;
+		goto cleanup;
+	}
+
+	rider->name = strdup(name);
+	if (rider->name == NULL) {
+		err = BEET_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	err = openFile(rider);
+	if (err != BEET_OK) goto cleanup;
+
+	err = loadUsed(rider);
+	if (err != BEET_OK) goto cleanup;
+
+	err = loadFree(rider);
+	if (err != BEET_OK) goto cleanup;
+
+	return BEET_OK;
+
+cleanup:
+	beet_rider_destroy(rider);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Initialise the rider over a memory map
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_map(beet_rider_t *rider,
+                          char *base, char *name,
+                          uint32_t      pagesz) {
+	struct stat st;
+	beet_err_t err;
+	char *path;
+	void *map;
+
+	RIDERNULL();
+	if (base == NULL || name == NULL) return BEET_ERR_NONAME;
+	if (strnlen(base, 4097) >= 4096) return BEET_ERR_TOOBIG;
+	if (strnlen(name, 4097) >= 4096) return BEET_ERR_TOOBIG;
+
+	memset(rider, 0, sizeof(beet_rider_t));
+	rider->pagesz = pagesz;
+	rider->policy = BEET_EVICT_LRU;
+	rider->mapped = 1;
+
+	err = beet_latch_init(&rider->latch);
+	if (err != BEET_OK) return err;
+
+	err = beet_aio_init(&rider->aio, 0);
+	if (err != BEET_OK) {
+		beet_latch_destroy(&rider->latch);
+		return err;
+	}
+
+	rider->base = strdup(base);
+	rider->name = strdup(name);
+	if (rider->base == NULL || rider->name == NULL) {
+		err = BEET_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	path = dataPath(rider);
+	if (path == NULL) {
+		err = BEET_ERR_NOMEM;
+		goto cleanup;
+	}
+	rider->file = fopen(path, "rb"); free(path);
+	if (rider->file == NULL) {
+		err = BEET_OSERR_OPEN;
+		goto cleanup;
+	}
+	if (fstat(fileno(rider->file), &st) != 0) {
+		err = BEET_OSERR_OPEN;
+		goto cleanup;
+	}
+	rider->fsz = st.st_size;
+	rider->fcap = st.st_size;
+
+	/* an empty file has nothing to map */
+	rider->npages = (uint64_t)st.st_size / pagesz;
+	if (rider->npages == 0) return BEET_OK;
+
+	rider->mpages = calloc(rider->npages, sizeof(beet_page_t*));
+	if (rider->mpages == NULL) {
+		err = BEET_ERR_NOMEM;
+		goto cleanup;
+	}
+	map = mmap(NULL, rider->npages*pagesz, PROT_READ, MAP_SHARED,
+	           fileno(rider->file), 0);
+	if (map == MAP_FAILED) {
+		err = BEET_OSERR_NOMEM;
+		goto cleanup;
+	}
+	rider->map = map;
+	return BEET_OK;
+
+cleanup:
+	beet_rider_destroy(rider);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy the rider
+ * ------------------------------------------------------------------------
+ */
+void beet_rider_destroy(beet_rider_t *rider) {
+	if (rider == NULL) return;
+	if (rider->pool != NULL) {
+		beet_pool_unregister(rider->pool, rider);
+	}
+	if (rider->shards != NULL) {
+		for(uint32_t i=0; i<rider->nshards; i++) {
+			destroyShard(rider, rider->shards+i);
+		}
+		free(rider->shards); rider->shards = NULL;
+		rider->nshards = 0;
+	}
+	if (rider->mpages != NULL) {
+		for(uint64_t i=0; i<rider->npages; i++) {
+			if (rider->mpages[i] != NULL) free(rider->mpages[i]);
+		}
+		free(rider->mpages); rider->mpages = NULL;
+	}
+	if (rider->map != NULL) {
+		munmap(rider->map, rider->npages*rider->pagesz);
+		rider->map = NULL;
+	}
+	beet_aio_destroy(&rider->aio);
+	beet_latch_destroy(&rider->latch);
+
+	/* give back what was preallocated but not used */
+	if (rider->file != NULL && rider->fcap > rider->fsz) {
+		if (ftruncate(fileno(rider->file), rider->fsz) != 0) {
+			fprintf(stderr, "cannot truncate %s\n", rider->name);
+		}
+	}
+	if (rider->file != NULL && rider->fused != NULL && !rider->mapped) {
+		if (saveUsed(rider) != BEET_OK) {
+			fprintf(stderr, "cannot save size of %s\n", rider->name);
+		}
+	}
+	if (rider->file != NULL && !rider->mapped) {
+		if (saveFree(rider) != BEET_OK) {
+			fprintf(stderr, "cannot save free-list of %s\n",
+			                 rider->name);
+		}
+	}
+	if (rider->flist != NULL) {
+		fclose(rider->flist); rider->flist = NULL;
+	}
+	if (rider->fused != NULL) {
+		fclose(rider->fused); rider->fused = NULL;
+	}
+	if (rider->spill != NULL) {
+		fclose(rider->spill); rider->spill = NULL;
+	}
+	if (rider->freed != NULL) {
+		free(rider->freed); rider->freed = NULL;
+		rider->nfreed = 0; rider->mfreed = 0;
+	}
+	if (rider->base != NULL) {
+		free(rider->base); rider->base = NULL;
+	}
+	if (rider->name != NULL) {
+		free(rider->name); rider->name = NULL;
+	}
+	if (rider->file != NULL) {
+		fclose(rider->file); rider->file = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: CLOCK victim: the first unpinned frame after the hand
+ * whose reference bit is not set (clearing the bits on the way)
+ * ------------------------------------------------------------------------
+ */
+static beet_rider_frame_t *clockVictim(beet_rider_shard_t *shard) {
+	beet_rider_frame_t *frame;
+	uint32_t n = 2*shard->main.count + 1;
+
+	frame = shard->hand != NULL ? shard->hand : shard->main.head;
+	while(frame != NULL && n-- > 0) {
+		if (frame->used == 0) {
+			if (!frame->ref) return frame;
+			frame->ref = 0;
+		}
+		frame = frame->nxt != NULL ? frame->nxt : shard->main.head;
+	}
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: size of the shard the 2Q queues are measured against:
+ * 'max' for limited shards, otherwise the pages currently
+ * in the shard, which, in pooled shards, is their share of the pool
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t shardSize(beet_rider_shard_t *shard) {
+	return (shard->max > 0 ? shard->max : shard->count);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: 2Q victim: the oldest unpinned frame in 'in'
+ * if 'in' exceeds its share of the shard, otherwise
+ * the least recently used unpinned frame in 'main'
+ * ------------------------------------------------------------------------
+ */
+static beet_rider_frame_t *twoqVictim(beet_rider_shard_t *shard) {
+	beet_rider_frame_t *frame = NULL;
+
+	if (shard->in.count > shardSize(shard)/4) {
+		frame = lastUnused(&shard->in);
+	}
+	if (frame == NULL) frame = lruUnused(&shard->main);
+	if (frame == NULL) frame = lastUnused(&shard->in);
+	return frame;
+}
+
+/* ------------------------------------------------------------------------
+ * Set the eviction policy
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setPolicy(beet_rider_t *rider, uint32_t policy) {
+	beet_err_t err;
+	uint32_t m;
+
+	RIDERNULL();
+
+	switch(policy) {
+	case BEET_EVICT_LRU:
+	case BEET_EVICT_CLOCK: break;
+	case BEET_EVICT_2Q:
+		for(uint32_t i=0; i<rider->nshards; i++) {
+			if (rider->shards[i].ghosts.slots != NULL) continue;
+			m = rider->shards[i].max/2;
+			err = ghostInit(&rider->shards[i].ghosts, m);
+			if (err != BEET_OK) return err;
+		}
+		break;
+	default: return BEET_ERR_INVALID;
+	}
+	rider->policy = policy;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Draw page memory from a buffer pool
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setPool(beet_rider_t *rider, beet_pool_t pool) {
+	beet_err_t err;
+
+	RIDERNULL();
+	if (pool == NULL) return BEET_ERR_INVALID;
+	if (rider->max != 0 || rider->pool != NULL) return BEET_ERR_INVALID;
+
+	err = beet_pool_register(pool, rider);
+	if (err != BEET_OK) return err;
+
+	rider->pool = pool;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Set the timeout for waiting for room
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setTimeout(beet_rider_t *rider, uint32_t timeout) {
+	RIDERNULL();
+	rider->timeout = timeout;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Set preallocation
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setPrealloc(beet_rider_t *rider, uint32_t pages) {
+	RIDERNULL();
+	rider->prealloc = pages;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Set the size of pageids on disk
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setIdSize(beet_rider_t *rider, uint32_t pidsz) {
+	RIDERNULL();
+	switch(pidsz) {
+	case 4: rider->maxpid = BEET_PAGE_NULL32^BEET_PAGE_LEAF32; break;
+	case 8: rider->maxpid = BEET_PAGE_LEAF; break;
+	default: return BEET_ERR_INVALID;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: alignment of offsets and buffers required
+ * for direct I/O on the file (0: not supported)
+ * ------------------------------------------------------------------------
+ */
+static uint32_t directAlign(int fd) {
+	struct stat st;
+#ifdef STATX_DIOALIGN
+	struct statx sx;
+
+	if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &sx) == 0 &&
+	    (sx.stx_mask & STATX_DIOALIGN)) {
+		if (sx.stx_dio_mem_align > sx.stx_dio_offset_align) {
+			return sx.stx_dio_mem_align;
+		}
+		return sx.stx_dio_offset_align;
+	}
+#endif
+	/* the kernel does not tell; be conservative */
+	if (fstat(fd, &st) != 0) return 0;
+	return (uint32_t)st.st_blksize;
+}
+
+/* ------------------------------------------------------------------------
+ * Set direct I/O
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setDirect(beet_rider_t *rider) {
+#ifdef O_DIRECT
+	uint32_t align;
+	char *path;
+	FILE *f;
+	int fd;
+
+	RIDERNULL();
+	if (rider->file == NULL) return BEET_ERR_NOFD;
+
+	path = dataPath(rider);
+	if (path == NULL) return BEET_ERR_NOMEM;
+
+	fd = open(path, O_RDWR | O_DIRECT); free(path);
+	if (fd < 0) {
+		if (errno == EINVAL) return BEET_ERR_NOTSUPP;
+		return BEET_OSERR_OPEN;
+	}
+	align = directAlign(fd);
+	if (align == 0) {
+		close(fd); return BEET_ERR_NOTSUPP;
+	}
+	if (align > BEET_PAGE_BLOCK || rider->pagesz % align != 0) {
+		close(fd); return BEET_ERR_BADSIZE;
+	}
+	f = fdopen(fd, "rb+");
+	if (f == NULL) {
+		close(fd); return BEET_OSERR_OPEN;
+	}
+	fclose(rider->file); rider->file = f;
+	return BEET_OK;
+#else
+	RIDERNULL();
+	return BEET_ERR_NOTSUPP;
+#endif
+}
+
+/* ------------------------------------------------------------------------
+ * Set batched I/O
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setAio(beet_rider_t *rider, uint32_t depth) {
+	beet_err_t err;
+	char **bufs;
+	size_t *sizes;
+	uint32_t n=0;
+
+	RIDERNULL();
+	beet_aio_destroy(&rider->aio);
+	err = beet_aio_init(&rider->aio, depth);
+	if (err != BEET_OK || !beet_aio_uring(&rider->aio)) return err;
+
+	/* the page memory of limited shards never moves,
+	 * we register it with the ring */
+	if (rider->max == 0 || rider->pool != NULL) return BEET_OK;
+
+	for(uint32_t i=0; i<rider->nshards; i++) {
+		n += rider->shards[i].nchunks;
+	}
+	bufs = malloc(n*sizeof(char*));
+	if (bufs == NULL) return BEET_ERR_NOMEM;
+	sizes = malloc(n*sizeof(size_t));
+	if (sizes == NULL) {
+		free(bufs); return BEET_ERR_NOMEM;
+	}
+	n = 0;
+	for(uint32_t i=0; i<rider->nshards; i++) {
+		beet_rider_shard_t *shard = rider->shards+i;
+		for(uint32_t k=0; k<shard->nchunks; k++) {
+			if (shard->chunks[k].data == NULL) continue;
+			bufs[n] = shard->chunks[k].data;
+			sizes[n++] = (size_t)shard->chunks[k].n *
+			                     rider->pagesz;
+		}
+	}
+	err = beet_aio_register(&rider->aio, bufs, sizes, n);
+	free(bufs); free(sizes);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Wait statistics
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_waitStats(beet_rider_t *rider,
+                                uint64_t     *waits,
+                                uint64_t    *waited) {
+	beet_err_t err;
+	beet_err_t err2;
+
+	RIDERNULL();
+
+	*waits = 0; *waited = 0;
+	for(uint32_t i=0; i<rider->nshards; i++) {
+		LOCK(rider->shards+i);
+		*waits += rider->shards[i].waits;
+		*waited += rider->shards[i].waited;
+		UNLOCK(rider->shards+i);
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: the frame to evict next according to the policy
+ * ------------------------------------------------------------------------
+ */
+static inline beet_rider_frame_t *victim(beet_rider_t       *rider,
+                                         beet_rider_shard_t *shard) {
+	switch(rider->policy) {
+	case BEET_EVICT_CLOCK: return clockVictim(shard);
+	case BEET_EVICT_2Q: return twoqVictim(shard);
+	default: return lruUnused(&shard->main);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: remove frame from the shard and put it on the free list
+ * ------------------------------------------------------------------------
+ */
+static void removeFrame(beet_rider_shard_t *shard,
+                        beet_rider_frame_t *frame) {
+	if (shard->hand == frame) {
+		shard->hand = frame->nxt;
+	}
+	if (frame->in) {
+		dequeue(&shard->in, frame);
+		ghostAdd(&shard->ghosts, frame->pageid,
+		                         shardSize(shard)/2);
+	} else {
+		dequeue(&shard->main, frame);
+	}
+	slotRemove(shard, frame);
+
+	/* invalidate optimistic readers */
+	beginChange(&frame->page);
+	endChange(&frame->page, 1);
+
+	putFrame(shard, frame);
+	shard->count--;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: write the page back if it is dirty and remove it
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t evict(beet_rider_t       *rider,
+                        beet_rider_shard_t *shard,
+                        beet_rider_frame_t *frame) {
+	beet_err_t err;
+
+	// fprintf(stderr, "removing %u\n", frame->pageid);
+	if (frame->page.dirty) {
+		err = beet_page_store(&frame->page, rider->file);
+		if (err != BEET_OK) return err;
+		frame->page.dirty = 0;
+	}
+	removeFrame(shard, frame);
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: position of a slot of the shard in the spill file
+ * ------------------------------------------------------------------------
+ */
+static inline off_t spillOff(beet_rider_t       *rider,
+                             beet_rider_shard_t *shard,
+                             uint32_t             slot) {
+	return ((off_t)slot*rider->nshards + (shard - rider->shards)) *
+	       (off_t)rider->pagesz;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: the spilled page 'pageid' or NULL
+ * ------------------------------------------------------------------------
+ */
+static beet_rider_spilled_t *findSpilled(beet_rider_shard_t *shard,
+                                         beet_pageid_t      pageid) {
+	if (shard->spills == 0) return NULL;
+	for(uint32_t i=0; i<shard->nspilled; i++) {
+		if (shard->spilled[i].pageid == pageid) return shard->spilled+i;
+	}
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: a free slot in the spill file
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t spillSlot(beet_rider_shard_t *shard, uint32_t *slot) {
+	beet_rider_spilled_t *tmp;
+	uint32_t m;
+
+	for(uint32_t i=0; i<shard->nspilled; i++) {
+		if (shard->spilled[i].pageid == BEET_PAGE_NULL) {
+			*slot = i; return BEET_OK;
+		}
+	}
+	if (shard->nspilled == shard->mspilled) {
+		m = shard->mspilled == 0 ? 8 : 2*shard->mspilled;
+		tmp = realloc(shard->spilled, m*sizeof(beet_rider_spilled_t));
+		if (tmp == NULL) return BEET_ERR_NOMEM;
+		shard->spilled = tmp; shard->mspilled = m;
+	}
+	*slot = shard->nspilled++;
+	shard->spilled[*slot].pageid = BEET_PAGE_NULL;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: free the slot of a spilled page
+ * ------------------------------------------------------------------------
+ */
+static inline void dropSpilled(beet_rider_shard_t  *shard,
+                               beet_rider_spilled_t   *sp) {
+	sp->pageid = BEET_PAGE_NULL;
+	shard->spills--;
+	if (shard->spills == 0) shard->nspilled = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: least recently used frame pinned only by the log
+ * ------------------------------------------------------------------------
+ */
+static inline beet_rider_frame_t *lastLogPinned(beet_rider_queue_t *q) {
+	beet_rider_frame_t *frame;
+
+	for(frame=q->tail; frame!=NULL; frame=frame->prv) {
+		if (frame->walpin && frame->used == 1) return frame;
+	}
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: make room when the pages not in use are pinned by the log.
+ * Those pages are released only when their group is committed,
+ * which waits for the running operations, possibly including the caller.
+ * So we move one of them to the spill file instead;
+ * it must not reach the data file before it is logged
+ * (see beet_rider_logged). Does nothing if there is no such page.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t spill(beet_rider_t       *rider,
+                        beet_rider_shard_t *shard) {
+	beet_rider_spilled_t *sp;
+	beet_rider_frame_t *frame;
+	beet_err_t err;
+	uint32_t slot;
+
+	if (rider->spill == NULL || shard->walpins == 0) return BEET_OK;
+
+	frame = lastLogPinned(&shard->in);
+	if (frame == NULL) frame = lastLogPinned(&shard->main);
+	if (frame == NULL) return BEET_OK;
+
+	err = spillSlot(shard, &slot);
+	if (err != BEET_OK) return err;
+
+	if (pwrite(fileno(rider->spill), frame->page.data, rider->pagesz,
+	           spillOff(rider, shard, slot)) != rider->pagesz) {
+		return BEET_OSERR_WRITE;
+	}
+	sp = shard->spilled+slot;
+	sp->pageid = frame->pageid;
+	sp->walcut = frame->walcut;
+	sp->walpend = frame->walpend;
+	shard->spills++;
+
+	__atomic_store_n(&frame->walpin, 0, __ATOMIC_RELAXED);
+	frame->walpend = 0;
+	frame->used = 0;
+	frame->page.dirty = 0;
+	shard->walpins--;
+
+	removeFrame(shard, frame);
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: load a spilled page into a frame;
+ * the page is pinned by the log again
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t unspill(beet_rider_t         *rider,
+                          beet_rider_shard_t   *shard,
+                          beet_rider_spilled_t    *sp,
+                          beet_rider_frame_t   *frame) {
+	/* optimistic readers may still look at the old page */
+	beginChange(&frame->page);
+	if (pread(fileno(rider->spill), frame->page.data, rider->pagesz,
+	          spillOff(rider, shard, sp - shard->spilled)) !=
+	                                              rider->pagesz) {
+		endChange(&frame->page, 1);
+		return BEET_OSERR_READ;
+	}
+	frame->page.pageid = sp->pageid;
+	frame->page.dirty = 1;
+	frame->pageid = sp->pageid;
+	frame->used = 1;
+	frame->walpin = 1;
+	frame->walpend = sp->walpend;
+	frame->walcut = sp->walcut;
+	frame->bad = 0;
+	endChange(&frame->page, 1);
+
+	shard->walpins++;
+	dropSpilled(shard, sp);
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: make room for more
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t makeRoom(beet_rider_t       *rider,
+                           beet_rider_shard_t *shard) {
+	beet_rider_frame_t *frame;
+
+	frame = victim(rider, shard);
+	if (frame == NULL) return spill(rider, shard);
+	return evict(rider, shard, frame);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: page was requested and found in the cache
+ * ------------------------------------------------------------------------
+ */
+static inline void touch(beet_rider_t       *rider,
+                         beet_rider_shard_t *shard,
+                         beet_rider_frame_t *frame) {
+	if (rider->pool != NULL) {
+		frame->stamp = __atomic_load_n(&rider->pool->tick,
+		                               __ATOMIC_RELAXED);
+	}
+	switch(rider->policy) {
+	case BEET_EVICT_CLOCK:
+		/* avoid writing the cache line if the bit is set */
+		if (!frame->ref) frame->ref = 1;
+		break;
+	case BEET_EVICT_2Q:
+		if (!frame->in) promote(&shard->main, frame);
+		break;
+	default:
+		promote(&shard->main, frame);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: page was loaded into the cache
+ * ------------------------------------------------------------------------
+ */
+static inline void place(beet_rider_t       *rider,
+                         beet_rider_shard_t *shard,
+                         beet_rider_frame_t *frame) {
+	frame->ref = 0;
+	frame->in = 0;
+	if (rider->pool != NULL) {
+		frame->stamp = __atomic_add_fetch(&rider->pool->tick, 1,
+		                                  __ATOMIC_RELAXED);
+	}
+	switch(rider->policy) {
+	case BEET_EVICT_CLOCK:
+		/* behind the hand, i.e. examined last */
+		enqueueBefore(&shard->main, shard->hand, frame); break;
+	case BEET_EVICT_2Q:
+		if (ghostRemove(&shard->ghosts, frame->pageid)) {
+			enqueue(&shard->main, frame);
+		} else {
+			frame->in = 1;
+			enqueue(&shard->in, frame);
+		}
+		break;
+	default:
+		enqueue(&shard->main, frame);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: check if there is room for more
+ * ------------------------------------------------------------------------
+ */
+static inline char hasRoom(beet_rider_shard_t *shard) {
+	return (shard->max == 0 || shard->max > shard->count);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: is victim a a better choice than victim b in a buffer pool?
+ * Pages in a 2Q 'in' queue were used only once and go first,
+ * otherwise the least recently used page is chosen.
+ * ------------------------------------------------------------------------
+ */
+static inline char older(beet_rider_frame_t *a, beet_rider_frame_t *b) {
+	if (a->in != b->in) return a->in;
+	return (a->stamp < b->stamp);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: evict the oldest page (see older) among
+ * this shard and a sample of shards of other riders in the pool.
+ * The pool latch is held while choosing to keep the riders
+ * from going away; the other shards are only tried,
+ * since we already hold our shard.
+ * A dirty victim is written back after releasing the pool latch:
+ * it stays protected by the latch of its shard and
+ * 'busy' keeps its rider from being unregistered.
+ * A page evicted from another shard gives its memory back to the pool.
+ * (BEET_ERR_NORSC: no page could be evicted)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t poolEvict(beet_rider_t       *rider,
+                            beet_rider_shard_t *shard) {
+	beet_pool_t pool = rider->pool;
+	beet_rider_frame_t *best, *frame;
+	beet_rider_shard_t *bshard, *s;
+	beet_rider_t *brider, *r;
+	beet_err_t err, err2;
+	uint32_t n, k=0;
+
+	err = beet_latch_lock(&pool->latch);
+	if (err != BEET_OK) return err;
+
+	best = victim(rider, shard);
+	bshard = shard; brider = rider;
+
+	/* many shards may be empty when memory is scarce,
+	   so we look at more shards until we have enough candidates */
+	n = pool->nriders * BEET_RIDER_MAXSHARDS;
+	for(uint32_t i=0; i<n && k<POOLSAMPLE; i++) {
+		pool->cursor++;
+		r = pool->riders[pool->cursor%pool->nriders];
+		s = r->shards+((pool->cursor/pool->nriders)%r->nshards);
+		if (s == shard || s == bshard) continue;
+		if (beet_latch_trylock(&s->latch) != BEET_OK) continue;
+		frame = victim(r, s);
+		if (frame != NULL) k++;
+		if (frame != NULL && (best == NULL || older(frame, best))) {
+			if (bshard != shard) beet_latch_unlock(&bshard->latch);
+			best = frame; bshard = s; brider = r;
+		} else {
+			beet_latch_unlock(&s->latch);
+		}
+	}
+	if (best == NULL) {
+		beet_latch_unlock(&pool->latch);
+
+		/* our pages may all be pinned by the log */
+		err = spill(rider, shard);
+		if (err != BEET_OK) return err;
+		return (shard->free != NULL ? BEET_OK : BEET_ERR_NORSC);
+	}
+	if (bshard != shard) pool->busy++;
+	beet_latch_unlock(&pool->latch);
+
+	err = evict(brider, bshard, best);
+	if (bshard == shard) return err;
+
+	if (err == BEET_OK) {
+		/* evict put the frame on the free list */
+		bshard->free = best->nxt;
+		free(best->page.data); best->page.data = NULL;
+		best->nxt = bshard->empty;
+		bshard->empty = best;
+	}
+	beet_latch_unlock(&bshard->latch);
+
+	err2 = beet_latch_lock(&pool->latch);
+	if (err2 != BEET_OK) return err2;
+	if (err == BEET_OK) {
+		pool->used -= brider->pagesz;
+		pool->evictions++;
+	}
+	pool->busy--;
+	if (pool->busy == 0) beet_cond_broadcast(&pool->idle);
+	beet_latch_unlock(&pool->latch);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: make sure there is a frame with memory for a new page
+ * in a shard drawing from a buffer pool
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t poolRoom(beet_rider_t       *rider,
+                           beet_rider_shard_t *shard) {
+	beet_err_t err;
+
+	for(;;) {
+		if (shard->free != NULL) return BEET_OK;
+		err = beet_pool_reserve(rider->pool, rider->pagesz);
+		if (err != BEET_ERR_NORSC) return err;
+		err = poolEvict(rider, shard);
+		if (err != BEET_OK) return err;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: evict a page from the shard if it is full
+ * (BEET_ERR_NORSC: all pages of the shard are in use)
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t ensureRoom(beet_rider_t       *rider,
+                                    beet_rider_shard_t *shard) {
+	beet_err_t err;
+
+	if (rider->pool != NULL) {
+		err = poolRoom(rider, shard);
+		if (err != BEET_OK) return err;
+
+	} else if (!hasRoom(shard)) {
+		err = makeRoom(rider, shard);
+		if (err != BEET_OK) return err;
+	}
+	if (!hasRoom(shard)) return BEET_ERR_NORSC;
+
+	/* unlimited shards grow their hash table */
+	if (2*(shard->count+1) > shard->nslots) return slotGrow(shard);
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: add milliseconds to a point in time
+ * ------------------------------------------------------------------------
+ */
+static inline void addms(struct timespec *ts, uint32_t ms) {
+	ts->tv_sec += ms/1000;
+	ts->tv_nsec += (long)(ms%1000)*1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: is a before b?
+ * ------------------------------------------------------------------------
+ */
+static inline char before(struct timespec *a, struct timespec *b) {
+	return (a->tv_sec < b->tv_sec ||
+	       (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec));
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: wait (with the shard locked) until a page of the shard
+ * is released. The deadline is computed on the first wait
+ * of a request (it is zero before).
+ * Riders drawing from a buffer pool wait at most POOLWAIT ms at once,
+ * since the pages in use may belong to other riders,
+ * which do not signal this shard.
+ * Pages pinned only by the log do not make us wait:
+ * they are spilled (see spill) and unpin signals
+ * when a page is left with that pin alone.
+ * Returns BEET_ERR_NORSC if the timeout expired.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t waitRoom(beet_rider_t         *rider,
+                           beet_rider_shard_t   *shard,
+                           struct timespec   *deadline) {
+	struct timespec t1, t2, slice;
+	struct timespec *until = NULL;
+	beet_err_t err;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (rider->timeout > 0) {
+		if (deadline->tv_sec == 0 && deadline->tv_nsec == 0) {
+			*deadline = t1; addms(deadline, rider->timeout);
+		}
+		until = deadline;
+	}
+	if (rider->pool != NULL) {
+		slice = t1; addms(&slice, POOLWAIT);
+		if (until == NULL || before(&slice, until)) until = &slice;
+	}
+
+	shard->waiting++;
+	err = beet_cond_wait(&shard->room, &shard->latch, until);
+	shard->waiting--;
+
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	shard->waits++;
+	shard->waited += (uint64_t)(t2.tv_sec - t1.tv_sec) * 1000000 +
+	                 (t2.tv_nsec - t1.tv_nsec) / 1000;
+
+	if (err == BEET_OSERR_TIMEOUT) {
+		if (until == &slice) return BEET_OK;
+		return BEET_ERR_NORSC;
+	}
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: signal a waiting thread that a page is no longer pinned
+ * or only pinned by the log (and can be spilled)
+ * ------------------------------------------------------------------------
+ */
+static inline void unpin(beet_rider_shard_t *shard,
+                         beet_rider_frame_t *frame) {
+	frame->used--;
+	if (shard->waiting > 0 && (frame->used == 0 ||
+	   (frame->used == 1 && frame->walpin))) {
+		beet_cond_signal(&shard->room);
+	}
+}
+
+#define READ   0
+#define WRITE  1
+#define CREATE 2
+
+/* ------------------------------------------------------------------------
+ * Helper: we waited for a page that a prefetch failed to load;
+ * the last thread that waited for it removes it
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t badFrame(beet_rider_t       *rider,
+                           beet_rider_shard_t *shard,
+                           beet_rider_frame_t *frame,
+                           char                    x) {
+	beet_err_t err;
+	beet_err_t err2;
+
+	if (x == READ) {
+		err = beet_unlock_read(&frame->page.lock);
+	} else {
+		err = beet_unlock_write(&frame->page.lock);
+	}
+	if (err != BEET_OK) return err;
+
+	LOCK(shard);
+	unpin(shard, frame);
+	if (frame->used == 0) removeFrame(shard, frame);
+	UNLOCK(shard);
+	return BEET_OSERR_READ;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get a frame and load the page (or allocate a new one)
+ * from the data file or, if it was spilled, from the spill file
+ * and add it to the shard
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t addPage(beet_rider_t        *rider,
+                          beet_rider_shard_t  *shard,
+                          beet_pageid_t       pageid,
+                          beet_rider_frame_t **frame) {
+	beet_rider_spilled_t *sp = NULL;
+	beet_err_t err;
+
+	err = getFrame(rider, shard, frame);
+	if (err != BEET_OK) return err;
+
+	if (pageid != BEET_PAGE_NULL) sp = findSpilled(shard, pageid);
+	if (sp != NULL) {
+		err = unspill(rider, shard, sp, *frame);
+	} else {
+		err = loadFrame(*frame, rider, pageid);
+	}
+	if (err != BEET_OK) {
+		putFrame(shard, *frame); return err;
+	}
+	slotInsert(shard, *frame);
+	place(rider, shard, *frame);
+	shard->count++;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: allocate a new page at the end of the file
+ * and add it to its shard (which is returned locked)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t allocpage(beet_rider_t        *rider,
+                            beet_rider_shard_t **shard,
+                            beet_rider_frame_t **frame) {
+	struct timespec deadline = {0,0};
+	beet_err_t err;
+	beet_err_t err2;
+
+	for(;;) {
+		LOCK(rider);
+
+		/* the new pageid must be representable on disk */
+		if ((beet_pageid_t)(rider->fsz/rider->pagesz) >=
+		                                      rider->maxpid) {
+			UNLOCK(rider);
+			return BEET_ERR_TOOBIG;
+		}
+		*shard = getShard(rider,
+		         (beet_pageid_t)(rider->fsz/rider->pagesz));
+
+		err = beet_latch_lock(&(*shard)->latch);
+		if (err != BEET_OK) {
+			UNLOCK(rider);
+			return err;
+		}
+		err = ensureRoom(rider, *shard);
+		if (err == BEET_OK) break;
+
+		/* do not block other allocations while waiting */
+		err2 = beet_latch_unlock(&rider->latch);
+		if (err2 != BEET_OK) {
+			beet_latch_unlock(&(*shard)->latch);
+			return err2;
+		}
+		if (err == BEET_ERR_NORSC) {
+			err = waitRoom(rider, *shard, &deadline);
+		}
+		err2 = beet_latch_unlock(&(*shard)->latch);
+		if (err != BEET_OK) return err;
+		if (err2 != BEET_OK) return err2;
+	}
+	err = addPage(rider, *shard, BEET_PAGE_NULL, frame);
+	if (err != BEET_OK) {
+		beet_latch_unlock(&(*shard)->latch);
+		UNLOCK(rider);
+		return err;
+	}
+	err2 = beet_latch_unlock(&rider->latch);
+	if (err2 != BEET_OK) {
+		beet_latch_unlock(&(*shard)->latch);
+		return err2;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Get and lock a page for reading or writing
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t getpage(beet_rider_t *rider,
+                          beet_pageid_t pageid,
+                          char          x,
+                          beet_page_t **page) {
+	struct timespec deadline = {0,0};
+	beet_err_t err = BEET_OK;
+	beet_err_t err2;
+	beet_rider_shard_t *shard;
+	beet_rider_frame_t *frame=NULL;
+
+	if (x == CREATE) {
+		err = allocpage(rider, &shard, &frame);
+		if (err != BEET_OK) return err;
+		goto found;
+	}
+
+	shard = getShard(rider, pageid);
+
+	LOCK(shard);
+
+	/* the page may have been loaded while we were waiting */
+	for(;;) {
+		frame = lookup(shard, pageid);
+		if (frame != NULL) {
+			touch(rider, shard, frame);
+			goto found;
+		}
+		err = ensureRoom(rider, shard);
+		if (err == BEET_OK) break;
+		if (err == BEET_ERR_NORSC) {
+			err = waitRoom(rider, shard, &deadline);
+		}
+		if (err != BEET_OK) {
+			UNLOCK(shard);
+			return err;
+		}
+	}
+	err = addPage(rider, shard, pageid, &frame);
+	if (err != BEET_OK) {
+		UNLOCK(shard);
+		return err;
+	}
+found:
+
+	frame->used++;
+
+	UNLOCK(shard);
+	if (x == READ) {
+		err = beet_lock_read(&frame->page.lock);
+	} else {
+		err = beet_lock_write(&frame->page.lock);
+	}
+	if (err != BEET_OK) return err;
+
+	if (frame->bad) return badFrame(rider, shard, frame, x);
+
+	if (x != READ) {
+		beginChange(&frame->page);
+		frame->page.changed = 0;
+	}
+
+	*page = &frame->page;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: tell the log that the page was changed;
+ *         the log holds a pin on the page until
+ *         the change is synced (see beet_rider_logged)
+ * ------------------------------------------------------------------------
+ */
+static inline void logChange(beet_rider_t       *rider,
+                             beet_rider_shard_t *shard,
+                             beet_rider_frame_t *frame) {
+	if (rider->wal == NULL || frame->walpend) return;
+	if (!beet_wal_changed(rider->wal, rider->walid, frame->pageid)) return;
+	frame->walpend = 1;
+	if (!frame->walpin) {
+		__atomic_store_n(&frame->walpin, 1, __ATOMIC_RELAXED);
+		frame->used++;
+		shard->walpins++;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Release a page for reading or writing
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t releasepage(beet_rider_t *rider,
+                              beet_pageid_t pageid,
+                              char          x) {
+	beet_err_t err;
+	beet_err_t err2;
+	beet_rider_shard_t *shard;
+	beet_rider_frame_t *frame;
+
+	shard = getShard(rider, pageid);
+
+	LOCK(shard);
+
+	frame = lookup(shard, pageid);
+	if (frame == NULL) {
+		UNLOCK(shard);
+		return BEET_ERR_UNKNKEY;
+	}
+	if (x == READ) {
+		err = beet_unlock_read(&frame->page.lock);
+	} else {
+		endChange(&frame->page, frame->page.changed);
+		if (frame->page.changed) logChange(rider, shard, frame);
+		err = beet_unlock_write(&frame->page.lock);
+	}
+	if (err != BEET_OK) {
+		UNLOCK(shard);
+		return err;
+	}
+	unpin(shard, frame);
+	UNLOCK(shard);
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: page over the mapping;
+ * the page descriptor is created on first access and
+ * lives as long as the rider (the mapping never changes)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t mappedPage(beet_rider_t  *rider,
+                             beet_pageid_t pageid,
+                             beet_page_t  **page) {
+	beet_page_t *p, *q = NULL;
+
+	if (pageid >= rider->npages) return BEET_ERR_BADPAGE;
+
+	p = __atomic_load_n(rider->mpages+pageid, __ATOMIC_ACQUIRE);
+	if (p != NULL) {
+		*page = p; return BEET_OK;
+	}
+	p = calloc(1, sizeof(beet_page_t));
+	if (p == NULL) return BEET_ERR_NOMEM;
+
+	p->data = rider->map + pageid*rider->pagesz;
+	p->sz = rider->pagesz;
+	p->pageid = pageid;
+
+	/* another thread may have been faster */
+	if (!__atomic_compare_exchange_n(rider->mpages+pageid, &q, p, 0,
+	                                 __ATOMIC_ACQ_REL,
+	                                 __ATOMIC_ACQUIRE)) {
+		free(p); p = q;
+	}
+	*page = p;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Get the page identified by 'pageid' for reading
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_getRead(beet_rider_t  *rider,
+                              beet_pageid_t pageid,
+                              beet_page_t  **page) {
+	RIDERNULL();
+	PAGENULL();
+	if (rider->mapped) return mappedPage(rider, pageid, page);
+	return getpage(rider, pageid, READ, page);
+}
+
+/* ------------------------------------------------------------------------
+ * Get the page identified by 'pageid' for writing
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_getWrite(beet_rider_t *rider,
+                               beet_pageid_t pageid,
+                               beet_page_t **page) {
+	RIDERNULL();
+	PAGENULL();
+	WRITABLE();
+	return getpage(rider, pageid, WRITE, page);
+}
+
+/* ------------------------------------------------------------------------
+ * Release the page identified by 'pageid'
+ * and obtained before for reading
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_releaseRead(beet_rider_t *rider,
+                                  beet_page_t   *page) {
+	RIDERNULL();
+	PAGENULL();
+	if (rider->mapped) return BEET_OK;
+	return releasepage(rider, page->pageid, READ);
+}
+
+/* ------------------------------------------------------------------------
+ * Release the page identified by 'pageid'
+ * and obtained before for writing
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_releaseWrite(beet_rider_t *rider,
+                                   beet_page_t   *page) {
+	RIDERNULL();
+	PAGENULL();
+	WRITABLE();
+	return releasepage(rider, page->pageid, WRITE);
+}
+
+/* ------------------------------------------------------------------------
+ * Allocate a new page
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_alloc(beet_rider_t  *rider,
+                            beet_page_t  **page) {
+	beet_pageid_t pid = BEET_PAGE_NULL;
+	beet_err_t err, err2;
+
+	RIDERNULL();
+	PAGENULL();
+	WRITABLE();
+
+	LOCK(rider);
+	if (rider->nfreed > 0) pid = rider->freed[rider->nfreed-1];
+
+	/* the file must not list the page anymore */
+	if (rider->nfreed > 0 && rider->nfreed <= rider->nsaved) {
+		err = writeSaved(rider, rider->nfreed-1);
+		if (err != BEET_OK) {
+			UNLOCK(rider); return err;
+		}
+	}
+	if (rider->nfreed > 0) rider->nfreed--;
+	UNLOCK(rider);
+
+	if (pid == BEET_PAGE_NULL) return getpage(rider,0,CREATE,page);
+
+	/* reuse a free page; it looks like a new one */
+	err = getpage(rider, pid, WRITE, page);
+	if (err != BEET_OK) {
+		beet_rider_free(rider, pid);
+		return err;
+	}
+	memset((*page)->data, 0, rider->pagesz);
+	(*page)->dirty = 1;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Give a page back to the free-list
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_free(beet_rider_t *rider,
+                           beet_pageid_t pageid) {
+	beet_err_t err, err2;
+
+	RIDERNULL();
+	WRITABLE();
+
+	if (pageid == BEET_PAGE_NULL) return BEET_ERR_INVALID;
+
+	LOCK(rider);
+	err = pushFree(rider, pageid);
+	UNLOCK(rider);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Store page to disk (i.e. mark it as dirty)
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_store(beet_rider_t *rider,
+                            beet_page_t  *page) {
+	RIDERNULL();
+	PAGENULL();
+	WRITABLE();
+	page->dirty = 1;
+	page->changed = 1;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: add frames for the pages of one shard that are not cached,
+ * pinned and locked for writing, so that others wait until
+ * they are loaded. Stops when the shard is full
+ * (we do not wait for room). Spilled pages are left alone.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t reserveFrames(beet_rider_t        *rider,
+                                beet_rider_shard_t  *shard,
+                                beet_pageid_t     *pageids,
+                                uint32_t                  n,
+                                beet_rider_frame_t **frames,
+                                uint32_t                 *m) {
+	beet_rider_frame_t *frame;
+	beet_pageid_t last;
+	beet_err_t err = BEET_OK;
+	beet_err_t err2;
+
+	last = (beet_pageid_t)(__atomic_load_n(&rider->fsz,
+	                       __ATOMIC_RELAXED)/rider->pagesz);
+	LOCK(shard);
+	for(uint32_t i=0; i<n; i++) {
+		if (pageids[i] >= last) continue;
+		if (getShard(rider, pageids[i]) != shard) continue;
+		if (lookup(shard, pageids[i]) != NULL) continue;
+		if (findSpilled(shard, pageids[i]) != NULL) continue;
+
+		err = ensureRoom(rider, shard);
+		if (err != BEET_OK) break;
+		err = getFrame(rider, shard, &frame);
+		if (err != BEET_OK) break;
+
+		/* nobody holds the lock of an unused frame */
+		err = beet_lock_write(&frame->page.lock);
+		if (err != BEET_OK) {
+			putFrame(shard, frame); break;
+		}
+		beginChange(&frame->page);
+		frame->page.pageid = pageids[i];
+		frame->page.dirty = 0;
+		frame->pageid = pageids[i];
+		frame->used = 1;
+		frame->walpin = 0;
+		frame->walpend = 0;
+		frame->bad = 0;
+		slotInsert(shard, frame);
+		place(rider, shard, frame);
+		shard->count++;
+		frames[(*m)++] = frame;
+	}
+	UNLOCK(shard);
+	if (err == BEET_ERR_NORSC) return BEET_OK;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Load pages that are not cached
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_prefetch(beet_rider_t  *rider,
+                               beet_pageid_t *pageids,
+                               uint32_t             n) {
+	beet_rider_frame_t **frames;
+	beet_rider_shard_t *shard;
+	beet_page_t **pages;
+	beet_err_t err = BEET_OK;
+	beet_err_t err2;
+	uint32_t done = 0;
+	uint32_t m=0, k;
+
+	RIDERNULL();
+	if (pageids == NULL) return BEET_ERR_INVALID;
+
+	/* without ring, loading them now gains nothing */
+	if (rider->mapped || n < 2 || !beet_aio_uring(&rider->aio)) {
+		return BEET_OK;
+	}
+	frames = malloc(n*sizeof(beet_rider_frame_t*));
+	if (frames == NULL) return BEET_ERR_NOMEM;
+	pages = malloc(n*sizeof(beet_page_t*));
+	if (pages == NULL) {
+		free(frames); return BEET_ERR_NOMEM;
+	}
+
+	/* visit the shards in the order of the pages */
+	for(uint32_t i=0; i<n && err == BEET_OK; i++) {
+		shard = getShard(rider, pageids[i]);
+		k = (uint32_t)(shard - rider->shards);
+		if (done & (1u << k)) continue;
+		done |= 1u << k;
+		err = reserveFrames(rider, shard, pageids+i, n-i,
+		                                  frames, &m);
+	}
+	for(uint32_t j=0; j<m; j++) pages[j] = &frames[j]->page;
+
+	err2 = beet_aio_load(&rider->aio, pages, m, rider->file);
+	for(uint32_t j=0; j<m; j++) {
+		if (err2 != BEET_OK) frames[j]->bad = 1;
+		endChange(pages[j], 1);
+		beet_unlock_write(&pages[j]->lock);
+	}
+	if (err == BEET_OK) err = err2;
+
+	/* pages we could not load are removed by the last one
+	 * who waited for them (see badFrame) */
+	for(uint32_t j=0; j<m; j++) {
+		shard = getShard(rider, frames[j]->pageid);
+		err2 = beet_latch_lock(&shard->latch);
+		if (err2 != BEET_OK) {
+			if (err == BEET_OK) err = err2;
+			continue;
+		}
+		unpin(shard, frames[j]);
+		if (frames[j]->bad && frames[j]->used == 0) {
+			removeFrame(shard, frames[j]);
+		}
+		err2 = beet_latch_unlock(&shard->latch);
+		if (err == BEET_OK) err = err2;
+	}
+	free(frames); free(pages);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Find a cached page without latching or pinning it
+ * ------------------------------------------------------------------------
+ * The hash table of a limited shard never grows and
+ * the frames never move, so the table and the page memory
+ * can be read while other threads change them.
+ * Pooled riders give page memory back to the pool and
+ * unlimited shards reallocate their table; they are not supported.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_peek(beet_rider_t  *rider,
+                           beet_pageid_t pageid,
+                           beet_page_t  **page,
+                           uint32_t    *version) {
+	beet_rider_shard_t *shard;
+	beet_rider_frame_t *frame;
+	uint32_t i, m, v;
+
+	RIDERNULL();
+	PAGENULL();
+
+	/* mapped pages never change */
+	if (rider->mapped) {
+		*version = 0;
+		return mappedPage(rider, pageid, page);
+	}
+	if (rider->max == 0 || rider->pool != NULL) return BEET_ERR_NOTSUPP;
+
+	shard = getShard(rider, pageid);
+	m = shard->nslots - 1;
+	i = home(shard, pageid);
+
+	for(uint32_t n=0; n<=m; n++, i=(i+1)&m) {
+		frame = __atomic_load_n(shard->slots+i, __ATOMIC_ACQUIRE);
+		if (frame == NULL) return BEET_ERR_UNKNKEY;
+		if (frame->pageid != pageid) continue;
+
+		v = __atomic_load_n(&frame->page.version, __ATOMIC_ACQUIRE);
+		if (v & 1) return BEET_OSERR_BUSY;
+
+		/* the frame may have been reused in the meantime */
+		if (frame->page.pageid != pageid) return BEET_ERR_UNKNKEY;
+
+		/* tell the eviction policy that the page is in use */
+		if (!frame->ref) frame->ref = 1;
+
+		*page = &frame->page;
+		*version = v;
+		return BEET_OK;
+	}
+	return BEET_ERR_UNKNKEY;
+}
+
+/* ------------------------------------------------------------------------
+ * Check that a page obtained with peek has not changed
+ * ------------------------------------------------------------------------
+ */
+char beet_rider_validate(beet_page_t  *page,
+                         beet_pageid_t pageid,
+                         uint32_t     version) {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&page->version, __ATOMIC_RELAXED) != version) {
+		return 0;
+	}
+	return (page->pageid == pageid);
+}
+
+/* ------------------------------------------------------------------------
+ * Macro: page changed but not yet logged
+ *        (may be read without the shard latch
+ *         by a thread holding the page lock)
+ * ------------------------------------------------------------------------
+ */
+#define NOTLOGGED(f) \
+	__atomic_load_n(&(f)->walpin, __ATOMIC_RELAXED)
+
+/* ------------------------------------------------------------------------
+ * Helper: extend the range of pages written since the last writeback
+ * ------------------------------------------------------------------------
+ */
+static void written(beet_rider_t *rider, beet_pageid_t pageid) {
+	beet_pageid_t x;
+
+	x = __atomic_load_n(&rider->wblo, __ATOMIC_RELAXED);
+	while(pageid < x && !__atomic_compare_exchange_n(&rider->wblo,
+	                   &x, pageid, 1, __ATOMIC_RELAXED,
+	                                  __ATOMIC_RELAXED));
+	x = __atomic_load_n(&rider->wbhi, __ATOMIC_RELAXED);
+	while(pageid >= x && !__atomic_compare_exchange_n(&rider->wbhi,
+	                    &x, pageid+1, 1, __ATOMIC_RELAXED,
+	                                     __ATOMIC_RELAXED));
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: write one dirty page to disk
+ * ------------------------------------------------------------------------
+ * The page is pinned while it is written,
+ * so it cannot be evicted in the meantime.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t flushpage(beet_rider_t *rider,
+                            beet_pageid_t pageid,
+                            char            wait) {
+	beet_err_t err;
+	beet_err_t err2;
+	beet_rider_shard_t *shard;
+	beet_rider_frame_t *frame;
+
+	shard = getShard(rider, pageid);
+
+	LOCK(shard);
+	frame = lookup(shard, pageid);
+	if (frame == NULL || !frame->page.dirty || frame->walpin) {
+		UNLOCK(shard);
+		return BEET_OK;
+	}
+	frame->used++;
+	UNLOCK(shard);
+
+	if (wait) {
+		err = beet_lock_read(&frame->page.lock);
+	} else {
+		err = beet_lock_tryread(&frame->page.lock);
+	}
+	if (err == BEET_OK) {
+		/* the page may have been changed in the meantime */
+		if (frame->page.dirty && !NOTLOGGED(frame)) {
+			err = beet_page_store(&frame->page, rider->file);
+			if (err == BEET_OK) {
+				frame->page.dirty = 0;
+				written(rider, pageid);
+			}
+		}
+		err2 = beet_unlock_read(&frame->page.lock);
+		if (err == BEET_OK) err = err2;
+
+	} else if (err == BEET_OSERR_BUSY) err = BEET_OK;
+
+	err2 = beet_latch_lock(&shard->latch);
+	if (err2 != BEET_OK) return err2;
+	unpin(shard, frame);
+	UNLOCK(shard);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: write dirty pages in batches submitted at once
+ * ------------------------------------------------------------------------
+ * Only pages that can be locked without waiting join a batch,
+ * since we must not block on a page while holding others.
+ * With 'wait', the pages that were busy are written afterwards
+ * one by one.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t flushBatches(beet_rider_t  *rider,
+                               beet_pageid_t *pageids,
+                               uint32_t             n,
+                               char              wait) {
+	beet_rider_shard_t *shard;
+	beet_rider_frame_t **frames;
+	beet_page_t **pages;
+	beet_err_t err = BEET_OK;
+	beet_err_t err2;
+	uint32_t depth = rider->aio.depth;
+	uint32_t i, k, m, b=0;
+
+	frames = malloc(depth*sizeof(beet_rider_frame_t*));
+	if (frames == NULL) return BEET_ERR_NOMEM;
+	pages = malloc(depth*sizeof(beet_page_t*));
+	if (pages == NULL) {
+		free(frames); return BEET_ERR_NOMEM;
+	}
+
+	/* all pageids belong to the same shard */
+	shard = getShard(rider, pageids[0]);
+
+	for(i=0; i<n && err == BEET_OK; i+=k) {
+		k = n-i < depth ? n-i : depth;
+
+		/* pin and lock what is still dirty */
+		m = 0;
+		err = beet_latch_lock(&shard->latch);
+		if (err != BEET_OK) break;
+		for(uint32_t j=i; j<i+k; j++) {
+			beet_rider_frame_t *frame = lookup(shard, pageids[j]);
+			if (frame == NULL || !frame->page.dirty) continue;
+			if (frame->walpin) continue;
+			if (beet_lock_tryread(&frame->page.lock) != BEET_OK) {
+				/* keep it for later */
+				if (wait) pageids[b++] = pageids[j];
+				continue;
+			}
+			frame->used++;
+			frames[m] = frame;
+			pages[m++] = &frame->page;
+		}
+		err = beet_latch_unlock(&shard->latch);
+		if (err == BEET_OK) {
+			err = beet_aio_store(&rider->aio, pages, m,
+			                     rider->file);
+		}
+
+		for(uint32_t j=0; j<m; j++) {
+			if (err == BEET_OK) {
+				pages[j]->dirty = 0;
+				written(rider, pages[j]->pageid);
+			}
+			err2 = beet_unlock_read(&pages[j]->lock);
+			if (err == BEET_OK) err = err2;
+		}
+		err2 = beet_latch_lock(&shard->latch);
+		if (err2 != BEET_OK) {
+			free(frames); free(pages); return err2;
+		}
+		for(uint32_t j=0; j<m; j++) unpin(shard, frames[j]);
+		err2 = beet_latch_unlock(&shard->latch);
+		if (err == BEET_OK) err = err2;
+	}
+	free(frames); free(pages);
+
+	for(i=0; i<b && err == BEET_OK; i++) {
+		err = flushpage(rider, pageids[i], wait);
+	}
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: write all dirty pages of one shard to disk
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t flushShard(beet_rider_t       *rider,
+                             beet_rider_shard_t *shard,
+                             char                 wait) {
+	beet_rider_queue_t *qs[2] = {&shard->main, &shard->in};
+	beet_rider_frame_t *frame;
+	beet_pageid_t *pageids;
+	beet_err_t err = BEET_OK;
+	beet_err_t err2;
+	uint32_t n=0, i;
+
+	LOCK(shard);
+	for(int k=0; k<2; k++) {
+		for(frame=qs[k]->head; frame!=NULL; frame=frame->nxt) {
+			if (frame->page.dirty) n++;
+		}
+	}
+	if (n == 0) {
+		UNLOCK(shard);
+		return BEET_OK;
+	}
+	pageids = malloc(n*sizeof(beet_pageid_t));
+	if (pageids == NULL) {
+		UNLOCK(shard);
+		return BEET_ERR_NOMEM;
+	}
+	n = 0;
+	for(int k=0; k<2; k++) {
+		for(frame=qs[k]->head; frame!=NULL; frame=frame->nxt) {
+			if (frame->page.dirty) pageids[n++] = frame->pageid;
+		}
+	}
+	err2 = beet_latch_unlock(&shard->latch);
+	if (err2 != BEET_OK) {
+		free(pageids); return err2;
+	}
+	if (beet_aio_uring(&rider->aio)) {
+		err = flushBatches(rider, pageids, n, wait);
+		free(pageids);
+		return err;
+	}
+	for(i=0;i<n;i++) {
+		err = flushpage(rider, pageids[i], wait);
+		if (err != BEET_OK) break;
+	}
+	free(pageids);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Write all dirty pages to disk
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_flush(beet_rider_t *rider, char wait) {
+	beet_err_t err, err2;
+
+	RIDERNULL();
+	if (rider->mapped) return BEET_OK;
+
+	for(uint32_t i=0; i<rider->nshards; i++) {
+		err = flushShard(rider, rider->shards+i, wait);
+		if (err != BEET_OK) return err;
+	}
+	if (!wait) return BEET_OK;
+
+	/* all pages referring to freed pages are written now */
+	LOCK(rider);
+	err = saveFree(rider);
+	UNLOCK(rider);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Spill file
+ * ------------------------------------------------------------------------
+ */
+#define SPILLEXT ".spill"
+
+/* ------------------------------------------------------------------------
+ * Helper: create the spill file; it is removed at once,
+ * since its content is of no use after the rider is gone
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t openSpill(beet_rider_t *rider) {
+	char *path;
+
+	path = malloc(strlen(rider->base) + strlen(rider->name) +
+	              strlen(SPILLEXT) + 2);
+	if (path == NULL) return BEET_ERR_NOMEM;
+
+	sprintf(path, "%s/%s%s", rider->base, rider->name, SPILLEXT);
+
+	rider->spill = fopen(path, "wb+");
+	if (rider->spill != NULL) unlink(path);
+	free(path);
+	if (rider->spill == NULL) return BEET_OSERR_OPEN;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Log changes
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setWal(beet_rider_t      *rider,
+                             struct beet_wal_st *wal,
+                             uint32_t         walid) {
+	beet_err_t err;
+
+	RIDERNULL();
+	WRITABLE();
+	if (wal != NULL && rider->spill == NULL) {
+		err = openSpill(rider);
+		if (err != BEET_OK) return err;
+	}
+	rider->wal = wal;
+	rider->walid = walid;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: copy the image of a spilled page (shard is locked)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t spilledImage(beet_rider_t       *rider,
+                               beet_rider_shard_t *shard,
+                               beet_pageid_t      pageid,
+                               uint64_t            group,
+                               char                *buf) {
+	beet_rider_spilled_t *sp;
+
+	sp = findSpilled(shard, pageid);
+	if (sp == NULL || !sp->walpend) return BEET_ERR_UNKNKEY;
+	if (pread(fileno(rider->spill), buf, rider->pagesz,
+	          spillOff(rider, shard, sp - shard->spilled)) !=
+	                                              rider->pagesz) {
+		return BEET_OSERR_READ;
+	}
+	sp->walpend = 0;
+	sp->walcut = group;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: a spilled page is logged; it is written to the data file
+ * and leaves the spill file (shard is locked)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t spilledLogged(beet_rider_t       *rider,
+                                beet_rider_shard_t *shard,
+                                beet_pageid_t      pageid,
+                                uint64_t            group) {
+	beet_rider_spilled_t *sp;
+	beet_err_t err = BEET_OK;
+	char *buf;
+
+	sp = findSpilled(shard, pageid);
+	if (sp == NULL) return BEET_ERR_UNKNKEY;
+
+	/* keep it if the page was changed after the image was taken */
+	if (sp->walpend || sp->walcut != group) return BEET_OK;
+
+	/* the data file may be opened for direct I/O */
+	buf = beet_page_mem(1, rider->pagesz);
+	if (buf == NULL) return BEET_ERR_NOMEM;
+
+	if (pread(fileno(rider->spill), buf, rider->pagesz,
+	          spillOff(rider, shard, sp - shard->spilled)) !=
+	                                              rider->pagesz) {
+		err = BEET_OSERR_READ;
+	} else if (pwrite(fileno(rider->file), buf, rider->pagesz,
+	                  (off_t)pageid*rider->pagesz) != rider->pagesz) {
+		err = BEET_OSERR_WRITE;
+	}
+	free(buf);
+	if (err == BEET_OK) dropSpilled(shard, sp);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Copy the image of a page changed since the last group
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_image(beet_rider_t *rider,
+                            beet_pageid_t pageid,
+                            uint64_t       group,
+                            char           *buf) {
+	beet_err_t err, err2;
+	beet_rider_shard_t *shard;
+	beet_rider_frame_t *frame;
+
+	RIDERNULL();
+	if (buf == NULL) return BEET_ERR_INVALID;
+
+	shard = getShard(rider, pageid);
+
+	LOCK(shard);
+	frame = lookup(shard, pageid);
+	if (frame == NULL) {
+		err = spilledImage(rider, shard, pageid, group, buf);
+		UNLOCK(shard);
+		return err;
+	}
+	if (!frame->walpend) {
+		UNLOCK(shard);
+		return BEET_ERR_UNKNKEY;
+	}
+	memcpy(buf, frame->page.data, rider->pagesz);
+	frame->walpend = 0;
+	frame->walcut = group;
+	UNLOCK(shard);
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * The image of a page is synced
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_logged(beet_rider_t *rider,
+                             beet_pageid_t pageid,
+                             uint64_t       group) {
+	beet_err_t err, err2;
+	beet_rider_shard_t *shard;
+	beet_rider_frame_t *frame;
+
+	RIDERNULL();
+
+	shard = getShard(rider, pageid);
+
+	LOCK(shard);
+	frame = lookup(shard, pageid);
+	if (frame == NULL) {
+		err = spilledLogged(rider, shard, pageid, group);
+		UNLOCK(shard);
+		return err;
+	}
+	/* keep the pin if the page was changed after the image was taken */
+	if (frame->walpin && !frame->walpend && frame->walcut == group) {
+		__atomic_store_n(&frame->walpin, 0, __ATOMIC_RELAXED);
+		shard->walpins--;
+		unpin(shard, frame);
+	}
+	UNLOCK(shard);
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Sync the file
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_sync(beet_rider_t *rider) {
+	beet_err_t err, err2;
+
+	RIDERNULL();
+	if (rider->file == NULL || rider->mapped) return BEET_OK;
+
+	/* the size first: after a crash, the pages synced
+	 * must not be taken for unused */
+	if (rider->fused != NULL) {
+		err = beet_latch_lock(&rider->latch);
+		if (err != BEET_OK) return err;
+		err = saveUsed(rider);
+		err2 = beet_latch_unlock(&rider->latch);
+		if (err != BEET_OK) return err;
+		if (err2 != BEET_OK) return err2;
+		if (fdatasync(fileno(rider->fused)) != 0) return BEET_OSERR_FLUSH;
+	}
+
+	if (fflush(rider->file) != 0) return BEET_OSERR_FLUSH;
+	if (fdatasync(fileno(rider->file)) != 0) return BEET_OSERR_FLUSH;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Cover pages written without rider
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_cover(char *base, char *name, uint64_t pages) {
+	beet_err_t err = BEET_OK;
+	uint64_t n;
+	FILE *f;
+
+	if (base == NULL || name == NULL) return BEET_ERR_NONAME;
+
+	/* without used-size file, the file size counts */
+	f = openUsed(base, name, 0);
+	if (f == NULL) return BEET_OK;
+
+	if (pread(fileno(f), &n, sizeof(uint64_t), 0) == sizeof(uint64_t) &&
+	    n < pages) {
+		if (pwrite(fileno(f), &pages, sizeof(uint64_t), 0) !=
+		                              sizeof(uint64_t)) {
+			err = BEET_OSERR_WRITE;
+		} else if (fdatasync(fileno(f)) != 0) err = BEET_OSERR_FLUSH;
+	}
+	fclose(f);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Start writeback
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_writeback(beet_rider_t *rider) {
+	beet_pageid_t lo, hi;
+
+	RIDERNULL();
+	if (rider->file == NULL || rider->mapped) return BEET_OK;
+
+	/* pages written while we take the range
+	 * are started with the next one (or synced anyway) */
+	lo = __atomic_exchange_n(&rider->wblo, BEET_PAGE_NULL,
+	                                      __ATOMIC_RELAXED);
+	hi = __atomic_exchange_n(&rider->wbhi, 0, __ATOMIC_RELAXED);
+	if (lo >= hi) return BEET_OK;
+#ifdef SYNC_FILE_RANGE_WRITE
+	if (sync_file_range(fileno(rider->file),
+	                    (off_t)lo * rider->pagesz,
+	                    (off_t)(hi-lo) * rider->pagesz,
+	                    SYNC_FILE_RANGE_WRITE) != 0) {
+		/* not supported by the file system: the sync does it all */
+		if (errno == ENOSYS || errno == EINVAL ||
+		    errno == ESPIPE) return BEET_OK;
+		return BEET_OSERR_FLUSH;
+	}
+#endif
+	return BEET_OK;
+}
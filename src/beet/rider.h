@@ -4,10 +4,14 @@
  * File Rider
  * ========================================================================
  * A cached File consisting of fix-sized pages
+ * Freed pages are kept in a free-list that is stored
+ * in a file beside the data file (name.free).
+ * The file grows in chunks of preallocated pages;
+ * the number of pages actually in use is kept
+ * in another file beside the data file (name.used).
+ * Alternatively, the file can be mapped into memory read-only;
+ * pages are then read directly from the mapping without caching.
  * TODO:
- * - for delete, we will need a free-list
- *   which contains empty nodes. Instead of always allocating a new page,
- *   when a new node is needed, we will first consult free-list. 
  * - for compression, we will need one more layer: storage blocks.
  *   Those blocks would contain compressed pages (or parts thereof).
  *   As part of its definition, a page would contain a reference to the
@@ -21,48 +25,273 @@
 #define beet_rider_decl
 
 #include <beet/types.h>
+#include <beet/config.h>
+#include <beet/pool.h>
 #include <beet/lock.h>
 #include <beet/page.h>
-
-#include <tsalgo/list.h>
-#include <tsalgo/tree.h>
+#include <beet/aio.h>
 
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
 
+/* ------------------------------------------------------------------------
+ * Page frame (see rider.c)
+ * ------------------------------------------------------------------------
+ */
+typedef struct beet_rider_frame_st beet_rider_frame_t;
+
+/* ------------------------------------------------------------------------
+ * Write-ahead log (see wal.h)
+ * ------------------------------------------------------------------------
+ */
+struct beet_wal_st;
+
+/* ------------------------------------------------------------------------
+ * Chunk of frames; the memory for the pages of all frames
+ * in the chunk is allocated as one block
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_rider_frame_t *frames; /* frames in this chunk    */
+	char                 *data; /* memory for their pages  */
+	uint32_t                 n; /* # of frames             */
+} beet_rider_chunk_t;
+
+/* ------------------------------------------------------------------------
+ * Eviction queue (intrusive list of frames)
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_rider_frame_t *head; /* most recently added/used */
+	beet_rider_frame_t *tail; /* next candidate           */
+	uint32_t           count; /* # of frames in the queue */
+} beet_rider_queue_t;
+
+/* ------------------------------------------------------------------------
+ * Ghost set: pageids recently evicted from the 2Q 'in' queue
+ * (hash set with FIFO replacement)
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_pageid_t *slots; /* hash set                 */
+	uint32_t      nslots; /* size of hash set (2^n)   */
+	beet_pageid_t  *fifo; /* ring buffer (insertion)  */
+	uint32_t         max; /* capacity of ring buffer  */
+	uint32_t       first; /* oldest entry in ring     */
+	uint32_t       count; /* # of entries             */
+} beet_rider_ghosts_t;
+
+/* ------------------------------------------------------------------------
+ * Page pinned by the log that was moved out of the cache
+ * to make room (see beet_rider_setWal);
+ * its slot in the spill file is its position in 'spilled'
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_pageid_t pageid; /* page or BEET_PAGE_NULL (free) */
+	uint64_t      walcut; /* group of the last image       */
+	char         walpend; /* change not yet in a group     */
+} beet_rider_spilled_t;
+
+/* ------------------------------------------------------------------------
+ * Cache shard:
+ * pages are distributed over the shards by pageid;
+ * each shard has its own latch, lookup table and eviction queues.
+ * Threads that need a frame while all frames of the shard are pinned
+ * wait on 'room' until a page is released.
+ * The lookup table is an open-addressing hash table (linear probing)
+ * mapping pageids to frames. Frames and their page memory
+ * are preallocated in chunks (one chunk of 'max' frames
+ * if the shard is limited); they never move in memory
+ * and are recycled on eviction without going through malloc/free.
+ * Riders drawing from a buffer pool are the exception:
+ * their frames get page memory on demand and
+ * give it back to the pool when the page is evicted
+ * to make room for another rider ('empty' frames).
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_latch_t          latch; /* in-memory latch             */
+	beet_rider_frame_t  **slots; /* hash table                  */
+	uint32_t             nslots; /* size of hash table (2^n)    */
+	uint32_t              count; /* # of pages in the shard     */
+	beet_rider_queue_t     main; /* LRU, CLOCK ring or 2Q 'Am'  */
+	beet_rider_queue_t       in; /* 2Q 'A1in' (FIFO)            */
+	beet_rider_ghosts_t  ghosts; /* 2Q 'A1out'                  */
+	beet_rider_frame_t    *hand; /* CLOCK hand                  */
+	beet_rider_frame_t    *free; /* unused frames               */
+	beet_rider_frame_t   *empty; /* unused frames without memory */
+	beet_rider_chunk_t  *chunks; /* frame chunks                */
+	uint32_t            nchunks; /* # of frame chunks           */
+	uint32_t                max; /* max of pages in the shard   */
+	beet_cond_t            room; /* signalled on unpinning      */
+	uint32_t            waiting; /* # of threads waiting        */
+	uint32_t            walpins; /* # of pages pinned by the log */
+	beet_rider_spilled_t *spilled; /* slots in the spill file  */
+	uint32_t           nspilled; /* # of slots                  */
+	uint32_t           mspilled; /* capacity of spilled         */
+	uint32_t             spills; /* # of pages spilled          */
+	uint64_t              waits; /* # of waits for room         */
+	uint64_t             waited; /* time waited for room (us)   */
+} beet_rider_shard_t;
+
 /* ------------------------------------------------------------------------
  * "Smart" file access using a page cache
  * ------------------------------------------------------------------------
  */
 typedef struct {
-	beet_latch_t   latch; /* in-memory latch           */
-	ts_algo_tree_t *tree; /* page cache                */
-	ts_algo_list_t queue; /* page cache                */
+	beet_latch_t   latch; /* protects file size        */
+	beet_rider_shard_t *shards; /* page cache          */
+	uint32_t     nshards; /* number of shards          */
+	uint32_t      policy; /* eviction policy           */
+	uint32_t     timeout; /* max wait for room (ms)    */
+	beet_pool_t     pool; /* shared buffer pool        */
 	char           *base; /* base path                 */
 	char           *name; /* file name                 */
 	FILE           *file; /* the file                  */
 	off_t            fsz; /* current file size         */
+	off_t           fcap; /* preallocated file size    */
+	uint32_t    prealloc; /* pages added at once       */
+	beet_pageid_t maxpid; /* new pageids stay below    */
+	beet_aio_t       aio; /* batched page I/O          */
+	beet_pageid_t   wblo; /* first page to write back  */
+	beet_pageid_t   wbhi; /* last page to write back+1 */
 	uint32_t      pagesz; /* size of one page          */
 	uint32_t          sz; /* # of pages in the cache   */
 	uint32_t         max; /* max of pages in the cache */
+	beet_pageid_t *freed; /* free-list                 */
+	uint32_t      nfreed; /* # of pages in free-list   */
+	uint32_t      mfreed; /* capacity of free-list     */
+	uint32_t      nsaved; /* # of pages saved in flist */
+	FILE          *flist; /* the free-list file        */
+	FILE          *fused; /* the used-size file        */
+	char          mapped; /* read-only over a mapping  */
+	char            *map; /* the mapping               */
+	uint64_t      npages; /* # of pages in the mapping */
+	beet_page_t **mpages; /* pages created on demand   */
+	struct beet_wal_st *wal; /* log of changes or NULL */
+	uint32_t       walid; /* this file in the log      */
+	FILE          *spill; /* log-pinned pages          */
 } beet_rider_t;
 
 /* ------------------------------------------------------------------------
  * Initialise the rider
  * ------------------------------------------------------------------------
+ * The number of shards is derived from 'max':
+ * each shard holds at least BEET_RIDER_MINSHARD pages,
+ * there are at most BEET_RIDER_MAXSHARDS shards;
+ * an unlimited cache (max = 0) uses the maximum.
+ * ------------------------------------------------------------------------
  */
+#define BEET_RIDER_MAXSHARDS 16
+#define BEET_RIDER_MINSHARD  64
+
 beet_err_t beet_rider_init(beet_rider_t    *rider,
                            char *base, char *name,
                            uint32_t        pagesz,
                            uint32_t          max);
 
+/* ------------------------------------------------------------------------
+ * Initialise the rider over a read-only memory map of the file
+ * ------------------------------------------------------------------------
+ * Pages are read directly from the mapping:
+ * there is no cache, no latching and no locking.
+ * Requests to change the file fail with BEET_ERR_RDONLY.
+ * The file must not change while it is mapped.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_map(beet_rider_t *rider,
+                          char *base, char *name,
+                          uint32_t      pagesz);
+
 /* ------------------------------------------------------------------------
  * Destroy the rider
  * ------------------------------------------------------------------------
  */
 void beet_rider_destroy(beet_rider_t *rider);
 
+/* ------------------------------------------------------------------------
+ * Set the eviction policy (BEET_EVICT_*, see config.h; default: LRU).
+ * Must be called before the first page is requested.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setPolicy(beet_rider_t *rider, uint32_t policy);
+
+/* ------------------------------------------------------------------------
+ * Draw page memory from a shared buffer pool instead of
+ * limiting the number of pages. The rider must have been initialised
+ * with max = 0 and the pool must be set before the first page
+ * is requested. The pool must outlive the rider.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setPool(beet_rider_t *rider, beet_pool_t pool);
+
+/* ------------------------------------------------------------------------
+ * Set the time (in milliseconds) a request waits for a frame
+ * when all frames of the cache are in use (0: wait forever, the default).
+ * When the timeout expires, the request fails with BEET_ERR_NORSC.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setTimeout(beet_rider_t *rider, uint32_t timeout);
+
+/* ------------------------------------------------------------------------
+ * Set the number of pages the file grows by at once
+ * (default: BEET_RIDER_PREALLOC). New pages within the preallocated
+ * region are handed out without I/O. With 0, the file grows
+ * page by page and each new page is written immediately.
+ * Preallocated pages not used when the rider is destroyed
+ * (or, after a crash, when it is initialised again)
+ * are cut off from the file.
+ * If the file cannot be preallocated, preallocation is
+ * switched off for the rider.
+ * ------------------------------------------------------------------------
+ */
+#define BEET_RIDER_PREALLOC 64
+
+beet_err_t beet_rider_setPrealloc(beet_rider_t *rider, uint32_t pages);
+
+/* ------------------------------------------------------------------------
+ * Set the size of pageids on disk (4 or 8 bytes, default: 8).
+ * With 4 bytes, the top bit marks leaves and all bits set mean NULL,
+ * so new pages must get ids below 2^31-1; when the file
+ * has reached this size, beet_rider_alloc fails with BEET_ERR_TOOBIG.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setIdSize(beet_rider_t *rider, uint32_t pidsz);
+
+/* ------------------------------------------------------------------------
+ * Read and write pages in batches of up to 'depth' pages
+ * submitted at once (io_uring, see aio.h) when flushing
+ * and prefetching (see beet_rider_prefetch).
+ * The page memory of limited riders without pool
+ * is registered with the ring.
+ * With 0 (the default), pages are read and written one by one.
+ * Must be called before the first page is requested.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setAio(beet_rider_t *rider, uint32_t depth);
+
+/* ------------------------------------------------------------------------
+ * Bypass the OS page cache (O_DIRECT), so that pages are cached
+ * only once (by the rider). The page size must be a multiple of
+ * the alignment the file system requires for direct I/O
+ * (BEET_ERR_BADSIZE otherwise); file systems without direct I/O
+ * yield BEET_ERR_NOTSUPP.
+ * Must be called before the first page is requested.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setDirect(beet_rider_t *rider);
+
+/* ------------------------------------------------------------------------
+ * Number of times requests had to wait for a frame
+ * and the total time they waited (in microseconds)
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_waitStats(beet_rider_t *rider,
+                                uint64_t     *waits,
+                                uint64_t    *waited);
+
 /* ------------------------------------------------------------------------
  * Get the page identified by 'pageid' for reading
  * ------------------------------------------------------------------------
@@ -82,10 +311,30 @@ beet_err_t beet_rider_getWrite(beet_rider_t *rider,
 /* ------------------------------------------------------------------------
  * Allocate a new page
  * ------------------------------------------------------------------------
+ * Pages in the free-list are reused before the file grows.
+ * The page is returned zeroed and locked for writing.
+ * When a page saved in the free-list file is reused,
+ * it is removed from the file before it is returned,
+ * so that the file never lists pages in use.
+ * ------------------------------------------------------------------------
  */
 beet_err_t beet_rider_alloc(beet_rider_t  *rider,
                             beet_page_t  **page);
 
+/* ------------------------------------------------------------------------
+ * Give the page identified by 'pageid' back to the free-list
+ * ------------------------------------------------------------------------
+ * The caller must make sure that nobody refers to the page anymore
+ * (a thread still holding the page delays its reuse,
+ *  but cannot prevent it).
+ * The page is added to the free-list file on the next
+ * flush with 'wait' or when the rider is destroyed,
+ * i.e. after the pages that referred to it have been written.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_free(beet_rider_t *rider,
+                           beet_pageid_t pageid);
+
 /* ------------------------------------------------------------------------
  * Release the page identified by 'pageid'
  * and obtained before for reading 
@@ -103,9 +352,121 @@ beet_err_t beet_rider_releaseWrite(beet_rider_t *rider,
                                    beet_page_t  *page);
 
 /* ------------------------------------------------------------------------
- * Store page to disk 
+ * Store page to disk
+ * ------------------------------------------------------------------------
+ * The page is only marked as dirty;
+ * it is written to disk when it is evicted from the cache,
+ * when the rider is flushed or when it is destroyed.
+ * The caller must hold the write lock on the page.
  * ------------------------------------------------------------------------
  */
 beet_err_t beet_rider_store(beet_rider_t *rider,
                             beet_page_t  *page);
+
+/* ------------------------------------------------------------------------
+ * Load the pages in 'pageids' that are not cached
+ * with one batch (see beet_rider_setAio), so that they are found
+ * when they are requested afterwards. This is only a hint:
+ * without batched I/O, nothing is done, and pages that do not fit
+ * into the cache without waiting are not loaded.
+ * Threads requesting one of the pages meanwhile wait until it is loaded.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_prefetch(beet_rider_t  *rider,
+                               beet_pageid_t *pageids,
+                               uint32_t             n);
+
+/* ------------------------------------------------------------------------
+ * Optimistic access: find the cached page identified by 'pageid'
+ * without locking or pinning it. The page may change or
+ * even be evicted at any time; whatever is read from it is only
+ * valid if beet_rider_validate with 'version' succeeds afterwards.
+ * Returns
+ * - BEET_ERR_UNKNKEY if the page is not in the cache,
+ * - BEET_OSERR_BUSY if the page is being changed and
+ * - BEET_ERR_NOTSUPP if the cache is unlimited or pooled.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_peek(beet_rider_t  *rider,
+                           beet_pageid_t pageid,
+                           beet_page_t  **page,
+                           uint32_t    *version);
+
+/* ------------------------------------------------------------------------
+ * Check that the page obtained with beet_rider_peek
+ * is still 'pageid' and has not changed since (returns 1 if so)
+ * ------------------------------------------------------------------------
+ */
+char beet_rider_validate(beet_page_t  *page,
+                         beet_pageid_t pageid,
+                         uint32_t     version);
+
+/* ------------------------------------------------------------------------
+ * Write all dirty pages to disk
+ * ------------------------------------------------------------------------
+ * If 'wait' is 0, pages currently locked for writing are skipped
+ * (they will be written on the next flush), otherwise
+ * the flush waits until it can read-lock the page
+ * and, afterwards, saves the free-list.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_flush(beet_rider_t *rider, char wait);
+
+/* ------------------------------------------------------------------------
+ * Log changed pages in 'wal' as file 'walid' (see wal.h).
+ * A page changed by a writer stays pinned (it is neither evicted
+ * nor written) until beet_rider_logged is called for the group
+ * that holds its last image.
+ * When there is no other way to make room, such pages are
+ * moved to a spill file (name.spill, removed as soon as it is created)
+ * and are written to the data file only once they are logged.
+ * Must be called before the first page is changed.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_setWal(beet_rider_t      *rider,
+                             struct beet_wal_st *wal,
+                             uint32_t         walid);
+
+/* ------------------------------------------------------------------------
+ * Copy the page 'pageid' changed since the last group
+ * into 'buf' as part of group 'group'.
+ * No writer must hold the page.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_image(beet_rider_t *rider,
+                            beet_pageid_t pageid,
+                            uint64_t       group,
+                            char           *buf);
+
+/* ------------------------------------------------------------------------
+ * Group 'group' is synced; the page is released
+ * unless it was changed again in the meantime.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_logged(beet_rider_t *rider,
+                             beet_pageid_t pageid,
+                             uint64_t       group);
+
+/* ------------------------------------------------------------------------
+ * Sync the file to disk (fdatasync)
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_sync(beet_rider_t *rider);
+
+/* ------------------------------------------------------------------------
+ * Make sure that the used size recorded for the file 'name'
+ * in 'base' covers at least 'pages' pages
+ * (for pages written to the file without rider, e.g. on recovery)
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_cover(char *base, char *name, uint64_t pages);
+
+/* ------------------------------------------------------------------------
+ * Start writeback of the pages written by flush
+ * since the last call without waiting for it
+ * (sync_file_range over the range of these pages on Linux,
+ * nothing elsewhere)
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_rider_writeback(beet_rider_t *rider);
 #endif
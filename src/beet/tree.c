@@ -5,6 +5,7 @@
  * ========================================================================
  */
 #include <beet/tree.h>
+#include <beet/keytype.h>
 
 #include <stdlib.h>
 #include <string.h>
@@ -68,9 +69,11 @@
  */
 #define STOREROOT(root) \
 	if (tree->roof != NULL) { \
+		char rb[sizeof(beet_pageid_t)]; \
+		beet_page_putid(rb, *(root), tree->pidsz); \
 		if (fseek(tree->roof, 0, SEEK_SET) !=0) \
 			return BEET_OSERR_SEEK; \
-		if (fwrite(root, sizeof(beet_pageid_t), 1, tree->roof) != 1) \
+		if (fwrite(rb, tree->pidsz, 1, tree->roof) != 1) \
 			return BEET_OSERR_SEEK; \
 		if (fflush(tree->roof) != 0) return BEET_OSERR_FLUSH; \
 	}
@@ -94,6 +97,21 @@ void beet_tree_destroy(beet_tree_t *tree) {
 		tree->rsc = NULL;
 	}
 	beet_lock_destroy(&tree->rlock);
+	for(int i=0; i<2; i++) {
+		if (tree->limbo[i].pages == NULL) continue;
+		for(uint32_t k=0; k<tree->limbo[i].n; k++) {
+			beet_pageid_t pge = tree->limbo[i].pages[k];
+			if (pge & BEET_PAGE_LEAF) {
+				beet_rider_free(tree->lfs, pge ^ BEET_PAGE_LEAF);
+			} else {
+				beet_rider_free(tree->nolfs, pge);
+			}
+		}
+		free(tree->limbo[i].pages);
+		tree->limbo[i].pages = NULL;
+		tree->limbo[i].n = 0;
+	}
+	beet_latch_destroy(&tree->elatch);
 	if (tree->ins != NULL) {
 		tree->ins->cleaner(tree->ins);
 		free(tree->ins); tree->ins = NULL;
@@ -108,6 +126,26 @@ void beet_tree_destroy(beet_tree_t *tree) {
 	}
 }
 
+/* ------------------------------------------------------------------------
+ * Write all dirty nodes to disk
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_flush(beet_tree_t *tree, char wait) {
+	beet_err_t err;
+
+	TREENULL();
+
+	if (tree->lfs != NULL) {
+		err = beet_rider_flush(tree->lfs, wait);
+		if (err != BEET_OK) return err;
+	}
+	if (tree->nolfs != NULL) {
+		err = beet_rider_flush(tree->nolfs, wait);
+		if (err != BEET_OK) return err;
+	}
+	return BEET_OK;
+}
+
 /* ------------------------------------------------------------------------
  * Helper: check whether pageid is leaf
  * ------------------------------------------------------------------------
@@ -133,6 +171,32 @@ static inline beet_pageid_t fromLeaf(beet_pageid_t pge) {
 	return (pge ^ BEET_PAGE_LEAF);
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: read the root pointer
+ * ------------------------------------------------------------------------
+ * The root of a standalone tree changes while other threads
+ * are reading it; the root of an embedded tree is protected
+ * by the lock on the leaf of the host tree in which it is stored.
+ * There, it is stored like any pageid on disk (pidsz bytes).
+ * ------------------------------------------------------------------------
+ */
+static inline beet_pageid_t getRoot(beet_tree_t   *tree,
+                                    beet_pageid_t *root) {
+	if (tree->roof == NULL) return beet_page_getid(root, tree->pidsz);
+	return __atomic_load_n(root, __ATOMIC_ACQUIRE);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: set the root pointer
+ * ------------------------------------------------------------------------
+ */
+static inline void setRoot(beet_tree_t   *tree,
+                           beet_pageid_t *root,
+                           beet_pageid_t   pge) {
+	if (tree->roof == NULL) beet_page_putid(root, pge, tree->pidsz);
+	else __atomic_store_n(root, pge, __ATOMIC_RELEASE);
+}
+
 /* ------------------------------------------------------------------------
  * Helper: allocate leaf node
  * ------------------------------------------------------------------------
@@ -142,24 +206,21 @@ static inline beet_err_t newLeaf(beet_tree_t  *tree,
 	beet_err_t err;
 	beet_page_t *page;
 
-	for(;;) {
-		err = beet_rider_alloc(tree->lfs, &page);
-		if (err == BEET_OK) break;
-		if (err == BEET_ERR_NORSC) continue;
-		if (err != BEET_OK) return err;
-	}
+	/* waits if the cache is full of pages in use */
+	err = beet_rider_alloc(tree->lfs, &page);
+	if (err != BEET_OK) return err;
 
 	*node = calloc(1, sizeof(beet_node_t));
 	if (*node == NULL) return BEET_ERR_NOMEM;
 
-	beet_node_init(*node, page, tree->lsize, tree->ksize, 1);
+	beet_node_init(*node, page, &tree->llay, 1);
 
 	(*node)->next = BEET_PAGE_NULL;
 	(*node)->prev = BEET_PAGE_NULL;
 	(*node)->mode = WRITE;
 
 	if (tree->ins != NULL) {
-		tree->ins->ninit(tree->ins, tree->lsize, (*node)->kids);
+		tree->ins->ninit(tree->ins->rsc, tree->lsize, (*node)->kids);
 	}
 	return BEET_OK;
 }
@@ -173,18 +234,16 @@ static inline beet_err_t newNonLeaf(beet_tree_t  *tree,
 	beet_err_t err;
 	beet_page_t *page;
 
-	for(;;) {
-		err = beet_rider_alloc(tree->nolfs, &page);
-		if (err == BEET_OK) break;
-		if (err == BEET_ERR_NORSC) continue;
-		if (err != BEET_OK) return err;
-	}
+	/* waits if the cache is full of pages in use */
+	err = beet_rider_alloc(tree->nolfs, &page);
+	if (err != BEET_OK) return err;
 
 	*node = calloc(1, sizeof(beet_node_t));
 	if (*node == NULL) return BEET_ERR_NOMEM;
 
-	beet_node_init(*node, page, tree->nsize, tree->ksize, 0);
+	beet_node_init(*node, page, &tree->nlay, 0);
 
+	(*node)->next = BEET_PAGE_NULL;
 	(*node)->mode = WRITE;
 
 	return BEET_OK;
@@ -203,43 +262,39 @@ static inline beet_err_t getNode(beet_tree_t  *tree,
 	beet_err_t    err;
 	beet_rider_t  *rd;
 	char         leaf;
-	uint32_t       sz;
 	beet_pageid_t pid;
 
 	if (isLeaf(pge)) {
 		rd = tree->lfs;
 		leaf = 1;
-		sz = tree->lsize;
 		pid = fromLeaf(pge);
 	} else {
 		rd = tree->nolfs;
 		leaf = 0;
-		sz = tree->nsize;
 		pid = pge;
 	}
 
 	*node = calloc(1,sizeof(beet_node_t));
 	if (*node == NULL) return BEET_ERR_NOMEM;
 
-	for(;;) {
-		if (mode == READ) {
-			err = beet_rider_getRead(rd, pid, &page);
-		} else {
-			err = beet_rider_getWrite(rd, pid, &page);
-		}
-		if (err == BEET_OK && page == NULL) {
-			fprintf(stderr, "getting page %u: %p\n", pid, page);
-			return BEET_ERR_BADPAGE;
-		}
-		if (err == BEET_OK) break;
-		if (err == BEET_ERR_NORSC) continue;
-		if (err != BEET_OK) {
-			free(*node); *node = NULL;
-			return err;
-		}
+	/* waits if the cache is full of pages in use */
+	if (mode == READ) {
+		err = beet_rider_getRead(rd, pid, &page);
+	} else {
+		err = beet_rider_getWrite(rd, pid, &page);
+	}
+	if (err != BEET_OK) {
+		free(*node); *node = NULL;
+		return err;
+	}
+	if (page == NULL) {
+		fprintf(stderr, "getting page %llu: %p\n",
+		                (unsigned long long)pid, (void*)page);
+		free(*node); *node = NULL;
+		return BEET_ERR_BADPAGE;
 	}
 
-	beet_node_init(*node, page, sz, tree->ksize, leaf);
+	beet_node_init(*node, page, leaf ? &tree->llay : &tree->nlay, leaf);
 
 	(*node)->mode = mode;
 
@@ -301,7 +356,7 @@ beet_err_t beet_tree_makeRoot(beet_tree_t *tree, beet_pageid_t *root) {
 	err = newLeaf(tree, &node);
 	if (err != BEET_OK) return err;
 
-	*root = toLeaf(node->self);
+	setRoot(tree, root, toLeaf(node->self));
 
 	STOREROOT(root);
 
@@ -351,6 +406,19 @@ beet_err_t beet_tree_init(beet_tree_t    *tree,
 	tree->rdest  = rdest;
 	tree->ins    = ins;
 	tree->rsc    = NULL;
+	tree->epoch  = 0;
+	tree->retired = 0;
+	memset(tree->active, 0, sizeof(tree->active));
+	memset(tree->limbo, 0, sizeof(tree->limbo));
+
+	beet_tree_setLayout(tree, 0, BEET_NODE_PTRSZ);
+
+	/* built-in byte strings are compared with the key size */
+	if (cmp == beet_keytype_cmpBytes) {
+		tree->rinit = NULL;
+		tree->rdest = NULL;
+		tree->rsc   = &tree->ksize;
+	}
 
 	/* user-defined resource */
 	if (tree->rinit != NULL) {
@@ -362,16 +430,50 @@ beet_err_t beet_tree_init(beet_tree_t    *tree,
 	err = beet_lock_init(&tree->rlock);
 	if (err != BEET_OK) return err;
 
+	/* init epoch latch */
+	err = beet_latch_init(&tree->elatch);
+	if (err != BEET_OK) return err;
+
 	return BEET_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Set the node layout and the size of pageids
+ * ------------------------------------------------------------------------
+ */
+void beet_tree_setLayout(beet_tree_t *tree, char aligned, uint32_t pidsz) {
+	tree->pidsz = pidsz;
+	beet_node_layout(&tree->llay, tree->lsize, tree->ksize,
+	                 tree->dsize, pidsz, 1, aligned);
+	beet_node_layout(&tree->nlay, tree->nsize, tree->ksize,
+	                 pidsz, pidsz, 0, aligned);
+}
+
+/* ------------------------------------------------------------------------
+ * Use the node layout of format version 1
+ * ------------------------------------------------------------------------
+ */
+void beet_tree_setUnlinked(beet_tree_t *tree) {
+	tree->pidsz = BEET_NODE_PTRSZ;
+	beet_node_unlinked(&tree->llay, tree->lsize, tree->ksize,
+	                                tree->dsize, 1);
+	beet_node_unlinked(&tree->nlay, tree->nsize, tree->ksize,
+	                                BEET_NODE_PTRSZ, 0);
+}
+
 /* ------------------------------------------------------------------------
  * Helper: set previous of node.next to node
  * ------------------------------------------------------------------------
+ * Empty leaves left behind by delete (see rebalance) are passed by;
+ * the first leaf after them must point to node as well,
+ * otherwise it would keep pointing to a leaf
+ * that may be merged away later.
+ * ------------------------------------------------------------------------
  */
 static inline beet_err_t setPrev(beet_tree_t *tree,
                                  beet_node_t *node) {
 	beet_node_t *node2;
+	beet_node_t *node3;
 	beet_err_t     err;
 
 	/* if there is no next, we're done */
@@ -380,12 +482,25 @@ static inline beet_err_t setPrev(beet_tree_t *tree,
 	/* load next */
 	err = getNode(tree, toLeaf(node->next), WRITE, &node2);
 	if (err != BEET_OK) return err;
-	
-	/* set previous of node.next to node */
-	node2->prev = node->self;
 
-	/* store and release */
-	err = storeNode(tree, node2);
+	for(;;) {
+		/* set previous of node.next to node */
+		node2->prev = node->self;
+
+		err = storeNode(tree, node2);
+		if (err != BEET_OK) break;
+
+		if (node2->size > 0 || node2->next == BEET_PAGE_NULL) break;
+
+		/* pass by the empty leaf (from left to right) */
+		err = getNode(tree, toLeaf(node2->next), WRITE, &node3);
+		if (err != BEET_OK) break;
+
+		err = releaseNode(tree, node2); free(node2);
+		node2 = node3;
+		if (err != BEET_OK) break;
+	}
+	/* release */
 	if (err != BEET_OK) {
 		releaseNode(tree, node2); free(node2);
 		return err;
@@ -482,6 +597,11 @@ static inline beet_err_t split(beet_tree_t *tree,
 
 	memcpy((*trg)->keys, srk, sz);
 
+	/* trg goes to the right of src and
+	 * inherits its high key and right-link */
+	memcpy((*trg)->high, src->high, tree->ksize);
+	(*trg)->level = src->level;
+
 	/* same logic as above, but, in a leaf,
  	 * we need to consider next and prev */
 	if (src->leaf) {
@@ -502,7 +622,7 @@ static inline beet_err_t split(beet_tree_t *tree,
 		}
 
 		// copy control block
-		splitctrl(src->ctrl, (*trg)->ctrl, BEET_NODE_CTRLSZ(tree->nsize), src->size/2);
+		splitctrl(src->ctrl, (*trg)->ctrl, BEET_NODE_CTRLSZ(tree->lsize), src->size/2);
 
 		dsz = tree->dsize;
 		if (dsz > 0) {
@@ -511,8 +631,11 @@ static inline beet_err_t split(beet_tree_t *tree,
 			srk = src->kids + off;
 		}
 	} else {
+		(*trg)->next = src->next;
+		src->next  = (*trg)->self;
+
 		/* note that we leave out one of the kids */
-		dsz = sizeof(beet_pageid_t);
+		dsz = tree->pidsz;
 		nsz = src->size+1;   
 		sz  = nsz/2 * dsz;    
 		off = nsz * dsz - sz; 
@@ -522,368 +645,617 @@ static inline beet_err_t split(beet_tree_t *tree,
 	if (dsz > 0) memcpy((*trg)->kids, srk, sz);
 	src->size /= 2;
 
+	/* the new high key of src is the splitter,
+	 * i.e. the first key in trg (leaf) or
+	 * the key right after the remaining ones (nonleaf) */
+	memcpy(src->high, src->leaf ? (*trg)->keys :
+	                              src->keys + src->size * tree->ksize,
+	                              tree->ksize);
 	return BEET_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Helper: add key to predecessor (predeclaration)
+ * Max height of the tree
+ * (pageids have at most 63 bits and each level has at least half
+ *  as many nodes as the level below)
  * ------------------------------------------------------------------------
  */
-static beet_err_t add2mom(beet_tree_t   *tree,
-                          beet_pageid_t *root,
-                          beet_node_t  *node1,
-                          beet_node_t  *node2,
-                          const void     *key,
-                          char          *lock,
-                   ts_algo_list_node_t *nodes);
+#define MAXHEIGHT 64
 
 /* ------------------------------------------------------------------------
- * Helper: insert (key,data) into node
+ * Path of nonleaves from the root downwards
  * ------------------------------------------------------------------------
  */
-static beet_err_t insert(beet_tree_t   *tree,
-                         beet_pageid_t *root,
-                         beet_node_t   *node,
-                         const void     *key,
-                         const void    *data,
-                         char           upd,
-                         char          *lock,
-                 ts_algo_list_node_t  *nodes) 
-{
-	beet_node_t *node2=NULL;
-	void *s;
-	beet_err_t err;
-	char     wrote;
-	uint32_t nsize;
+typedef struct {
+	beet_pageid_t nodes[MAXHEIGHT]; /* nodes we descended from */
+	int           n;                /* number of nodes          */
+} path_t;
+
+/* ------------------------------------------------------------------------
+ * Epochs
+ * ------------------------------------------------------------------------
+ * Threads take pageids from nodes they release before
+ * they lock the node the pageid refers to (descending,
+ * following right-links). A page removed from the tree
+ * must not be reused for another node while threads
+ * may still be on their way to it. Removed pages are therefore
+ * retired to the limbo of the current epoch and given back
+ * to the rider only when all threads that entered
+ * in the epoch before have left; then the epoch advances.
+ * Threads that hold a node while moving to its neighbour
+ * (iterators) do not need to enter.
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t enter(beet_tree_t *tree) {
+	uint32_t e;
 
-	nsize = node->leaf ? tree->lsize : tree->nsize;
+	for(;;) {
+		e = __atomic_load_n(&tree->epoch, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&tree->active[e&1], 1, __ATOMIC_SEQ_CST);
 
-	err = beet_node_add(node, nsize,
-			          tree->ksize,
-			          tree->dsize,
-			          key, data,
-			          tree->cmp,
-	                          tree->rsc,
-			          tree->ins,
-                                  upd, &wrote);
-	if (err != BEET_OK) return err;
-	if (wrote) {
-		err = storeNode(tree, node);
-		if (err != BEET_OK) return err;
+		/* the epoch may have advanced in the meantime */
+		if (__atomic_load_n(&tree->epoch, __ATOMIC_SEQ_CST) == e) break;
+		__atomic_sub_fetch(&tree->active[e&1], 1, __ATOMIC_SEQ_CST);
 	}
+	return e;
+}
 
-	/* we need to split */
-	if ((node->leaf && node->size == tree->lsize) ||
-	   (!node->leaf && node->size == tree->nsize)) {
-
-		err = split(tree, node, &node2);
-		if (err != BEET_OK) return err;
+/* ------------------------------------------------------------------------
+ * Helper: give the pages retired in the last epoch back
+ *         and advance the epoch if nobody is left in it
+ * ------------------------------------------------------------------------
+ */
+static void reclaim(beet_tree_t *tree) {
+	beet_tree_limbo_t *old;
+	beet_pageid_t pge;
+	uint32_t e;
+
+	/* somebody else is doing it */
+	if (beet_latch_trylock(&tree->elatch) != BEET_OK) return;
+
+	e = __atomic_load_n(&tree->epoch, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&tree->active[(e+1)&1], __ATOMIC_SEQ_CST) == 0) {
+		old = tree->limbo+((e+1)&1);
+		for(uint32_t i=0; i<old->n; i++) {
+			pge = old->pages[i];
+			if (isLeaf(pge)) {
+				beet_rider_free(tree->lfs, fromLeaf(pge));
+			} else {
+				beet_rider_free(tree->nolfs, pge);
+			}
+		}
+		__atomic_sub_fetch(&tree->retired, old->n, __ATOMIC_SEQ_CST);
+		old->n = 0;
+		__atomic_store_n(&tree->epoch, e+1, __ATOMIC_SEQ_CST);
+	}
+	beet_latch_unlock(&tree->elatch);
+}
 
-		/* get splitter */
-		s = node->leaf ? node2->keys :
-		                 node->keys  +
-		                 node->size * tree->ksize;
+/* ------------------------------------------------------------------------
+ * Helper: leave the epoch
+ * ------------------------------------------------------------------------
+ */
+static inline void leave(beet_tree_t *tree, uint32_t e) {
+	__atomic_sub_fetch(&tree->active[e&1], 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&tree->retired, __ATOMIC_SEQ_CST) > 0) {
+		reclaim(tree);
+	}
+}
 
-		/* add the splitter to parent node */
-		err = add2mom(tree, root, node, node2, s, lock, nodes);
-		if (err != BEET_OK) {
-			releaseNode(tree, node2); free(node2);
-			return err;
-		}
+/* ------------------------------------------------------------------------
+ * Helper: retire a page removed from the tree
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t retire(beet_tree_t *tree, beet_pageid_t pge) {
+	beet_tree_limbo_t *cur;
+	beet_pageid_t *tmp;
+	beet_err_t err;
+	uint32_t m;
 
-		/* store new node */
-		err = storeNode(tree, node2);
-		if (err != BEET_OK) {
-			releaseNode(tree, node2); free(node2);
-			return err;
-		}
+	err = beet_latch_lock(&tree->elatch);
+	if (err != BEET_OK) return err;
 
-		/* release new node */
-		err = releaseNode(tree, node2);
-		if (err != BEET_OK) {
-			free(node2); return err;
+	cur = tree->limbo+(tree->epoch&1);
+	if (cur->n == cur->max) {
+		m = cur->max == 0 ? 16 : 2*cur->max;
+		tmp = realloc(cur->pages, m*sizeof(beet_pageid_t));
+		if (tmp == NULL) {
+			beet_latch_unlock(&tree->elatch);
+			return BEET_ERR_NOMEM;
 		}
-		free(node2);
+		cur->pages = tmp;
+		cur->max = m;
 	}
-	return storeNode(tree, node);
+	cur->pages[cur->n++] = pge;
+	__atomic_add_fetch(&tree->retired, 1, __ATOMIC_SEQ_CST);
+
+	return beet_latch_unlock(&tree->elatch);
 }
 
 /* ------------------------------------------------------------------------
- * Helper: add2mom
+ * Helper: move right while key is beyond the high key of node.
+ * On error, *node is still locked and must be released by the caller.
  * ------------------------------------------------------------------------
  */
-static beet_err_t add2mom(beet_tree_t   *tree,
-                          beet_pageid_t *root,
-                          beet_node_t  *node1,
-                          beet_node_t  *node2,
-                          const void     *key,
-                          char          *lock,
-                   ts_algo_list_node_t *nodes)
-{
-	beet_err_t   err;
-	beet_err_t  err2;
-	beet_node_t *mom;
-	beet_pageid_t p1, p2;
+static beet_err_t moveRight(beet_tree_t  *tree,
+                            beet_node_t **node,
+                            const void    *key) {
+	beet_err_t    err;
+	beet_node_t  *nxt;
+	beet_pageid_t pge;
 
-	if (node1->leaf) {
-		p1 = toLeaf(node1->self);
-		p2 = toLeaf(node2->self);
-	} else {
-		p1 = node1->self;
-		p2 = node2->self;
-	}
+	while(beet_node_beyond(*node, tree->ksize, key,
+	                       tree->cmp, tree->rsc)) {
+		pge = (*node)->leaf ? toLeaf((*node)->next) : (*node)->next;
 
-	/* we ran out of nodes. That means
-	 * we reached the top of the tree
-	 * and need a new root node. */
-	if (nodes == NULL) {
-		err = newNonLeaf(tree, &mom);
+		/* left to right: we may hold the left one */
+		err = getNode(tree, pge, (*node)->mode, &nxt);
 		if (err != BEET_OK) return err;
 
-		mom->size = 1;
-
-		memcpy(mom->keys, key, tree->ksize);
-		memcpy(mom->kids, &p1, sizeof(beet_pageid_t));
-		memcpy(mom->kids+sizeof(beet_pageid_t), &p2,
-		                 sizeof(beet_pageid_t));
+		err = releaseNode(tree, *node); free(*node);
+		*node = nxt;
+		if (err != BEET_OK) return err;
+	}
+	return BEET_OK;
+}
 
-		/*
-		fprintf(stderr, "root goes from %u to %u\n", *root, mom->self);
-		*/
+/* ------------------------------------------------------------------------
+ * Helper: descend from pge to the node on level 'stop'
+ * where key belongs (0: the leaf). The target is not locked.
+ * ------------------------------------------------------------------------
+ * Nodes are read one at a time (without lock coupling):
+ * a node we are heading for may have been split
+ * when we get there; then we move right.
+ * The nodes from which we descended are remembered in path
+ * (if not NULL), so we can later add a splitter to them.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t descend(beet_tree_t   *tree,
+                          beet_pageid_t   pge,
+                          const void     *key,
+                          uint32_t       stop,
+                          path_t        *path,
+                          beet_pageid_t  *trg) {
+	beet_err_t   err;
+	beet_node_t *node;
 
-		*root = mom->self;
+	if (path != NULL) path->n = 0;
 
-		STOREROOT(root);
+	while(!isLeaf(pge)) {
+		err = getNode(tree, pge, READ, &node);
+		if (err != BEET_OK) return err;
 
-		err = storeNode(tree, mom);
-		if (err != BEET_OK) {
-			releaseNode(tree, mom); free(mom);
-			return err;
+		/* nonleaves of format version 1 have level 0 */
+		if (stop > 0 && node->level <= stop) {
+			if (node->level < stop) {
+				releaseNode(tree, node); free(node);
+				return BEET_ERR_PANIC;
+			}
+			err = releaseNode(tree, node); free(node);
+			if (err != BEET_OK) return err;
+			break;
 		}
 
-		UNLOCK(WRITE, lock);
+		if (beet_node_beyond(node, tree->ksize, key,
+		                     tree->cmp, tree->rsc)) {
+			pge = node->next;
+		} else {
+			if (path != NULL) {
+				if (path->n >= MAXHEIGHT) {
+					releaseNode(tree, node); free(node);
+					return BEET_ERR_PANIC;
+				}
+				path->nodes[path->n++] = pge;
+			}
+			pge = beet_node_searchPageid(node, tree->ksize,
+			                             key, tree->cmp,
+			                                  tree->rsc);
+		}
+		err = releaseNode(tree, node); free(node);
+		if (err != BEET_OK) return err;
 
-		err = releaseNode(tree, mom); free(mom);
-		return err;
+		if (pge == BEET_PAGE_NULL) return BEET_ERR_BADPAGE;
 	}
-
-	/* otherwise, we insert here:
-	 * into the next node in the list,
-	 * the splitter (key) and the nodeid
-	 * of the new node */
-	return insert(tree, root, nodes->cont, key, &p2, 0, lock, nodes->nxt);
+	*trg = pge;
+	return BEET_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Helper: node is a barrier (it has enough room for at least 1 more node)
+ * Optimistic descents before falling back to locking
  * ------------------------------------------------------------------------
  */
-static inline int isBarrier(beet_tree_t *tree, 
-                            beet_node_t *node) {
-	if (node->leaf) return (node->size + 1 < tree->lsize);
-	return (node->size + 1 < tree->nsize);
-}
+#define OPTIMISTIC 8
 
 /* ------------------------------------------------------------------------
- * Helper: unlock all nodes in opposite order of acquistion
+ * Helper: peek at nonleaf without locking it
  * ------------------------------------------------------------------------
  */
-static inline beet_err_t unlockAll(beet_tree_t *tree, 
-                                   char        *lock,
-                               ts_algo_list_t *nodes) {
-	beet_err_t err;
-	beet_err_t err2;
-	ts_algo_list_node_t *runner, *tmp;
-	beet_node_t *node;
+static inline beet_err_t peekNode(beet_tree_t  *tree,
+                                  beet_pageid_t  pge,
+                                  beet_node_t  *node,
+                                  uint32_t  *version) {
+	beet_page_t *page;
+	beet_err_t    err;
 
-	runner=nodes->head;
-	while(runner != NULL) {
-		node = runner->cont;
-		err = releaseNode(tree, node); free(node);
-		if (err != BEET_OK) return err;
-		tmp = runner->nxt;
-		ts_algo_list_remove(nodes, runner);
-		free(runner); runner = tmp;
-	}
-	UNLOCK(WRITE, lock);
+	err = beet_rider_peek(tree->nolfs, pge, &page, version);
+	if (err != BEET_OK) return err;
+
+	beet_node_init(node, page, &tree->nlay, 0);
+
+	/* the page may be changing under our feet,
+	 * but the size must not lead us out of the page */
+	if (node->size > tree->nsize) node->size = tree->nsize;
 	return BEET_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Helper: findNode where to add a (key,data) pair
+ * Helper: optimistic descent
+ * ------------------------------------------------------------------------
+ * Nonleaves are read without locks and validated against
+ * their version after we have decided where to go next.
+ * Once a node is validated, the pointer we took from it
+ * was correct at some point in time; if the target
+ * has been split since, we move right.
+ * Only the leaf is locked (in 'mode').
+ * Returns BEET_OSERR_BUSY if the descent must be restarted and
+ * BEET_ERR_NOTSUPP or BEET_ERR_UNKNKEY if it cannot be done
+ * optimistically (the root is a leaf, the cache does not support
+ * peeking or a page is not in the cache).
  * ------------------------------------------------------------------------
  */
-static beet_err_t findNode(beet_tree_t     *tree,
-                           beet_node_t      *src,
-                           beet_node_t     **trg,
-                           char             mode,
-                           const void       *key,
-                           char            *lock,
-                           ts_algo_list_t *nodes) {
+static beet_err_t optimisticFind(beet_tree_t   *tree,
+                                 beet_pageid_t *root,
+                                 const void     *key,
+                                 char           mode,
+                                 path_t        *path,
+                                 beet_node_t  **trg) {
 	beet_err_t    err;
-	beet_err_t   err2;
-	beet_pageid_t pge;
+	beet_node_t   src;
+	beet_pageid_t pid, pge;
+	uint32_t      v;
 
-	/* we are at the bottom */
-	if (src->leaf) {
-		*trg = src; return BEET_OK;
-	}
+	pid = getRoot(tree, root);
+	if (isLeaf(pid)) return BEET_ERR_NOTSUPP;
 
-	/* remember node, so we can release it later */
-	if (mode == WRITE) {
-		if (ts_algo_list_insert(nodes, src) != TS_ALGO_OK) {
-			releaseNode(tree, src); free(src);
-			return BEET_ERR_NOMEM;
+	if (path != NULL) path->n = 0;
+
+	for(;;) {
+		char down = 0;
+
+		err = peekNode(tree, pid, &src, &v);
+		if (err != BEET_OK) return err;
+
+		if (beet_node_beyond(&src, tree->ksize, key,
+		                     tree->cmp, tree->rsc)) {
+			pge = src.next;
+		} else {
+			pge = beet_node_searchPageid(&src, tree->ksize,
+			                             key, tree->cmp,
+			                                  tree->rsc);
+			down = 1;
 		}
-	}
+		if (!beet_rider_validate(src.page, pid, v)) return BEET_OSERR_BUSY;
+		if (pge == BEET_PAGE_NULL) return BEET_ERR_BADPAGE;
 
-	/* search pointer to next node */
-	pge = beet_node_searchPageid(src, tree->ksize,
-	                             key, tree->cmp,
-	                                  tree->rsc);
-	if (pge == BEET_PAGE_NULL) {
-		if (mode == READ) {
-			releaseNode(tree, src); free(src);
+		if (down && path != NULL) {
+			if (path->n >= MAXHEIGHT) return BEET_ERR_PANIC;
+			path->nodes[path->n++] = pid;
 		}
-		return BEET_ERR_BADPAGE;
+		if (isLeaf(pge)) break;
+		pid = pge;
 	}
 
-	/* we obtain the next lock,
-	 * before releasing the previous one.
-	 * deadlock detectors (e.g. helgrind)
-	 * do not like this. But we must not
-	 * release the previous lock earlier.
-	 * Otherwise, something may change
-	 * before we actually reach our target */
 	err = getNode(tree, pge, mode, trg);
+	if (err != BEET_OK) return err;
+
+	err = moveRight(tree, trg, key);
 	if (err != BEET_OK) {
-		if (mode == READ) {
-			releaseNode(tree, src); free(src);
-		}
+		releaseNode(tree, *trg); free(*trg);
 		return err;
 	}
-
-	/* in write mode, if we have reached a barrier,
-	 * we can release all nodes we locked so far */
-	if (mode == WRITE && isBarrier(tree, *trg)) {
-		err = unlockAll(tree, lock, nodes);
-		if (err != BEET_OK) {
-			return err;
-		}
-
-	/* in read mode, we release the previous node,
-	 * as soon as we have locked the next one */
-	} else if (mode == READ) {
-		err = releaseNode(tree, src); free(src);
-		if (err != BEET_OK) {
-			UNLOCK(WRITE,lock);
-			releaseNode(tree, *trg);
-			free(*trg);
-			return err;
-		}
-		UNLOCK(READ,lock);
-	}
-	return findNode(tree, *trg, trg, mode, key, lock, nodes);
+	return BEET_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Helper: insert or upsert data into the tree
+ * Helper: get the leaf where key belongs locked in 'mode'
+ * ------------------------------------------------------------------------
+ * We first try to descend optimistically,
+ * i.e. without locking the nonleaves at all.
+ * If that fails repeatedly or is not possible,
+ * we read-lock one node after the other.
  * ------------------------------------------------------------------------
  */
-static inline beet_err_t insorupsert(beet_tree_t   *tree,
-                                     beet_pageid_t *root,
-                                     const void     *key,
-                                     const void    *data,
-                                     char            upd) {
-	beet_err_t err;
-	beet_err_t err2; /* for LOCK and UNLOCK */
-	ts_algo_list_t nodes;
-	beet_node_t *node, *leaf;
-	char lock = 1; /* root poiner is locked */
-
-	TREENULL();
-	ROOTNULL();
-
-	if (key  == NULL) return BEET_ERR_NOKEY;
-
-	ts_algo_list_init(&nodes);
-
-	LOCK(WRITE);
+static beet_err_t locateLeaf(beet_tree_t   *tree,
+                             beet_pageid_t *root,
+                             const void     *key,
+                             char           mode,
+                             path_t        *path,
+                             beet_node_t  **leaf) {
+	beet_err_t    err;
+	beet_pageid_t pge;
 
-	err = getNode(tree, *root, WRITE, &node);
-	if (err != BEET_OK) {
-		UNLOCK(WRITE, &lock);
-		return err;
+	for(int i=0; i<OPTIMISTIC; i++) {
+		err = optimisticFind(tree, root, key, mode, path, leaf);
+		if (err != BEET_OSERR_BUSY) break;
 	}
-
-	err = findNode(tree, node, &leaf, WRITE, key, &lock, &nodes);	
-	if (err != BEET_OK) {
-		unlockAll(tree, &lock, &nodes);
-		return err;
+	switch(err) {
+	case BEET_OK: return BEET_OK;
+	case BEET_OSERR_BUSY:
+	case BEET_ERR_NOTSUPP:
+	case BEET_ERR_UNKNKEY: break;
+	default: return err;
 	}
 
-	err = insert(tree, root, leaf, key, data, upd, &lock, nodes.head);
-	if (err != BEET_OK) {
-		releaseNode(tree, leaf); free(leaf);
-		unlockAll(tree, &lock, &nodes);
-		return err;
-	}
-	
-	err = releaseNode(tree, leaf); free(leaf);
+	err = descend(tree, getRoot(tree, root), key, 0, path, &pge);
+	if (err != BEET_OK) return err;
+
+	err = getNode(tree, pge, mode, leaf);
+	if (err != BEET_OK) return err;
+
+	err = moveRight(tree, leaf, key);
 	if (err != BEET_OK) {
-		unlockAll(tree, &lock, &nodes);
+		releaseNode(tree, *leaf); free(*leaf);
 		return err;
 	}
-
-	err = unlockAll(tree, &lock, &nodes);
-	if (err != BEET_OK) return err;
-	
 	return BEET_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Helper: hide or uncover data in the tree
+ * Helper: get the leaf where key belongs (see above)
+ *         within an epoch
  * ------------------------------------------------------------------------
  */
-static inline beet_err_t hide(beet_tree_t   *tree,
-                              beet_pageid_t *root,
-                              const void     *key,
-                              char           undo) {
-	beet_err_t err = BEET_OK;
-	beet_err_t err2; /* for LOCK and UNLOCK */
-	ts_algo_list_t nodes;
-	beet_node_t *node, *leaf;
-	int32_t slot;
-	char lock = 1; /* root poiner is locked */
+static beet_err_t findLeaf(beet_tree_t   *tree,
+                           beet_pageid_t *root,
+                           const void     *key,
+                           char           mode,
+                           path_t        *path,
+                           beet_node_t  **leaf) {
+	beet_err_t err;
+	uint32_t     e;
 
-	TREENULL();
-	ROOTNULL();
+	e = enter(tree);
+	err = locateLeaf(tree, root, key, mode, path, leaf);
+	leave(tree, e);
+	return err;
+}
 
-	if (key  == NULL) return BEET_ERR_NOKEY;
+/* ------------------------------------------------------------------------
+ * Helper: we have split the topmost node we know of
+ * ------------------------------------------------------------------------
+ * If it is the root, we create a new root.
+ * Otherwise, another thread has created a new root since we started;
+ * we then find the parent of node1 from there.
+ * The caller holds node1 and node2. Other threads hold at most
+ * one node at a time above them, so we cannot deadlock.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t newRoot(beet_tree_t   *tree,
+                          beet_pageid_t *root,
+                          beet_node_t  *node1,
+                          beet_node_t  *node2,
+                          const void     *key,
+                          path_t        *path,
+                          char          *done) {
+	beet_err_t   err;
+	beet_err_t  err2;
+	beet_node_t *mom;
+	beet_pageid_t p1, p2, pge;
+	char lock = 1;
+
+	if (node1->leaf) {
+		p1 = toLeaf(node1->self);
+		p2 = toLeaf(node2->self);
+	} else {
+		p1 = node1->self;
+		p2 = node2->self;
+	}
 
-	ts_algo_list_init(&nodes);
+	*done = 0;
 
 	LOCK(WRITE);
 
-	err = getNode(tree, *root, WRITE, &node);
+	if (getRoot(tree, root) != p1) {
+		UNLOCK(WRITE, &lock);
+
+		err = descend(tree, getRoot(tree, root), key,
+		                    node1->level+1, path, &pge);
+		if (err != BEET_OK) return err;
+		if (isLeaf(pge)) return BEET_ERR_PANIC;
+		if (path->n >= MAXHEIGHT) return BEET_ERR_PANIC;
+
+		path->nodes[path->n++] = pge;
+		return BEET_OK;
+	}
+
+	err = newNonLeaf(tree, &mom);
 	if (err != BEET_OK) {
 		UNLOCK(WRITE, &lock);
 		return err;
 	}
 
-	err = findNode(tree, node, &leaf, WRITE, key, &lock, &nodes);
+	mom->size = 1;
+	mom->level = node1->level+1;
+
+	memcpy(mom->keys, key, tree->ksize);
+	beet_node_setPageid(mom, 0, p1);
+	beet_node_setPageid(mom, 1, p2);
+
+	/*
+	fprintf(stderr, "root goes from %u to %u\n", *root, mom->self);
+	*/
+
+	setRoot(tree, root, mom->self);
+
+	STOREROOT(root);
+
+	err = storeNode(tree, mom);
 	if (err != BEET_OK) {
-		unlockAll(tree, &lock, &nodes);
+		UNLOCK(WRITE, &lock);
+		releaseNode(tree, mom); free(mom);
 		return err;
 	}
 
-	err = unlockAll(tree, &lock, &nodes); // unlock all but the leaf
+	UNLOCK(WRITE, &lock);
+
+	err = releaseNode(tree, mom); free(mom);
+	if (err != BEET_OK) return err;
+
+	*done = 1;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: insert (key,data) into node and
+ * propagate splits upwards along path.
+ * ------------------------------------------------------------------------
+ * Node is locked for writing and released here.
+ * A split node is released before its parent is locked,
+ * so a writer holds only the nodes it is actually modifying
+ * (and never a node below one it is waiting for).
+ * Until the splitter has arrived in the parent,
+ * the new node is reached through the right-link of its left sibling.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t insert(beet_tree_t   *tree,
+                         beet_pageid_t *root,
+                         beet_node_t   *node,
+                         const void     *key,
+                         const void    *data,
+                         char           upd,
+                         path_t        *path) 
+{
+	beet_node_t *node2=NULL;
+	beet_err_t err, err2;
+	beet_pageid_t p2;
+	char     wrote;
+	char     done;
+	uint32_t nsize;
+	char *s=NULL;
+
+	for(;;) {
+		nsize = node->leaf ? tree->lsize : tree->nsize;
+
+		err = beet_node_add(node, nsize,
+		                    tree->ksize,
+		                    tree->dsize,
+		                    key, data,
+		                    tree->cmp,
+		                    tree->rsc,
+		                    tree->ins,
+		                    upd, &wrote);
+		if (err != BEET_OK) break;
+
+		/* node has not changed */
+		if (!wrote) break;
+
+		/* no need to split */
+		if (node->size < nsize) {
+			err = storeNode(tree, node); break;
+		}
+
+		/* the splitter, which is passed up;
+		 * most inserts do not split */
+		if (s == NULL) {
+			s = malloc(tree->ksize);
+			if (s == NULL) {
+				err = BEET_ERR_NOMEM; break;
+			}
+		}
+
+		err = split(tree, node, &node2);
+		if (err != BEET_OK) break;
+
+		/* get splitter */
+		memcpy(s, node->leaf ? node2->keys :
+		                       node->keys  +
+		                       node->size * tree->ksize,
+		                       tree->ksize);
+
+		p2 = node->leaf ? toLeaf(node2->self) : node2->self;
+
+		/* store new node and node */
+		err = storeNode(tree, node2);
+		if (err == BEET_OK) err = storeNode(tree, node);
+		if (err == BEET_OK && path->n == 0) {
+			err = newRoot(tree, root, node, node2, s, path, &done);
+		} else done = 0;
+
+		err2 = releaseNode(tree, node2); free(node2);
+		if (err == BEET_OK) err = err2;
+		if (err != BEET_OK || done) break;
+
+		err = releaseNode(tree, node); free(node); node = NULL;
+		if (err != BEET_OK) break;
+
+		/* add the splitter to the parent,
+		 * which may have been split in the meantime */
+		path->n--;
+		err = getNode(tree, path->nodes[path->n], WRITE, &node);
+		if (err != BEET_OK) break;
+
+		err = moveRight(tree, &node, s);
+		if (err != BEET_OK) break;
+
+		key = s; data = &p2; upd = 0;
+	}
+	if (node != NULL) {
+		err2 = releaseNode(tree, node); free(node);
+		if (err == BEET_OK) err = err2;
+	}
+	if (s != NULL) free(s);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: insert or upsert data into the tree
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t insorupsert(beet_tree_t   *tree,
+                                     beet_pageid_t *root,
+                                     const void     *key,
+                                     const void    *data,
+                                     char            upd) {
+	beet_err_t err;
+	beet_node_t *leaf;
+	path_t path;
+
+	TREENULL();
+	ROOTNULL();
+
+	if (key  == NULL) return BEET_ERR_NOKEY;
+
+	err = findLeaf(tree, root, key, WRITE, &path, &leaf);
+	if (err != BEET_OK) return err;
+
+	return insert(tree, root, leaf, key, data, upd, &path);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: hide or uncover data in the tree
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t hide(beet_tree_t   *tree,
+                              beet_pageid_t *root,
+                              const void     *key,
+                              char           undo) {
+	beet_err_t err = BEET_OK;
+	beet_err_t err2;
+	beet_node_t *leaf;
+	int32_t slot;
+
+	TREENULL();
+	ROOTNULL();
+
+	if (key  == NULL) return BEET_ERR_NOKEY;
+
+	err = findLeaf(tree, root, key, WRITE, NULL, &leaf);
 	if (err != BEET_OK) return err;
 
 	slot = beet_node_search(leaf, tree->ksize,
 	                        key,  tree->cmp,
 	                              tree->rsc);
-	if (slot < 0 || slot > tree->lsize) {
+	if (slot < 0 || slot >= leaf->size) {
 		err = BEET_ERR_KEYNOF; goto unlock;
 	}
 	if (!beet_node_equal(leaf, slot, tree->ksize,
@@ -908,10 +1280,7 @@ static inline beet_err_t hide(beet_tree_t   *tree,
 
 unlock:
 	err2 = releaseNode(tree, leaf); free(leaf);
-	if (err2 != BEET_OK) {
-		unlockAll(tree, &lock, &nodes);
-		return err2;
-	}
+	if (err2 != BEET_OK) return err2;
 
 	return err;
 }
@@ -938,24 +1307,582 @@ beet_err_t beet_tree_upsert(beet_tree_t   *tree,
 	return insorupsert(tree, root, key, data, 1);
 }
 
-/* ------------------------------------------------------------------------
- * Hide a key in the tree without removing data physically
- * ------------------------------------------------------------------------
- */
-beet_err_t beet_tree_hide(beet_tree_t   *tree,
-                          beet_pageid_t *root,
-                          const void     *key) {
-	return hide(tree, root, key, 0);
+/* ------------------------------------------------------------------------
+ * Helper: sort a batch of keys
+ * ------------------------------------------------------------------------
+ * The keys themselves are not moved; the result is the order
+ * in which they are to be inserted (merge sort, which is stable:
+ * of equal keys, the first one comes first).
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t sortBatch(beet_tree_t *tree,
+                            const char  *keys,
+                            uint32_t        n,
+                            uint32_t  **order) {
+	uint32_t *a, *b, *t;
+	uint32_t ksz = tree->ksize;
+
+	a = malloc(n*sizeof(uint32_t));
+	if (a == NULL) return BEET_ERR_NOMEM;
+
+	b = malloc(n*sizeof(uint32_t));
+	if (b == NULL) {
+		free(a); return BEET_ERR_NOMEM;
+	}
+
+	for(uint32_t i=0; i<n; i++) a[i] = i;
+
+	for(uint32_t w=1; w<n; w*=2) {
+		for(uint32_t lo=0; lo<n; lo+=2*w) {
+			uint32_t m = lo+w < n ? lo+w : n;
+			uint32_t h = lo+2*w < n ? lo+2*w : n;
+			uint32_t i=lo, j=m, k=lo;
+
+			while(i<m && j<h) {
+				if (tree->cmp(keys+(size_t)a[j]*ksz,
+				              keys+(size_t)a[i]*ksz,
+				              tree->rsc) == BEET_CMP_LESS) {
+					b[k++] = a[j++];
+				} else b[k++] = a[i++];
+			}
+			while(i<m) b[k++] = a[i++];
+			while(j<h) b[k++] = a[j++];
+		}
+		t = a; a = b; b = t;
+	}
+	free(b);
+	*order = a;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: store (if changed) and release leaf
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t closeLeaf(beet_tree_t *tree,
+                                   beet_node_t *leaf,
+                                   char        dirty) {
+	beet_err_t err = BEET_OK;
+	beet_err_t err2;
+
+	if (dirty) err = storeNode(tree, leaf);
+	err2 = releaseNode(tree, leaf); free(leaf);
+	if (err == BEET_OK) err = err2;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Insert a batch of (key, data) pairs
+ * ------------------------------------------------------------------------
+ * Consecutive keys that fall into the same leaf are added
+ * under one lock and the leaf is stored once.
+ * We descend again only when a key is beyond the high key
+ * of the leaf or when the leaf is about to split
+ * (the split is then done by insert as usual).
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_insertBatch(beet_tree_t   *tree,
+                                 beet_pageid_t *root,
+                                 const char    *keys,
+                                 const char    *data,
+                                 uint32_t    dstride,
+                                 uint32_t          n,
+                                 char         sorted,
+                                 char            upd,
+                                 beet_tree_step_t step,
+                                 void           *arg) {
+	beet_err_t    err = BEET_OK;
+	beet_node_t *leaf = NULL;
+	uint32_t   *order = NULL;
+	const char  *prev = NULL;
+	const char   *key;
+	const char     *d;
+	char  wrote, dirty=0;
+	uint32_t        x;
+	path_t path;
+
+	TREENULL();
+	ROOTNULL();
+
+	if (n == 0) return BEET_OK;
+	if (keys == NULL) return BEET_ERR_NOKEY;
+
+	if (!sorted && n > 1) {
+		err = sortBatch(tree, keys, n, &order);
+		if (err != BEET_OK) return err;
+	}
+
+	for(uint32_t i=0; i<n; i++) {
+		x = order == NULL ? i : order[i];
+		key = keys + (size_t)x*tree->ksize;
+		d = data == NULL ? NULL : data + (size_t)x*dstride;
+
+		/* leave the leaf if the key does not belong here
+		 * (or the batch was not sorted after all) */
+		if (leaf != NULL &&
+		   (tree->cmp(key, prev, tree->rsc) == BEET_CMP_LESS ||
+		    beet_node_beyond(leaf, tree->ksize, key,
+		                     tree->cmp, tree->rsc))) {
+			err = closeLeaf(tree, leaf, dirty);
+			leaf = NULL; dirty = 0;
+			if (err != BEET_OK) break;
+		}
+		prev = key;
+
+		if (leaf == NULL) {
+			if (step != NULL && i > 0) {
+				err = step(arg);
+				if (err != BEET_OK) break;
+			}
+			err = findLeaf(tree, root, key, WRITE, &path, &leaf);
+			if (err != BEET_OK) break;
+		}
+
+		/* the leaf may split: insert takes it over */
+		if (leaf->size >= tree->lsize-1) {
+			if (dirty) err = storeNode(tree, leaf);
+			if (err != BEET_OK) break;
+
+			err = insert(tree, root, leaf, key, d, upd, &path);
+			leaf = NULL; dirty = 0;
+			if (err != BEET_OK) break;
+			continue;
+		}
+
+		err = beet_node_add(leaf, tree->lsize,
+		                    tree->ksize,
+		                    tree->dsize,
+		                    key, d,
+		                    tree->cmp,
+		                    tree->rsc,
+		                    tree->ins,
+		                    upd, &wrote);
+		if (err != BEET_OK) break;
+		if (wrote) dirty = 1;
+	}
+	if (leaf != NULL) {
+		beet_err_t err2 = closeLeaf(tree, leaf, dirty);
+		if (err == BEET_OK) err = err2;
+	}
+	if (order != NULL) free(order);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Hide a key in the tree without removing data physically
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_hide(beet_tree_t   *tree,
+                          beet_pageid_t *root,
+                          const void     *key) {
+	return hide(tree, root, key, 0);
+}
+
+/* ------------------------------------------------------------------------
+ * Uncover a hidden key in the tree.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_unhide(beet_tree_t   *tree,
+                            beet_pageid_t *root,
+                            const void     *key) {
+	return hide(tree, root, key, 1);
+}
+
+/* ------------------------------------------------------------------------
+ * A leaf with less than a third of its capacity is underfull
+ * ------------------------------------------------------------------------
+ */
+#define UNDERFULL(n) ((n)/3)
+
+/* ------------------------------------------------------------------------
+ * Helper: get the parent of 'kid' locked for writing
+ * ------------------------------------------------------------------------
+ * 'key' lies in the range of kid (or of an empty leaf forwarding to it).
+ * Returns BEET_ERR_KEYNOF if kid is not found in the nonleaf
+ * where key leads us.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t lockParent(beet_tree_t   *tree,
+                             beet_pageid_t *root,
+                             const void     *key,
+                             beet_pageid_t    kid,
+                             beet_node_t   **mom,
+                             uint32_t      *slot) {
+	beet_err_t    err;
+	beet_pageid_t pge;
+
+	err = descend(tree, getRoot(tree, root), key, 1, NULL, &pge);
+	if (err != BEET_OK) return err;
+	if (isLeaf(pge)) return BEET_ERR_KEYNOF;
+
+	err = getNode(tree, pge, WRITE, mom);
+	if (err != BEET_OK) return err;
+
+	err = moveRight(tree, mom, key);
+	if (err != BEET_OK) {
+		releaseNode(tree, *mom); free(*mom);
+		return err;
+	}
+	for(uint32_t i=0; i<=(*mom)->size; i++) {
+		if (beet_node_getPageid(*mom, i) == kid) {
+			*slot = i; return BEET_OK;
+		}
+	}
+	err = releaseNode(tree, *mom); free(*mom);
+	if (err != BEET_OK) return err;
+	return BEET_ERR_KEYNOF;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: let the left neighbour of the empty leaf 'dead'
+ *         point to the right neighbour of 'dead'
+ * ------------------------------------------------------------------------
+ * We start at 'pred', which was left of dead when we looked,
+ * and move right until we find the node pointing to dead.
+ * 'done' is 0 if we do not find it.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t skipLeaf(beet_tree_t   *tree,
+                           beet_pageid_t  pred,
+                           beet_pageid_t  dead,
+                           char          *done) {
+	beet_err_t   err;
+	beet_err_t  err2;
+	beet_node_t *node;
+	beet_node_t  *nxt;
+
+	*done = 0;
+
+	err = getNode(tree, toLeaf(pred), WRITE, &node);
+	if (err != BEET_OK) return err;
+
+	while(node->next != dead) {
+		if (node->next == BEET_PAGE_NULL || node->self == dead) {
+			err = releaseNode(tree, node); free(node);
+			return err;
+		}
+
+		/* left to right: we may hold the left one */
+		err = getNode(tree, toLeaf(node->next), WRITE, &nxt);
+		if (err != BEET_OK) {
+			releaseNode(tree, node); free(node);
+			return err;
+		}
+		err = releaseNode(tree, node); free(node);
+		node = nxt;
+		if (err != BEET_OK) {
+			releaseNode(tree, node); free(node);
+			return err;
+		}
+	}
+
+	/* dead's right-link may change until we hold it */
+	err = getNode(tree, toLeaf(dead), READ, &nxt);
+	if (err != BEET_OK) {
+		releaseNode(tree, node); free(node);
+		return err;
+	}
+	node->next = nxt->next;
+
+	err = releaseNode(tree, nxt); free(nxt);
+	if (err == BEET_OK) err = storeNode(tree, node);
+	err2 = releaseNode(tree, node); free(node);
+	if (err == BEET_OK) err = err2;
+	if (err == BEET_OK) *done = 1;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: remove the empty leaf 'dead' from the tree
+ * ------------------------------------------------------------------------
+ * Dead has given its keys to its right neighbour 'nxt';
+ * until it is removed, it forwards every key to nxt.
+ * We remove it from its parent (which must keep one key at least):
+ * if nxt is the next kid in the parent, nxt takes over its range,
+ * otherwise the kid to the left of dead does (and forwards keys
+ * through its right-link). Then the left neighbour skips dead
+ * and dead is retired. If any of this is not possible,
+ * dead stays where it is; it is still correct, just useless.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t unlinkLeaf(beet_tree_t   *tree,
+                             beet_pageid_t *root,
+                             beet_pageid_t  dead,
+                             beet_pageid_t   nxt,
+                             beet_pageid_t  pred,
+                             const void     *key) {
+	beet_err_t   err;
+	beet_err_t  err2;
+	beet_node_t *mom;
+	uint32_t slot;
+	char     done;
+
+	err = lockParent(tree, root, key, toLeaf(dead), &mom, &slot);
+	if (err == BEET_ERR_KEYNOF) return BEET_OK;
+	if (err != BEET_OK) return err;
+
+	done = 0;
+	if (mom->size > 1) {
+		if (slot < mom->size &&
+		    beet_node_getPageid(mom, slot+1) == toLeaf(nxt)) {
+			beet_node_setPageid(mom, slot, toLeaf(nxt));
+			beet_node_remove(mom, tree->ksize, 0, slot);
+			done = 1;
+		} else if (slot > 0) {
+			beet_node_remove(mom, tree->ksize, 0, slot-1);
+			done = 1;
+		}
+	}
+	if (done) err = storeNode(tree, mom);
+	err2 = releaseNode(tree, mom); free(mom);
+	if (err == BEET_OK) err = err2;
+	if (err != BEET_OK || !done) return err;
+
+	/* the leftmost leaf has no left neighbour */
+	if (pred != BEET_PAGE_NULL) {
+		err = skipLeaf(tree, pred, dead, &done);
+		if (err != BEET_OK || !done) return err;
+	}
+	return retire(tree, toLeaf(dead));
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: rebalance an underfull leaf
+ * ------------------------------------------------------------------------
+ * The leaf is locked for writing (and stored) and released here.
+ * Keys move only to the right: the leaf is merged into
+ * its right neighbour; if that is too full,
+ * the left neighbour is merged into the leaf or gives
+ * half of the difference. Since we must not lock from right to left,
+ * we release the leaf before we lock the left neighbour
+ * and check that nothing has changed in between.
+ * The separator in the parent is not lowered when keys
+ * come from the left; they are found through the right-link.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t rebalance(beet_tree_t   *tree,
+                            beet_pageid_t *root,
+                            beet_node_t   *leaf,
+                            const void     *key) {
+	beet_err_t   err;
+	beet_err_t  err2;
+	beet_node_t  *nb;
+	beet_pageid_t self, pred, dead, nxt;
+	char *k;
+	uint32_t n;
+
+	/* merge into the right neighbour */
+	if (leaf->next != BEET_PAGE_NULL) {
+		err = getNode(tree, toLeaf(leaf->next), WRITE, &nb);
+		if (err != BEET_OK) {
+			releaseNode(tree, leaf); free(leaf);
+			return err;
+		}
+		if (nb->size > 0 && leaf->size + nb->size < tree->lsize) {
+			beet_node_give(leaf, nb, tree->ksize,
+			                         tree->dsize, leaf->size);
+			nb->prev = leaf->prev;
+
+			dead = leaf->self;
+			pred = leaf->prev;
+			nxt  = leaf->next;
+
+			err = storeNode(tree, nb);
+			if (err == BEET_OK) err = storeNode(tree, leaf);
+			err2 = releaseNode(tree, nb); free(nb);
+			if (err == BEET_OK) err = err2;
+			err2 = releaseNode(tree, leaf); free(leaf);
+			if (err == BEET_OK) err = err2;
+			if (err != BEET_OK) return err;
+
+			return unlinkLeaf(tree, root, dead, nxt, pred, key);
+		}
+		err = releaseNode(tree, nb); free(nb);
+		if (err != BEET_OK) {
+			releaseNode(tree, leaf); free(leaf);
+			return err;
+		}
+	}
+
+	/* otherwise, the left neighbour gives */
+	self = leaf->self;
+	pred = leaf->prev;
+
+	err = releaseNode(tree, leaf); free(leaf);
+	if (err != BEET_OK) return err;
+
+	if (pred == BEET_PAGE_NULL) return BEET_OK;
+
+	err = getNode(tree, toLeaf(pred), WRITE, &nb);
+	if (err != BEET_OK) return err;
+
+	if (nb->next != self || nb->size == 0) {
+		err = releaseNode(tree, nb); free(nb);
+		return err;
+	}
+
+	err = getNode(tree, toLeaf(self), WRITE, &leaf);
+	if (err != BEET_OK) {
+		releaseNode(tree, nb); free(nb);
+		return err;
+	}
+
+	/* the leaf may have changed while we were not holding it */
+	if ((leaf->size == 0 && leaf->next != BEET_PAGE_NULL) ||
+	     leaf->size >= UNDERFULL(tree->lsize)) {
+		err = releaseNode(tree, leaf); free(leaf);
+		err2 = releaseNode(tree, nb); free(nb);
+		if (err == BEET_OK) err = err2;
+		return err;
+	}
+
+	k = NULL;
+	if (nb->size + leaf->size < tree->lsize) {
+
+		/* a key in the range of the left neighbour
+		 * to find its parent */
+		k = malloc(tree->ksize);
+		if (k == NULL) {
+			releaseNode(tree, leaf); free(leaf);
+			releaseNode(tree, nb); free(nb);
+			return BEET_ERR_NOMEM;
+		}
+		memcpy(k, nb->keys, tree->ksize);
+
+		beet_node_give(nb, leaf, tree->ksize, tree->dsize, nb->size);
+		leaf->prev = nb->prev;
+	} else {
+		n = (nb->size - leaf->size)/2;
+		beet_node_give(nb, leaf, tree->ksize, tree->dsize, n);
+		memcpy(nb->high, leaf->keys, tree->ksize);
+	}
+
+	dead = nb->self;
+	pred = nb->prev;
+
+	err = storeNode(tree, leaf);
+	if (err == BEET_OK) err = storeNode(tree, nb);
+	err2 = releaseNode(tree, leaf); free(leaf);
+	if (err == BEET_OK) err = err2;
+	err2 = releaseNode(tree, nb); free(nb);
+	if (err == BEET_OK) err = err2;
+
+	if (err == BEET_OK && k != NULL) {
+		err = unlinkLeaf(tree, root, dead, self, pred, k);
+	}
+	if (k != NULL) free(k);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Remove a key and its data from the tree
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_delete(beet_tree_t   *tree,
+                            beet_pageid_t *root,
+                            const void     *key) {
+	beet_err_t   err;
+	beet_node_t *leaf;
+	int32_t      slot;
+	uint32_t        e;
+
+	TREENULL();
+	ROOTNULL();
+
+	if (key  == NULL) return BEET_ERR_NOKEY;
+
+	e = enter(tree);
+
+	err = findLeaf(tree, root, key, WRITE, NULL, &leaf);
+	if (err != BEET_OK) goto done;
+
+	slot = beet_node_search(leaf, tree->ksize,
+	                        key,  tree->cmp,
+	                              tree->rsc);
+	if (slot < 0 || slot >= leaf->size ||
+	    !beet_node_equal(leaf, slot, tree->ksize,
+	                           key,  tree->cmp,
+	                                 tree->rsc)) {
+		err = BEET_ERR_KEYNOF; goto release;
+	}
+
+	/* release what the data refer to (e.g. an embedded tree) */
+	if (tree->ins != NULL && tree->ins->drop != NULL) {
+		err = tree->ins->drop(tree->ins->rsc,
+		                      leaf->kids+slot*tree->dsize);
+		if (err != BEET_OK) goto release;
+	}
+
+	beet_node_remove(leaf, tree->ksize, tree->dsize, slot);
+
+	err = storeNode(tree, leaf);
+	if (err != BEET_OK) goto release;
+
+	/* the root has no neighbours */
+	if ((leaf->next != BEET_PAGE_NULL || leaf->prev != BEET_PAGE_NULL) &&
+	    (leaf->size == 0 || leaf->size < UNDERFULL(tree->lsize))) {
+		err = rebalance(tree, root, leaf, key);
+		goto done;
+	}
+
+release:
+	if (err == BEET_OK) {
+		err = releaseNode(tree, leaf);
+	} else {
+		releaseNode(tree, leaf);
+	}
+	free(leaf);
+done:
+	leave(tree, e);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: retire node and all nodes below
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t dropNode(beet_tree_t *tree, beet_pageid_t pge) {
+	beet_err_t   err;
+	beet_err_t  err2;
+	beet_node_t *node;
+
+	if (!isLeaf(pge)) {
+		err = getNode(tree, pge, READ, &node);
+		if (err != BEET_OK) return err;
+
+		for(uint32_t i=0; i<=node->size; i++) {
+			err = dropNode(tree, beet_node_getPageid(node, i));
+			if (err != BEET_OK) break;
+		}
+		err2 = releaseNode(tree, node); free(node);
+		if (err == BEET_OK) err = err2;
+		if (err != BEET_OK) return err;
+	}
+	return retire(tree, pge);
 }
 
 /* ------------------------------------------------------------------------
- * Uncover a hidden key in the tree.
+ * Give all pages of the tree back to the rider
  * ------------------------------------------------------------------------
  */
-beet_err_t beet_tree_unhide(beet_tree_t   *tree,
-                            beet_pageid_t *root,
-                            const void     *key) {
-	return hide(tree, root, key, 1);
+beet_err_t beet_tree_drop(beet_tree_t   *tree,
+                          beet_pageid_t *root) {
+	beet_err_t err;
+	beet_pageid_t pge;
+
+	TREENULL();
+	ROOTNULL();
+
+	pge = getRoot(tree, root);
+	if (pge == BEET_PAGE_NULL) return BEET_OK;
+
+	err = dropNode(tree, pge);
+	if (err != BEET_OK) return err;
+
+	setRoot(tree, root, BEET_PAGE_NULL);
+	STOREROOT(root);
+
+	return BEET_OK;
 }
 
 /* ------------------------------------------------------------------------
@@ -966,59 +1893,86 @@ beet_err_t beet_tree_get(beet_tree_t   *tree,
                          beet_pageid_t *root,
                          const void     *key,
                          beet_node_t  **node) {
-	beet_err_t   err;
-	beet_err_t  err2;
-	beet_node_t *tmp;
-	char lock = 1;
+	return findLeaf(tree, root, key, READ, NULL, node);
+}
 
-	LOCK(READ);
+#define LEFT  0
+#define RIGHT 1
 
-	err = getNode(tree, *root, READ, &tmp);
-	if (err != BEET_OK) {
-		UNLOCK(READ, &lock);
-		return err;
-	}
+/* ------------------------------------------------------------------------
+ * Leaves prefetched when a scan starts
+ * ------------------------------------------------------------------------
+ */
+#define PREFETCH 64
 
-	err = findNode(tree, tmp, node, READ, key, &lock, NULL);
-	if (err != BEET_OK) {
-		UNLOCK(READ, &lock);
-		return err;
+/* ------------------------------------------------------------------------
+ * Helper: prefetch the leaves below node in the direction of the scan
+ * (this is only a hint, errors are ignored)
+ * ------------------------------------------------------------------------
+ */
+static void prefetchLeaves(beet_tree_t *tree,
+                           beet_node_t *node,
+                           char          dir) {
+	beet_pageid_t pids[PREFETCH];
+	uint32_t n = node->size+1;
+
+	if (!isLeaf(beet_node_getPageid(node, 0))) return;
+	if (n > PREFETCH) n = PREFETCH;
+	for(uint32_t i=0; i<n; i++) {
+		pids[i] = fromLeaf(beet_node_getPageid(node,
+		                   dir==LEFT?i:node->size-i));
 	}
-	UNLOCK(READ, &lock);
-	return BEET_OK;
+	beet_rider_prefetch(tree->lfs, pids, n);
 }
 
 /* ------------------------------------------------------------------------
  * Follow down
  * ------------------------------------------------------------------------
+ * To the right, we follow the right-links first,
+ * since the rightmost node may have been split.
+ * The leaves below the last nonleaf are prefetched,
+ * since a scan starting here is likely to read them.
+ * ------------------------------------------------------------------------
  */
-#define LEFT  0
-#define RIGHT 1
 static beet_err_t follow(beet_tree_t     *tree,
-                         beet_node_t      *src,
+                         beet_pageid_t     pge,
                          beet_node_t     **trg,
                          char              dir) {
 	beet_err_t     err;
-	beet_pageid_t *pge;
+	beet_node_t  *node;
+	beet_node_t   *nxt;
 
-	if (src->leaf) {
-		*trg = src; return BEET_OK;
-	}
+	for(;;) {
+		err = getNode(tree, pge, READ, &node);
+		if (err != BEET_OK) return err;
 
-	pge = dir==LEFT?(beet_pageid_t*)src->kids:
-		        (beet_pageid_t*)(src->kids+
-	                                 src->size*
-	                                 sizeof(beet_pageid_t));
+		if (node->leaf) break;
 
-	err = getNode(tree, *pge, READ, trg);
-	if (err != BEET_OK) {
-		releaseNode(tree, src); free(src);
-		return err;
+		if (dir == RIGHT && node->next != BEET_PAGE_NULL) {
+			pge = node->next;
+		} else {
+			prefetchLeaves(tree, node, dir);
+			pge = beet_node_getPageid(node, dir==LEFT?0:node->size);
+		}
+		err = releaseNode(tree, node); free(node);
+		if (err != BEET_OK) return err;
 	}
-	err = releaseNode(tree, src); free(src);
-	if (err != BEET_OK) return err;
 
-	return follow(tree, *trg, trg, dir);
+	while(dir == RIGHT && node->next != BEET_PAGE_NULL) {
+		err = getNode(tree, toLeaf(node->next), READ, &nxt);
+		if (err != BEET_OK) {
+			releaseNode(tree, node); free(node);
+			return err;
+		}
+		err = releaseNode(tree, node); free(node);
+		node = nxt;
+		if (err != BEET_OK) {
+			releaseNode(tree, node); free(node);
+			return err;
+		}
+	}
+	*trg = node;
+	return BEET_OK;
 }
 
 /* ------------------------------------------------------------------------
@@ -1028,27 +1982,16 @@ static beet_err_t follow(beet_tree_t     *tree,
 beet_err_t beet_tree_left(beet_tree_t   *tree,
                           beet_pageid_t *root,
                           beet_node_t  **node) {
-	beet_err_t   err;
-	beet_err_t  err2;
-	beet_node_t *tmp;
-	char lock = 1;
-
-	LOCK(READ);
-
-	err = getNode(tree, *root, READ, &tmp);
-	if (err != BEET_OK) {
-		UNLOCK(READ, &lock);
-		return err;
-	}
+	beet_err_t err;
+	uint32_t     e;
 
-	UNLOCK(READ, &lock);
+	TREENULL();
+	ROOTNULL();
 
-	err = follow(tree, tmp, node, LEFT);
-	if (err != BEET_OK) {
-		UNLOCK(READ, &lock);
-		return err;
-	}
-	return BEET_OK;
+	e = enter(tree);
+	err = follow(tree, getRoot(tree, root), node, LEFT);
+	leave(tree, e);
+	return err;
 }
 
 /* ------------------------------------------------------------------------
@@ -1058,27 +2001,109 @@ beet_err_t beet_tree_left(beet_tree_t   *tree,
 beet_err_t beet_tree_right(beet_tree_t   *tree,
                            beet_pageid_t *root,
                            beet_node_t  **node) {
+	beet_err_t err;
+	uint32_t     e;
+
+	TREENULL();
+	ROOTNULL();
+
+	e = enter(tree);
+	err = follow(tree, getRoot(tree, root), node, RIGHT);
+	leave(tree, e);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Remove the hidden keys from one leaf
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_purge(beet_tree_t   *tree,
+                           beet_pageid_t *root,
+                           const void   *cursor,
+                           void           *next,
+                           uint32_t          *n) {
 	beet_err_t   err;
 	beet_err_t  err2;
-	beet_node_t *tmp;
-	char lock = 1;
+	beet_node_t *leaf;
+	beet_node_t   *nb;
+	beet_pageid_t pge;
+	char *k = NULL;
+	char eof = 1;
+	uint32_t e, m = 0;
+
+	TREENULL();
+	ROOTNULL();
 
-	LOCK(READ);
+	if (next == NULL) return BEET_ERR_NOKEY;
 
-	err = getNode(tree, *root, READ, &tmp);
-	if (err != BEET_OK) {
-		UNLOCK(READ, &lock);
-		return err;
+	e = enter(tree);
+
+	if (cursor == NULL) {
+		err = follow(tree, getRoot(tree, root), &leaf, LEFT);
+		if (err != BEET_OK) goto done;
+
+		pge = toLeaf(leaf->self);
+		err = releaseNode(tree, leaf); free(leaf);
+		if (err != BEET_OK) goto done;
+
+		err = getNode(tree, pge, WRITE, &leaf);
+	} else {
+		err = locateLeaf(tree, root, cursor, WRITE, NULL, &leaf);
+	}
+	if (err != BEET_OK) goto done;
+
+	/* we go on with the first key of the next leaf
+	 * (cursor and next may be the same) */
+	pge = leaf->next;
+	while(pge != BEET_PAGE_NULL) {
+		err = getNode(tree, toLeaf(pge), READ, &nb);
+		if (err != BEET_OK) goto release;
+		if (nb->size > 0) {
+			memcpy(next, nb->keys, tree->ksize); eof = 0;
+		}
+		pge = eof ? nb->next : BEET_PAGE_NULL;
+		err = releaseNode(tree, nb); free(nb);
+		if (err != BEET_OK) goto release;
+	}
+
+	for(uint32_t i=0; i<leaf->size; i++) {
+		if (!beet_node_hidden(leaf, i)) continue;
+		if (tree->ins != NULL && tree->ins->drop != NULL) {
+			err = tree->ins->drop(tree->ins->rsc,
+			                      leaf->kids+i*tree->dsize);
+			if (err != BEET_OK) goto release;
+		}
+		m++;
 	}
+	if (m == 0) goto release;
 
-	UNLOCK(READ, &lock);
+	/* a key in the range of the leaf to find its parent */
+	k = malloc(tree->ksize);
+	if (k == NULL) {
+		err = BEET_ERR_NOMEM; goto release;
+	}
+	memcpy(k, leaf->keys, tree->ksize);
 
-	err = follow(tree, tmp, node, RIGHT);
-	if (err != BEET_OK) {
-		UNLOCK(READ, &lock);
-		return err;
+	beet_node_compact(leaf, tree->ksize, tree->dsize);
+
+	err = storeNode(tree, leaf);
+	if (err != BEET_OK) goto release;
+
+	if ((leaf->next != BEET_PAGE_NULL || leaf->prev != BEET_PAGE_NULL) &&
+	    (leaf->size == 0 || leaf->size < UNDERFULL(tree->lsize))) {
+		err = rebalance(tree, root, leaf, k);
+		goto done;
 	}
-	return BEET_OK;
+
+release:
+	err2 = releaseNode(tree, leaf); free(leaf);
+	if (err == BEET_OK) err = err2;
+done:
+	leave(tree, e);
+	if (k != NULL) free(k);
+	if (n != NULL) *n = m;
+	if (err == BEET_OK && eof) return BEET_ERR_EOF;
+	return err;
 }
 
 /* ------------------------------------------------------------------------
@@ -1121,9 +2146,72 @@ beet_err_t beet_tree_next(beet_tree_t  *tree,
  */
 beet_err_t beet_tree_prev(beet_tree_t  *tree,
                           beet_node_t   *cur,
+                          const void    *low,
                           beet_node_t **prev)
 {
-	return move(tree, cur, cur->prev, prev);
+	beet_err_t    err;
+	beet_node_t  *tmp, *tmp2;
+	beet_pageid_t self, nxt, pge;
+	uint32_t e;
+
+	TREENULL();
+
+	if (cur == NULL) return BEET_ERR_NONODE;
+	if (!cur->leaf) return BEET_ERR_NOTLEAF;
+
+	/* writers lock leaves from left to right;
+	 * we must not wait for the left neighbour while holding 'cur'.
+	 * Meanwhile, the left neighbour may split or
+	 * give keys to the right (see rebalance); we therefore
+	 * move right to the last leaf with keys below 'low'. */
+	self = cur->self; nxt = cur->next; pge = cur->prev;
+	*prev = NULL;
+
+	e = enter(tree);
+
+	err = releaseNode(tree, cur);
+	if (err != BEET_OK) goto done;
+
+	if (pge == BEET_PAGE_NULL) {
+		err = BEET_ERR_EOF; goto done;
+	}
+
+	err = getNode(tree, toLeaf(pge), READ, prev);
+	if (err != BEET_OK) goto done;
+
+	while((*prev)->next != BEET_PAGE_NULL) {
+		if (low == NULL && ((*prev)->next == self ||
+		                    (*prev)->next == nxt)) break;
+
+		err = getNode(tree, toLeaf((*prev)->next), READ, &tmp);
+		if (err != BEET_OK) break;
+
+		/* pass by empty leaves */
+		while(low != NULL && tmp->size == 0 &&
+		      tmp->next != BEET_PAGE_NULL) {
+			err = getNode(tree, toLeaf(tmp->next), READ, &tmp2);
+			if (err != BEET_OK) break;
+			err = releaseNode(tree, tmp); free(tmp);
+			tmp = tmp2;
+			if (err != BEET_OK) break;
+		}
+		if (err != BEET_OK) {
+			releaseNode(tree, tmp); free(tmp); break;
+		}
+		if (low != NULL && (tmp->size == 0 ||
+		    tree->cmp(tmp->keys, low, tree->rsc) != BEET_CMP_LESS)) {
+			err = releaseNode(tree, tmp); free(tmp); break;
+		}
+		err = releaseNode(tree, *prev); free(*prev);
+		*prev = tmp;
+		if (err != BEET_OK) break;
+	}
+	if (err != BEET_OK) {
+		releaseNode(tree, *prev); free(*prev); *prev = NULL;
+	}
+done:
+	leave(tree, e);
+	return err;
 }
 
 /* ------------------------------------------------------------------------
@@ -1136,62 +2224,280 @@ beet_err_t beet_tree_release(beet_tree_t *tree,
 }
 
 /* ------------------------------------------------------------------------
- * Height
+ * Height of the tree
  * ------------------------------------------------------------------------
  */
-static beet_err_t height(beet_tree_t     *tree,
-                         beet_node_t      *src,
-                         uint32_t           *h) {
-	beet_err_t   err;
-	beet_node_t *trg;
+beet_err_t beet_tree_height(beet_tree_t   *tree,
+                            beet_pageid_t *root,
+                            uint32_t      *h) {
+	beet_err_t    err;
+	beet_node_t  *tmp;
+	beet_pageid_t pge;
 
-	if (src->leaf) {
-		err = releaseNode(tree, src); free(src);
+	TREENULL();
+	ROOTNULL();
+	if (h == NULL) return BEET_ERR_INVALID;
+
+	err = getNode(tree, getRoot(tree, root), READ, &tmp);
+	if (err != BEET_OK) return err;
+
+	if (tree->nlay.links || tmp->leaf) {
+		*h = tmp->leaf ? 1 : tmp->level + 1;
+		err = releaseNode(tree, tmp); free(tmp);
+		return err;
+	}
+
+	/* without levels, we count them on the way down */
+	for(*h=1; !tmp->leaf; (*h)++) {
+		pge = beet_node_getPageid(tmp, 0);
+		err = releaseNode(tree, tmp); free(tmp);
+		if (err != BEET_OK) return err;
+
+		err = getNode(tree, pge, READ, &tmp);
 		if (err != BEET_OK) return err;
-		return BEET_OK;
 	}
+	err = releaseNode(tree, tmp); free(tmp);
+	if (err != BEET_OK) return err;
+	return BEET_OK;
+}
 
-	(*h)++;
+/* ------------------------------------------------------------------------
+ * Bulk load: one open node per level (0: the leaves)
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_node_t *nodes[MAXHEIGHT]; /* rightmost node on each level */
+	int          n;                /* number of levels             */
+	uint32_t     lcap;             /* keys per leaf                */
+	uint32_t     ncap;             /* keys per nonleaf             */
+} bulk_t;
 
-	err = getNode(tree, *(beet_pageid_t*)src->kids, READ, &trg);
-	if (err != BEET_OK) {
-		releaseNode(tree, src); free(src);
-		return err;
+/* ------------------------------------------------------------------------
+ * Helper: number of keys a node of size 'nsize'
+ *         receives when filled to 'fill' percent
+ * ------------------------------------------------------------------------
+ * A node splits when it reaches nsize keys,
+ * so it holds at most nsize-1 keys at rest.
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t bulkcap(uint32_t nsize, uint32_t fill) {
+	uint32_t c;
+
+	if (fill == 0 || fill > 100) fill = 100;
+	c = (uint32_t)(((uint64_t)nsize * fill) / 100);
+	if (c >= nsize) c = nsize-1;
+	if (c < 1) c = 1;
+	return c;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: store and release the open nodes
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t bulkclose(beet_tree_t *tree, bulk_t *b) {
+	beet_err_t err = BEET_OK;
+	beet_err_t err2;
+
+	for(int i=0; i<b->n; i++) {
+		if (b->nodes[i] == NULL) continue;
+		err2 = storeNode(tree, b->nodes[i]);
+		if (err == BEET_OK) err = err2;
+		err2 = releaseNode(tree, b->nodes[i]);
+		if (err == BEET_OK) err = err2;
+		free(b->nodes[i]); b->nodes[i] = NULL;
+	}
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: the node on level-1 is full; 'left' (its pageid)
+ *         is followed by 'kid', whose first key is 'key'.
+ *         Add 'key' and 'kid' to the open node on 'level'.
+ * ------------------------------------------------------------------------
+ * The first node on a level is created with 'left' as first kid.
+ * When a nonleaf is full, a new one is opened with the last kid
+ * of the full node as first kid and 'key' as first key,
+ * so no nonleaf is ever left without keys. The last key of the
+ * full node becomes its high key and is passed up.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t bulkadd(beet_tree_t *tree,
+                          bulk_t         *b,
+                          int         level,
+                          const void   *key,
+                          beet_pageid_t kid,
+                          beet_pageid_t left) {
+	beet_err_t    err;
+	beet_node_t *node;
+	beet_node_t  *nxt;
+	uint32_t      ksz = tree->ksize;
+	uint32_t      psz = tree->pidsz;
+
+	if (level >= MAXHEIGHT) return BEET_ERR_PANIC;
+
+	if (level == b->n) {
+		err = newNonLeaf(tree, &node);
+		if (err != BEET_OK) return err;
+
+		node->level = level;
+		beet_node_setPageid(node, 0, left);
+
+		b->nodes[level] = node; b->n++;
+	}
+
+	node = b->nodes[level];
+	if (node->size < b->ncap) {
+		memcpy(node->keys+node->size*ksz, key, ksz);
+		node->size++;
+		beet_node_setPageid(node, node->size, kid);
+		return BEET_OK;
 	}
-	err = releaseNode(tree, src); free(src);
+
+	err = newNonLeaf(tree, &nxt);
 	if (err != BEET_OK) return err;
 
-	return height(tree, trg, h);
+	nxt->level = level;
+	nxt->size = 1;
+	memcpy(nxt->kids, node->kids+node->size*psz, psz);
+	memcpy(nxt->keys, key, ksz);
+	beet_node_setPageid(nxt, 1, kid);
+
+	node->size--;
+	memcpy(node->high, node->keys+node->size*ksz, ksz);
+	node->next = nxt->self;
+	left = node->self;
+
+	b->nodes[level] = nxt;
+
+	err = bulkadd(tree, b, level+1, node->high, nxt->self, left);
+	if (err == BEET_OK) err = storeNode(tree, node);
+	if (err == BEET_OK) err = releaseNode(tree, node);
+	else releaseNode(tree, node);
+	free(node);
+	return err;
 }
 
 /* ------------------------------------------------------------------------
- * Height of the tree
+ * Helper: append (key, data) to the open leaf
  * ------------------------------------------------------------------------
  */
-beet_err_t beet_tree_height(beet_tree_t   *tree,
-                            beet_pageid_t *root,
-                            uint32_t      *h) {
-	beet_err_t err, err2;
-	beet_node_t     *tmp;
-	char lock = 1;
+static beet_err_t bulkleaf(beet_tree_t *tree,
+                           bulk_t         *b,
+                           const void   *key,
+                           const void  *data) {
+	beet_err_t    err;
+	beet_node_t *leaf = b->nodes[0];
+	beet_node_t  *nxt;
+	beet_pageid_t left;
+	char c;
+
+	/* the key must be greater than the last one */
+	if (leaf->size > 0) {
+		c = tree->cmp(key, leaf->keys+(leaf->size-1)*tree->ksize,
+		                                              tree->rsc);
+		if (c == BEET_CMP_EQUAL) return BEET_ERR_DBLKEY;
+		if (c == BEET_CMP_LESS) return BEET_ERR_NOTSORTED;
+	}
+
+	if (leaf->size >= b->lcap) {
+		err = newLeaf(tree, &nxt);
+		if (err != BEET_OK) return err;
+
+		memcpy(leaf->high, key, tree->ksize);
+		leaf->next = nxt->self;
+		nxt->prev = leaf->self;
+		left = toLeaf(leaf->self);
+
+		err = storeNode(tree, leaf);
+		if (err == BEET_OK) err = releaseNode(tree, leaf);
+		free(leaf);
+
+		b->nodes[0] = leaf = nxt;
+		if (err != BEET_OK) return err;
+
+		err = bulkadd(tree, b, 1, key, toLeaf(nxt->self), left);
+		if (err != BEET_OK) return err;
+	}
+
+	memcpy(leaf->keys+leaf->size*tree->ksize, key, tree->ksize);
+	if (tree->dsize > 0 && data != NULL) {
+		memcpy(leaf->kids+leaf->size*tree->dsize, data, tree->dsize);
+	}
+	leaf->size++;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Build the tree bottom-up from a sorted source
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_bulkload(beet_tree_t     *tree,
+                              beet_pageid_t   *root,
+                              beet_tree_next_t next,
+                              void            *src,
+                              uint32_t        fill) {
+	beet_err_t    err, err2;
+	beet_pageid_t pge;
+	const void   *key;
+	const void  *data;
+	bulk_t b;
 
 	TREENULL();
 	ROOTNULL();
-	if (h == NULL) return BEET_ERR_INVALID;
 
-	LOCK(READ);
+	if (next == NULL) return BEET_ERR_INVALID;
 
-	err = getNode(tree, *root, READ, &tmp);
-	if (err != BEET_OK) {
-		UNLOCK(READ, &lock);
-		return err;
+	memset(&b, 0, sizeof(bulk_t));
+
+	/* nonleaves are filled up to ncap keys and
+	 * give one away when the next arrives (see bulkadd) */
+	if (tree->nsize < 3) return BEET_ERR_NOTSUPP;
+
+	b.lcap = bulkcap(tree->lsize, fill);
+	b.ncap = bulkcap(tree->nsize, fill) + 1;
+	if (b.ncap > tree->nsize-1) b.ncap = tree->nsize-1;
+
+	/* start with the empty root leaf or a new one */
+	pge = getRoot(tree, root);
+	if (pge == BEET_PAGE_NULL) {
+		err = newLeaf(tree, &b.nodes[0]);
+	} else {
+		if (!isLeaf(pge)) return BEET_ERR_NOTEMPTY;
+
+		err = getNode(tree, pge, WRITE, &b.nodes[0]);
+		if (err == BEET_OK && b.nodes[0]->size > 0) {
+			releaseNode(tree, b.nodes[0]); free(b.nodes[0]);
+			return BEET_ERR_NOTEMPTY;
+		}
 	}
+	if (err != BEET_OK) return err;
+	b.n = 1;
 
-	UNLOCK(READ, &lock);
+	for(;;) {
+		err = next(src, &key, &data);
+		if (err == BEET_ERR_EOF) {
+			err = BEET_OK; break;
+		}
+		if (err != BEET_OK) break;
+		if (key == NULL) {
+			err = BEET_ERR_NOKEY; break;
+		}
+		err = bulkleaf(tree, &b, key, data);
+		if (err != BEET_OK) break;
+	}
 
-	*h = 1;
+	/* the topmost node is the root */
+	if (err == BEET_OK) {
+		pge = b.n == 1 ? toLeaf(b.nodes[0]->self) :
+		                 b.nodes[b.n-1]->self;
+	}
 
-	err = height(tree, tmp, h);
+	err2 = bulkclose(tree, &b);
+	if (err == BEET_OK) err = err2;
 	if (err != BEET_OK) return err;
+
+	setRoot(tree, root, pge);
+	STOREROOT(root);
+
 	return BEET_OK;
 }
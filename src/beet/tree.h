@@ -20,6 +20,17 @@
 #include <stdint.h>
 #include <stdio.h>
 
+/* ------------------------------------------------------------------------
+ * Pages removed from the tree that threads may still be heading for
+ * (leaves are marked with BEET_PAGE_LEAF)
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_pageid_t *pages; /* retired pages            */
+	uint32_t           n; /* # of retired pages       */
+	uint32_t         max; /* capacity                 */
+} beet_tree_limbo_t;
+
 /* ------------------------------------------------------------------------
  * B+Tree
  * ------------------------------------------------------------------------
@@ -29,6 +40,9 @@ typedef struct beet_tree_st {
 	uint32_t        nsize; /* internal nodes size      */
 	uint32_t        ksize; /* key  size                */
 	uint32_t        dsize; /* data size                */
+	uint32_t        pidsz; /* size of pageids on disk  */
+	beet_node_layout_t llay; /* layout of leaves       */
+	beet_node_layout_t nlay; /* layout of nonleaves    */
 	beet_rider_t   *nolfs; /* rider for non-leaves     */
 	beet_rider_t     *lfs; /* rider for leaves         */
 	beet_compare_t    cmp; /* key compare callback     */
@@ -38,6 +52,11 @@ typedef struct beet_tree_st {
 	beet_ins_t       *ins; /* data insertion callback  */
 	FILE            *roof; /* root file                */
 	beet_lock_t     rlock; /* root file protection     */
+	beet_latch_t   elatch; /* protects epoch and limbo */
+	uint32_t        epoch; /* current epoch            */
+	uint32_t    active[2]; /* threads per epoch parity */
+	uint32_t      retired; /* # of pages in limbo      */
+	beet_tree_limbo_t limbo[2]; /* retired per parity  */
 } beet_tree_t;
 
 /* ------------------------------------------------------------------------
@@ -58,12 +77,37 @@ beet_err_t beet_tree_init(beet_tree_t    *tree,
                           void            *rsc,
                           beet_ins_t     *ins);
 
+/* ------------------------------------------------------------------------
+ * Use the aligned node layout (the default is packed)
+ * and store pageids with 'pidsz' bytes (BEET_NODE_PTRSZ, the default,
+ * or BEET_NODE_PTRSZ64). This applies to the nodes, the root file
+ * and, for embedded trees, to the root stored in the host.
+ * Must be called before the first node is accessed.
+ * ------------------------------------------------------------------------
+ */
+void beet_tree_setLayout(beet_tree_t *tree, char aligned, uint32_t pidsz);
+
+/* ------------------------------------------------------------------------
+ * Use the node layout of format version 1 (see beet_node_unlinked).
+ * Trees with this layout can be read, but not changed.
+ * Must be called before the first node is accessed.
+ * ------------------------------------------------------------------------
+ */
+void beet_tree_setUnlinked(beet_tree_t *tree);
+
 /* ------------------------------------------------------------------------
  * Destroy B+Tree
  * ------------------------------------------------------------------------
  */
 void beet_tree_destroy(beet_tree_t *tree);
 
+/* ------------------------------------------------------------------------
+ * Write all dirty nodes to disk
+ * (if 'wait' is 0, nodes locked for writing are skipped)
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_flush(beet_tree_t *tree, char wait);
+
 /* ------------------------------------------------------------------------
  * Create first node in the tree (if needed)
  * ------------------------------------------------------------------------
@@ -89,6 +133,61 @@ beet_err_t beet_tree_upsert(beet_tree_t   *tree,
                             const void     *key,
                             const void    *data);
 
+/* ------------------------------------------------------------------------
+ * Called by the batch insert between two leaves
+ * (no node is held at that point)
+ * ------------------------------------------------------------------------
+ */
+typedef beet_err_t (*beet_tree_step_t)(void *arg);
+
+/* ------------------------------------------------------------------------
+ * Insert a batch of n keys (stored one after the other) and
+ * their data (n elements of 'dstride' bytes; NULL if there is no data).
+ * If 'sorted' is 0, the batch is sorted first (the arrays are not changed).
+ * Keys are processed in ascending order; on error, the keys before
+ * the failing one are in the tree.
+ * If 'step' is not NULL, it is called with 'arg' whenever
+ * the batch moves on to the next leaf.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_insertBatch(beet_tree_t   *tree,
+                                 beet_pageid_t *root,
+                                 const char    *keys,
+                                 const char    *data,
+                                 uint32_t    dstride,
+                                 uint32_t          n,
+                                 char         sorted,
+                                 char            upd,
+                                 beet_tree_step_t step,
+                                 void           *arg);
+
+/* ------------------------------------------------------------------------
+ * Source of (key, data) pairs for the bulk loader:
+ * sets key and data to the next pair in ascending key order
+ * or returns BEET_ERR_EOF. Key and data are copied
+ * before the source is called again.
+ * ------------------------------------------------------------------------
+ */
+typedef beet_err_t (*beet_tree_next_t)(void *src, const void **key,
+                                                  const void **data);
+
+/* ------------------------------------------------------------------------
+ * Build the tree bottom-up from a sorted source
+ * ------------------------------------------------------------------------
+ * The tree must be empty (root is BEET_PAGE_NULL or an empty leaf).
+ * Nodes are filled left to right up to 'fill' percent
+ * (0: as full as possible) and written in the order
+ * they are allocated. Data is copied as is
+ * (the data insertion callback is not used).
+ * The tree must not be accessed concurrently.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_bulkload(beet_tree_t     *tree,
+                              beet_pageid_t   *root,
+                              beet_tree_next_t next,
+                              void            *src,
+                              uint32_t        fill);
+
 /* ------------------------------------------------------------------------
  * Hide a key in the tree without removing data physically
  * ------------------------------------------------------------------------
@@ -105,6 +204,51 @@ beet_err_t beet_tree_unhide(beet_tree_t   *tree,
                             beet_pageid_t *root,
                             const void     *key);
 
+/* ------------------------------------------------------------------------
+ * Remove a key (hidden or not) and its data from the tree
+ * ------------------------------------------------------------------------
+ * A leaf that falls below a third of its capacity
+ * is merged into its right neighbour or, if that is too full,
+ * receives keys from its left neighbour (or is merged into it).
+ * Keys only ever move to the right, so concurrent readers
+ * find them following the right-links.
+ * The merged leaf is removed from its parent and
+ * its page is given back to the rider once no thread
+ * can be on its way to it anymore.
+ * Nonleaves are not merged; the tree never gets lower.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_delete(beet_tree_t   *tree,
+                            beet_pageid_t *root,
+                            const void     *key);
+
+/* ------------------------------------------------------------------------
+ * Remove the hidden keys from one leaf
+ * ------------------------------------------------------------------------
+ * The leaf is the one where 'cursor' belongs or,
+ * if cursor is NULL, the leftmost leaf.
+ * The hidden keys are removed in one pass and the leaf is
+ * rebalanced as in delete. The first key of the next leaf
+ * is copied to 'next' (which may point to the cursor);
+ * if there is no next leaf, BEET_ERR_EOF is returned.
+ * 'n' (if not NULL) receives the number of keys removed.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_purge(beet_tree_t   *tree,
+                           beet_pageid_t *root,
+                           const void   *cursor,
+                           void           *next,
+                           uint32_t          *n);
+
+/* ------------------------------------------------------------------------
+ * Give all pages of the tree back to the rider
+ * and set root to BEET_PAGE_NULL.
+ * The tree must not be accessed concurrently.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_tree_drop(beet_tree_t   *tree,
+                          beet_pageid_t *root);
+
 /* ------------------------------------------------------------------------
  * Get the node that contains the given key
  * ------------------------------------------------------------------------
@@ -141,9 +285,17 @@ beet_err_t beet_tree_next(beet_tree_t  *tree,
 /* ------------------------------------------------------------------------
  * Get prev
  * ------------------------------------------------------------------------
+ * Unlike next, prev releases 'cur' (also on error).
+ * 'low' is the least key seen so far (or NULL);
+ * the node returned contains the greatest keys less than 'low'.
+ * This is usually the left neighbour of 'cur',
+ * but keys may have been moved to the right while
+ * no lock was held, so it may even be 'cur' again.
+ * ------------------------------------------------------------------------
  */
 beet_err_t beet_tree_prev(beet_tree_t  *tree,
                           beet_node_t   *cur,
+                          const void    *low,
                           beet_node_t **prev);
 
 /* ------------------------------------------------------------------------
@@ -0,0 +1,693 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2023
+ * ========================================================================
+ * Write-ahead Log
+ * ========================================================================
+ * The log is a sequence of records:
+ * - a header (magic, # of pages, sequence, root, size of the pages)
+ * - for each page: file, size, pageid and the image of the page
+ * - a checksum (FNV-1a) over header and pages.
+ * The first record (sequence 0) is the base record without pages;
+ * the groups follow with sequences 1, 2, ...
+ * A record that is incomplete or does not match its checksum
+ * ends the log (it was being written when the system crashed).
+ * ========================================================================
+ */
+#include <beet/wal.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MAGIC 0x4c415742
+
+#define WALNULL() \
+	if (wal == NULL) return BEET_ERR_INVALID;
+
+/* ------------------------------------------------------------------------
+ * Record header
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	uint32_t  magic; /* MAGIC                     */
+	uint32_t npages; /* # of pages in the record  */
+	uint64_t    seq; /* sequence since the base   */
+	uint64_t   root; /* root of the index         */
+	uint64_t   size; /* size of the page entries  */
+} header_t;
+
+/* ------------------------------------------------------------------------
+ * Page entry (followed by the image)
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	uint32_t   file; /* BEET_WAL_*                */
+	uint32_t   size; /* size of the image         */
+	uint64_t pageid; /* the page                  */
+} entry_t;
+
+/* ------------------------------------------------------------------------
+ * Helper: FNV-1a
+ * ------------------------------------------------------------------------
+ */
+static uint64_t checksum(const char *buf, size_t len) {
+	uint64_t h = 14695981039346656037ULL;
+
+	for(size_t i=0; i<len; i++) {
+		h ^= (unsigned char)buf[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: write all of buf at offset 'off'
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t writeAll(int fd, const char *buf, size_t len, off_t off) {
+	ssize_t r;
+
+	while(len > 0) {
+		r = pwrite(fd, buf, len, off);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) return BEET_OSERR_WRITE;
+		buf += r; len -= (size_t)r; off += r;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: read all of buf from offset 'off' (0: end of file reached)
+ * ------------------------------------------------------------------------
+ */
+static char readAll(int fd, char *buf, size_t len, off_t off) {
+	ssize_t r;
+
+	while(len > 0) {
+		r = pread(fd, buf, len, off);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) return 0;
+		buf += r; len -= (size_t)r; off += r;
+	}
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: make a record with room for 'size' bytes of page entries
+ * ------------------------------------------------------------------------
+ */
+static char *mkrecord(uint32_t npages, uint64_t seq,
+                      beet_pageid_t root, uint64_t size) {
+	header_t *hdr;
+	char *buf;
+
+	buf = malloc(sizeof(header_t) + size + sizeof(uint64_t));
+	if (buf == NULL) return NULL;
+
+	hdr = (header_t*)buf;
+	hdr->magic = MAGIC;
+	hdr->npages = npages;
+	hdr->seq = seq;
+	hdr->root = root;
+	hdr->size = size;
+	return buf;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: seal the record with its checksum and return its length
+ * ------------------------------------------------------------------------
+ */
+static size_t seal(char *buf) {
+	size_t len = sizeof(header_t) + ((header_t*)buf)->size;
+	uint64_t h = checksum(buf, len);
+
+	memcpy(buf+len, &h, sizeof(uint64_t));
+	return len + sizeof(uint64_t);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: start a new log with a base record
+ *         (called while no operation is in flight)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t restart(beet_wal_t *wal) {
+	beet_err_t err;
+	size_t len;
+	char *buf;
+
+	buf = mkrecord(0, 0, *wal->root, 0);
+	if (buf == NULL) return BEET_ERR_NOMEM;
+	len = seal(buf);
+
+	if (ftruncate(wal->fd, 0) != 0) {
+		free(buf); return BEET_OSERR_WRITE;
+	}
+	err = writeAll(wal->fd, buf, len, 0); free(buf);
+	if (err != BEET_OK) return err;
+	if (fdatasync(wal->fd) != 0) return BEET_OSERR_FLUSH;
+
+	wal->size = len;
+	wal->seq = 0;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Init
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_init(beet_wal_t    *wal,
+                         char         *path,
+                         beet_pageid_t *root,
+                         uint64_t        max) {
+	beet_err_t err;
+
+	WALNULL();
+	if (path == NULL || root == NULL) return BEET_ERR_INVALID;
+
+	memset(wal, 0, sizeof(beet_wal_t));
+
+	wal->root = root;
+	wal->max = max;
+
+	wal->fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (wal->fd < 0) return BEET_OSERR_OPEN;
+
+	err = beet_latch_init(&wal->latch);
+	if (err != BEET_OK) {
+		close(wal->fd); wal->fd = -1;
+		return err;
+	}
+	err = beet_cond_init(&wal->wake);
+	if (err != BEET_OK) {
+		beet_latch_destroy(&wal->latch);
+		close(wal->fd); wal->fd = -1;
+		return err;
+	}
+	err = restart(wal);
+	if (err != BEET_OK) {
+		beet_wal_destroy(wal);
+		return err;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void beet_wal_destroy(beet_wal_t *wal) {
+	if (wal == NULL) return;
+	if (wal->fd >= 0) {
+		close(wal->fd); wal->fd = -1;
+	}
+	if (wal->changes != NULL) {
+		free(wal->changes); wal->changes = NULL;
+		wal->nchanges = 0; wal->mchanges = 0;
+	}
+	beet_cond_destroy(&wal->wake);
+	beet_latch_destroy(&wal->latch);
+}
+
+/* ------------------------------------------------------------------------
+ * Log rider
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_addRider(beet_wal_t   *wal,
+                             beet_rider_t *rider,
+                             uint32_t       file) {
+	WALNULL();
+	if (rider == NULL) return BEET_ERR_INVALID;
+	if (file >= BEET_WAL_FILES) return BEET_ERR_INVALID;
+
+	wal->riders[file] = rider;
+	return beet_rider_setWal(rider, wal, file);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: wait for something to happen (latch is held)
+ * ------------------------------------------------------------------------
+ */
+static inline beet_err_t await(beet_wal_t *wal) {
+	return beet_cond_wait(&wal->wake, &wal->latch, NULL);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: tell everybody that something happened (latch is held)
+ * ------------------------------------------------------------------------
+ */
+static inline void wakeup(beet_wal_t *wal) {
+	beet_cond_broadcast(&wal->wake);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: become the leader (latch is held)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t lead(beet_wal_t *wal) {
+	beet_err_t err;
+
+	while(wal->leader) {
+		err = await(wal);
+		if (err != BEET_OK) return err;
+	}
+	wal->leader = 1;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: stop new operations and wait for those in flight
+ *         (latch is held)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t drain(beet_wal_t *wal) {
+	beet_err_t err;
+
+	wal->closed = 1;
+	while(wal->active > 0) {
+		err = await(wal);
+		if (err != BEET_OK) return err;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: copy the images of the changed pages into a group record
+ *         (called while no operation is in flight)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t cut(beet_wal_t          *wal,
+                      uint64_t               c,
+                      beet_wal_change_t *changes,
+                      uint32_t               n,
+                      char                **rec) {
+	beet_err_t err;
+	uint64_t size = 0;
+	entry_t *e;
+	char *buf, *p;
+
+	for(uint32_t i=0; i<n; i++) {
+		size += sizeof(entry_t) + wal->riders[changes[i].file]->pagesz;
+	}
+	wal->seq++;
+	buf = mkrecord(n, wal->seq, *wal->root, size);
+	if (buf == NULL) return BEET_ERR_NOMEM;
+
+	p = buf + sizeof(header_t);
+	for(uint32_t i=0; i<n; i++) {
+		beet_rider_t *rider = wal->riders[changes[i].file];
+
+		e = (entry_t*)p;
+		e->file = changes[i].file;
+		e->size = rider->pagesz;
+		e->pageid = changes[i].pageid;
+		p += sizeof(entry_t);
+
+		err = beet_rider_image(rider, changes[i].pageid, c, p);
+		if (err != BEET_OK) {
+			free(buf); return err;
+		}
+		p += rider->pagesz;
+	}
+	*rec = buf;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: append and sync the group record and
+ *         release the pages (the latch is not held)
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t commit(beet_wal_t          *wal,
+                         uint64_t               c,
+                         beet_wal_change_t *changes,
+                         uint32_t               n,
+                         char                 *rec,
+                         size_t               *len) {
+	beet_err_t err;
+
+	*len = seal(rec);
+	err = writeAll(wal->fd, rec, *len, (off_t)wal->size);
+	if (err != BEET_OK) return err;
+	if (fdatasync(wal->fd) != 0) return BEET_OSERR_FLUSH;
+
+	for(uint32_t i=0; i<n; i++) {
+		err = beet_rider_logged(wal->riders[changes[i].file],
+		                        changes[i].pageid, c);
+		if (err != BEET_OK) return err;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: commit the changes made so far
+ * ------------------------------------------------------------------------
+ * The leader calls this with the latch held;
+ * if 'reopen' is set, new operations may start
+ * as soon as the images are copied, otherwise
+ * they remain excluded (the caller reopens).
+ * On return, the latch is held again.
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t group(beet_wal_t *wal, char reopen) {
+	beet_wal_change_t *changes;
+	beet_err_t err, err2;
+	size_t len = 0;
+	uint32_t n;
+	uint64_t c;
+	char *rec = NULL;
+
+	err = drain(wal);
+	if (err != BEET_OK) return err;
+
+	c = ++wal->ncut;
+	changes = wal->changes; n = wal->nchanges;
+	wal->changes = NULL;
+	wal->nchanges = 0; wal->mchanges = 0;
+
+	err = beet_latch_unlock(&wal->latch);
+	if (err != BEET_OK) {
+		free(changes); return err;
+	}
+
+	if (n > 0) err = cut(wal, c, changes, n, &rec);
+
+	if (reopen) {
+		err2 = beet_latch_lock(&wal->latch);
+		if (err2 != BEET_OK) {
+			free(rec); free(changes); return err2;
+		}
+		wal->closed = 0; wakeup(wal);
+		err2 = beet_latch_unlock(&wal->latch);
+		if (err == BEET_OK) err = err2;
+	}
+
+	/* operations of the next group may run in the meantime */
+	if (err == BEET_OK && n > 0) {
+		err = commit(wal, c, changes, n, rec, &len);
+	}
+	free(rec); free(changes);
+
+	err2 = beet_latch_lock(&wal->latch);
+	if (err2 != BEET_OK) return err2;
+	if (err != BEET_OK) return err;
+
+	wal->size += len;
+	wal->nsynced = c;
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Begin operation
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_begin(beet_wal_t *wal) {
+	beet_err_t err, err2;
+
+	WALNULL();
+
+	err = beet_latch_lock(&wal->latch);
+	if (err != BEET_OK) return err;
+	while(wal->closed && wal->failed == BEET_OK) {
+		err = await(wal);
+		if (err != BEET_OK) break;
+	}
+	if (err == BEET_OK) err = wal->failed;
+	if (err == BEET_OK) wal->active++;
+	err2 = beet_latch_unlock(&wal->latch);
+	if (err == BEET_OK) err = err2;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * End operation
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_end(beet_wal_t *wal) {
+	beet_err_t err, err2;
+	uint64_t target;
+
+	WALNULL();
+
+	err = beet_latch_lock(&wal->latch);
+	if (err != BEET_OK) return err;
+
+	/* the next group will include our changes */
+	target = wal->ncut + 1;
+
+	wal->active--;
+	if (wal->active == 0 && wal->closed) wakeup(wal);
+
+	while(wal->nsynced < target && wal->failed == BEET_OK) {
+		if (wal->leader) {
+			err = await(wal);
+			if (err != BEET_OK) break;
+			continue;
+		}
+		wal->leader = 1;
+		err = group(wal, 1);
+		wal->leader = 0;
+		if (err != BEET_OK) wal->failed = err;
+		wakeup(wal);
+	}
+	if (err == BEET_OK) err = wal->failed;
+	err2 = beet_latch_unlock(&wal->latch);
+	if (err == BEET_OK) err = err2;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Page changed
+ * ------------------------------------------------------------------------
+ */
+char beet_wal_changed(beet_wal_t    *wal,
+                      uint32_t       file,
+                      beet_pageid_t pageid) {
+	beet_wal_change_t *tmp;
+	char logged = 0;
+
+	if (wal == NULL) return 0;
+	if (beet_latch_lock(&wal->latch) != BEET_OK) return 0;
+
+	if (wal->bypass) goto unlock;
+
+	if (wal->nchanges == wal->mchanges) {
+		uint32_t m = wal->mchanges == 0 ? 64 : 2*wal->mchanges;
+		tmp = realloc(wal->changes, m*sizeof(beet_wal_change_t));
+		if (tmp == NULL) {
+			/* the change cannot be made durable */
+			wal->failed = BEET_ERR_NOMEM;
+			goto unlock;
+		}
+		wal->changes = tmp; wal->mchanges = m;
+	}
+	wal->changes[wal->nchanges].file = file;
+	wal->changes[wal->nchanges].pageid = pageid;
+	wal->nchanges++;
+	logged = 1;
+
+unlock:
+	beet_latch_unlock(&wal->latch);
+	return logged;
+}
+
+/* ------------------------------------------------------------------------
+ * Checkpoint due
+ * ------------------------------------------------------------------------
+ */
+char beet_wal_full(beet_wal_t *wal) {
+	char full;
+
+	if (wal == NULL) return 0;
+	if (beet_latch_lock(&wal->latch) != BEET_OK) return 0;
+	full = (wal->size > wal->max);
+	beet_latch_unlock(&wal->latch);
+	return full;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: commit what is pending, run 'op' (if not NULL) unlogged,
+ *         call 'sync' and start a new log,
+ *         all while no operation is in flight
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t exclusive(beet_wal_t   *wal,
+                            beet_wal_sync_t op,
+                            void        *oparg,
+                            beet_wal_sync_t sync,
+                            void          *arg,
+                            char          force) {
+	beet_err_t err, err2;
+
+	WALNULL();
+
+	err = beet_latch_lock(&wal->latch);
+	if (err != BEET_OK) return err;
+
+	err = lead(wal);
+	if (err != BEET_OK) {
+		beet_latch_unlock(&wal->latch);
+		return err;
+	}
+
+	/* somebody else may have made the checkpoint */
+	if (!force && wal->size <= wal->max) {
+		wal->leader = 0; wakeup(wal);
+		return beet_latch_unlock(&wal->latch);
+	}
+
+	err = wal->failed;
+	if (err == BEET_OK) err = group(wal, 0);
+	if (err == BEET_OK) {
+		err = beet_latch_unlock(&wal->latch);
+		if (err != BEET_OK) return err;
+
+		if (op != NULL) {
+			wal->bypass = 1;
+			err = op(oparg);
+			wal->bypass = 0;
+		}
+		err2 = sync(arg);
+		if (err == BEET_OK) err = err2;
+		if (err2 == BEET_OK) err2 = restart(wal);
+
+		/* without a new log, we cannot go on */
+		if (err2 != BEET_OK) wal->failed = err2;
+		if (err == BEET_OK) err = err2;
+
+		err2 = beet_latch_lock(&wal->latch);
+		if (err2 != BEET_OK) return err2;
+	} else if (wal->failed == BEET_OK) wal->failed = err;
+
+	wal->closed = 0;
+	wal->leader = 0;
+	wakeup(wal);
+	err2 = beet_latch_unlock(&wal->latch);
+	if (err == BEET_OK) err = err2;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Checkpoint
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_checkpoint(beet_wal_t   *wal,
+                               beet_wal_sync_t sync,
+                               void          *arg,
+                               char          force) {
+	if (sync == NULL) return BEET_ERR_INVALID;
+	return exclusive(wal, NULL, NULL, sync, arg, force);
+}
+
+/* ------------------------------------------------------------------------
+ * Unlogged operation
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_unlogged(beet_wal_t   *wal,
+                             beet_wal_sync_t op,
+                             void        *oparg,
+                             beet_wal_sync_t sync,
+                             void          *arg) {
+	if (op == NULL || sync == NULL) return BEET_ERR_INVALID;
+	return exclusive(wal, op, oparg, sync, arg, 1);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: read the record at 'off' (NULL if there is none)
+ * ------------------------------------------------------------------------
+ */
+static char *readRecord(int fd, off_t off, uint64_t seq, size_t *len) {
+	header_t hdr;
+	uint64_t h;
+	char *buf;
+
+	if (!readAll(fd, (char*)&hdr, sizeof(header_t), off)) return NULL;
+	if (hdr.magic != MAGIC || hdr.seq != seq) return NULL;
+	if (hdr.size < (uint64_t)hdr.npages*sizeof(entry_t)) return NULL;
+
+	buf = mkrecord(hdr.npages, hdr.seq, hdr.root, hdr.size);
+	if (buf == NULL) return NULL;
+
+	if (!readAll(fd, buf+sizeof(header_t),
+	             hdr.size+sizeof(uint64_t), off+sizeof(header_t))) {
+		free(buf); return NULL;
+	}
+	*len = sizeof(header_t) + hdr.size;
+	memcpy(&h, buf + *len, sizeof(uint64_t));
+	if (h != checksum(buf, *len)) {
+		free(buf); return NULL;
+	}
+	*len += sizeof(uint64_t);
+	return buf;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: pass the pages of a record to 'apply'
+ * ------------------------------------------------------------------------
+ */
+static beet_err_t applyRecord(char *buf,
+                              beet_wal_apply_t apply,
+                              void *arg) {
+	header_t *hdr = (header_t*)buf;
+	char *p = buf + sizeof(header_t);
+	char *end = p + hdr->size;
+	beet_err_t err;
+	entry_t *e;
+
+	for(uint32_t i=0; i<hdr->npages; i++) {
+		if (p + sizeof(entry_t) > end) return BEET_ERR_BADF;
+		e = (entry_t*)p; p += sizeof(entry_t);
+		if (e->file >= BEET_WAL_FILES ||
+		    p + e->size > end) return BEET_ERR_BADF;
+		err = apply(arg, e->file, e->pageid, e->size, p);
+		if (err != BEET_OK) return err;
+		p += e->size;
+	}
+	return BEET_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Replay
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_replay(char            *path,
+                           beet_wal_apply_t apply,
+                           void             *arg,
+                           beet_pageid_t   *root,
+                           uint64_t      *groups) {
+	beet_err_t err = BEET_OK;
+	off_t off = 0;
+	size_t len;
+	char *buf;
+	int fd;
+
+	if (path == NULL || root == NULL || groups == NULL) {
+		return BEET_ERR_INVALID;
+	}
+	*groups = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) return BEET_ERR_NOFILE;
+
+	/* the base record */
+	buf = readRecord(fd, 0, 0, &len);
+	if (buf == NULL) {
+		close(fd); return BEET_ERR_NOFILE;
+	}
+	*root = ((header_t*)buf)->root;
+
+	do {
+		off += len; free(buf);
+		buf = readRecord(fd, off, *groups+1, &len);
+		if (buf == NULL) break;
+		if (apply != NULL) err = applyRecord(buf, apply, arg);
+		if (err != BEET_OK) break;
+		*root = ((header_t*)buf)->root;
+		(*groups)++;
+	} while(1);
+
+	free(buf); close(fd);
+	return err;
+}
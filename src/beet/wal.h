@@ -0,0 +1,193 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2023
+ * ========================================================================
+ * Write-ahead Log
+ * ========================================================================
+ * A redo log of page images.
+ * Writers enclose each operation in beet_wal_begin and beet_wal_end.
+ * Pages changed by an operation stay pinned in the cache
+ * (they are neither evicted nor flushed) until their images
+ * are in the log and the log is synced.
+ * beet_wal_end returns when the changes of the operation are durable.
+ * Operations ending at about the same time share one append
+ * and one fdatasync (group commit): the first waiting writer
+ * becomes the leader; it waits until no operation is in flight,
+ * copies the images of all pages changed since the last group
+ * together with the current root, lets the writers continue
+ * and then appends and syncs the group for everybody.
+ *
+ * A checkpoint writes all pages to their files, syncs them and
+ * starts a new log with a base record holding the root.
+ * On open, the groups after the base record are replayed
+ * (the last complete group wins), so that the files contain
+ * the state of the last group synced before a crash.
+ *
+ * Pages must not reach their files before they are logged;
+ * when a cache runs out of room, such pages are moved
+ * to a spill file instead (see beet_rider_setWal).
+ * ========================================================================
+ */
+#ifndef beet_wal_decl
+#define beet_wal_decl
+
+#include <beet/types.h>
+#include <beet/lock.h>
+#include <beet/rider.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* ------------------------------------------------------------------------
+ * Files (riders) in the log:
+ * leaf and nonleaf files of the index and of its embedded index
+ * ------------------------------------------------------------------------
+ */
+#define BEET_WAL_LEAF      0
+#define BEET_WAL_NONLEAF   1
+#define BEET_WAL_SUBLEAF   2
+#define BEET_WAL_SUBNOLEAF 3
+#define BEET_WAL_FILES     4
+
+/* ------------------------------------------------------------------------
+ * Page changed by an operation and not yet copied into a group
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	uint32_t          file; /* BEET_WAL_*              */
+	beet_pageid_t   pageid; /* the page                */
+} beet_wal_change_t;
+
+/* ------------------------------------------------------------------------
+ * Write-ahead Log
+ * ------------------------------------------------------------------------
+ */
+typedef struct beet_wal_st {
+	beet_latch_t    latch; /* protects the fields below     */
+	beet_cond_t      wake; /* broadcast on any state change */
+	int                fd; /* the log file                  */
+	uint64_t         size; /* current size of the log       */
+	uint64_t          max; /* checkpoint beyond this size   */
+	uint64_t          seq; /* sequence of the last record   */
+	beet_rider_t *riders[BEET_WAL_FILES]; /* logged files   */
+	beet_pageid_t   *root; /* the root of the index         */
+	beet_wal_change_t *changes; /* changes not yet copied   */
+	uint32_t     nchanges; /* # of changes                  */
+	uint32_t     mchanges; /* capacity of changes           */
+	uint32_t       active; /* # of operations in flight     */
+	uint64_t         ncut; /* # of groups copied            */
+	uint64_t      nsynced; /* # of groups synced            */
+	char           closed; /* no new operations             */
+	char           leader; /* a group is being committed    */
+	char           bypass; /* changes are not logged        */
+	beet_err_t     failed; /* the log cannot be written     */
+} beet_wal_t;
+
+/* ------------------------------------------------------------------------
+ * Open the log 'path' for an index with root 'root';
+ * the log is started anew with a base record.
+ * Checkpoints are made when the log grows beyond 'max' bytes.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_init(beet_wal_t    *wal,
+                         char         *path,
+                         beet_pageid_t *root,
+                         uint64_t        max);
+
+/* ------------------------------------------------------------------------
+ * Close the log
+ * ------------------------------------------------------------------------
+ */
+void beet_wal_destroy(beet_wal_t *wal);
+
+/* ------------------------------------------------------------------------
+ * Log the pages of rider as 'file' (BEET_WAL_*)
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_addRider(beet_wal_t   *wal,
+                             beet_rider_t *rider,
+                             uint32_t       file);
+
+/* ------------------------------------------------------------------------
+ * Begin an operation
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_begin(beet_wal_t *wal);
+
+/* ------------------------------------------------------------------------
+ * End an operation and wait until its changes are synced
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_end(beet_wal_t *wal);
+
+/* ------------------------------------------------------------------------
+ * Called by the rider when a page was changed;
+ * returns 1 if the change is logged
+ * (the rider then keeps the page pinned until
+ * beet_rider_logged is called for it), 0 otherwise.
+ * ------------------------------------------------------------------------
+ */
+char beet_wal_changed(beet_wal_t    *wal,
+                      uint32_t       file,
+                      beet_pageid_t pageid);
+
+/* ------------------------------------------------------------------------
+ * Is a checkpoint due?
+ * ------------------------------------------------------------------------
+ */
+char beet_wal_full(beet_wal_t *wal);
+
+/* ------------------------------------------------------------------------
+ * Checkpoint callback: write all pages and the root and sync them
+ * ------------------------------------------------------------------------
+ */
+typedef beet_err_t (*beet_wal_sync_t)(void *arg);
+
+/* ------------------------------------------------------------------------
+ * Checkpoint: commit pending changes, call 'sync' while
+ * no operation is in flight and start a new log.
+ * Without 'force', nothing is done if the log is not full.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_checkpoint(beet_wal_t   *wal,
+                               beet_wal_sync_t sync,
+                               void          *arg,
+                               char          force);
+
+/* ------------------------------------------------------------------------
+ * Run 'op' with 'oparg' as one unlogged operation
+ * while no other operation is in flight
+ * and checkpoint afterwards (used for bulk loads).
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_unlogged(beet_wal_t   *wal,
+                             beet_wal_sync_t op,
+                             void        *oparg,
+                             beet_wal_sync_t sync,
+                             void          *arg);
+
+/* ------------------------------------------------------------------------
+ * Replay callback: write 'size' bytes of page 'pageid' to 'file'
+ * ------------------------------------------------------------------------
+ */
+typedef beet_err_t (*beet_wal_apply_t)(void         *arg,
+                                       uint32_t     file,
+                                       beet_pageid_t pageid,
+                                       uint32_t     size,
+                                       char        *image);
+
+/* ------------------------------------------------------------------------
+ * Replay the log 'path' passing all page images
+ * of complete groups to 'apply' (if not NULL).
+ * On return, 'groups' is the number of groups replayed and
+ * 'root' the root of the last complete record;
+ * if the log does not exist or is empty, 'groups' is 0
+ * and 'root' is not changed.
+ * Returns BEET_ERR_NOFILE if there is no (non-empty) log.
+ * ------------------------------------------------------------------------
+ */
+beet_err_t beet_wal_replay(char            *path,
+                           beet_wal_apply_t apply,
+                           void             *arg,
+                           beet_pageid_t   *root,
+                           uint64_t      *groups);
+#endif
@@ -17,7 +17,7 @@
 #include <common/cmd.h>
 
 #define NODESZ 14
-#define BYTES 128
+#define BYTES 136
 #define KEYSZ   4
 #define DATASZ  4
 
@@ -239,7 +239,7 @@ int readRandom(beet_tree_t *tree, beet_pageid_t *root, int hi) {
 		}
 		if (!beet_node_equal(node, slot, KEYSZ, &k, &cmp, NULL)) {
 			fprintf(stderr,
-			"%lu: key not found: %d in %u (%d - %d)\n",
+			"%lu: key not found: %d in %lu (%d - %d)\n",
 			pthread_self(), k, node->self,
 			(*(int*)node->keys),
 			(*(int*)(node->keys+KEYSZ*node->size-KEYSZ)));
@@ -267,6 +267,41 @@ int readRandom(beet_tree_t *tree, beet_pageid_t *root, int hi) {
 	return 0;
 }
 
+/* -----------------------------------------------------------------------
+ * Check that all keys written by all threads are there
+ * -----------------------------------------------------------------------
+ */
+int readAll(beet_tree_t *tree, beet_pageid_t *root, int threads) {
+	beet_err_t    err;
+	beet_node_t *node;
+	int32_t slot;
+
+	for(int k=0; k<(2*threads+1)*NODESZ-1; k++) {
+
+		/* keys not written by any thread */
+		if (k >= NODESZ-1 && (k+1)/NODESZ%2 == 1) continue;
+
+		err = beet_tree_get(tree, root, &k, &node);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot get node");
+			return -1;
+		}
+		slot = beet_node_search(node, KEYSZ, &k, &cmp, NULL);
+		if (slot < 0 || !beet_node_equal(node, slot, KEYSZ,
+		                                  &k, &cmp, NULL)) {
+			fprintf(stderr, "key not found: %d\n", k);
+			beet_tree_release(tree, node); free(node);
+			return -1;
+		}
+		err = beet_tree_release(tree, node); free(node);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot release node");
+			return -1;
+		}
+	}
+	return 0;
+}
+
 /* -----------------------------------------------------------------------
  * What the threads do
  * -----------------------------------------------------------------------
@@ -275,8 +310,9 @@ void randomReadOrWrite(params_t *params,
                        int lo, int hi) {
 	int x;
 
+	/* each range is written at least once */
 	for(int i=0; i<10; i++) {
-		x = rand()%2;
+		x = i==0?1:rand()%2;
 
 		if (x) {
 			/*
@@ -575,6 +611,11 @@ int testrun(int threads) {
 		fprintf(stderr, "final readRandom failed\n");
 		return -1;
 	}
+	if (readAll(&params.tree, &params.root, threads) != 0) {
+		params_destroy(&params);
+		fprintf(stderr, "final readAll failed\n");
+		return -1;
+	}
 
 	/* cleanup */
 	params_destroy(&params);
@@ -15,7 +15,7 @@
 
 #define NODESZ 14
 #define BIG   160
-#define BYTES 128
+#define BYTES 136
 #define KEYSZ   4
 
 void errmsg(beet_err_t err, char *s) {
@@ -113,7 +113,7 @@ int initTree(beet_tree_t *tree, char *base,
 	if (initRider(nlfs, base, name1) != 0) return -1;
 	if (initRider(lfs, base, name2) != 0) return -1;
 
-	ds = ins == NULL ? 0 : sizeof(beet_pageid_t);
+	ds = ins == NULL ? 0 : BEET_NODE_PTRSZ;
 	err = beet_tree_init(tree, NODESZ, NODESZ, KEYSZ, ds,
 	    nlfs, lfs, roof, &compare, NULL, NULL, NULL, ins);
 	if (err != BEET_OK) {
@@ -171,7 +171,7 @@ int testReadRandom(beet_tree_t *tree, beet_pageid_t *root, int hi) {
 			return -1;
 		}
 		if (!beet_node_equal(node, slot, KEYSZ, &k, &compare, NULL)) {
-			fprintf(stderr, "key not found: %d in %u (%d - %d)\n", k,
+			fprintf(stderr, "key not found: %d in %lu (%d - %d)\n", k,
 					node->self,
 			                (*(int*)node->keys),
 			                (*(int*)(node->keys+KEYSZ*node->size-KEYSZ)));
@@ -17,6 +17,8 @@
 #define BASE   "rsc"
 #define EMBIDX "idx20"
 #define HOSTIDX "idx30"
+#define BULKEMB "idx21"
+#define BULKIDX "idx31"
 
 void errmsg(beet_err_t err, char *msg) {
 	fprintf(stderr, "%s: %s (%d)\n", msg, beet_errdesc(err), err);
@@ -26,6 +28,7 @@ void errmsg(beet_err_t err, char *msg) {
 }
 
 beet_config_t config;
+beet_pool_t pool = NULL;
 
 int createIndex(char *base, char *path, beet_config_t *cfg) {
 	beet_err_t err;
@@ -43,11 +46,8 @@ beet_index_t openIndex(char *base, char *path, void *handle) {
 	beet_index_t idx=NULL;
 	beet_open_config_t cfg;
 
-	cfg.leafCacheSize = BEET_CACHE_IGNORE;
-	cfg.intCacheSize = BEET_CACHE_IGNORE;
-	cfg.compare = NULL;
-	cfg.rscinit = NULL;
-	cfg.rscdest = NULL;
+	beet_open_config_ignore(&cfg);
+	cfg.pool = pool;
 
 	err = beet_index_open(base, path, handle, &cfg, &idx);
 	if (err != BEET_OK) {
@@ -273,6 +273,230 @@ int dontfind(beet_index_t idx, int hi) {
 	return 0;
 }
 
+/* like writeRange, but all pairs in one batch (in reverse order) */
+int writeBatch(beet_index_t idx, int lo, int hi) {
+	beet_pair_t *pairs;
+	uint64_t *keys, *keys2;
+	beet_err_t err;
+	int n=0, m;
+
+	fprintf(stderr, "writing batch %d to %d\n", lo, hi);
+	for(uint64_t k=lo; k<hi; k++) {
+		for(uint64_t i=1; i<=k; i++) {
+			if (i>1 && gcd(k,i) != 1) continue;
+			n++;
+		}
+	}
+	keys = malloc(2*n*sizeof(uint64_t));
+	if (keys == NULL) return -1;
+	keys2 = keys+n;
+	pairs = malloc(n*sizeof(beet_pair_t));
+	if (pairs == NULL) {
+		free(keys); return -1;
+	}
+	m = n;
+	for(uint64_t k=lo; k<hi; k++) {
+		for(uint64_t i=1; i<=k; i++) {
+			if (i>1 && gcd(k,i) != 1) continue;
+			m--;
+			keys[m] = k;
+			keys2[m] = i;
+			pairs[m].key = keys2+m;
+			pairs[m].data = NULL;
+		}
+	}
+	err = beet_index_upsertBatch(idx, keys, pairs, n, 0);
+	free(keys); free(pairs);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot upsert batch");
+		return -1;
+	}
+	return 0;
+}
+
+/* delete random data points below lo and the keys from lo to hi */
+int deleteDeep(beet_index_t idx, ts_algo_map_t *hidden, int lo, int hi) {
+	beet_err_t err;
+	uint64_t k, x;
+
+	fprintf(stderr, "deleting %d to %d\n", lo, hi);
+	for(int i=0; i<25; i++) {
+		do k=rand()%lo; while(k==0);
+
+		for(uint64_t z=1;z<=k; z++) {
+			if (gcd(k,z) != 1 || rand()%2) continue;
+			x = (k << 16) + z;
+			err = beet_index_delete2(idx, &k, &z);
+			if (err == BEET_ERR_KEYNOF &&
+			    ts_algo_map_getId(hidden, x) != NULL) continue;
+			if (err != BEET_OK) {
+				fprintf(stderr, "%lu for %lu: ", z, k);
+				errmsg(err, "cannot delete");
+				return -1;
+			}
+			err = beet_index_doesExist2(idx, &k, &z);
+			if (err != BEET_ERR_KEYNOF) {
+				fprintf(stderr, "deleted %lu for %lu: ", z, k);
+				errmsg(err, "wrong error");
+				return -1;
+			}
+			if (ts_algo_map_getId(hidden, x) != NULL) continue;
+			if (ts_algo_map_addId(hidden, x, FAKEDATA) != TS_ALGO_OK) {
+				fprintf(stderr, "cannot add key %lu to map\n", x);
+				return -1;
+			}
+		}
+	}
+	for(k=lo; k<hi; k++) {
+		err = beet_index_delete(idx, &k);
+		if (err != BEET_OK) {
+			fprintf(stderr, "%lu: ", k);
+			errmsg(err, "cannot delete");
+			return -1;
+		}
+		err = beet_index_doesExist(idx, &k);
+		if (err != BEET_ERR_KEYNOF) {
+			fprintf(stderr, "deleted %lu: ", k);
+			errmsg(err, "wrong error");
+			return -1;
+		}
+		for(uint64_t z=1;z<=k; z++) {
+			if (gcd(k,z) != 1) continue;
+			x = (k << 16) + z;
+			if (ts_algo_map_getId(hidden, x) != NULL) continue;
+			if (ts_algo_map_addId(hidden, x, FAKEDATA) != TS_ALGO_OK) {
+				fprintf(stderr, "cannot add key %lu to map\n", x);
+				return -1;
+			}
+		}
+	}
+	k = lo;
+	err = beet_index_delete(idx, &k);
+	if (err != BEET_ERR_KEYNOF) {
+		errmsg(err, "deleted twice");
+		return -1;
+	}
+	return 0;
+}
+
+/* stream of (n, (i, NULL)) for all i <= n with gcd(n,i) = 1 */
+typedef struct {
+	uint64_t n;
+	uint64_t i;
+	uint64_t hi;
+	uint64_t key1;
+	uint64_t key2;
+	beet_pair_t pair;
+} stream_t;
+
+beet_err_t nextPair(void *stream, const void **key, const void **data) {
+	stream_t *s = stream;
+
+	do {
+		s->i++;
+		if (s->i > s->n) {
+			s->n++; s->i = 1;
+		}
+		if (s->n >= s->hi) return BEET_ERR_EOF;
+	} while(s->i > 1 && gcd(s->n, s->i) != 1);
+
+	s->key1 = s->n;
+	s->key2 = s->i;
+	s->pair.key = &s->key2;
+	s->pair.data = NULL;
+
+	*key = &s->key1;
+	*data = &s->pair;
+	return BEET_OK;
+}
+
+int bulkLoad(void *handle, int hi, uint32_t pids) {
+	beet_config_t cfg;
+	beet_index_t idx;
+	ts_algo_map_t hidden;
+	beet_err_t err;
+	stream_t s;
+	int rc = -1;
+
+	fprintf(stderr, "bulk loading 1 to %d\n", hi);
+
+	memcpy(&cfg, &config, sizeof(beet_config_t));
+	cfg.indexType = BEET_INDEX_NULL;
+	cfg.subPath = NULL;
+	cfg.dataSize = 0;
+	cfg.pageIds = pids;
+	if (createIndex(BASE, BULKEMB, &cfg) != 0) return -1;
+
+	/* the host must store pageids of the embedded size */
+	cfg.indexType = BEET_INDEX_HOST;
+	cfg.subPath = BULKEMB;
+	cfg.pageIds = BEET_PAGEID_32;
+	cfg.dataSize = BEET_PAGEID_SIZE(pids) == 4 ? 8 : 4;
+	if (createIndex(BASE, BULKIDX, &cfg) != 0) return -1;
+	idx = openIndex(BASE, BULKIDX, handle);
+	if (idx != NULL) {
+		fprintf(stderr, "host with wrong dataSize opened\n");
+		beet_index_close(idx);
+		return -1;
+	}
+	cfg.dataSize = BEET_PAGEID_SIZE(pids);
+	if (createIndex(BASE, BULKIDX, &cfg) != 0) return -1;
+
+	if (ts_algo_map_init(&hidden, 0, ts_algo_hash_id, NULL) != TS_ALGO_OK) {
+		fprintf(stderr, "cannot init map\n");
+		return -1;
+	}
+
+	idx = openIndex(BASE, BULKIDX, handle);
+	if (idx == NULL) {
+		ts_algo_map_destroy(&hidden);
+		return -1;
+	}
+
+	memset(&s, 0, sizeof(stream_t));
+	s.n = 1; s.i = 0; s.hi = hi;
+	err = beet_index_bulkload(idx, nextPair, &s, 90);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot bulk load");
+		goto cleanup;
+	}
+	if (testDoesExist(idx, hi) != 0) goto cleanup;
+	if (deepExists(idx, &hidden, hi) != 0) goto cleanup;
+	if (dontfind(idx, hi) != 0) goto cleanup;
+
+	/* grow the loaded index */
+	if (writeRange(idx, &hidden, hi/2, 2*hi) != 0) goto cleanup;
+	if (deepExists(idx, &hidden, 2*hi) != 0) goto cleanup;
+	if (dontfind(idx, 2*hi) != 0) goto cleanup;
+	rc = 0;
+
+cleanup:
+	beet_index_close(idx);
+	ts_algo_map_destroy(&hidden);
+	return rc;
+}
+
+int purgeHost(beet_index_t idx, uint64_t k) {
+	beet_err_t err;
+
+	err = beet_index_hide(idx, &k);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot hide");
+		return -1;
+	}
+	while((err = beet_index_purge(idx, 1)) == BEET_OK);
+	if (err != BEET_ERR_EOF) {
+		errmsg(err, "cannot purge");
+		return -1;
+	}
+	err = beet_index_delete(idx, &k);
+	if (err != BEET_ERR_KEYNOF) {
+		errmsg(err, "hidden key not purged");
+		return -1;
+	}
+	return 0;
+}
+
 int main() {
 	int rc = EXIT_SUCCESS;
 	beet_index_t idx;
@@ -387,8 +611,13 @@ int main() {
 		rc = EXIT_FAILURE; goto cleanup;
 	}
 
-	/* close/open in between */
+	/* close/open in between,
+	   now with all caches sharing a small pool */
 	beet_index_close(idx); haveIndex = 0;
+	if (beet_pool_new(64*256, &pool) != BEET_OK) {
+		fprintf(stderr, "cannot create pool\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
 	idx = openIndex(BASE, HOSTIDX, handle);
 	if (idx == NULL) {
 		fprintf(stderr, "openIndex (2) failed\n");
@@ -446,8 +675,57 @@ int main() {
 		rc = EXIT_FAILURE; goto cleanup;
 	}
 
+	/* batches */
+	if (writeBatch(idx, 200, 250) != 0) {
+		fprintf(stderr, "writeBatch 200-250 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (deepExists(idx, &hidden, 250) != 0) {
+		fprintf(stderr, "deepExists 250 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (dontfind(idx, 250) != 0) {
+		fprintf(stderr, "dontfind 250 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+	/* delete */
+	if (deleteDeep(idx, &hidden, 240, 250) != 0) {
+		fprintf(stderr, "deleteDeep 240-250 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (deepExists(idx, &hidden, 250) != 0) {
+		fprintf(stderr, "deepExists 250 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (writeRange(idx, &hidden, 240, 250) != 0) {
+		fprintf(stderr, "writeRange 240-250 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (deepExists(idx, &hidden, 250) != 0) {
+		fprintf(stderr, "deepExists 250 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+	/* purge drops the embedded trees of hidden keys */
+	if (purgeHost(idx, 245) != 0) {
+		fprintf(stderr, "purgeHost 245 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+	/* bulk load */
+	if (bulkLoad(handle, 150, BEET_PAGEID_32) != 0) {
+		fprintf(stderr, "bulkLoad 150 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (bulkLoad(handle, 150, BEET_PAGEID_64) != 0) {
+		fprintf(stderr, "bulkLoad 150 (64bit) failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
 cleanup:
 	if (haveIndex) beet_index_close(idx);
+	if (pool != NULL) beet_pool_destroy(pool);
 	if (haveMap) ts_algo_map_destroy(&hidden);
 	if (handle != NULL) beet_lib_close(handle);
 	if (rc == EXIT_SUCCESS) {
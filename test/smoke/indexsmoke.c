@@ -12,6 +12,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 void errmsg(beet_err_t err, char *msg) {
 	fprintf(stderr, "%s: %s (%d)\n", msg, beet_errdesc(err), err);
@@ -45,11 +50,8 @@ beet_index_t openIndex(char *path) {
 	beet_index_t idx=NULL;
 	beet_open_config_t cfg;
 
-	cfg.leafCacheSize = BEET_CACHE_IGNORE;
-	cfg.intCacheSize = BEET_CACHE_IGNORE;
+	beet_open_config_ignore(&cfg);
 	cfg.compare = &compare;
-	cfg.rscinit = NULL;
-	cfg.rscdest = NULL;
 
 	err = beet_index_open("rsc", "idx10", NULL, &cfg, &idx);
 	if (err != BEET_OK) {
@@ -315,6 +317,1047 @@ int hideAndSeek(beet_index_t idx, ts_algo_map_t *hidden, int hi) {
 	return 0;
 }
 
+/* stream of keys from 0 to hi */
+typedef struct {
+	int cur;
+	int hi;
+	int step;
+	int key;
+} stream_t;
+
+beet_err_t nextKey(void *stream, const void **key, const void **data) {
+	stream_t *s = stream;
+	if (s->cur >= s->hi) return BEET_ERR_EOF;
+	s->key = s->cur;
+	*key = &s->key;
+	*data = &s->key;
+	s->cur += s->step;
+	return BEET_OK;
+}
+
+/* unsorted: goes back at key 100 */
+beet_err_t nextBad(void *stream, const void **key, const void **data) {
+	stream_t *s = stream;
+	if (s->cur >= s->hi) return BEET_ERR_EOF;
+	if (s->cur == 100) s->cur = 10;
+	s->key = s->cur;
+	*key = &s->key;
+	*data = &s->key;
+	s->cur += s->step;
+	return BEET_OK;
+}
+
+int bulkLoad(beet_config_t *cfg, uint32_t fill, int hi) {
+	beet_index_t idx;
+	beet_err_t err;
+	stream_t s;
+	int rc = -1;
+	int d;
+
+	fprintf(stderr, "bulk loading %d keys (fill %u)\n", hi/2, fill);
+
+	if (createIndex(cfg) != 0) return -1;
+	idx = openIndex("rsc/idx10");
+	if (idx == NULL) return -1;
+
+	s.cur = 0; s.hi = hi; s.step = 2;
+	err = beet_index_bulkload(idx, nextKey, &s, fill);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot bulk load");
+		goto cleanup;
+	}
+
+	/* only empty indices can be loaded */
+	s.cur = 0;
+	err = beet_index_bulkload(idx, nextKey, &s, fill);
+	if (err != BEET_ERR_NOTEMPTY) {
+		errmsg(err, "bulk loaded twice");
+		goto cleanup;
+	}
+
+	/* fill the gaps */
+	for(int i=1; i<hi; i+=2) {
+		err = beet_index_insert(idx, &i, &i);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot insert after bulk load");
+			goto cleanup;
+		}
+	}
+
+	/* close/open and read all */
+	beet_index_close(idx);
+	idx = openIndex("rsc/idx10");
+	if (idx == NULL) return -1;
+
+	for(int i=0; i<hi; i++) {
+		err = beet_index_copy(idx, &i, &d);
+		if (err != BEET_OK) {
+			fprintf(stderr, "key %d: ", i);
+			errmsg(err, "cannot copy from index");
+			goto cleanup;
+		}
+		if (d != i) {
+			fprintf(stderr, "wrong data: %d - %d\n", i, d);
+			goto cleanup;
+		}
+	}
+	d = hi;
+	err = beet_index_doesExist(idx, &d);
+	if (err != BEET_ERR_KEYNOF) {
+		errmsg(err, "key exists");
+		goto cleanup;
+	}
+	rc = 0;
+
+cleanup:
+	beet_index_close(idx);
+	err = beet_index_drop("rsc", "idx10");
+	if (err != BEET_OK) {
+		errmsg(err, "cannot drop index");
+		return -1;
+	}
+	return rc;
+}
+
+int bulkUnsorted(beet_config_t *cfg) {
+	beet_index_t idx;
+	beet_err_t err;
+	stream_t s;
+	int rc = 0;
+
+	if (createIndex(cfg) != 0) return -1;
+	idx = openIndex("rsc/idx10");
+	if (idx == NULL) return -1;
+
+	s.cur = 0; s.hi = 200; s.step = 2;
+	err = beet_index_bulkload(idx, nextBad, &s, 0);
+	if (err != BEET_ERR_NOTSORTED) {
+		errmsg(err, "unsorted stream accepted");
+		rc = -1;
+	}
+
+	beet_index_close(idx);
+	err = beet_index_drop("rsc", "idx10");
+	if (err != BEET_OK) {
+		errmsg(err, "cannot drop index");
+		return -1;
+	}
+	if (rc != 0) return rc;
+
+	/* duplicates */
+	if (createIndex(cfg) != 0) return -1;
+	idx = openIndex("rsc/idx10");
+	if (idx == NULL) return -1;
+
+	s.cur = 0; s.hi = 10; s.step = 0;
+	err = beet_index_bulkload(idx, nextKey, &s, 0);
+	if (err != BEET_ERR_DBLKEY) {
+		errmsg(err, "duplicate keys accepted");
+		rc = -1;
+	}
+	beet_index_close(idx);
+	err = beet_index_drop("rsc", "idx10");
+	if (err != BEET_OK) {
+		errmsg(err, "cannot drop index");
+		return -1;
+	}
+	return rc;
+}
+
+/* insert 0..hi-1 in shuffled batches of size n */
+int batchInsert(beet_config_t *cfg, int hi, int n) {
+	beet_index_t idx;
+	beet_err_t err;
+	int *keys, *data;
+	int rc = -1;
+	int d, k, t;
+
+	fprintf(stderr, "inserting %d keys in batches of %d\n", hi, n);
+
+	keys = malloc(hi*sizeof(int));
+	if (keys == NULL) return -1;
+	data = malloc(hi*sizeof(int));
+	if (data == NULL) {
+		free(keys); return -1;
+	}
+	for(int i=0; i<hi; i++) keys[i] = i;
+	for(int i=hi-1; i>0; i--) {
+		k = rand()%(i+1);
+		t = keys[i]; keys[i] = keys[k]; keys[k] = t;
+	}
+	for(int i=0; i<hi; i++) data[i] = keys[i];
+
+	if (createIndex(cfg) != 0) goto cleanup;
+	idx = openIndex("rsc/idx10");
+	if (idx == NULL) goto cleanup;
+
+	for(int i=0; i<hi; i+=n) {
+		int m = i+n < hi ? n : hi-i;
+		err = beet_index_insertBatch(idx, keys+i, data+i, m, 0);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot insert batch");
+			goto close;
+		}
+	}
+
+	/* keys exist already */
+	err = beet_index_insertBatch(idx, keys, data, n < hi ? n : hi, 0);
+	if (err != BEET_ERR_DBLKEY) {
+		errmsg(err, "batch inserted twice");
+		goto close;
+	}
+
+	/* upsert a sorted batch */
+	for(int i=0; i<n && i<hi; i++) {
+		keys[i] = i; data[i] = 2*i;
+	}
+	err = beet_index_upsertBatch(idx, keys, data, n < hi ? n : hi, 1);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot upsert batch");
+		goto close;
+	}
+
+	for(int i=0; i<hi; i++) {
+		err = beet_index_copy(idx, &i, &d);
+		if (err != BEET_OK) {
+			fprintf(stderr, "key %d: ", i);
+			errmsg(err, "cannot copy from index");
+			goto close;
+		}
+		if (d != (i < n ? 2*i : i)) {
+			fprintf(stderr, "wrong data: %d - %d\n", i, d);
+			goto close;
+		}
+	}
+	rc = 0;
+
+close:
+	beet_index_close(idx);
+	err = beet_index_drop("rsc", "idx10");
+	if (err != BEET_OK) {
+		errmsg(err, "cannot drop index");
+		rc = -1;
+	}
+
+cleanup:
+	free(keys); free(data);
+	return rc;
+}
+
+int scanKeys(beet_index_t idx, beet_dir_t dir, char *there, int hi) {
+	beet_iter_t iter;
+	beet_err_t err;
+	int *k, *d;
+	int o, c=0, rc=-1;
+
+	err = beet_iter_alloc(idx, &iter);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot create iter");
+		return -1;
+	}
+	err = beet_index_range(idx, NULL, dir, iter);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot init iter");
+		goto cleanup;
+	}
+	o = dir == BEET_DIR_ASC ? -1 : hi;
+	while((err = beet_iter_move(iter, (void**)&k,
+	                                  (void**)&d)) == BEET_OK) {
+		if (dir == BEET_DIR_ASC) {
+			do o++; while(o < hi && !there[o]);
+		} else {
+			do o--; while(o >= 0 && !there[o]);
+		}
+		if (*k != o || *d != o) {
+			fprintf(stderr, "expected %d, have %d/%d\n", o, *k, *d);
+			goto cleanup;
+		}
+		c++;
+	}
+	if (err != BEET_ERR_EOF) {
+		errmsg(err, "cannot move iter");
+		goto cleanup;
+	}
+	for(int i=0; i<hi; i++) if (there[i]) c--;
+	if (c != 0) {
+		fprintf(stderr, "wrong number of keys: %d\n", c);
+		goto cleanup;
+	}
+	rc = 0;
+
+cleanup:
+	beet_iter_destroy(iter);
+	return rc;
+}
+
+int deleteKeys(beet_config_t *cfg, int hi) {
+	beet_index_t idx;
+	beet_err_t err;
+	struct stat st;
+	char *there;
+	int *keys;
+	off_t sz;
+	int rc = -1;
+	int d, k, t;
+
+	fprintf(stderr, "deleting from %d keys\n", hi);
+
+	keys = malloc(hi*sizeof(int));
+	if (keys == NULL) return -1;
+	there = calloc(hi, 1);
+	if (there == NULL) {
+		free(keys); return -1;
+	}
+	for(int i=0; i<hi; i++) keys[i] = i;
+	for(int i=hi-1; i>0; i--) {
+		k = rand()%(i+1);
+		t = keys[i]; keys[i] = keys[k]; keys[k] = t;
+	}
+
+	if (createIndex(cfg) != 0) goto cleanup;
+	idx = openIndex("rsc/idx10");
+	if (idx == NULL) goto cleanup;
+
+	for(int i=0; i<hi; i++) {
+		err = beet_index_insert(idx, keys+i, keys+i);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot insert");
+			goto close;
+		}
+		there[keys[i]] = 1;
+	}
+	if (stat("rsc/idx10/leaf", &st) != 0) {
+		perror("cannot stat leaf file");
+		goto close;
+	}
+	sz = st.st_size;
+
+	/* hidden keys are deleted as well */
+	err = beet_index_hide(idx, keys);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot hide key");
+		goto close;
+	}
+
+	/* delete three quarters in random order and
+	 * everything above 7/8 (the rightmost leaves get empty) */
+	for(int i=0; i<hi; i++) {
+		if (i >= hi/4 && keys[i] < hi-hi/8) continue;
+		err = beet_index_delete(idx, keys+i);
+		if (err != BEET_OK) {
+			fprintf(stderr, "key %d: ", keys[i]);
+			errmsg(err, "cannot delete");
+			goto close;
+		}
+		there[keys[i]] = 0;
+	}
+	for(int i=0; i<hi; i++) {
+		err = beet_index_copy(idx, &i, &d);
+		if (there[i]) {
+			if (err != BEET_OK) {
+				fprintf(stderr, "key %d: ", i);
+				errmsg(err, "cannot copy from index");
+				goto close;
+			}
+			if (d != i) {
+				fprintf(stderr, "wrong data: %d - %d\n", i, d);
+				goto close;
+			}
+		} else if (err != BEET_ERR_KEYNOF) {
+			fprintf(stderr, "deleted key %d: ", i);
+			errmsg(err, "found");
+			goto close;
+		}
+	}
+	err = beet_index_delete(idx, keys);
+	if (err != BEET_ERR_KEYNOF) {
+		errmsg(err, "deleted twice");
+		goto close;
+	}
+	if (scanKeys(idx, BEET_DIR_ASC, there, hi) != 0) goto close;
+	if (scanKeys(idx, BEET_DIR_DESC, there, hi) != 0) goto close;
+
+	/* the deleted keys come back into the freed pages */
+	for(int i=0; i<hi; i++) {
+		if (there[i]) continue;
+		err = beet_index_insert(idx, &i, &i);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot insert again");
+			goto close;
+		}
+		there[i] = 1;
+	}
+	if (stat("rsc/idx10/leaf", &st) != 0) {
+		perror("cannot stat leaf file");
+		goto close;
+	}
+	if (st.st_size > 2*sz) {
+		fprintf(stderr, "leaf file has grown from %ld to %ld\n",
+		                (long)sz, (long)st.st_size);
+		goto close;
+	}
+	if (scanKeys(idx, BEET_DIR_ASC, there, hi) != 0) goto close;
+
+	/* delete all */
+	for(int i=0; i<hi; i++) {
+		err = beet_index_delete(idx, keys+i);
+		if (err != BEET_OK) {
+			fprintf(stderr, "key %d: ", keys[i]);
+			errmsg(err, "cannot delete");
+			goto close;
+		}
+		there[keys[i]] = 0;
+	}
+	if (scanKeys(idx, BEET_DIR_ASC, there, hi) != 0) goto close;
+	if (scanKeys(idx, BEET_DIR_DESC, there, hi) != 0) goto close;
+	rc = 0;
+
+close:
+	beet_index_close(idx);
+	err = beet_index_drop("rsc", "idx10");
+	if (err != BEET_OK) {
+		errmsg(err, "cannot drop index");
+		rc = -1;
+	}
+
+cleanup:
+	free(keys); free(there);
+	return rc;
+}
+
+int purgeKeys(beet_config_t *cfg, int hi) {
+	beet_index_t idx;
+	beet_err_t err;
+	char *there;
+	int rc = -1;
+	int d, n;
+
+	fprintf(stderr, "purging %d keys\n", hi);
+
+	there = calloc(hi, 1);
+	if (there == NULL) return -1;
+
+	if (createIndex(cfg) != 0) goto cleanup;
+	idx = openIndex("rsc/idx10");
+	if (idx == NULL) goto cleanup;
+
+	for(int i=0; i<hi; i++) {
+		err = beet_index_insert(idx, &i, &i);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot insert");
+			goto close;
+		}
+		there[i] = 1;
+	}
+	/* hide two thirds (the leaves get underfull) */
+	for(int i=0; i<hi; i++) {
+		if (i%3 == 0) continue;
+		err = beet_index_hide(idx, &i);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot hide");
+			goto close;
+		}
+		there[i] = 0;
+	}
+
+	/* one slice, then continue after reopening */
+	err = beet_index_purge(idx, 1);
+	if (err != BEET_OK && err != BEET_ERR_EOF) {
+		errmsg(err, "cannot purge");
+		goto close;
+	}
+	beet_index_close(idx);
+	idx = openIndex("rsc/idx10");
+	if (idx == NULL) goto cleanup;
+
+	for(n=0; n<hi; n++) {
+		err = beet_index_purge(idx, 1);
+		if (err != BEET_OK) break;
+	}
+	if (err != BEET_ERR_EOF) {
+		errmsg(err, "cannot purge");
+		goto close;
+	}
+	for(int i=0; i<hi; i++) {
+		if (there[i]) {
+			err = beet_index_copy(idx, &i, &d);
+			if (err != BEET_OK || d != i) {
+				fprintf(stderr, "key %d: ", i);
+				errmsg(err, "cannot copy from index");
+				goto close;
+			}
+		} else {
+			/* delete finds hidden keys, but not purged ones */
+			err = beet_index_delete(idx, &i);
+			if (err != BEET_ERR_KEYNOF) {
+				fprintf(stderr, "hidden key %d: ", i);
+				errmsg(err, "not purged");
+				goto close;
+			}
+		}
+	}
+	if (scanKeys(idx, BEET_DIR_ASC, there, hi) != 0) goto close;
+	if (scanKeys(idx, BEET_DIR_DESC, there, hi) != 0) goto close;
+
+	/* nothing left to do */
+	err = beet_index_purge(idx, 0);
+	if (err != BEET_ERR_EOF) {
+		errmsg(err, "cannot purge again");
+		goto close;
+	}
+	rc = 0;
+
+close:
+	beet_index_close(idx);
+	err = beet_index_drop("rsc", "idx10");
+	if (err != BEET_OK) {
+		errmsg(err, "cannot drop index");
+		rc = -1;
+	}
+
+cleanup:
+	free(there);
+	return rc;
+}
+
+int durableSync(beet_config_t *cfg, int32_t policy, int hi) {
+	beet_open_config_t ocfg;
+	beet_index_t idx;
+	beet_err_t err;
+	char *there;
+	int rc = -1;
+	int d;
+
+	fprintf(stderr, "syncing %d keys with policy %d\n", hi, policy);
+
+	there = calloc(hi, 1);
+	if (there == NULL) return -1;
+
+	if (createIndex(cfg) != 0) {
+		free(there); return -1;
+	}
+
+	beet_open_config_ignore(&ocfg);
+	ocfg.compare = &compare;
+	ocfg.flushInterval = 5;
+	ocfg.durability = policy;
+
+	err = beet_index_open("rsc", "idx10", NULL, &ocfg, &idx);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot open index");
+		free(there); return -1;
+	}
+	for(int k=0; k<hi; k++) {
+		if (rand()%3 == 0) continue;
+		err = beet_index_insert(idx, &k, &k);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot insert");
+			beet_index_close(idx); free(there);
+			return -1;
+		}
+		there[k] = 1;
+		if (k%1000 == 0) usleep(1000);
+	}
+	err = beet_index_sync(idx);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot sync index");
+		beet_index_close(idx); free(there);
+		return -1;
+	}
+	beet_index_close(idx);
+
+	idx = openIndex("rsc/idx10");
+	if (idx == NULL) {
+		free(there); return -1;
+	}
+	for(int k=0; k<hi; k++) {
+		err = beet_index_copy(idx, &k, &d);
+		if (there[k] && (err != BEET_OK || d != k)) {
+			errmsg(err, "cannot copy from index");
+			goto cleanup;
+		}
+		if (!there[k] && err != BEET_ERR_KEYNOF) {
+			fprintf(stderr, "found key %d\n", k);
+			goto cleanup;
+		}
+	}
+	if (scanKeys(idx, BEET_DIR_ASC, there, hi) != 0) goto cleanup;
+	rc = 0;
+
+cleanup:
+	beet_index_close(idx);
+	err = beet_index_drop("rsc", "idx10");
+	if (err != BEET_OK) {
+		errmsg(err, "cannot drop index");
+		rc = -1;
+	}
+	free(there);
+	return rc;
+}
+
+int readOnly(beet_config_t *cfg, int hi) {
+	beet_open_config_t ocfg;
+	beet_index_t idx;
+	beet_err_t err;
+	char *there;
+	int rc = -1;
+	int d;
+
+	fprintf(stderr, "reading %d keys from a mapped index\n", hi);
+
+	there = calloc(hi, 1);
+	if (there == NULL) return -1;
+
+	if (createIndex(cfg) != 0) {
+		free(there); return -1;
+	}
+	idx = openIndex("rsc/idx10");
+	if (idx == NULL) {
+		free(there); return -1;
+	}
+	for(int k=0; k<hi; k++) {
+		if (rand()%3 == 0) continue;
+		err = beet_index_insert(idx, &k, &k);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot insert");
+			beet_index_close(idx); free(there);
+			return -1;
+		}
+		there[k] = 1;
+	}
+	beet_index_close(idx);
+
+	beet_open_config_ignore(&ocfg);
+	ocfg.compare = &compare;
+	ocfg.readOnly = BEET_READONLY_MMAP;
+
+	err = beet_index_open("rsc", "idx10", NULL, &ocfg, &idx);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot open index");
+		free(there); return -1;
+	}
+	for(int k=0; k<hi; k++) {
+		err = beet_index_copy(idx, &k, &d);
+		if (there[k] && (err != BEET_OK || d != k)) {
+			errmsg(err, "cannot copy from index");
+			goto cleanup;
+		}
+		if (!there[k] && err != BEET_ERR_KEYNOF) {
+			fprintf(stderr, "found key %d\n", k);
+			goto cleanup;
+		}
+	}
+	if (scanKeys(idx, BEET_DIR_ASC, there, hi) != 0) goto cleanup;
+	if (scanKeys(idx, BEET_DIR_DESC, there, hi) != 0) goto cleanup;
+
+	d = hi;
+	err = beet_index_insert(idx, &d, &d);
+	if (err != BEET_ERR_RDONLY) {
+		errmsg(err, "insert into read-only index");
+		goto cleanup;
+	}
+	rc = 0;
+
+cleanup:
+	beet_index_close(idx);
+	free(there);
+	return rc;
+}
+
+/* an index as written by format version 1 (no high keys, no right-links):
+ * leaves are size, next, prev, ctrl, keys and data;
+ * nonleaves are size, keys and kids. */
+#define V1LEAF 16
+#define V1INT   8
+#define V1LPAGE (12 + V1LEAF/8+1 + 8*V1LEAF)
+#define V1IPAGE (4 + 4*V1INT + 4*(V1INT+1))
+#define V1FILL 12
+#define V1LEAFID 0x80000000
+#define V1NULL 0xffffffff
+
+int writeV1config(char *path) {
+	uint32_t cfg[10];
+	char names[4] = {0,0,0,0};
+	char p[256];
+	FILE *f;
+
+	cfg[0] = (0x8ee7<<16) | 1;
+	cfg[1] = BEET_INDEX_PLAIN;
+	cfg[2] = V1LPAGE; cfg[3] = V1IPAGE;
+	cfg[4] = V1LEAF; cfg[5] = V1INT;
+	cfg[6] = sizeof(int); cfg[7] = sizeof(int);
+	cfg[8] = 100; cfg[9] = 100;
+
+	sprintf(p, "%s/config", path);
+	f = fopen(p, "wb");
+	if (f == NULL) return -1;
+	if (fwrite(cfg, 4, 10, f) != 10 ||
+	    fwrite(names, 1, 4, f) != 4) {
+		fclose(f); return -1;
+	}
+	return fclose(f);
+}
+
+/* writes the even keys below hi; every 7th of them is hidden.
+ * Returns the height of the tree. */
+int writeV1(char *path, int hi, char *there) {
+	char page[V1LPAGE > V1IPAGE ? V1LPAGE : V1IPAGE];
+	uint32_t *ids, *lows, nids, n, nxt, prv, root;
+	int h = 1, k = 0;
+	char p[256];
+	FILE *f;
+
+	if (mkdir(path, S_IRWXU) != 0 && errno != EEXIST) return -1;
+	if (writeV1config(path) != 0) return -1;
+
+	nids = (hi/2+V1FILL-1)/V1FILL;
+	ids = calloc(nids, sizeof(uint32_t));
+	lows = calloc(nids, sizeof(uint32_t));
+	if (ids == NULL || lows == NULL) {
+		free(ids); free(lows); return -1;
+	}
+
+	/* leaves */
+	sprintf(p, "%s/leaf", path);
+	f = fopen(p, "wb");
+	if (f == NULL) goto failure;
+	for(uint32_t i=0; i<nids; i++) {
+		uint8_t *ctrl = (uint8_t*)page+12;
+		char *keys = page+12+V1LEAF/8+1;
+		char *data = keys+4*V1LEAF;
+
+		memset(page, 0, V1LPAGE);
+		nxt = i+1 < nids ? i+1 : V1NULL;
+		prv = i > 0 ? i-1 : V1NULL;
+		memcpy(page+4, &nxt, 4);
+		memcpy(page+8, &prv, 4);
+		for(n=0; n<V1FILL && k<hi; n++, k+=2) {
+			if (n == 0) lows[i] = k;
+			memcpy(keys+4*n, &k, 4);
+			memcpy(data+4*n, &k, 4);
+			if (k%14 == 0) ctrl[n/8] |= 1<<(n%8);
+			else there[k] = 1;
+		}
+		memcpy(page, &n, 4);
+		if (fwrite(page, V1LPAGE, 1, f) != 1) {
+			fclose(f); goto failure;
+		}
+		ids[i] = i | V1LEAFID;
+	}
+	if (fclose(f) != 0) goto failure;
+
+	/* nonleaves, level by level */
+	sprintf(p, "%s/nonleaf", path);
+	f = fopen(p, "wb");
+	if (f == NULL) goto failure;
+	root = 0;
+	while(nids > 1) {
+		uint32_t m = 0;
+		for(uint32_t i=0; i<nids; i+=V1INT+1) {
+			char *keys = page+4;
+			char *kids = keys+4*V1INT;
+
+			memset(page, 0, V1IPAGE);
+			for(n=0; n<=V1INT && i+n<nids; n++) {
+				memcpy(kids+4*n, ids+i+n, 4);
+				if (n > 0) memcpy(keys+4*(n-1), lows+i+n, 4);
+			}
+			n--; memcpy(page, &n, 4);
+			if (fwrite(page, V1IPAGE, 1, f) != 1) {
+				fclose(f); goto failure;
+			}
+			ids[m] = root; lows[m] = lows[i];
+			root++; m++;
+		}
+		nids = m; h++;
+	}
+	if (fclose(f) != 0) goto failure;
+
+	sprintf(p, "%s/roof", path);
+	f = fopen(p, "wb");
+	if (f == NULL) goto failure;
+	if (fwrite(ids, 4, 1, f) != 1) {
+		fclose(f); goto failure;
+	}
+	if (fclose(f) != 0) goto failure;
+
+	free(ids); free(lows);
+	return h;
+
+failure:
+	free(ids); free(lows);
+	return -1;
+}
+
+/* indices written by format version 1 are read-only */
+int oldFormat(int hi) {
+	beet_open_config_t ocfg;
+	beet_index_t idx;
+	beet_config_t cfg;
+	beet_err_t err;
+	uint32_t h;
+	char *there;
+	int rc = -1;
+	int d, x;
+
+	fprintf(stderr, "reading %d keys from an index of version 1\n", hi);
+
+	there = calloc(hi, 1);
+	if (there == NULL) return -1;
+
+	x = writeV1("rsc/idx11", hi, there);
+	if (x < 0) {
+		fprintf(stderr, "cannot write index of version 1\n");
+		free(there); return -1;
+	}
+
+	err = beet_config_get("rsc/idx11", &cfg);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot get config");
+		free(there); return -1;
+	}
+	d = cfg.layout;
+	beet_config_destroy(&cfg);
+	if (d != BEET_LAYOUT_LEGACY) {
+		fprintf(stderr, "wrong layout: %d\n", d);
+		free(there); return -1;
+	}
+
+	beet_open_config_ignore(&ocfg);
+	ocfg.compare = &compare;
+
+	err = beet_index_open("rsc", "idx11", NULL, &ocfg, &idx);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot open index");
+		free(there); return -1;
+	}
+	err = beet_index_height(idx, &h);
+	if (err != BEET_OK || h != x) {
+		fprintf(stderr, "height is %u, not %d\n", h, x);
+		goto cleanup;
+	}
+	for(int k=0; k<hi; k++) {
+		err = beet_index_copy(idx, &k, &d);
+		if (there[k] && (err != BEET_OK || d != k)) {
+			errmsg(err, "cannot copy from index");
+			goto cleanup;
+		}
+		if (!there[k] && err != BEET_ERR_KEYNOF) {
+			fprintf(stderr, "found key %d\n", k);
+			goto cleanup;
+		}
+	}
+	if (scanKeys(idx, BEET_DIR_ASC, there, hi) != 0) goto cleanup;
+	if (scanKeys(idx, BEET_DIR_DESC, there, hi) != 0) goto cleanup;
+
+	d = 1;
+	err = beet_index_insert(idx, &d, &d);
+	if (err != BEET_ERR_RDONLY) {
+		errmsg(err, "insert into index of version 1");
+		goto cleanup;
+	}
+	rc = 0;
+
+cleanup:
+	beet_index_close(idx);
+	free(there);
+	return rc;
+}
+
+typedef struct {
+	beet_index_t idx;
+	char      *there;
+	int         from;
+	int           hi;
+	int           rc;
+} walarg_t;
+
+#define WALTHREADS 16
+
+void *walWriter(void *p) {
+	walarg_t *a = p;
+	beet_err_t err;
+
+	for(int k=a->from; k<a->hi; k+=WALTHREADS) {
+		if (!a->there[k]) continue;
+		err = beet_index_insert(a->idx, &k, &k);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot insert");
+			a->rc = -1; return NULL;
+		}
+	}
+	for(int k=a->from; k<a->hi; k+=WALTHREADS) {
+		if (!a->there[k] || k%5 != 0) continue;
+		err = beet_index_delete(a->idx, &k);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot delete");
+			a->rc = -1; return NULL;
+		}
+	}
+	a->rc = 0;
+	return NULL;
+}
+
+/* the child writes with log and terminates without closing the index */
+void walCrash(beet_config_t *cfg, char *there, int hi) {
+	beet_open_config_t ocfg;
+	walarg_t args[WALTHREADS];
+	pthread_t tids[WALTHREADS];
+	beet_index_t idx;
+	beet_err_t err;
+
+	beet_open_config_ignore(&ocfg);
+	ocfg.compare = &compare;
+	ocfg.walSize = 1;
+
+	err = beet_index_open("rsc", "idx10", NULL, &ocfg, &idx);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot open index");
+		_exit(1);
+	}
+	for(int i=0; i<WALTHREADS; i++) {
+		args[i].idx = idx;
+		args[i].there = there;
+		args[i].from = i;
+		args[i].hi = hi;
+		args[i].rc = -1;
+		if (pthread_create(tids+i, NULL, walWriter, args+i) != 0) {
+			_exit(1);
+		}
+	}
+	for(int i=0; i<WALTHREADS; i++) {
+		pthread_join(tids[i], NULL);
+		if (args[i].rc != 0) _exit(1);
+	}
+	_exit(0);
+}
+
+/* with a small cache, pages not yet logged are spilled */
+int walRecovery(beet_config_t *cfg, int hi, int cache) {
+	beet_config_t small;
+	beet_index_t idx;
+	beet_err_t err;
+	char *there;
+	int status;
+	int rc = -1;
+	pid_t pid;
+	int d;
+
+	fprintf(stderr, "recovering %d keys from the log with %d pages\n",
+	                                                     hi, cache);
+
+	there = calloc(hi, 1);
+	if (there == NULL) return -1;
+
+	for(int k=0; k<hi; k++) there[k] = rand()%3 != 0;
+
+	memcpy(&small, cfg, sizeof(beet_config_t));
+	if (cache > 0) {
+		small.leafCacheSize = cache;
+		small.intCacheSize = cache;
+	}
+	if (createIndex(&small) != 0) {
+		free(there); return -1;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		free(there); return -1;
+	}
+	if (pid == 0) walCrash(&small, there, hi);
+
+	if (waitpid(pid, &status, 0) != pid ||
+	    !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "writer failed\n");
+		free(there); return -1;
+	}
+	for(int k=0; k<hi; k++) {
+		if (k%5 == 0) there[k] = 0;
+	}
+
+	idx = openIndex("rsc/idx10");
+	if (idx == NULL) {
+		free(there); return -1;
+	}
+	for(int k=0; k<hi; k++) {
+		err = beet_index_copy(idx, &k, &d);
+		if (there[k] && (err != BEET_OK || d != k)) {
+			errmsg(err, "cannot copy from index");
+			goto cleanup;
+		}
+		if (!there[k] && err != BEET_ERR_KEYNOF) {
+			fprintf(stderr, "found key %d\n", k);
+			goto cleanup;
+		}
+	}
+	if (scanKeys(idx, BEET_DIR_ASC, there, hi) != 0) goto cleanup;
+	if (scanKeys(idx, BEET_DIR_DESC, there, hi) != 0) goto cleanup;
+	rc = 0;
+
+cleanup:
+	beet_index_close(idx);
+	free(there);
+	return rc;
+}
+
+/* a logged batch larger than the cache does not wait forever for room */
+int walBatch(beet_config_t *cfg, int hi, int cache) {
+	beet_open_config_t ocfg;
+	beet_config_t small;
+	beet_index_t idx;
+	beet_err_t err;
+	int *keys;
+	int rc = -1;
+	int d, k, t;
+
+	fprintf(stderr, "logging a batch of %d keys with %d pages\n",
+	                                              hi, cache);
+
+	keys = malloc(hi*sizeof(int));
+	if (keys == NULL) return -1;
+	for(int i=0; i<hi; i++) keys[i] = i;
+	for(int i=hi-1; i>0; i--) {
+		k = rand()%(i+1);
+		t = keys[i]; keys[i] = keys[k]; keys[k] = t;
+	}
+
+	memcpy(&small, cfg, sizeof(beet_config_t));
+	small.leafCacheSize = cache;
+	small.intCacheSize = cache;
+	if (createIndex(&small) != 0) {
+		free(keys); return -1;
+	}
+
+	beet_open_config_ignore(&ocfg);
+	ocfg.compare = &compare;
+	ocfg.walSize = 1;
+
+	err = beet_index_open("rsc", "idx10", NULL, &ocfg, &idx);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot open index");
+		free(keys); return -1;
+	}
+	err = beet_index_insertBatch(idx, keys, keys, hi, 0);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot insert batch");
+		goto cleanup;
+	}
+	for(int i=0; i<hi; i++) {
+		err = beet_index_copy(idx, &i, &d);
+		if (err != BEET_OK || d != i) {
+			fprintf(stderr, "key %d: ", i);
+			errmsg(err, "cannot copy from index");
+			goto cleanup;
+		}
+	}
+	rc = 0;
+
+cleanup:
+	beet_index_close(idx);
+	free(keys);
+	return rc;
+}
+
 int main() {
 	beet_config_t config;
 	int rc = EXIT_SUCCESS;
@@ -469,6 +1512,106 @@ int main() {
 		rc = EXIT_FAILURE; goto cleanup;
 	}
 
+	/* bulk load */
+	beet_index_close(idx); haveIndex = 0;
+	if (beet_index_drop("rsc", "idx10") != BEET_OK) {
+		fprintf(stderr, "cannot drop index\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (bulkLoad(&config, 0, 26) != 0) {
+		fprintf(stderr, "bulkLoad 13 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (bulkLoad(&config, 100, 2000) != 0) {
+		fprintf(stderr, "bulkLoad 1000 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (bulkLoad(&config, 70, 20000) != 0) {
+		fprintf(stderr, "bulkLoad 10000 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (bulkLoad(&config, 1, 2000) != 0) {
+		fprintf(stderr, "bulkLoad 1000 (1%%) failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (batchInsert(&config, 100, 7) != 0) {
+		fprintf(stderr, "batchInsert 100/7 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (batchInsert(&config, 10000, 1000) != 0) {
+		fprintf(stderr, "batchInsert 10000/1000 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (bulkUnsorted(&config) != 0) {
+		fprintf(stderr, "bulkUnsorted failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (deleteKeys(&config, 100) != 0) {
+		fprintf(stderr, "deleteKeys 100 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (deleteKeys(&config, 20000) != 0) {
+		fprintf(stderr, "deleteKeys 20000 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (purgeKeys(&config, 100) != 0) {
+		fprintf(stderr, "purgeKeys 100 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (purgeKeys(&config, 20000) != 0) {
+		fprintf(stderr, "purgeKeys 20000 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+	if (readOnly(&config, 20000) != 0) {
+		fprintf(stderr, "readOnly 20000 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (oldFormat(20000) != 0) {
+		fprintf(stderr, "oldFormat 20000 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (walRecovery(&config, 20000, 0) != 0) {
+		fprintf(stderr, "walRecovery 20000 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (walRecovery(&config, 20000, 10) != 0) {
+		fprintf(stderr, "walRecovery 20000/10 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (walBatch(&config, 2000, 20) != 0) {
+		fprintf(stderr, "walBatch 2000/20 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (durableSync(&config, BEET_DURABLE_ONSYNC, 20000) != 0) {
+		fprintf(stderr, "durableSync onsync 20000 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (durableSync(&config, BEET_DURABLE_PERIODIC, 20000) != 0) {
+		fprintf(stderr, "durableSync periodic 20000 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+	/* the same with 64bit pageids */
+	config.pageIds = BEET_PAGEID_64;
+	if (bulkLoad(&config, 70, 20000) != 0) {
+		fprintf(stderr, "bulkLoad 10000 (64bit) failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (batchInsert(&config, 10000, 1000) != 0) {
+		fprintf(stderr, "batchInsert 10000/1000 (64bit) failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (deleteKeys(&config, 20000) != 0) {
+		fprintf(stderr, "deleteKeys 20000 (64bit) failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (purgeKeys(&config, 20000) != 0) {
+		fprintf(stderr, "purgeKeys 20000 (64bit) failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	config.pageIds = BEET_PAGEID_32;
+
 cleanup:
 	if (haveMap) ts_algo_map_destroy(&hidden);
 	if (haveIndex) beet_index_close(idx);
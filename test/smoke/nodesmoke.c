@@ -4,6 +4,7 @@
  */
 #include <beet/rider.h>
 #include <beet/node.h>
+#include <beet/keytype.h>
 #include <common/math.h>
 
 #include <stdlib.h>
@@ -13,7 +14,7 @@
 
 #define NODESZ 14
 #define BIG   160
-#define BYTES 128
+#define BYTES 256
 #define KEYSZ   4
 
 void errmsg(beet_err_t err, char *s) {
@@ -71,6 +72,7 @@ char compare(const void *one, const void *two, void *ignore) {
 }
 
 int testWriteNums(beet_rider_t *rider) {
+	beet_node_layout_t layout;
 	beet_page_t *page;
 	beet_node_t  node;
 	beet_err_t    err;
@@ -81,8 +83,15 @@ int testWriteNums(beet_rider_t *rider) {
 		errmsg(err, "cannot allocate page");
 		return -1;
 	}
-	beet_node_init(&node, page, NODESZ, KEYSZ, 1);
+	beet_node_layout(&layout, NODESZ, KEYSZ, 0, BEET_NODE_PTRSZ, 1, 1);
+	beet_node_init(&node, page, &layout, 1);
 	node.next = BEET_PAGE_NULL;
+
+	if ((uintptr_t)node.keys % BEET_NODE_LINESZ != 0 ||
+	    (uintptr_t)node.kids % BEET_NODE_LINESZ != 0) {
+		fprintf(stderr, "keys or kids not aligned\n");
+		return -1;
+	}
 	node.prev = BEET_PAGE_NULL;
 
 	for(int z=NODESZ-1;z>=0;z--) {
@@ -114,6 +123,7 @@ int testWriteNums(beet_rider_t *rider) {
 }
 
 int testReadRandom(beet_rider_t *rider) {
+	beet_node_layout_t layout;
 	beet_page_t *page;
 	beet_node_t  node;
 	beet_err_t    err;
@@ -126,7 +136,8 @@ int testReadRandom(beet_rider_t *rider) {
 		return -1;
 	}
 
-	beet_node_init(&node, page, NODESZ, KEYSZ, 1);
+	beet_node_layout(&layout, NODESZ, KEYSZ, 0, BEET_NODE_PTRSZ, 1, 1);
+	beet_node_init(&node, page, &layout, 1);
 
 	for(int i=0;i<50;i++) {
 		k=rand()%NODESZ;
@@ -150,6 +161,90 @@ int testReadRandom(beet_rider_t *rider) {
 
 }
 
+/* ------------------------------------------------------------------------
+ * Built-in key types: the inline search must find
+ * the same slot as searching with the compare function
+ * ------------------------------------------------------------------------
+ */
+#define MAXKEYS 100
+
+static uint64_t randKey(uint32_t keyType) {
+	uint64_t k = ((uint64_t)rand() << 33) ^ ((uint64_t)rand() << 10) ^ rand();
+	switch(keyType) {
+	case BEET_KEY_UINT32: case BEET_KEY_INT32:
+		return k%1000 + (rand()%2 ? 0 : 0x80000000ULL);
+	default: return k%1000 + (rand()%2 ? 0 : 0x8000000000000000ULL);
+	}
+}
+
+static void setKey(char *buf, uint32_t keyType, uint32_t ksize, uint64_t k) {
+	uint32_t x = (uint32_t)k;
+	if (keyType == BEET_KEY_UINT32 || keyType == BEET_KEY_INT32) {
+		memcpy(buf, &x, 4);
+	} else if (keyType == BEET_KEY_BYTES) {
+		for(int i=ksize-1; i>=0; i--) {
+			buf[i] = (char)(k&0xff); k>>=8;
+		}
+	} else memcpy(buf, &k, 8);
+}
+
+int testKeyType(uint32_t keyType, uint32_t ksize) {
+	beet_compare_t cmp = beet_keytype_compare(keyType);
+	char keys[MAXKEYS*8], key[8], tmp[8];
+	beet_node_t node;
+	int32_t slot, exp;
+	uint32_t n;
+
+	memset(&node, 0, sizeof(beet_node_t));
+	node.keys = keys;
+
+	for(int r=0; r<200; r++) {
+		n = rand()%MAXKEYS+1;
+
+		/* sorted unique keys */
+		for(uint32_t i=0; i<n; i++) {
+			setKey(keys+i*ksize, keyType, ksize, randKey(keyType));
+			for(uint32_t j=i; j>0; j--) {
+				char x = cmp(keys+(j-1)*ksize, keys+j*ksize, &ksize);
+				if (x == BEET_CMP_LESS) break;
+				if (x == BEET_CMP_EQUAL) {
+					memmove(keys+j*ksize, keys+(j+1)*ksize, (i-j)*ksize);
+					i--; break;
+				}
+				memcpy(tmp, keys+j*ksize, ksize);
+				memcpy(keys+j*ksize, keys+(j-1)*ksize, ksize);
+				memcpy(keys+(j-1)*ksize, tmp, ksize);
+			}
+		}
+		node.size = n;
+
+		for(int z=0; z<50; z++) {
+			if (z%2) memcpy(key, keys+(rand()%n)*ksize, ksize);
+			else setKey(key, keyType, ksize, randKey(keyType));
+
+			for(exp=0; exp<n; exp++) {
+				if (cmp(keys+exp*ksize, key, &ksize) != BEET_CMP_LESS) break;
+			}
+			slot = beet_node_search(&node, ksize, key, cmp, &ksize);
+			if (slot != exp) {
+				fprintf(stderr, "key type %u: slot %d, expected %d of %u\n",
+				                keyType, slot, exp, n);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+int testKeyTypes() {
+	if (testKeyType(BEET_KEY_UINT32, 4) != 0) return -1;
+	if (testKeyType(BEET_KEY_INT32, 4) != 0) return -1;
+	if (testKeyType(BEET_KEY_UINT64, 8) != 0) return -1;
+	if (testKeyType(BEET_KEY_INT64, 8) != 0) return -1;
+	if (testKeyType(BEET_KEY_BYTES, 5) != 0) return -1;
+	return 0;
+}
+
 int main() {
 	char *path = "rsc";
 	char *name = "test5.bin";
@@ -176,6 +271,10 @@ int main() {
 		fprintf(stderr, "testReadRandom failed\n");
 		rc = EXIT_FAILURE; goto cleanup;
 	}
+	if (testKeyTypes() != 0) {
+		fprintf(stderr, "testKeyTypes failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
 	// find pageid
 	// get pageid
 	// getData
@@ -3,6 +3,7 @@
  * ========================================================================
  */
 #include <beet/page.h>
+#include <beet/aio.h>
 #include <common/math.h>
 
 #include <stdlib.h>
@@ -42,7 +43,7 @@ int writeFibs(FILE *store) {
 			return -1;
 		}
 		pos += BYTES;
-		fprintf(stderr, "writing page %d\n", page->pageid);
+		fprintf(stderr, "writing page %lu\n", page->pageid);
 		fibonacci_r((uint64_t*)page->data, SIZE, f1, f2);
 		memcpy(&f1, page->data+112, 8);
 		memcpy(&f2, page->data+120, 8);
@@ -111,7 +112,7 @@ int testReadFibs(char *path) {
 		free(page); return -1;
 	}
 	for(int i=0; i<10; i++) {
-		fprintf(stderr, "reading page %d\n", page->pageid);
+		fprintf(stderr, "reading page %lu\n", page->pageid);
 		err = beet_page_load(page, store);
 		if (err != BEET_OK) {
 			fprintf(stderr, "cannot load page: %d\n", err);
@@ -138,6 +139,130 @@ int testReadFibs(char *path) {
 	return 0;
 }
 
+int testAttachedRead(char *path) {
+	beet_page_t page;
+	beet_err_t   err;
+	FILE      *store;
+	char  mem[2*BYTES];
+	int x = 0;
+
+	store = fopen(path, "rb");
+	if (store == NULL) {
+		fprintf(stderr, "cannot open file\n");
+		return -1;
+	}
+	/* the page uses the second half of mem */
+	memset(mem, 0xff, 2*BYTES);
+	err = beet_page_attach(&page, mem+BYTES, BYTES);
+	if (err != BEET_OK) {
+		fprintf(stderr, "cannot attach page: %d\n", err);
+		fclose(store); return -1;
+	}
+	for(int i=0; i<10; i++) {
+		page.pageid = i;
+		err = beet_page_load(&page, store);
+		if (err != BEET_OK) {
+			fprintf(stderr, "cannot load page: %d\n", err);
+			beet_page_detach(&page);
+			fclose(store); return -1;
+		}
+		if (comp((uint64_t*)page.data, bigbuf+x, SIZE) != 0) {
+			beet_page_detach(&page);
+			fclose(store); return -1;
+		}
+		x+=BYTES/8;
+	}
+	beet_page_detach(&page);
+	for(int i=0; i<BYTES; i++) {
+		if (mem[i] != (char)0xff) {
+			fprintf(stderr, "page written out of bounds\n");
+			fclose(store); return -1;
+		}
+	}
+	if (fclose(store) != 0) {
+		fprintf(stderr, "cannot close file\n");
+		return -1;
+	}
+	return 0;
+}
+
+int batchIO(char *path, char *copy, uint32_t depth) {
+	beet_page_t pages[10];
+	beet_page_t *ps[10];
+	beet_page_t page;
+	beet_aio_t aio;
+	beet_err_t err;
+	FILE *store, *out;
+	int rc = -1, n = 0;
+
+	err = beet_aio_init(&aio, depth);
+	if (err != BEET_OK) {
+		fprintf(stderr, "cannot init aio: %d\n", err);
+		return -1;
+	}
+	fprintf(stderr, "batch I/O with depth %u (%s)\n", depth,
+	        beet_aio_uring(&aio) ? "io_uring" : "pread/pwrite");
+
+	store = fopen(path, "rb");
+	if (store == NULL) {
+		fprintf(stderr, "cannot open file\n");
+		beet_aio_destroy(&aio); return -1;
+	}
+	out = fopen(copy, "wb+");
+	if (out == NULL) {
+		fprintf(stderr, "cannot create file\n");
+		fclose(store); beet_aio_destroy(&aio); return -1;
+	}
+	/* read in reverse order */
+	for(n=0; n<10; n++) {
+		err = beet_page_init(pages+n, BYTES);
+		if (err != BEET_OK) {
+			fprintf(stderr, "cannot init page: %d\n", err);
+			goto cleanup;
+		}
+		pages[n].pageid = 9-n;
+		ps[n] = pages+n;
+	}
+	err = beet_aio_load(&aio, ps, 10, store);
+	if (err != BEET_OK) {
+		fprintf(stderr, "cannot load pages: %d\n", err);
+		goto cleanup;
+	}
+	for(int i=0; i<10; i++) {
+		if (comp((uint64_t*)pages[i].data,
+		         bigbuf+(9-i)*(BYTES/8), SIZE) != 0) goto cleanup;
+	}
+	err = beet_aio_store(&aio, ps, 10, out);
+	if (err != BEET_OK) {
+		fprintf(stderr, "cannot store pages: %d\n", err);
+		goto cleanup;
+	}
+
+	/* read the copy back page by page */
+	err = beet_page_init(&page, BYTES);
+	if (err != BEET_OK) goto cleanup;
+	for(int i=0; i<10; i++) {
+		page.pageid = i;
+		err = beet_page_load(&page, out);
+		if (err != BEET_OK) {
+			fprintf(stderr, "cannot load page: %d\n", err);
+			beet_page_destroy(&page); goto cleanup;
+		}
+		if (comp((uint64_t*)page.data,
+		         bigbuf+i*(BYTES/8), SIZE) != 0) {
+			beet_page_destroy(&page); goto cleanup;
+		}
+	}
+	beet_page_destroy(&page);
+	rc = 0;
+
+cleanup:
+	for(int i=0; i<n; i++) beet_page_destroy(pages+i);
+	fclose(out); fclose(store);
+	beet_aio_destroy(&aio);
+	return rc;
+}
+
 int main() {
 	int rc = EXIT_SUCCESS;
 	
@@ -153,6 +278,18 @@ int main() {
 		fprintf(stderr, "testReadFibo failed\n");
 		rc = EXIT_FAILURE; goto cleanup;
 	}
+	if (testAttachedRead("rsc/pages.bin") != 0) {
+		fprintf(stderr, "testAttachedRead failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (batchIO("rsc/pages.bin", "rsc/pages2.bin", 4) != 0) {
+		fprintf(stderr, "batchIO 4 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (batchIO("rsc/pages.bin", "rsc/pages2.bin", 0) != 0) {
+		fprintf(stderr, "batchIO 0 failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
 
 cleanup:
 	if (rc == EXIT_SUCCESS) {
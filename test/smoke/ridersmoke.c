@@ -9,6 +9,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #define SIZE   16
 #define BIG   160
@@ -156,7 +160,7 @@ int testRandomRead(beet_rider_t *rider) {
 			return -1;
 		}
 		if (page->pageid != pid) {
-			fprintf(stderr, "wrong page: %u != %u\n",
+			fprintf(stderr, "wrong page: %lu != %u\n",
 			                      page->pageid, pid);
 		}
 		err = beet_rider_releaseRead(rider, page);
@@ -168,12 +172,1023 @@ int testRandomRead(beet_rider_t *rider) {
 	return 0;
 }
 
+int testWriteBack(char *path, char *name, uint32_t depth) {
+	beet_rider_t rider;
+	beet_page_t *page;
+	beet_err_t    err;
+	uint64_t f1=1, f2=1;
+	uint64_t tmp[SIZE];
+	int x = 0;
+
+	if (createFile(path, name) != 0) return -1;
+	if (initRider(&rider, path, name) != 0) return -1;
+	if (depth > 0) {
+		err = beet_rider_setAio(&rider, depth);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot set aio");
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+	}
+
+	fibonacci(bigbuf, BIG);
+
+	/* more pages than fit into the cache,
+	 * some are written on eviction, others are still dirty */
+	for(int i=0;i<10;i++) {
+		err = beet_rider_alloc(&rider, &page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot allocate page");
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+		fibonacci_r((uint64_t*)page->data, SIZE, f1, f2);
+		memcpy(&f1, page->data+112, 8);
+		memcpy(&f2, page->data+120, 8);
+		err = beet_rider_store(&rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot store page");
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+		if (!page->dirty) {
+			fprintf(stderr, "page %d is not dirty\n", i);
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+		err = beet_rider_releaseWrite(&rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot release page");
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+	}
+
+	err = beet_rider_flush(&rider, 1);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot flush rider");
+		beet_rider_destroy(&rider);
+		return -1;
+	}
+
+	/* everything is on disk now */
+	for(int i=0;i<10;i++) {
+		if (pread(fileno(rider.file), tmp, BYTES, i*BYTES) != BYTES) {
+			perror("cannot read page");
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+		if (comp(tmp, bigbuf+x, SIZE) != 0) {
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+		x+=BYTES/8;
+	}
+	beet_rider_destroy(&rider);
+
+	/* and survives reopening */
+	if (initRider(&rider, path, name) != 0) return -1;
+	if (testReadFibs(&rider) != 0) {
+		beet_rider_destroy(&rider);
+		return -1;
+	}
+	beet_rider_destroy(&rider);
+	return 0;
+}
+
+int testManyPages(char *path, char *name, uint32_t max, uint32_t policy) {
+	beet_rider_t rider;
+	beet_page_t *page;
+	beet_err_t    err;
+	uint32_t      pid;
+
+	if (createFile(path, name) != 0) return -1;
+	err = beet_rider_init(&rider, path, name, BYTES, max);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot initialise rider");
+		return -1;
+	}
+	err = beet_rider_setPolicy(&rider, policy);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot set policy");
+		beet_rider_destroy(&rider);
+		return -1;
+	}
+	for(uint32_t i=0;i<1000;i++) {
+		err = beet_rider_alloc(&rider, &page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot allocate page");
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+		memcpy(page->data, &page->pageid, sizeof(beet_pageid_t));
+		beet_rider_store(&rider, page);
+		err = beet_rider_releaseWrite(&rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot release page");
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+	}
+	for(int i=0;i<5000;i++) {
+		pid = rand()%1000;
+		err = beet_rider_getRead(&rider, pid, &page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot get page for reading");
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+		if (page->pageid != pid || memcmp(page->data, &pid, 4) != 0) {
+			fprintf(stderr, "wrong page: %lu != %u\n",
+			                      page->pageid, pid);
+			beet_rider_releaseRead(&rider, page);
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+		err = beet_rider_releaseRead(&rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot release page");
+			beet_rider_destroy(&rider);
+			return -1;
+		}
+	}
+	beet_rider_destroy(&rider);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Two riders drawing from a pool with room for 50 pages
+ * ------------------------------------------------------------------------
+ */
+int fillPages(beet_rider_t *rider, uint32_t n) {
+	beet_page_t *page;
+	beet_err_t    err;
+
+	for(uint32_t i=0; i<n; i++) {
+		err = beet_rider_alloc(rider, &page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot allocate page");
+			return -1;
+		}
+		memcpy(page->data, &page->pageid, sizeof(beet_pageid_t));
+		beet_rider_store(rider, page);
+		err = beet_rider_releaseWrite(rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot release page");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int readPages(beet_rider_t *rider, uint32_t n, int times) {
+	beet_page_t *page;
+	beet_err_t    err;
+	uint32_t      pid;
+
+	for(int i=0; i<times; i++) {
+		pid = rand()%n;
+		err = beet_rider_getRead(rider, pid, &page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot get page for reading");
+			return -1;
+		}
+		if (page->pageid != pid || memcmp(page->data, &pid, 4) != 0) {
+			fprintf(stderr, "wrong page: %lu != %u\n",
+			                      page->pageid, pid);
+			beet_rider_releaseRead(rider, page);
+			return -1;
+		}
+		err = beet_rider_releaseRead(rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot release page");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int testPool(char *path) {
+	beet_rider_t r1, r2;
+	beet_pool_t pool;
+	beet_err_t   err;
+	uint64_t used, evictions;
+	int rc = -1;
+
+	err = beet_pool_new(50*BYTES, &pool);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot create pool");
+		return -1;
+	}
+	if (createFile(path, "test5.bin") != 0) goto cleanup;
+	if (createFile(path, "test6.bin") != 0) goto cleanup;
+
+	err = beet_rider_init(&r1, path, "test5.bin", BYTES, 0);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot initialise rider");
+		goto cleanup;
+	}
+	err = beet_rider_init(&r2, path, "test6.bin", BYTES, 0);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot initialise rider");
+		beet_rider_destroy(&r1);
+		goto cleanup;
+	}
+	err = beet_rider_setPool(&r1, pool);
+	if (err == BEET_OK) err = beet_rider_setPool(&r2, pool);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot set pool");
+		goto destroy;
+	}
+
+	/* r1 takes all the memory */
+	if (fillPages(&r1, 200) != 0) goto destroy;
+	if (readPages(&r1, 200, 1000) != 0) goto destroy;
+
+	beet_pool_stats(pool, &used, &evictions);
+	if (used != 50*BYTES) {
+		fprintf(stderr, "wrong usage: %lu\n", used);
+		goto destroy;
+	}
+
+	/* r2 takes it from r1 */
+	if (fillPages(&r2, 200) != 0) goto destroy;
+	if (readPages(&r2, 200, 1000) != 0) goto destroy;
+	if (readPages(&r1, 200, 1000) != 0) goto destroy;
+
+	beet_pool_stats(pool, &used, &evictions);
+	if (used > 50*BYTES || evictions == 0) {
+		fprintf(stderr, "wrong stats: %lu, %lu\n", used, evictions);
+		goto destroy;
+	}
+	rc = 0;
+
+destroy:
+	beet_rider_destroy(&r1);
+	beet_rider_destroy(&r2);
+	if (rc == 0) {
+		beet_pool_stats(pool, &used, &evictions);
+		if (used != 0) {
+			fprintf(stderr, "memory not released: %lu\n", used);
+			rc = -1;
+		}
+	}
+cleanup:
+	beet_pool_destroy(pool);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * A range scan through a pooled 2Q rider does not evict the hot pages
+ * ------------------------------------------------------------------------
+ */
+#define HOT    32
+#define POOLPG 256
+
+int readRange(beet_rider_t *rider, uint32_t lo, uint32_t hi) {
+	beet_page_t *page;
+	beet_err_t    err;
+
+	for(uint32_t pid=lo; pid<hi; pid++) {
+		err = beet_rider_getRead(rider, pid, &page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot get page for reading");
+			return -1;
+		}
+		if (memcmp(page->data, &pid, 4) != 0) {
+			fprintf(stderr, "page %u was reloaded\n", pid);
+			beet_rider_releaseRead(rider, page);
+			return -1;
+		}
+		err = beet_rider_releaseRead(rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot release page");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* overwrite the pages on disk, so we see if they are read again */
+int zeroPages(char *path, char *name, uint32_t n) {
+	char p[256], z[BYTES];
+	FILE *f;
+
+	memset(z, 0, BYTES);
+	snprintf(p, 256, "%s/%s", path, name);
+	f = fopen(p, "r+");
+	if (f == NULL) {
+		perror("cannot open file");
+		return -1;
+	}
+	for(uint32_t i=0; i<n; i++) {
+		if (pwrite(fileno(f), z, BYTES, i*BYTES) != BYTES) {
+			perror("cannot write file");
+			fclose(f); return -1;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+int testPoolScan(char *path, char *name) {
+	beet_rider_t rider;
+	beet_pool_t pool;
+	beet_err_t   err;
+	int rc = -1;
+
+	if (createFile(path, name) != 0) return -1;
+
+	err = beet_rider_init(&rider, path, name, BYTES, 0);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot initialise rider");
+		return -1;
+	}
+	if (fillPages(&rider, 4*POOLPG) != 0) {
+		beet_rider_destroy(&rider);
+		return -1;
+	}
+	beet_rider_destroy(&rider);
+
+	err = beet_pool_new(POOLPG*BYTES, &pool);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot create pool");
+		return -1;
+	}
+	err = beet_rider_init(&rider, path, name, BYTES, 0);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot initialise rider");
+		beet_pool_destroy(pool);
+		return -1;
+	}
+	err = beet_rider_setPool(&rider, pool);
+	if (err == BEET_OK) err = beet_rider_setPolicy(&rider, BEET_EVICT_2Q);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot configure rider");
+		goto cleanup;
+	}
+
+	/* the hot pages are read, pushed out of 'in'
+	   by the pages read afterwards and read again */
+	if (readRange(&rider, 0, HOT) != 0) goto cleanup;
+	if (readRange(&rider, HOT, POOLPG+2*HOT) != 0) goto cleanup;
+	for(int i=0; i<3; i++) {
+		if (readRange(&rider, 0, HOT) != 0) goto cleanup;
+	}
+	if (zeroPages(path, name, HOT) != 0) goto cleanup;
+
+	/* scan twice as many pages as fit into the pool */
+	if (readRange(&rider, 2*POOLPG, 4*POOLPG) != 0) goto cleanup;
+
+	/* the hot pages are still there */
+	if (readRange(&rider, 0, HOT) != 0) goto cleanup;
+	rc = 0;
+
+cleanup:
+	beet_rider_destroy(&rider);
+	beet_pool_destroy(pool);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * waiter: requests one page while the cache is full of pinned pages
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	beet_rider_t *rider;
+	beet_pageid_t pageid;
+	beet_err_t       err;
+} waiter_t;
+
+void *waiter(void *p) {
+	waiter_t *w = p;
+	beet_page_t *page;
+
+	w->err = beet_rider_getRead(w->rider, w->pageid, &page);
+	if (w->err != BEET_OK) return NULL;
+	if (page->pageid != w->pageid) w->err = BEET_ERR_BADPAGE;
+	beet_rider_releaseRead(w->rider, page);
+	return NULL;
+}
+
+int testWait(char *path, char *name) {
+	beet_rider_t rider;
+	beet_page_t *pages[8];
+	beet_page_t *page;
+	beet_err_t    err;
+	uint64_t waits, waited;
+	pthread_t tid;
+	waiter_t w;
+	int rc = -1;
+	int n = 0;
+
+	if (createFile(path, name) != 0) return -1;
+	if (initRider(&rider, path, name) != 0) return -1;
+
+	/* 9 pages in a cache of 8 */
+	for(int i=0; i<9; i++) {
+		err = beet_rider_alloc(&rider, &page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot allocate page");
+			goto cleanup;
+		}
+		err = beet_rider_releaseWrite(&rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot release page");
+			goto cleanup;
+		}
+	}
+	/* pin the first 8 */
+	for(n=0; n<8; n++) {
+		err = beet_rider_getRead(&rider, n, pages+n);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot get page");
+			goto cleanup;
+		}
+	}
+
+	/* with timeout: the request fails */
+	beet_rider_setTimeout(&rider, 20);
+	err = beet_rider_getRead(&rider, 8, &page);
+	if (err != BEET_ERR_NORSC) {
+		fprintf(stderr, "request did not time out: %d\n", err);
+		if (err == BEET_OK) beet_rider_releaseRead(&rider, page);
+		goto cleanup;
+	}
+	err = beet_rider_waitStats(&rider, &waits, &waited);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot get wait stats");
+		goto cleanup;
+	}
+	if (waits == 0 || waited < 20000) {
+		fprintf(stderr, "wrong wait stats: %lu / %luus\n",
+		                                  waits, waited);
+		goto cleanup;
+	}
+
+	/* without timeout: the request waits until a page is released */
+	beet_rider_setTimeout(&rider, 0);
+	w.rider = &rider;
+	w.pageid = 8;
+	w.err = BEET_OK;
+	if (pthread_create(&tid, NULL, &waiter, &w) != 0) {
+		fprintf(stderr, "cannot create thread\n");
+		goto cleanup;
+	}
+	usleep(10000);
+	n--;
+	err = beet_rider_releaseRead(&rider, pages[n]);
+	pthread_join(tid, NULL);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot release page");
+		goto cleanup;
+	}
+	if (w.err != BEET_OK) {
+		errmsg(w.err, "waiter failed");
+		goto cleanup;
+	}
+	rc = 0;
+
+cleanup:
+	for(int i=0; i<n; i++) beet_rider_releaseRead(&rider, pages[i]);
+	beet_rider_destroy(&rider);
+	return rc;
+}
+
+int testPeek(char *path, char *name) {
+	beet_rider_t rider;
+	beet_page_t *page, *peeked;
+	beet_err_t    err;
+	uint32_t v;
+	int rc = -1;
+
+	if (createFile(path, name) != 0) return -1;
+	if (initRider(&rider, path, name) != 0) return -1;
+
+	/* 9 pages in a cache of 8: page 0 is evicted */
+	for(int i=0; i<9; i++) {
+		err = beet_rider_alloc(&rider, &page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot allocate page");
+			goto cleanup;
+		}
+		err = beet_rider_releaseWrite(&rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot release page");
+			goto cleanup;
+		}
+	}
+	err = beet_rider_peek(&rider, 0, &peeked, &v);
+	if (err != BEET_ERR_UNKNKEY) {
+		fprintf(stderr, "evicted page found: %d\n", err);
+		goto cleanup;
+	}
+	err = beet_rider_peek(&rider, 8, &peeked, &v);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot peek at page");
+		goto cleanup;
+	}
+	if (peeked->pageid != 8 || !beet_rider_validate(peeked, 8, v)) {
+		fprintf(stderr, "peeked page not valid\n");
+		goto cleanup;
+	}
+
+	/* writing without storing does not change the version */
+	err = beet_rider_getWrite(&rider, 8, &page);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot get page");
+		goto cleanup;
+	}
+	if (beet_rider_validate(peeked, 8, v)) {
+		fprintf(stderr, "page being written is valid\n");
+		beet_rider_releaseWrite(&rider, page);
+		goto cleanup;
+	}
+	err = beet_rider_releaseWrite(&rider, page);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot release page");
+		goto cleanup;
+	}
+	if (!beet_rider_validate(peeked, 8, v)) {
+		fprintf(stderr, "unchanged page not valid\n");
+		goto cleanup;
+	}
+
+	/* storing does */
+	err = beet_rider_getWrite(&rider, 8, &page);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot get page");
+		goto cleanup;
+	}
+	page->data[0] = 1;
+	err = beet_rider_store(&rider, page);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot store page");
+		beet_rider_releaseWrite(&rider, page);
+		goto cleanup;
+	}
+	err = beet_rider_releaseWrite(&rider, page);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot release page");
+		goto cleanup;
+	}
+	if (beet_rider_validate(peeked, 8, v)) {
+		fprintf(stderr, "changed page is valid\n");
+		goto cleanup;
+	}
+	rc = 0;
+
+cleanup:
+	beet_rider_destroy(&rider);
+	return rc;
+}
+
+int allocExpect(beet_rider_t *rider, beet_pageid_t expected) {
+	beet_page_t *page;
+	beet_err_t    err;
+	int rc = 0;
+
+	err = beet_rider_alloc(rider, &page);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot allocate page");
+		return -1;
+	}
+	if (page->pageid != expected) {
+		fprintf(stderr, "expected page %lu, got %lu\n",
+		                 expected, page->pageid);
+		rc = -1;
+	}
+	for(int i=0; i<BYTES; i++) {
+		if (page->data[i] != 0) {
+			fprintf(stderr, "reused page %lu not empty\n",
+			                                 page->pageid);
+			rc = -1; break;
+		}
+	}
+	page->data[0] = 1;
+	err = beet_rider_store(rider, page);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot store page");
+		rc = -1;
+	}
+	err = beet_rider_releaseWrite(rider, page);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot release page");
+		return -1;
+	}
+	return rc;
+}
+
+int testFreeList(char *path, char *name) {
+	beet_rider_t rider;
+	beet_err_t    err;
+	int rc = -1;
+
+	if (createFile(path, name) != 0) return -1;
+	if (initRider(&rider, path, name) != 0) return -1;
+
+	for(int i=0; i<4; i++) {
+		if (allocExpect(&rider, i) != 0) goto cleanup;
+	}
+	err = beet_rider_free(&rider, 1);
+	if (err == BEET_OK) err = beet_rider_free(&rider, 3);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot free page");
+		goto cleanup;
+	}
+
+	/* the last freed page comes first */
+	if (allocExpect(&rider, 3) != 0) goto cleanup;
+
+	/* the free-list survives the rider */
+	beet_rider_destroy(&rider);
+	if (initRider(&rider, path, name) != 0) return -1;
+
+	if (allocExpect(&rider, 1) != 0) goto cleanup;
+	if (allocExpect(&rider, 4) != 0) goto cleanup;
+
+	/* flush saves the free-list as well */
+	err = beet_rider_free(&rider, 2);
+	if (err == BEET_OK) err = beet_rider_flush(&rider, 1);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot free and flush");
+		goto cleanup;
+	}
+	if (allocExpect(&rider, 2) != 0) goto cleanup;
+
+	/* reused pages are not listed anymore */
+	beet_rider_destroy(&rider);
+	if (initRider(&rider, path, name) != 0) return -1;
+
+	if (allocExpect(&rider, 5) != 0) goto cleanup;
+	rc = 0;
+
+cleanup:
+	beet_rider_destroy(&rider);
+	return rc;
+}
+
+int expectSize(char *path, char *name, off_t expected) {
+	struct stat st;
+	char p[256];
+
+	snprintf(p, 256, "%s/%s", path, name);
+	if (stat(p, &st) != 0) {
+		perror("cannot stat file");
+		return -1;
+	}
+	if (st.st_size != expected) {
+		fprintf(stderr, "expected file size %ld, got %ld\n",
+		                (long)expected, (long)st.st_size);
+		return -1;
+	}
+	return 0;
+}
+
+int testPreallocCrash(char *path, char *name) {
+	beet_rider_t rider;
+	beet_err_t    err;
+	int status;
+	pid_t pid;
+
+	/* the child crashes without cutting off the unused pages */
+	pid = fork();
+	if (pid < 0) {
+		perror("cannot fork");
+		return -1;
+	}
+	if (pid == 0) {
+		if (initRider(&rider, path, name) != 0) _exit(1);
+		err = beet_rider_setPrealloc(&rider, 8);
+		if (err != BEET_OK) _exit(1);
+		/* the size is saved with the chunk (11 pages),
+		 * the pages handed out from it are not */
+		for(int i=11; i<14; i++) {
+			if (allocExpect(&rider, i) != 0) _exit(1);
+		}
+		err = beet_rider_flush(&rider, 1);
+		if (err != BEET_OK) _exit(1);
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) != pid ||
+	    !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "child failed\n");
+		return -1;
+	}
+	if (expectSize(path, name, 19*BYTES) != 0) return -1;
+
+	/* the unused pages are cut off when the file is opened again,
+	 * the pages written are kept */
+	if (initRider(&rider, path, name) != 0) return -1;
+	if (expectSize(path, name, 14*BYTES) != 0) {
+		beet_rider_destroy(&rider); return -1;
+	}
+	if (allocExpect(&rider, 14) != 0) {
+		beet_rider_destroy(&rider); return -1;
+	}
+	beet_rider_destroy(&rider);
+	return 0;
+}
+
+int testPrealloc(char *path, char *name) {
+	beet_rider_t rider;
+	beet_page_t  *page;
+	beet_err_t    err;
+	int rc = -1;
+
+	if (createFile(path, name) != 0) return -1;
+	if (initRider(&rider, path, name) != 0) return -1;
+
+	err = beet_rider_setPrealloc(&rider, 8);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot set prealloc");
+		goto cleanup;
+	}
+
+	/* more pages than the cache holds: some are evicted */
+	for(int i=0; i<10; i++) {
+		if (allocExpect(&rider, i) != 0) goto cleanup;
+	}
+	if (expectSize(path, name, 16*BYTES) != 0) goto cleanup;
+
+	/* unused pages are cut off */
+	beet_rider_destroy(&rider);
+	if (expectSize(path, name, 10*BYTES) != 0) return -1;
+	if (initRider(&rider, path, name) != 0) return -1;
+
+	for(int i=0; i<10; i++) {
+		err = beet_rider_getRead(&rider, i, &page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot get page");
+			goto cleanup;
+		}
+		if (page->data[0] != 1) {
+			fprintf(stderr, "page %d was not written\n", i);
+			beet_rider_releaseRead(&rider, page);
+			goto cleanup;
+		}
+		err = beet_rider_releaseRead(&rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot release page");
+			goto cleanup;
+		}
+	}
+
+	/* without preallocation the file grows page by page */
+	err = beet_rider_setPrealloc(&rider, 0);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot set prealloc");
+		goto cleanup;
+	}
+	if (allocExpect(&rider, 10) != 0) goto cleanup;
+	if (expectSize(path, name, 11*BYTES) != 0) goto cleanup;
+	rc = 0;
+
+cleanup:
+	beet_rider_destroy(&rider);
+	if (rc != 0) return rc;
+	return testPreallocCrash(path, name);
+}
+
+int testIdSize(char *path, char *name) {
+	beet_rider_t rider;
+	beet_page_t  *page;
+	beet_err_t    err;
+	char p[256];
+	int rc = -1;
+
+	/* a sparse file just below the limit of 32bit pageids */
+	if (createFile(path, name) != 0) return -1;
+	snprintf(p, 256, "%s/%s", path, name);
+	if (truncate(p, (off_t)0x7ffffffe * BYTES) != 0) {
+		perror("cannot truncate file");
+		return -1;
+	}
+	if (initRider(&rider, path, name) != 0) return -1;
+
+	err = beet_rider_setIdSize(&rider, 3);
+	if (err != BEET_ERR_INVALID) {
+		errmsg(err, "invalid id size accepted");
+		goto cleanup;
+	}
+	err = beet_rider_setIdSize(&rider, 4);
+	if (err == BEET_OK) err = beet_rider_setPrealloc(&rider, 0);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot set id size");
+		goto cleanup;
+	}
+	if (allocExpect(&rider, 0x7ffffffe) != 0) goto cleanup;
+
+	/* the next id would be NULL as a leaf */
+	err = beet_rider_alloc(&rider, &page);
+	if (err != BEET_ERR_TOOBIG) {
+		errmsg(err, "expected TOOBIG");
+		if (err == BEET_OK) beet_rider_releaseWrite(&rider, page);
+		goto cleanup;
+	}
+
+	/* 64bit ids go on */
+	err = beet_rider_setIdSize(&rider, 8);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot set id size");
+		goto cleanup;
+	}
+	if (allocExpect(&rider, 0x7fffffff) != 0) goto cleanup;
+	rc = 0;
+
+cleanup:
+	beet_rider_destroy(&rider);
+	if (createFile(path, name) != 0) return -1;
+	return rc;
+}
+
+int directRider(beet_rider_t *rider, char *path, char *name) {
+	beet_err_t err;
+
+	err = beet_rider_init(rider, path, name, BEET_PAGE_BLOCK, 8);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot initialise rider");
+		return -1;
+	}
+	err = beet_rider_setDirect(rider);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot set direct I/O");
+		beet_rider_destroy(rider);
+		return -1;
+	}
+	return 0;
+}
+
+int testDirect(char *path, char *name) {
+	beet_rider_t rider;
+	beet_page_t  *page;
+	beet_err_t    err;
+	int rc = -1;
+
+	/* small pages cannot be read directly */
+	if (createFile(path, name) != 0) return -1;
+	if (initRider(&rider, path, name) != 0) return -1;
+	err = beet_rider_setDirect(&rider);
+	beet_rider_destroy(&rider);
+	if (err == BEET_ERR_NOTSUPP) {
+		fprintf(stderr, "no direct I/O on %s\n", path);
+		return 0;
+	}
+	if (err != BEET_ERR_BADSIZE) {
+		errmsg(err, "direct I/O with small pages");
+		return -1;
+	}
+
+	if (directRider(&rider, path, name) != 0) return -1;
+
+	/* more pages than the cache holds: some are evicted */
+	for(int i=0; i<20; i++) {
+		err = beet_rider_alloc(&rider, &page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot allocate page");
+			goto cleanup;
+		}
+		memset(page->data, i+1, BEET_PAGE_BLOCK);
+		err = beet_rider_store(&rider, page);
+		if (err == BEET_OK) err = beet_rider_releaseWrite(&rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot store page");
+			goto cleanup;
+		}
+	}
+	beet_rider_destroy(&rider);
+
+	if (directRider(&rider, path, name) != 0) return -1;
+	for(int i=0; i<20; i++) {
+		err = beet_rider_getRead(&rider, i, &page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot get page");
+			goto cleanup;
+		}
+		if (page->data[0] != i+1 ||
+		    page->data[BEET_PAGE_BLOCK-1] != i+1) {
+			fprintf(stderr, "page %d was not written\n", i);
+			beet_rider_releaseRead(&rider, page);
+			goto cleanup;
+		}
+		err = beet_rider_releaseRead(&rider, page);
+		if (err != BEET_OK) {
+			errmsg(err, "cannot release page");
+			goto cleanup;
+		}
+	}
+	rc = 0;
+
+cleanup:
+	beet_rider_destroy(&rider);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Threads prefetching pages in batches that share the ring
+ * ------------------------------------------------------------------------
+ */
+#define FETCHERS 4
+#define FETCHED 16
+
+typedef struct {
+	beet_rider_t *rider;
+	uint32_t        lo;
+	int             rc;
+} fetcher_t;
+
+void *fetcher(void *p) {
+	fetcher_t *f = p;
+	beet_pageid_t pids[FETCHED];
+	beet_err_t err;
+
+	f->rc = -1;
+	for(uint32_t i=0; i<FETCHED; i++) pids[i] = f->lo+i;
+	err = beet_rider_prefetch(f->rider, pids, FETCHED);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot prefetch");
+		return NULL;
+	}
+	/* pages loaded one by one meanwhile */
+	if (readRange(f->rider, f->lo+FETCHED, f->lo+2*FETCHED) != 0) {
+		return NULL;
+	}
+	f->rc = 0;
+	return NULL;
+}
+
+int testPrefetch(char *path, char *name) {
+	beet_rider_t rider;
+	pthread_t tids[FETCHERS];
+	fetcher_t fs[FETCHERS];
+	beet_err_t err;
+	int rc = -1;
+	int n = 0;
+
+	if (createFile(path, name) != 0) return -1;
+
+	err = beet_rider_init(&rider, path, name, BYTES, 256);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot initialise rider");
+		return -1;
+	}
+	if (fillPages(&rider, 4*FETCHERS*FETCHED) != 0) {
+		beet_rider_destroy(&rider);
+		return -1;
+	}
+	beet_rider_destroy(&rider);
+
+	err = beet_rider_init(&rider, path, name, BYTES, 256);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot initialise rider");
+		return -1;
+	}
+	err = beet_rider_setAio(&rider, 8);
+	if (err != BEET_OK) {
+		errmsg(err, "cannot set aio");
+		goto cleanup;
+	}
+	for(n=0; n<FETCHERS; n++) {
+		fs[n].rider = &rider;
+		fs[n].lo = 2*n*FETCHED;
+		if (pthread_create(tids+n, NULL, &fetcher, fs+n) != 0) {
+			fprintf(stderr, "cannot create thread\n");
+			goto cleanup;
+		}
+	}
+	for(; n>0; n--) {
+		pthread_join(tids[n-1], NULL);
+		if (fs[n-1].rc != 0) goto cleanup;
+	}
+
+	/* the prefetched pages are not read again
+	   (without ring, nothing is prefetched) */
+	if (beet_aio_uring(&rider.aio)) {
+		if (zeroPages(path, name, 2*FETCHERS*FETCHED) != 0) {
+			goto cleanup;
+		}
+		for(int i=0; i<FETCHERS; i++) {
+			if (readRange(&rider, 2*i*FETCHED,
+			                     (2*i+1)*FETCHED) != 0) goto cleanup;
+		}
+	}
+	rc = 0;
+
+cleanup:
+	for(; n>0; n--) pthread_join(tids[n-1], NULL);
+	beet_rider_destroy(&rider);
+	return rc;
+}
+
 int main() {
 	char *path = "rsc";
 	char *name = "test1.bin";
 	int rc = EXIT_SUCCESS;
 	beet_rider_t rider;
 	char haveRider = 0;
+	uint32_t maxs[] = {0, 100, 500};
+	uint32_t policies[] = {BEET_EVICT_LRU, BEET_EVICT_CLOCK, BEET_EVICT_2Q};
+	char *pnames[] = {"LRU", "CLOCK", "2Q"};
 
 	srand(time(NULL));
 
@@ -199,6 +1214,59 @@ int main() {
 		fprintf(stderr, "testRandomRead failed\n");
 		rc = EXIT_FAILURE; goto cleanup;
 	}
+	if (testWriteBack(path, "test2.bin", 0) != 0) {
+		fprintf(stderr, "testWriteBack failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testWriteBack(path, "test2.bin", 4) != 0) {
+		fprintf(stderr, "testWriteBack (aio) failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	for(int i=0; i<3; i++) {
+		for(int j=0; j<3; j++) {
+			if (testManyPages(path, "test3.bin",
+			                  maxs[j], policies[i]) != 0) {
+				fprintf(stderr, "testManyPages (%u, %s) failed\n",
+				                 maxs[j], pnames[i]);
+				rc = EXIT_FAILURE; goto cleanup;
+			}
+		}
+	}	if (testWait(path, "test4.bin") != 0) {
+		fprintf(stderr, "testWait failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testPool(path) != 0) {
+		fprintf(stderr, "testPool failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testPoolScan(path, "test12.bin") != 0) {
+		fprintf(stderr, "testPoolScan failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testPeek(path, "test7.bin") != 0) {
+		fprintf(stderr, "testPeek failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testFreeList(path, "test8.bin") != 0) {
+		fprintf(stderr, "testFreeList failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testPrealloc(path, "test9.bin") != 0) {
+		fprintf(stderr, "testPrealloc failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testDirect(path, "test10.bin") != 0) {
+		fprintf(stderr, "testDirect failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testIdSize(path, "test11.bin") != 0) {
+		fprintf(stderr, "testIdSize failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testPrefetch(path, "test13.bin") != 0) {
+		fprintf(stderr, "testPrefetch failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
 
 cleanup:
 	if (haveRider) beet_rider_destroy(&rider);
@@ -41,11 +41,7 @@ beet_index_t openIndex(char *base, char *path, void *handle) {
 	beet_index_t idx=NULL;
 	beet_open_config_t cfg;
 
-	cfg.leafCacheSize = BEET_CACHE_IGNORE;
-	cfg.intCacheSize = BEET_CACHE_IGNORE;
-	cfg.compare = NULL;
-	cfg.rscinit = NULL;
-	cfg.rscdest = NULL;
+	beet_open_config_ignore(&cfg);
 
 	err = beet_index_open(base, path, handle, &cfg, &idx);
 	if (err != BEET_OK) {
@@ -15,7 +15,7 @@
 #include <stdint.h>
 
 #define NODESZ 14
-#define BYTES 128
+#define BYTES 136
 #define KEYSZ   4
 #define DATASZ  4
 
@@ -195,14 +195,14 @@ int testReadRandom(beet_tree_t *tree, beet_pageid_t *root, ts_algo_map_t *hidden
 			return -1;
 		}
 		if (!beet_node_equal(node, slot, KEYSZ, &k, &compare, NULL)) {
-			fprintf(stderr, "key not found: %lu in %u (%d - %d)\n", k,
+			fprintf(stderr, "key not found: %lu in %lu (%d - %d)\n", k,
 					node->self,
 			                (*(int*)node->keys),
 			                (*(int*)(node->keys+KEYSZ*node->size-KEYSZ)));
 			return -1;
 		}
 		if (beet_node_hidden(node, slot)) {
-			fprintf(stderr, "key hidden: %lu in %u (%d - %d)\n", k,
+			fprintf(stderr, "key hidden: %lu in %lu (%d - %d)\n", k,
 					node->self,
 			                (*(int*)node->keys),
 			                (*(int*)(node->keys+KEYSZ*node->size-KEYSZ)));
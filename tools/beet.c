@@ -36,6 +36,7 @@ char    *global_lib     = NULL;
 char    *global_path    = NULL;
 int      global_stndaln = 1;
 int      global_type    = 1;
+int      global_ktype   = BEET_KEY_CUSTOM;
 
 void *global_handle=NULL;
 
@@ -71,10 +72,15 @@ void helptxt(char *prog) {
 	fprintf(stderr, 
 	"-internal: number of keys in internal nodes (mandatory)\n");
 	fprintf(stderr, "-key: size of key (mandatory)\n");
+	fprintf(stderr, "-keytype: built-in key type (default: CUSTOM)\n");
+	fprintf(stderr, "       0: CUSTOM (user-defined compare function)\n");
+	fprintf(stderr, "       1: UINT32 2: UINT64 3: INT32 4: INT64\n");
+	fprintf(stderr, "       5: BYTES  (memcmp)\n");
 	fprintf(stderr, "-data: size of data (mandatory if type = PLAIN)\n");
 	fprintf(stderr, "-cache: size of cache (default: 10000)\n");
 	fprintf(stderr,
-	"-compare: symbol of user-defined compare function (mandatory)\n");
+	"-compare: symbol of user-defined compare function\n"
+	"          (mandatory if keytype = CUSTOM)\n");
 	fprintf(stderr,
 	"-init: symbol of user-defined init function (default: NULL)\n");
 	fprintf(stderr,
@@ -125,7 +131,7 @@ int parsecreatecmd(int argc, char **argv) {
 		global_dsize = 0; break;
 
 	case BEET_INDEX_HOST: 
-		global_dsize = sizeof(beet_pageid_t);
+		global_dsize = BEET_PAGEID_SIZE(BEET_PAGEID_32);
 		global_path = ts_algo_args_findString(
 		 argc, argv, 4, "subpath", NULL, &err);
 		if (err != 0) {
@@ -163,13 +169,21 @@ int parsecreatecmd(int argc, char **argv) {
 		return -1;
 	}
 
+	global_ktype = (int)ts_algo_args_findUint(
+	 argc, argv, 4, "keytype", BEET_KEY_CUSTOM, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error (keytype): %d\n", err);
+		return -1;
+	}
+
 	global_compare = ts_algo_args_findString(
 	            argc, argv, 4, "compare", NULL, &err);
 	if (err != 0) {
 		fprintf(stderr, "command line error: %d\n", err);
 		return -1;
 	}
-	if (global_compare == NULL) return -1;
+	if (global_compare == NULL &&
+	    global_ktype == BEET_KEY_CUSTOM) return -1;
 
 	global_rscinit = ts_algo_args_findString(
 	            argc, argv, 4, "init", NULL, &err);
@@ -241,8 +255,8 @@ int createIndex(char *base, char *path) {
 	cfg.leafPageSize = global_ksize * global_lsize +
 	                   global_dsize * global_lsize + 16;
 
-	cfg.intPageSize = global_ksize          * global_nsize +
-                          sizeof(beet_pageid_t) * global_nsize + 8;
+	cfg.intPageSize = global_ksize                  * global_nsize +
+                          BEET_PAGEID_SIZE(cfg.pageIds) * global_nsize + 8;
 	               
 
 	cfg.indexType = global_type;
@@ -252,6 +266,7 @@ int createIndex(char *base, char *path) {
 	cfg.intCacheSize = global_cache;
 	cfg.keySize = global_ksize;
 	cfg.dataSize = global_dsize;
+	cfg.keyType = global_ktype;
 	cfg.subPath = global_path;
 	cfg.compare = global_compare;
 	cfg.rscinit = global_rscinit;
@@ -459,6 +474,18 @@ int handlecount(int argc, char **argv,
  * print nice type
  * ------------------------------------------------------------------------
  */
+const char *ktypedesc(int t) {
+	switch(t) {
+	case BEET_KEY_CUSTOM: return "CUSTOM";
+	case BEET_KEY_UINT32: return "UINT32";
+	case BEET_KEY_UINT64: return "UINT64";
+	case BEET_KEY_INT32: return "INT32";
+	case BEET_KEY_INT64: return "INT64";
+	case BEET_KEY_BYTES: return "BYTES";
+	default: return "unknown";
+	}
+}
+
 const char *typedesc(int t) {
 	switch(t) {
 	case BEET_INDEX_NULL: return "NULL";
@@ -497,6 +524,12 @@ int handleconfig(int argc, char **argv, char *base, char *path) {
 	fprintf(stdout, "keys per leaf  : %u\n", cfg.leafNodeSize);
 	fprintf(stdout, "keys per int.  : %u\n", cfg.intNodeSize);
 	fprintf(stdout, "key size       : %u\n", cfg.keySize);
+	fprintf(stdout, "key type       : %s\n", ktypedesc(cfg.keyType));
+	fprintf(stdout, "node layout    : %s\n",
+	        cfg.layout == BEET_LAYOUT_PACKED ? "PACKED" :
+	        cfg.layout == BEET_LAYOUT_LEGACY ? "LEGACY" : "ALIGNED");
+	fprintf(stdout, "pageids        : %s\n",
+	        cfg.pageIds == BEET_PAGEID_64 ? "64bit" : "32bit");
 	fprintf(stdout, "data size      : %u\n", cfg.dataSize);
 	fprintf(stdout, "leaf cache size: %u\n", cfg.leafCacheSize);
 	fprintf(stdout, "int. cache size: %u\n", cfg.intCacheSize);